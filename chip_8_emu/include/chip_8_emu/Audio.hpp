@@ -1,17 +1,29 @@
 #pragma once
 
-#include <SFML/Audio/Sound.hpp>
-#include <SFML/Audio/SoundBuffer.hpp>
+#include "AudioSink.hpp"
+#include "ToneGenerator.hpp"
+#include "TripleBuffer.hpp"
+#include <SFML/Audio/SoundStream.hpp>
+#include <vector>
 
-class Audio
+// Streams the buzzer, the samples are rendered on the SFML audio thread from the latest state published by update()
+// The stream plays silence while the buzzer is off, so starting and stopping it never restarts the playback
+class Audio : public AudioSink, private sf::SoundStream
 {
 public:
-	Audio();
+	// A chunk of bufferSamples is rendered at a time, smaller chunks lower the latency but wake the audio thread more often
+	Audio(unsigned int sampleRate = 44100, size_t bufferSamples = 512);
+	~Audio();
 
-	void playSound();
-	void stopSound();
+	void update(const SoundState& state) override;
 
 private:
-	sf::SoundBuffer _buffer;
-	sf::Sound _sound;
+	bool onGetData(sf::SoundStream::Chunk& data) override;
+	void onSeek(sf::Time timeOffset) override;
+
+	// Written by the emulation thread and read by the audio thread, neither waits for the other
+	TripleBuffer<SoundState> _states;
+	ToneGenerator _generator;
+	std::vector<sf::Int16> _samples;
+	bool _isStarted;
 };
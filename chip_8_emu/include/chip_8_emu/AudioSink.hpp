@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Sound of a frame: whether the buzzer sounds and the 1 bit pattern it loops
+// The pattern is played at 4000 * 2 ^ ((pitch - 64) / 48) bits per second, as on XO-CHIP
+struct SoundState
+{
+	bool isActive;
+	uint8_t pitch;
+	uint8_t pattern[16];
+
+	static const size_t PATTERN_BITS = 128;
+};
+
+// Front-end that plays the buzzer, given the sound state once per emulated frame by the emulation thread
+class AudioSink
+{
+public:
+	virtual ~AudioSink() {}
+
+	virtual void update(const SoundState& state) = 0;
+};
+
+// Discards the sound, for runs that must not be heard
+class NullAudioSink : public AudioSink
+{
+public:
+	void update(const SoundState& state) override {}
+};
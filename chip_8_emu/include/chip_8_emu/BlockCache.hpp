@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Straight-line runs of pre-decoded instructions, keyed by the address of their first instruction
+// A block ends with the first instruction that may jump, skip, draw or write memory
+class BlockCache
+{
+public:
+	// Sequences of two instructions executed as one
+	enum OpKind : uint8_t
+	{
+		Single,
+		LoadLoad,      // 6XNN 6XNN
+		AddSkipEqual,  // 7XNN 3XNN
+		LoadIDraw      // ANNN DXYN
+	};
+
+	struct Op
+	{
+		uint16_t opCode;
+		uint16_t next;         // Address following the op
+		uint16_t NNN;
+		uint8_t NN;
+		uint8_t N;
+		uint8_t X;
+		uint8_t Y;
+		uint8_t kind;
+		uint8_t cycles;        // Number of instructions covered by the op
+		uint8_t instruction;   // Index of the instruction, of the first one for fused ops
+		uint8_t instruction2;  // Index of the second instruction of fused ops
+		// Operands of the second instruction of fused ops
+		uint8_t NN2;
+		uint8_t N2;
+		uint8_t X2;
+		uint8_t Y2;
+	};
+
+	struct Block
+	{
+		uint16_t begin;
+		// Past the last byte, up to the size of a 64KB memory
+		uint32_t end;
+		bool isValid;
+		std::vector<BlockCache::Op> ops;
+	};
+
+	BlockCache();
+
+	const BlockCache::Block* find(uint16_t addr) const;
+	BlockCache::Block& insert(uint16_t addr);
+	// Drops every block overlapping [begin, end), returns true if any was dropped
+	bool invalidate(size_t begin, size_t end);
+	void clear();
+	// Clears the cache and sizes it for an address space of addressCount bytes
+	void resize(size_t addressCount);
+
+	const std::vector<BlockCache::Block>& blocks() const { return _blocks; }
+
+private:
+	static const int32_t NO_BLOCK = -1;
+
+	std::vector<int32_t> _entries;
+	std::vector<BlockCache::Block> _blocks;
+	std::vector<int32_t> _freeBlocks;
+};
@@ -1,37 +1,132 @@
 #pragma once
 
-#include <functional>
-#include <stack>
+#include "AudioSink.hpp"
+#include "BlockCache.hpp"
+#include "Platform.hpp"
+#include "Quirks.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
 
 class Chip8;
-class Display;
+class Debugger;
+class Framebuffer;
 class Input;
+struct MachineState;
 class Memory;
+class Profiler;
+class RomAnalysis;
+class StateReader;
+class StateWriter;
+class TraceRecorder;
 
 class CPU
 {
 public:
+	// Linear scans the instruction list for every opCode, Table looks it up in a decode table built once in initialize()
+	// BasicBlock runs pre-decoded blocks from a cache and fuses common instruction pairs
+	enum DispatchMode
+	{
+		Linear,
+		Table,
+		BasicBlock
+	};
+
 	CPU(Chip8& emulator);
 
 	void initialize();
 	bool tick();
+	// Executes at most maxCycles instructions, stopping after a sprite is drawn when display wait is enabled
+	// Busy waits are detected and their cycles accounted in executed without running them, keys must not change during a run
+	// Returns false when an unknown opCode stops the execution
+	// With a debugger or a trace recorder attached, instructions run one by one through tick()
+	// and the run ends early when the debugger stops it
+	bool run(size_t maxCycles, size_t& executed);
 	void updateTimers();
 
+	void saveState(StateWriter& writer) const;
+	void loadState(StateReader& reader);
+	static size_t stateSize();
+	// Only the state of the 4KB platforms, the XO-CHIP planes and audio registers keep their value
+	void saveState(MachineState& state) const;
+	void loadState(const MachineState& state);
+
+	// CXNN draws from a generator owned by the CPU, the same seed gives the same numbers
+	void setSeed(uint64_t seed);
+
 	bool drawThisFrame() const { return _drawThisFrame; }
 	void setDrawThisFrame(bool drawThisFrame) { _drawThisFrame = drawThisFrame; }
 
 	bool isSoundTimerActive() const { return _soundTimer > 0; }
+	SoundState soundState() const;
+
+	// XO-CHIP state: planes drawn by the sprite, clear and scroll instructions, 1 bit audio pattern and its pitch
+	uint8_t planeMask() const { return _planeMask; }
+	const uint8_t* audioPattern() const { return _audioPattern; }
+	uint8_t pitch() const { return _pitch; }
+
+	CPU::DispatchMode dispatchMode() const { return _dispatchMode; }
+	// Blocks are only kept up to date while they are used, switching to BasicBlock starts from an empty cache
+	void setDispatchMode(CPU::DispatchMode dispatchMode);
+	// Decodes the blocks of the code found by the analysis up front, in the BasicBlock mode before the rom runs
+	// A complete analysis also lets the stores proven to write data only run inside their block instead of ending it
+	// Returns false if the memory is not the one analyzed or the execution already started
+	// Loading a state or switching the mode drops what the analysis gave, as the memory may differ
+	bool loadAnalysis(const RomAnalysis& analysis);
+
+	// Not owned, nullptr disables the counting
+	void setProfiler(Profiler* profiler);
+	// Not owned, nullptr runs at full speed
+	void setDebugger(Debugger* debugger) { _debugger = debugger; }
+	// Not owned, nullptr stops recording
+	void setTraceRecorder(TraceRecorder* traceRecorder) { _traceRecorder = traceRecorder; }
+
+	// Timers and keys only change between frames, so a loop that comes back to the same state without touching
+	// memory or the screen spins until the end of the frame. The whole periods left in the frame are skipped,
+	// which gives exactly the same state as running them. FX0A waiting for a key is skipped the same way
+	void setIdleSkipEnabled(bool isEnabled) { _isIdleSkipEnabled = isEnabled; }
+	// Cycles skipped since the CPU was created
+	uint64_t idleCycleCount() const { return _idleCycleCount; }
+
+	// When enabled, initialize() picks handlers specialized for the quirks of the COSMAC VIP, SUPER-CHIP or XO-CHIP
+	// profiles when they match, disabled the handlers always read the quirks at runtime
+	void setQuirkSpecializationEnabled(bool isEnabled) { _isQuirkSpecializationEnabled = isEnabled; }
+	// Name of the handlers profile in use: vip, schip, xochip or runtime
+	const char* quirkProfile() const { return _quirkProfile; }
 
 	static const size_t MAX_REGISTER = 16;
+	static const size_t STACK_SIZE = 16;
+	// SUPER-CHIP saves 8 of them, XO-CHIP all 16
+	static const size_t FLAG_REGISTER_COUNT = 16;
+	static const size_t AUDIO_PATTERN_SIZE = sizeof(SoundState::pattern);
 
 private:
+	typedef void (CPU::*Handler)(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+
+	// State at a backward jump, compared the next time the same jump is taken
+	struct LoopSnapshot
+	{
+		uint16_t jump;
+		uint16_t target;
+		uint64_t cycles;
+		uint32_t sideEffects;
+		uint8_t registers[CPU::MAX_REGISTER];
+		uint16_t I;
+		uint8_t stackSize;
+		uint16_t stack[CPU::STACK_SIZE];
+		uint8_t delayTimer;
+		uint8_t soundTimer;
+		uint64_t randomState;
+	};
+
 	class Instruction
 	{
 	public:
-		Instruction(uint16_t mask, uint16_t code, std::function<void(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)> execute) :
+		Instruction(uint16_t mask, uint16_t code, CPU::Handler execute, const char* name) :
 			mask(mask),
 			code(code),
-			execute(execute)
+			execute(execute),
+			name(name)
 		{}
 
 		// Mask and code are used to filter the opCode and determines the action to execute
@@ -39,24 +134,149 @@ private:
 		uint16_t mask; 
 		uint16_t code;
 
-		std::function<void(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)> execute;
+		CPU::Handler execute;
+		const char* name;
 	};
 
-	void addInstruction(uint16_t mask, uint16_t code, std::function<void(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)> execute);
+	template <typename Policy>
+	void addInstructions();
+	void addInstruction(uint16_t mask, uint16_t code, CPU::Handler execute, const char* name);
+	void nameProfilerInstructions();
+	void buildDecodeTable();
 	const CPU::Instruction* getInstruction(uint16_t opCode) const;
+	const CPU::Instruction* decodeInstruction(uint16_t opCode) const;
+
+	const BlockCache::Block* buildBlock(uint16_t addr);
+	size_t executeBlock(const BlockCache::Block& block, size_t maxCycles);
+	void invalidateWrittenBlocks();
+	// Drops every block and the code marks they set
+	void clearBlocks();
+	static bool isBlockEnd(uint16_t opCode);
+	void skipNextInstruction();
+	void detectIdleLoop(uint16_t target);
+	void skipIdleCycles(size_t maxCycles, size_t& executed);
+	// run() with the hooks of the debugger and the trace recorder around every instruction
+	// An unknown opCode stops the debugger instead of being an error
+	bool runStepped(size_t maxCycles, size_t& executed);
+	uint8_t nextRandom();
+
+	void op0NNN(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void op00E0(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void op00EE(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void op00CN(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void op00DN(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void op00FB(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void op00FC(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void op00FD(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void op00FE(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void op00FF(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void op1NNN(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void op2NNN(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void op3XNN(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void op4XNN(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void op5XY0(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void op5XY2(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void op5XY3(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void op6XNN(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void op7XNN(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void op8XY0(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	template <typename Policy>
+	void op8XY1(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	template <typename Policy>
+	void op8XY2(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	template <typename Policy>
+	void op8XY3(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void op8XY4(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void op8XY5(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	template <typename Policy>
+	void op8XY6(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void op8XY7(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	template <typename Policy>
+	void op8XYE(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void op9XY0(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void opANNN(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void opBNNN(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void opCXNN(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	template <typename Policy>
+	void opDXYN(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void opEX9E(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void opEXA1(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void opF000(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void opFN01(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void opF002(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void opFX07(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void opFX0A(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void opFX15(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void opFX18(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void opFX1E(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void opFX29(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void opFX30(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void opFX33(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void opFX3A(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	template <typename Policy>
+	void opFX55(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	template <typename Policy>
+	void opFX65(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void opFX75(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+	void opFX85(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y);
+
+	static const size_t OPCODE_COUNT = 0x10000;
+	static const uint8_t UNKNOWN_INSTRUCTION = 0xFF;
+	static const size_t MAX_BLOCK_SIZE = 64;
+	static const uint8_t BIG_SPRITE_SIZE = 16;
+	static const uint8_t BIG_FONT_CHARACTER_SIZE = 10;
+	static const uint8_t SCROLL_PIXELS = 4;
+	// Square wave of 500Hz until a rom loads its own pattern, at 4000 bits per second
+	static const uint8_t DEFAULT_PITCH = 64;
+	static const uint8_t DEFAULT_PATTERN_BYTE = 0xF0;
+	static const uint16_t NO_LOOP = 0xFFFF;
 
 	Chip8& _emulator;
 	Memory& _memory;
-	Display& _display;
+	Framebuffer& _framebuffer;
 	Input& _input;
 	std::vector<CPU::Instruction> _instructions;
+	// Index in _instructions for each of the 65536 opCodes
+	std::vector<uint8_t> _decodeTable;
+	BlockCache _blockCache;
+	// Set at the stores of a complete analysis that never write the code, they do not end their block
+	std::vector<uint8_t> _dataStores;
+	bool _hasDataStores;
 	uint16_t _pc;
 	uint8_t _registers[CPU::MAX_REGISTER];
 	uint16_t _I;
-	std::stack<uint16_t> _stack;
+	uint16_t _stack[CPU::STACK_SIZE];
+	uint8_t _stackSize;
 
 	uint8_t _delayTimer;
 	uint8_t _soundTimer;
+	uint64_t _randomState;
+
+	uint8_t _flagRegisters[CPU::FLAG_REGISTER_COUNT];
+	uint8_t _planeMask;
+	uint8_t _audioPattern[CPU::AUDIO_PATTERN_SIZE];
+	uint8_t _pitch;
 
 	bool _drawThisFrame;
+	// Set when an instruction cannot complete, stops the execution
+	bool _isHalted;
+	CPU::DispatchMode _dispatchMode;
+	Profiler* _profiler;
+	Debugger* _debugger;
+	TraceRecorder* _traceRecorder;
+
+	bool _isIdleSkipEnabled;
+	// Instructions executed, the length of a loop is the difference between two of its snapshots
+	uint64_t _cycles;
+	// Incremented by the instructions that write memory, change the screen or the audio, a loop doing so is never idle
+	uint32_t _sideEffects;
+	CPU::LoopSnapshot _loopSnapshot;
+	// Length of the idle loop just detected, 0 when none
+	size_t _idlePeriod;
+	uint64_t _idleCycleCount;
+	// Copied from the emulator at initialize() so the handlers don't go through it
+	Quirks _quirks;
+	Platform::Type _platform;
+	bool _isQuirkSpecializationEnabled;
+	const char* _quirkProfile;
 };
@@ -1,53 +1,223 @@
 #pragma once
 
-#include "Audio.hpp"
 #include "CPU.hpp"
+#include "Framebuffer.hpp"
 #include "Input.hpp"
 #include "Memory.hpp"
-#include "Display.hpp"
+#include "Platform.hpp"
+#include "Quirks.hpp"
+#include "Rewind.hpp"
+#include "TripleBuffer.hpp"
+#include <atomic>
+#include <chrono>
 #include <string>
+#include <vector>
+
+class AudioSink;
+class Debugger;
+class InputLog;
+class InputQueue;
+class InputSource;
+struct MachineState;
+class Profiler;
+class Renderer;
+class SharedStateWriter;
+class SpectatorServer;
+class TraceRecorder;
+class VideoCapture;
 
 class Chip8
 {
 public:
-	Chip8(size_t cyclesPerFrame, bool saveLoadIncrement, bool vfReset, bool clipping, bool shifting, bool displayWait);
+	// Written by the emulation thread of update() and read by the thread presenting the frames
+	struct EmulationStats
+	{
+		std::atomic<uint64_t> emulatedFrames;
+		std::atomic<uint64_t> droppedFrames;
+		std::atomic<size_t> cyclesPerFrame;
+	};
+
+	Chip8(size_t cyclesPerFrame, const Quirks& quirks);
+
+	// Sizes the memory and the screen for the platform, to call before loadRom() as it clears the memory
+	// The quirks are independent, Platform::quirks() gives the usual ones
+	void setPlatform(Platform::Type platform);
+	Platform::Type platform() const { return _platform; }
 
 	void initialize();
+	// Runs in real time at 60Hz until the renderer is closed, requires a renderer
+	// Emulation runs on its own thread while the calling thread samples the inputs and presents the frames
 	void update();
+	// Runs a single frame as fast as possible, returns false if the execution stopped on an error
+	// A frame the debugger stopped in the middle of is suspended, the next call resumes it
+	bool runFrame();
+	bool isFrameSuspended() const { return _isFrameSuspended; }
 	bool loadRom(const std::string& path);
+	bool loadRom(const uint8_t* data, size_t size);
+
+	// Snapshot of the whole machine: framebuffer, memory, registers, stack, timers, random generator and keypad
+	void saveState(std::vector<uint8_t>& data) const;
+	// The state is validated before being applied, returns false if it is truncated, from another version or platform
+	bool loadState(const uint8_t* data, size_t size);
+	bool saveStateToFile(const std::string& path) const;
+	bool loadStateFromFile(const std::string& path);
 
-	Display& display() { return _display; }
+	// Flat copy of the machine, for the 4KB platforms only, returns false on XO-CHIP
+	bool saveState(MachineState& state) const;
+	// Returns false if the resolution of the state does not fit, or on XO-CHIP
+	bool loadState(const MachineState& state);
+	// Loads the state, runs frames frames with the keys of the mask held and writes the result back
+	// Returns false if the state cannot be loaded or the execution stopped, during these frames or in an earlier step
+	// Blocks are dropped on every load, the Table dispatch mode is the fastest one to step many states
+	bool step(MachineState& state, uint16_t keys, size_t frames);
+	// Steps each state with its own keys, returns the number of states that ran without error
+	size_t step(MachineState* states, const uint16_t* keys, size_t count, size_t frames);
+	// State file next to the rom loaded from a path
+	std::string statePath() const { return _romPath + ".state"; }
+
+	// Captures a state at the end of every frame so the execution can be stepped back
+	void setRewindEnabled(bool rewindEnabled);
+	bool isRewindEnabled() const { return _rewindEnabled; }
+	// Restores the state of the previous frame, returns false when the history is empty
+	bool rewindFrame();
+	const Rewind& rewind() const { return _rewind; }
+
+	Framebuffer& framebuffer() { return _framebuffer; }
 	Input& input() { return _input; }
 	Memory& memory() { return _memory; }
+	CPU& cpu() { return _cpu; }
 
-	bool isSaveLoadIncrementEnabled() const { return _saveLoadIncrement; }
-	bool isVfResetEnabled() const { return _vfReset; }
-	bool isClippingEnabled() const { return _clipping; }
-	bool isShiftingEnabled() const { return _shifting; }
-	bool isDisplayWaitEnabled() const { return _displayWait; }
+	const Quirks& quirks() const { return _quirks; }
+	bool isSaveLoadIncrementEnabled() const { return _quirks.saveLoadIncrement; }
+	bool isVfResetEnabled() const { return _quirks.vfReset; }
+	bool isClippingEnabled() const { return _quirks.clipping; }
+	bool isShiftingEnabled() const { return _quirks.shifting; }
+	bool isDisplayWaitEnabled() const { return _quirks.displayWait; }
+
+	// Front-ends are optional and not owned by the emulator
+	void setRenderer(Renderer* renderer) { _renderer = renderer; }
+	void setAudioSink(AudioSink* audioSink) { _audioSink = audioSink; }
+	void setInputSource(InputSource* inputSource) { _inputSource = inputSource; }
 
 	void setAudioEnabled(bool audioEnabled) { _audioEnabled = audioEnabled; }
 
+	// Seeds the random numbers of CXNN, runs with the same seed and inputs are identical
+	void setSeed(uint64_t seed) { _cpu.setSeed(seed); }
+	// Records the keypad of every frame, rewinding and loading states are disabled meanwhile
+	void setInputLog(InputLog* inputLog) { _inputLog = inputLog; }
+	// Not owned, counts the execution and times the phases of update(), which writes the report to reportPath
+	// when Profiler::takeReportRequest() says so
+	void setProfiler(Profiler* profiler, const std::string& reportPath);
+	// Not owned, breaks into the execution on the breakpoints and watchpoints of the debugger, nullptr detaches it
+	void setDebugger(Debugger* debugger);
+	// Not owned, records every instruction from the next one on, nullptr stops recording
+	void setTraceRecorder(TraceRecorder* traceRecorder);
+	// Not owned, given the screen at the end of every frame, nullptr stops capturing
+	void setVideoCapture(VideoCapture* videoCapture) { _videoCapture = videoCapture; }
+	// Not owned, given the screen at the end of every frame to stream it, nullptr stops streaming
+	void setSpectatorServer(SpectatorServer* spectatorServer) { _spectatorServer = spectatorServer; }
+	// Not owned, given the screen and the registers at the end of every frame for other processes, nullptr stops it
+	void setSharedStateWriter(SharedStateWriter* sharedStateWriter) { _sharedStateWriter = sharedStateWriter; }
+
+	// Fast forward runs speed frames per 60Hz tick, 0 runs as many as the host can
+	// Timers still step once per emulated frame
+	void setFastForward(bool isFastForward) { _isFastForward = isFastForward; }
+	bool isFastForward() const { return _isFastForward; }
+	void setFastForwardSpeed(size_t speed) { _fastForwardSpeed = speed; }
+
+	size_t cyclesPerFrame() const { return _cyclesPerFrame; }
+	void setCyclesPerFrame(size_t cyclesPerFrame) { _cyclesPerFrame = cyclesPerFrame; }
+	// Adjusts the cycles per frame between minCycles and maxCycles so a frame takes about budget
+	// of a 60Hz frame on the host, 0 disables it. Slow hosts run the rom slower instead of missing frames
+	void setCpuBudget(double budget, size_t minCycles, size_t maxCycles);
+
+	uint64_t instructionCount() const { return _instructionCount; }
+
 	static const uint16_t FONT_START_ADDRESS = 0x050;
+	// 8x10 digits of SUPER-CHIP and XO-CHIP, right after the small font
+	static const uint16_t BIG_FONT_START_ADDRESS = 0x0A0;
 	static const uint16_t ROM_START_ADDR = 0x200;
 	static const uint8_t SPRITE_WIDTH = 8;
+	static const uint8_t SCREEN_WIDTH = 64;
+	static const uint8_t SCREEN_HEIGHT = 32;
+	static const uint8_t HIRES_SCREEN_WIDTH = 128;
+	static const uint8_t HIRES_SCREEN_HEIGHT = 64;
+	static const uint16_t STATE_VERSION = 3;
+	// 1 minute of history with a full state every second, about 400KB on CHIP-8 and 4MB on XO-CHIP
+	static const size_t REWIND_FRAMES = 3600;
+	static const size_t REWIND_KEYFRAME_INTERVAL = 60;
 
 private:
+	// Keys taken at an instruction of the frame, from a key event at that time
+	struct KeyChange
+	{
+		size_t cycle;
+		uint16_t keys;
+		std::chrono::steady_clock::time_point time;
+	};
+
+	// Handed to the thread presenting the frames, with the time of the oldest key change it is the first to show
+	struct PresentedFrame
+	{
+		Framebuffer framebuffer;
+		std::chrono::steady_clock::time_point inputTime;
+		bool hasInput;
+	};
+
 	void loadFont();
+	size_t stateSize(uint8_t width, uint8_t height, uint8_t planeCount) const;
+	// Without source the keys follow the changes queued by queueKeyChanges()
+	bool runFrame(InputSource* inputSource);
+	void queueKeyChanges(const InputQueue& inputQueue, std::chrono::steady_clock::time_point windowStart, std::chrono::steady_clock::time_point windowEnd);
+	void adaptCyclesPerFrame(double frameSeconds);
+	void runEmulationThread(TripleBuffer<Chip8::PresentedFrame>& frames, InputQueue& inputQueue, std::atomic<bool>& isRunning, Chip8::EmulationStats& stats);
 	
-	Display _display;
+	Framebuffer _framebuffer;
 	Memory _memory;
 	Input _input;
-	Audio _audio;
 	CPU _cpu;
 
+	Renderer* _renderer;
+	AudioSink* _audioSink;
+	InputSource* _inputSource;
+	InputLog* _inputLog;
+	Profiler* _profiler;
+	std::string _profileReportPath;
+	Debugger* _debugger;
+	TraceRecorder* _traceRecorder;
+	VideoCapture* _videoCapture;
+	SpectatorServer* _spectatorServer;
+	SharedStateWriter* _sharedStateWriter;
+
 	// Configurable because some games may depends on it to run properly
 	size_t _cyclesPerFrame;
-	bool _saveLoadIncrement;
-	bool _vfReset;
-	bool _clipping;
-	bool _shifting;
-	bool _displayWait;
+	Quirks _quirks;
+	Platform::Type _platform;
 	
 	bool _audioEnabled;
+	bool _isFastForward;
+	size_t _fastForwardSpeed;
+	double _cpuBudget;
+	size_t _minCyclesPerFrame;
+	size_t _maxCyclesPerFrame;
+	// Smoothed host time of a frame, in seconds
+	double _frameSeconds;
+	uint64_t _instructionCount;
+	uint32_t _frameCount;
+	// Instructions the suspended frame already ran
+	size_t _suspendedCycles;
+	bool _isFrameSuspended;
+
+	// Key changes not applied yet, the keys of the last one applied and the time of the first one not presented yet
+	std::vector<Chip8::KeyChange> _keyChanges;
+	uint16_t _appliedKeys;
+	std::chrono::steady_clock::time_point _inputTime;
+	bool _hasInputTime;
+
+	std::string _romPath;
+	Rewind _rewind;
+	bool _rewindEnabled;
+	// Reused for every capture to avoid allocating each frame, holds the current state after a capture or a rewind
+	std::vector<uint8_t> _stateBuffer;
+	std::vector<uint8_t> _rewindBuffer;
 };
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Chip8;
+
+// Breakpoints, watchpoints and single-stepping, driven by a front-end such as GdbServer
+// Attached with Chip8::setDebugger(), the CPU runs one instruction at a time and stops before a breakpoint or after the
+// instruction that hit a watchpoint, inside the frame that Chip8::runFrame() resumes on its next call
+// Detached, the hooks cost a null test per CPU::run() and per memory read, writes test the marks they already test for the code
+// They are compiled out without CHIP8_ENABLE_DEBUGGER
+class Debugger
+{
+public:
+	enum StopReason
+	{
+		None,
+		Interrupt,
+		Step,
+		Breakpoint,
+		Watchpoint,
+		// Unknown opCode, pc points to it
+		Error,
+		// Call with a full stack, pc points to it
+		StackOverflow,
+		// 00FD ended the rom
+		Exit
+	};
+
+	enum WatchKind
+	{
+		Read,
+		Write,
+		Access
+	};
+
+	Debugger(Chip8& emulator);
+
+	// Breakpoints and watches are one byte per address, so the CPU and the memory check them in constant time
+	void addBreakpoint(uint16_t addr);
+	void removeBreakpoint(uint16_t addr);
+	bool isBreakpoint(uint16_t addr) const { return _breakpoints[addr] != 0; }
+	// Watches are set on the memory of the emulator and dropped when the platform resizes it
+	void addWatchpoint(uint16_t addr, size_t size, Debugger::WatchKind kind);
+	void removeWatchpoint(uint16_t addr, size_t size, Debugger::WatchKind kind);
+	void clear();
+
+	// A resumed execution does not stop on the breakpoint it stopped before
+	void resume();
+	// Stops after the next instruction
+	void step();
+	// Stops before the next instruction, from any thread
+	void interrupt() { _isInterruptRequested = true; }
+	void stop(Debugger::StopReason reason);
+
+	bool isStopped() const { return _stopReason != Debugger::StopReason::None; }
+	Debugger::StopReason stopReason() const { return _stopReason; }
+	// Address and kind of the watchpoint of a Watchpoint stop
+	uint16_t watchAddress() const { return _watchAddress; }
+	Debugger::WatchKind watchKind() const { return _watchKind; }
+
+	// Hooks of the CPU, before and after every instruction, true when the CPU must stop before it
+	bool shouldStop(uint16_t pc);
+	void endInstruction();
+	// Hook of the memory, the accesses made while stopped are the ones of the front-end and are not reported
+	void hitWatchpoint(uint16_t addr, bool isWrite);
+
+private:
+	struct Watch
+	{
+		uint16_t addr;
+		size_t size;
+		Debugger::WatchKind kind;
+	};
+
+	void markWatches();
+
+	Chip8& _emulator;
+	std::vector<uint8_t> _breakpoints;
+	std::vector<Debugger::Watch> _watches;
+
+	Debugger::StopReason _stopReason;
+	uint16_t _watchAddress;
+	Debugger::WatchKind _watchKind;
+	bool _isStepping;
+	// Set until the first instruction after resume() or step() ran
+	bool _isResuming;
+	std::atomic<bool> _isInterruptRequested;
+};
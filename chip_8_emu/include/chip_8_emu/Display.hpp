@@ -1,38 +1,50 @@
 #pragma once
 
+#include "Renderer.hpp"
 #include <SFML/Graphics.hpp>
+#include <functional>
+#include <vector>
 
-class Display
+// Keeps the framebuffer in a texture with one texel per pixel, scaled to the window by a sprite
+// Only the rows that changed since the previous present are uploaded
+class Display : public Renderer
 {
 public:
 	Display(uint8_t width, uint8_t height, uint8_t pixelSize, const std::string& title);
 
-	void display();
-	void clear();
+	void present(const Framebuffer& framebuffer) override;
 	void close();
-	bool isOpen() const;
-	void pollEvent();
+	bool isOpen() const override;
+	void pollEvent() override;
+	// Receives every event of the window, as the keyboard needs the key events
+	void setEventHandler(const std::function<void(const sf::Event&)>& eventHandler) { _eventHandler = eventHandler; }
 
 	uint8_t width() const { return _width; }
 	uint8_t height() const { return _height; }
 
-	bool isPixelOn(uint8_t x, uint8_t y) const;
-	void putPixel(uint8_t x, uint8_t y, bool isOn);
-
-	sf::Color getPixel(uint8_t x, uint8_t y) const;
-	void putPixel(uint8_t x, uint8_t y, sf::Color color);
-
-	void setPixelColorOff(sf::Color color) { _pixelColorOff = color; }
-	void setPixelColorOn(sf::Color color) { _pixelColorOn = color; }
+	void setPixelColorOff(sf::Color color);
+	void setPixelColorOn(sf::Color color);
+	// Color of a pixel whose bit in plane i is bit i of index, 2 and 3 are only used by the XO-CHIP planes
+	void setPixelColor(uint8_t index, sf::Color color);
 
 private:
+	void resize(uint8_t width, uint8_t height, uint8_t planeCount);
+	void unpackRow(const Framebuffer& framebuffer, uint8_t y);
+
 	sf::RenderWindow _window;
-	sf::VertexArray _vertices;
+	sf::Texture _texture;
+	sf::Sprite _sprite;
 	sf::Shader _shader;
+	bool _isShaderLoaded;
+
+	// RGBA texels of the whole framebuffer and the rows of every plane they were unpacked from
+	std::vector<sf::Uint8> _pixels;
+	std::vector<uint64_t> _presentedRows;
+	uint8_t _planeCount;
 
 	uint8_t _width;
 	uint8_t _height;
 	uint8_t _pixelSize;
-	sf::Color _pixelColorOff;
-	sf::Color _pixelColorOn;
+	sf::Color _palette[4];
+	std::function<void(const sf::Event&)> _eventHandler;
 };
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct MachineState;
+class StateReader;
+class StateWriter;
+
+// Pixels of the emulated screen, owned by the core and read by the renderers
+// Each row is packed in 64 bits words, the leftmost pixel of a word being its most significant bit
+// XO-CHIP has two bitplanes, a pixel color being the index formed by its bit in each plane
+class Framebuffer
+{
+public:
+	Framebuffer(uint8_t width, uint8_t height, uint8_t planeCount = 1);
+
+	// Changes the resolution or the number of planes, every pixel is cleared
+	void resize(uint8_t width, uint8_t height, uint8_t planeCount);
+	// Bit i of planeMask selects plane i
+	void clear(uint8_t planeMask = Framebuffer::ALL_PLANES);
+
+	uint8_t width() const { return _width; }
+	uint8_t height() const { return _height; }
+	uint8_t planeCount() const { return _planeCount; }
+	size_t wordsPerRow() const { return _wordsPerRow; }
+	const uint64_t* row(uint8_t y, uint8_t plane = 0) const { return &_rows[(plane * _height + y) * _wordsPerRow]; }
+
+	bool isPixelOn(uint8_t x, uint8_t y, uint8_t plane = 0) const;
+	void putPixel(uint8_t x, uint8_t y, bool isOn, uint8_t plane = 0);
+
+	// Xors the bitCount lowest bits of sprite (most significant first) on row y starting at column x
+	// With clipping the pixels past the right edge are dropped when x is on screen, otherwise they wrap around
+	// Returns true if a pixel was flipped from set to unset
+	bool xorRow(uint8_t x, uint8_t y, uint32_t sprite, uint8_t bitCount, bool clipping, uint8_t plane = 0);
+
+	// Scrolls the selected planes by count pixels, the pixels scrolled out are lost and the new ones are off
+	// Rows are moved or shifted a word at a time
+	void scrollDown(uint8_t count, uint8_t planeMask);
+	void scrollUp(uint8_t count, uint8_t planeMask);
+	void scrollRight(uint8_t count, uint8_t planeMask);
+	void scrollLeft(uint8_t count, uint8_t planeMask);
+
+	// FNV-1a hash of the pixels, used to compare frames against stored references
+	uint64_t hash() const;
+
+	void saveState(StateWriter& writer) const;
+	// Takes the resolution of the state, returns false if it is not a valid one
+	bool loadState(StateReader& reader);
+	static size_t stateSize(uint8_t width, uint8_t height, uint8_t planeCount);
+	// A MachineState holds a single plane of at most 128x64, both return false for anything else
+	bool saveState(MachineState& state) const;
+	bool loadState(const MachineState& state);
+
+	static const uint8_t WORD_BITS = 64;
+	static const uint8_t MAX_PLANES = 2;
+	static const uint8_t ALL_PLANES = 0xFF;
+
+private:
+	uint64_t* planeRow(uint8_t y, uint8_t plane) { return &_rows[(plane * _height + y) * _wordsPerRow]; }
+	// Clears the pixels past the width in the last word of each row, the shifts may have moved some there
+	void clearPadding(uint8_t plane);
+
+	uint8_t _width;
+	uint8_t _height;
+	uint8_t _planeCount;
+	size_t _wordsPerRow;
+	uint64_t _lastWordMask;
+	std::vector<uint64_t> _rows;
+};
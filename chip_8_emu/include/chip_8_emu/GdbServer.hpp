@@ -0,0 +1,59 @@
+#pragma once
+
+#include "MachineState.hpp"
+#include "Socket.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class Chip8;
+class Debugger;
+
+// GDB Remote Serial Protocol on a localhost TCP socket, so GDB or any other client of the protocol can attach
+// Registers are V0 to VF, I, pc, the stack size, the 16 entries of the stack and the two timers, as described by the
+// target description sent to the client. Breakpoints and watchpoints go to the debugger, the execution runs as
+// usual between two stops, frame after frame, with poll() called between the frames
+class GdbServer
+{
+public:
+	GdbServer(Chip8& emulator, Debugger& debugger);
+	~GdbServer();
+
+	// Waits for a client on localhost:port and attaches the debugger, the execution starts stopped
+	bool listen(uint16_t port);
+	bool isConnected() const { return _client != Socket::NO_SOCKET; }
+	// Tells the client the execution stopped and serves its packets until it resumes it, while the execution runs
+	// only looks for an interrupt. The debugger is detached once the client is gone
+	// Returns false when the client killed the rom or the rom exited
+	bool poll();
+
+private:
+	bool serve();
+	bool hasInput();
+	bool readByte(char& byte);
+	bool readPacket(std::string& packet);
+	void sendPacket(const std::string& data);
+	// Returns false on the packets that end the session, isResumed is set by the ones that resume the execution
+	bool handlePacket(const std::string& packet, bool& isResumed);
+	std::string stopReply() const;
+	std::string readRegister(size_t index);
+	bool writeRegister(size_t index, const std::string& hex);
+	void disconnect();
+
+	static const size_t REGISTER_COUNT = 37;
+	// Bytes of a memory read, its reply fits in the packet size announced to the client
+	static const size_t MAX_READ_SIZE = 0x7F0;
+
+	Chip8& _emulator;
+	Debugger& _debugger;
+	intptr_t _listener;
+	intptr_t _client;
+	// Set while the client waits for the execution to stop
+	bool _isRunning;
+	bool _isAckEnabled;
+	char _input[4096];
+	size_t _inputBegin;
+	size_t _inputEnd;
+	// Carries the registers to and from the CPU, only its CPU fields are used
+	MachineState _registers;
+};
@@ -1,8 +1,12 @@
 #pragma once
 
-#include <SFML/Window/Keyboard.hpp>
 #include <cstdint>
 
+class InputSource;
+struct MachineState;
+class StateReader;
+class StateWriter;
+
 class Input
 {
 public:
@@ -16,13 +20,24 @@ public:
 
 	Input();
 
-	void tick();
+	// Without source every key is considered released
+	void tick(InputSource* source);
+	// Start of a frame with the keys of the mask pressed
+	void tick(uint16_t keys);
+	// Change of the keys in the middle of a frame, only the keys that went down or up change state
+	void setKeys(uint16_t keys);
 	bool isKeyDown(uint8_t keyCode) const;
 	Input::KeyState getKeyState(uint8_t keyCode) const;
+	// Bit i set when key i is down
+	uint16_t keyMask() const;
+
+	void saveState(StateWriter& writer) const;
+	void loadState(StateReader& reader);
+	void saveState(MachineState& state) const;
+	void loadState(const MachineState& state);
 
 	static const uint8_t INPUT_COUNT = 16;
 
 private:
 	KeyState _inputs[INPUT_COUNT];
-	sf::Keyboard::Key _bindings[INPUT_COUNT];
 };
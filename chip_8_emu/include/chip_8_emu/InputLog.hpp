@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Platform.hpp"
+#include "Quirks.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Keypad states of a session, stored only on the frames where they change
+// Along with the seed and the machine configuration, replaying it reproduces the session exactly
+class InputLog
+{
+public:
+	struct Event
+	{
+		uint32_t frame;
+		uint16_t keys;   // Bit i set when key i is pressed
+	};
+
+	InputLog();
+
+	void clear();
+	// Frames must be recorded in increasing order
+	void record(uint32_t frame, uint16_t keys);
+	uint16_t keysAt(uint32_t frame, size_t& cursor) const;
+
+	bool save(const std::string& path) const;
+	bool load(const std::string& path);
+
+	const std::vector<InputLog::Event>& events() const { return _events; }
+
+	uint64_t seed;
+	size_t cyclesPerFrame;
+	Quirks quirks;
+	Platform::Type platform;
+	uint32_t frameCount;
+
+	// Version 1 logs have no platform and were recorded on the COSMAC VIP one
+	static const uint16_t VERSION = 2;
+
+private:
+	std::vector<InputLog::Event> _events;
+};
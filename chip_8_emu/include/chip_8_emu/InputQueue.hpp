@@ -0,0 +1,45 @@
+#pragma once
+
+#include "InputSource.hpp"
+#include "SpscQueue.hpp"
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Carries input snapshots from the thread that samples the front-end to the emulation thread
+// Snapshots received between two polls are merged so a short key press is never missed
+class InputQueue : public InputSource
+{
+public:
+	struct Snapshot
+	{
+		uint16_t keys;     // Bit i set when key i is pressed
+		uint8_t hotkeys;   // Bit h set when InputSource::Hotkey h is pressed
+		std::chrono::steady_clock::time_point time; // When the keys took this state
+
+		bool operator==(const InputQueue::Snapshot& other) const { return keys == other.keys && hotkeys == other.hotkeys; }
+		bool operator!=(const InputQueue::Snapshot& other) const { return !(*this == other); }
+	};
+
+	InputQueue();
+
+	// Sampling thread: polls the source and reads every key and hotkey, timed now
+	static InputQueue::Snapshot sample(InputSource& source);
+	// Sampling thread, returns false when the queue is full and the snapshot must be pushed again later
+	bool push(const InputQueue::Snapshot& snapshot);
+
+	// Emulation thread
+	void poll() override;
+	bool isKeyPressed(uint8_t keyCode) const override;
+	bool isHotkeyPressed(InputSource::Hotkey hotkey) const override;
+	// Every snapshot received by the last poll, in order, for the keys to change at their time in the frame
+	const std::vector<InputQueue::Snapshot>& snapshots() const { return _snapshots; }
+
+private:
+	static const size_t CAPACITY = 64;
+
+	SpscQueue<InputQueue::Snapshot, InputQueue::CAPACITY> _queue;
+	InputQueue::Snapshot _current;  // Reported until the next poll
+	InputQueue::Snapshot _latest;   // Last snapshot received
+	std::vector<InputQueue::Snapshot> _snapshots;
+};
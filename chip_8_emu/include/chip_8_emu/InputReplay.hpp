@@ -0,0 +1,25 @@
+#pragma once
+
+#include "InputSource.hpp"
+#include <cstddef>
+#include <cstdint>
+
+class InputLog;
+
+// Plays the keys of a recorded log back, one frame per poll
+class InputReplay : public InputSource
+{
+public:
+	InputReplay(const InputLog& log);
+
+	void poll() override;
+	bool isKeyPressed(uint8_t keyCode) const override;
+
+	bool isFinished() const;
+
+private:
+	const InputLog& _log;
+	uint32_t _frame;
+	size_t _cursor;
+	uint16_t _keys;
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Front-end that reports the physical state of the 16 keys of the keypad
+class InputSource
+{
+public:
+	// Emulator commands outside of the keypad
+	enum Hotkey
+	{
+		SaveState,
+		LoadState,
+		Rewind,
+		FastForward,
+		HotkeyCount
+	};
+
+	// State of every key right after a key went down or up
+	struct Event
+	{
+		uint16_t keys;     // Bit i set when key i is pressed
+		uint8_t hotkeys;   // Bit h set when InputSource::Hotkey h is pressed
+		std::chrono::steady_clock::time_point time;
+	};
+
+	virtual ~InputSource() {}
+
+	// Called once per frame before the keys are sampled
+	virtual void poll() {}
+	virtual bool isKeyPressed(uint8_t keyCode) const = 0;
+	virtual bool isHotkeyPressed(InputSource::Hotkey hotkey) const { return false; }
+	// Event driven sources return their events in order, one per call, until none is left
+	// Polled sources have none and are only sampled
+	virtual bool nextEvent(InputSource::Event& event) { return false; }
+};
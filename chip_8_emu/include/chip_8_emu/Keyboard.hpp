@@ -0,0 +1,42 @@
+#pragma once
+
+#include "InputSource.hpp"
+#include "Input.hpp"
+#include <SFML/Window/Event.hpp>
+#include <SFML/Window/Keyboard.hpp>
+#include <string>
+#include <vector>
+
+// Keys follow the key events of the window instead of being polled, every change is timed when it is received
+class Keyboard : public InputSource
+{
+public:
+	Keyboard();
+
+	// Called with every event of the window, by the thread that polls them
+	void handleEvent(const sf::Event& event);
+
+	// One letter or digit per key of the keypad, from key 0 to key F
+	// Returns false and keeps the bindings if the layout is not 16 letters or digits
+	bool setBindings(const std::string& layout);
+	void setBinding(uint8_t keyCode, sf::Keyboard::Key key);
+	void setHotkeyBinding(InputSource::Hotkey hotkey, sf::Keyboard::Key key);
+
+	bool isKeyPressed(uint8_t keyCode) const override;
+	bool isHotkeyPressed(InputSource::Hotkey hotkey) const override;
+	bool nextEvent(InputSource::Event& event) override;
+
+	// Row by row on an AZERTY keyboard: 1234, AZER, QSDF and WXCV
+	static const char* DEFAULT_LAYOUT;
+
+private:
+	void setKeys(uint16_t keys, uint8_t hotkeys);
+
+	sf::Keyboard::Key _bindings[Input::INPUT_COUNT];
+	sf::Keyboard::Key _hotkeyBindings[InputSource::Hotkey::HotkeyCount];
+	uint16_t _keys;
+	uint8_t _hotkeys;
+	// Received since the last time nextEvent() returned false
+	std::vector<InputSource::Event> _events;
+	size_t _nextEvent;
+};
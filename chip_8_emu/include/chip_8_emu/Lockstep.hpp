@@ -0,0 +1,133 @@
+#pragma once
+
+#include "Chip8.hpp"
+#include "MachineState.hpp"
+#include "Platform.hpp"
+#include "Quirks.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Runs many instances of the same rom side by side, one lane per instance, for agents, fuzzing and parameter sweeps
+// Registers, I, pc and timers are stored register by register across the lanes, so the lanes at the same address run
+// 6XNN, 7XNN, 8XYN, the skips, ANNN, 1NNN and the timer instructions all at once with SIMD instructions
+// Calls and returns go through the lanes one by one, the instructions touching memory, the screen or the keys run on
+// a scalar core owned by each lane, as do the lanes left alone at their address. Lanes end as Chip8::step() leaves states
+class Lockstep
+{
+public:
+	Lockstep(size_t cyclesPerFrame, const Quirks& quirks, Platform::Type platform);
+
+	// One lane per state, the lanes only run together on the code their states share
+	// Returns false if a state does not fit the platform, XO-CHIP is not supported as for MachineState
+	bool load(const MachineState* states, size_t count);
+	void save(MachineState* states) const;
+	// Runs frames with the keys of each lane held, returns the number of lanes still running
+	// A lane stopped by an error keeps its state and does not run anymore
+	size_t run(const uint16_t* keys, size_t frames);
+
+	size_t laneCount() const { return _laneCount; }
+	bool isLaneRunning(size_t lane) const { return _lanes[lane].isRunning; }
+	// Instructions of the lanes run together and one lane at a time since the lanes were loaded
+	uint64_t vectorCycleCount() const { return _vectorCycleCount; }
+	uint64_t scalarCycleCount() const { return _scalarCycleCount; }
+
+	// SIMD instructions picked at compile time: avx2, sse2 or none
+	static const char* instructionSet();
+
+private:
+	enum OpKind
+	{
+		Scalar,
+		Register,
+		Skip,
+		Jump,
+		Call,
+		Return
+	};
+
+	// State of a lane only used one lane at a time
+	struct Lane
+	{
+		uint16_t stack[MachineState::STACK_SIZE];
+		uint8_t stackSize;
+		uint8_t flagRegisters[MachineState::REGISTER_COUNT];
+		uint64_t randomState;
+		bool isRunning;
+	};
+
+	static Lockstep::OpKind opKind(uint16_t opCode);
+	bool isSharedCode(uint16_t pc) const;
+	uint16_t sharedOpCode(uint16_t pc) const;
+	uint8_t* registers(uint8_t index) { return &_registers[index * _stride]; }
+
+	void startFrame(const uint16_t* keys);
+	void endFrame();
+	// Selects the lanes at the address of the lane the most behind, returns false when every lane ended its frame
+	bool findGroup(uint16_t& pc, size_t& leader);
+	bool isJoinAddress(uint16_t pc) const;
+	// Runs the group while its instructions can run on all of its lanes at once
+	// Returns true when it stopped on an instruction to run lane by lane
+	bool runGroup(uint16_t& pc);
+	// Runs a single instruction on every lane of the group, or the instructions up to the last one of a straight run
+	// of code that the lanes cannot run together
+	void stepGroup(uint16_t pc);
+	size_t scalarRunLength(uint16_t pc) const;
+	void executeRegisters(uint16_t opCode);
+	// Sets _skip for the lanes of the group that skip, returns the number of them
+	size_t compareSkip(uint16_t opCode);
+	// Return false and leave the lanes as they are when a stack is full or the lanes return to different addresses
+	bool callGroup(uint16_t& pc);
+	bool returnGroup(uint16_t& pc);
+	void runLane(size_t lane, size_t maxCycles);
+	// Copies the registers of a lane to and from a state, then to and from the CPU of the lane core
+	void storeLane(size_t lane, MachineState& state) const;
+	void loadLane(size_t lane, const MachineState& state);
+	void pushLane(size_t lane);
+	void pullLane(size_t lane);
+
+	// Other addresses a group stops at so the lanes waiting there can join it, a group passes the others
+	static const size_t MAX_JOIN_ADDRESSES = 8;
+	static const size_t MAX_SCALAR_RUN = 16;
+
+	size_t _cyclesPerFrame;
+	Quirks _quirks;
+	Platform::Type _platform;
+
+	size_t _laneCount;
+	// Lanes rounded up to a whole number of vectors, the lanes past the count are never in a group
+	size_t _stride;
+	// Not copied nor moved once created, the CPU of a core refers to it
+	std::deque<Chip8> _cores;
+	std::vector<Lane> _lanes;
+
+	// V0 of every lane, then V1 and so on
+	std::vector<uint8_t> _registers;
+	std::vector<uint16_t> _I;
+	std::vector<uint16_t> _pc;
+	std::vector<uint8_t> _delayTimer;
+	std::vector<uint8_t> _soundTimer;
+	std::vector<size_t> _cyclesLeft;
+	// 0xFF for the lanes of the group, the lanes which started the frame and the lanes skipping
+	std::vector<uint8_t> _mask;
+	std::vector<uint8_t> _frameMask;
+	std::vector<uint8_t> _skip;
+	size_t _groupSize;
+	// Cycles left to the lane of the group the closest to the end of its frame
+	size_t _groupCycles;
+	uint16_t _joinAddresses[Lockstep::MAX_JOIN_ADDRESSES];
+	size_t _joinAddressCount;
+	// Set when the other lanes are at more addresses than a group can stop at
+	bool _isDiverged;
+
+	// Memory of the first lane, the lanes share the instructions read outside of the bytes where any memory differs
+	std::vector<uint8_t> _code;
+	size_t _codeDirtyBegin;
+	size_t _codeDirtyEnd;
+	// Carries the registers to and from the scalar cores, only its CPU fields are used
+	MachineState _transfer;
+
+	uint64_t _vectorCycleCount;
+	uint64_t _scalarCycleCount;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Whole machine in a flat struct without pointers, so a copy by assignment or memcpy clones it
+// Sized for the 4KB platforms, COSMAC VIP and SUPER-CHIP, a 64KB XO-CHIP memory would make every clone 13 times larger
+// Chip8::step() runs frames on it, an agent branches a state as often as it needs with a single Chip8 per thread
+struct MachineState
+{
+	static const size_t MEMORY_SIZE = 4096;
+	static const size_t MAX_WIDTH = 128;
+	static const size_t MAX_HEIGHT = 64;
+	// Rows packed as in Framebuffer, 64 pixels per word with the leftmost pixel in the highest bit
+	static const size_t FRAMEBUFFER_WORDS = MachineState::MAX_WIDTH / 64 * MachineState::MAX_HEIGHT;
+	static const size_t REGISTER_COUNT = 16;
+	static const size_t STACK_SIZE = 16;
+	static const size_t KEY_COUNT = 16;
+
+	uint8_t memory[MachineState::MEMORY_SIZE];
+	uint64_t framebuffer[MachineState::FRAMEBUFFER_WORDS];
+	uint8_t width;
+	uint8_t height;
+	uint8_t registers[MachineState::REGISTER_COUNT];
+	uint8_t flagRegisters[MachineState::REGISTER_COUNT];
+	uint16_t I;
+	uint16_t pc;
+	uint16_t stack[MachineState::STACK_SIZE];
+	uint8_t stackSize;
+	uint8_t delayTimer;
+	uint8_t soundTimer;
+	// Input::KeyState of each key
+	uint8_t keys[MachineState::KEY_COUNT];
+	// 1 once the machine stopped on 00FD, an unknown opCode or a stack overflow, Chip8::step() no longer runs it
+	uint8_t halted;
+	// Padding made explicit and always zero, equal machines are equal byte for byte
+	uint8_t reserved[6];
+	uint64_t randomState;
+};
+
+static_assert(std::is_trivially_copyable<MachineState>::value, "MachineState must be cloned with memcpy");
+static_assert(std::has_unique_object_representations<MachineState>::value, "MachineState must be compared and hashed with memcmp");
@@ -1,17 +1,85 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <vector>
+
+class Debugger;
+struct MachineState;
+class StateReader;
+class StateWriter;
+class TraceRecorder;
 
 class Memory
 {
 public:
+	Memory();
+
+	// Size of the address space, a power of two, addresses wrap around past it
+	// Resizing clears the memory
+	void setSize(size_t size);
+	size_t size() const { return _data.size(); }
+	uint16_t addressMask() const { return _addressMask; }
+
 	uint8_t read8(uint16_t addr) const;
 	void write8(uint16_t addr, uint8_t value);
-	void copyBuffer(uint16_t addr, uint8_t* buffer, size_t size);
+	// Instruction fetch, never reported to the read watchpoints
+	uint16_t readOpCode(uint16_t addr) const { return (_data[addr & _addressMask] << 8) | _data[(addr + 1) & _addressMask]; }
+	void copyBuffer(uint16_t addr, const uint8_t* buffer, size_t size);
 	void clear();
 
-	static const uint16_t MEMORY_SIZE = 4096;
+	void saveState(StateWriter& writer) const;
+	// Loaded bytes are recorded as a code write
+	void loadState(StateReader& reader);
+	// The memory must be of MachineState::MEMORY_SIZE bytes, nothing is recorded as a code write
+	void saveState(MachineState& state) const;
+	void loadState(const MachineState& state);
+	// Copies only the bytes written since loadState(), to save a state back where it was loaded from
+	void saveWrites(MachineState& state) const;
+	// Range [begin, end) of the bytes written since loadState(), empty when begin >= end
+	void writeRange(size_t& begin, size_t& end) const { begin = _writeBegin; end = _writeEnd; }
+
+	// Bytes marked as code are pre-decoded by the CPU, any write on them is recorded
+	// so the CPU can invalidate what it decoded from there
+	void markCode(uint16_t addr, size_t size);
+	void clearCodeMarks();
+	bool hasCodeWrite() const { return _codeWriteBegin < _codeWriteEnd; }
+	// Returns the range [begin, end) of the code written since the last call
+	void takeCodeWrite(size_t& begin, size_t& end);
+
+	// Not owned, the watched bytes report their accesses to it, nullptr ignores them
+	void setDebugger(Debugger* debugger) { _debugger = debugger; }
+	// Watches share the marks of the code, so a write only tests one byte whether anything is watched or not
+	// Resizing the memory drops them
+	void addWatch(uint16_t addr, size_t size, bool isRead, bool isWrite);
+	void clearWatches();
+	// Not owned, every write is reported to it while attached, nullptr detaches it
+	void setTraceRecorder(TraceRecorder* traceRecorder);
+
+	static const size_t MEMORY_SIZE = 4096;
+	static const size_t MAX_MEMORY_SIZE = 0x10000;
 
 private:
-	uint8_t _data[MEMORY_SIZE];
+	enum Mark : uint8_t
+	{
+		Code = 1,
+		ReadWatch = 2,
+		WriteWatch = 4,
+		// Every byte while a trace is recorded, writes then take the path of the marked bytes
+		TraceWrite = 8
+	};
+
+	void recordWrite(size_t addr, size_t size);
+
+	std::vector<uint8_t> _data;
+	// Memory::Mark bits of every byte
+	std::vector<uint8_t> _marks;
+	Debugger* _debugger;
+	TraceRecorder* _traceRecorder;
+	uint16_t _addressMask;
+	size_t _codeWriteBegin;
+	size_t _codeWriteEnd;
+	// Every byte written since the last MachineState was loaded
+	size_t _writeBegin;
+	size_t _writeEnd;
 };
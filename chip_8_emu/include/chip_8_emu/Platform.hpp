@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Quirks.hpp"
+#include <cstddef>
+#include <string>
+
+// Machines the emulator can behave as, they differ by their instructions, memory size, screen and quirks
+// CosmacVip is the original 64x32 CHIP-8 with 4KB of memory
+// SuperChip adds a 128x64 mode, 16x16 sprites, scrolling and the persistent flag registers
+// XoChip extends SuperChip with 64KB of memory, two bitplanes, a 16 bits I load and an audio pattern
+struct Platform
+{
+	enum Type
+	{
+		CosmacVip,
+		SuperChip,
+		XoChip
+	};
+
+	static const char* name(Platform::Type type);
+	// Accepts the names returned by name(): vip, schip and xochip
+	static bool fromString(const std::string& text, Platform::Type& type);
+
+	// Quirks of the reference interpreter of the platform
+	static Quirks quirks(Platform::Type type);
+	static size_t memorySize(Platform::Type type);
+};
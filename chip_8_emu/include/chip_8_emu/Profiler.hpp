@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Memory.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Execution counters per instruction and per address, sprite draws, the time spent in each phase of Chip8::update()
+// and the latency from a key event to the present of the first frame run with it
+// The CPU only feeds it when it is attached to the emulator, and the hooks are compiled out without CHIP8_ENABLE_PROFILER
+class Profiler
+{
+public:
+	enum Phase
+	{
+		Cpu,
+		Render,
+		Sleep,
+		PhaseCount
+	};
+
+	Profiler();
+
+	void reset();
+
+	// Hot path, called for every instruction executed
+	void countInstruction(uint16_t pc, uint8_t instruction)
+	{
+		_pcCounts[pc]++;
+		_instructionCounts[instruction]++;
+	}
+	void countDraw(uint32_t pixels)
+	{
+		_drawCalls++;
+		_drawPixels += pixels;
+	}
+	void countFrame() { _frames++; }
+	// Cycles of a busy wait accounted without being executed
+	void countIdleCycles(uint64_t cycles) { _idleCycles += cycles; }
+	// Render is timed on another thread than the emulation, the phase times can be added from any thread
+	void addPhaseTime(Profiler::Phase phase, std::chrono::steady_clock::duration duration);
+	// Called by the thread presenting the frames
+	void addInputLatency(std::chrono::steady_clock::duration latency);
+
+	void setInstructionName(uint8_t instruction, const std::string& name);
+
+	uint64_t instructionCount() const;
+	uint64_t pcCount(uint16_t pc) const { return _pcCounts[pc]; }
+
+	void writeJson(std::ostream& stream) const;
+	void writeCsv(std::ostream& stream) const;
+	// Format is chosen from the extension, .csv or JSON otherwise
+	bool writeReport(const std::string& path) const;
+
+	// SIGUSR1 requests a report where the signal is available, the emulation polls the request once per frame
+	static void installSignalHandler();
+	static bool takeReportRequest();
+
+	static const size_t MAX_INSTRUCTIONS = 256;
+	static const size_t HOTSPOT_COUNT = 32;
+
+private:
+	// Indexed by any 16 bits address, so the largest memory fits
+	std::vector<uint64_t> _pcCounts;
+	uint64_t _instructionCounts[Profiler::MAX_INSTRUCTIONS];
+	std::string _instructionNames[Profiler::MAX_INSTRUCTIONS];
+	uint64_t _drawCalls;
+	uint64_t _drawPixels;
+	uint64_t _frames;
+	uint64_t _idleCycles;
+	std::atomic<int64_t> _phaseNanoseconds[Profiler::PhaseCount];
+	std::atomic<uint64_t> _inputLatencyCount;
+	std::atomic<int64_t> _inputLatencyNanoseconds;
+	std::atomic<int64_t> _maxInputLatencyNanoseconds;
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Quirks.hpp"
+
+// Quirks seen by the CPU handlers, templated on one of these policies
+// The fixed profiles answer with constants so the compiler removes the branches, the runtime one reads the quirks
+template <bool SaveLoadIncrement, bool VfReset, bool Clipping, bool Shifting>
+struct StaticQuirkPolicy
+{
+	static bool saveLoadIncrement(const Quirks&) { return SaveLoadIncrement; }
+	static bool vfReset(const Quirks&) { return VfReset; }
+	static bool clipping(const Quirks&) { return Clipping; }
+	static bool shifting(const Quirks&) { return Shifting; }
+
+	static bool matches(const Quirks& quirks)
+	{
+		return quirks.saveLoadIncrement == SaveLoadIncrement && quirks.vfReset == VfReset && quirks.clipping == Clipping && quirks.shifting == Shifting;
+	}
+};
+
+typedef StaticQuirkPolicy<true, true, true, true> VipQuirkPolicy;
+typedef StaticQuirkPolicy<false, false, true, false> SchipQuirkPolicy;
+typedef StaticQuirkPolicy<true, false, false, true> XoChipQuirkPolicy;
+
+struct RuntimeQuirkPolicy
+{
+	static bool saveLoadIncrement(const Quirks& quirks) { return quirks.saveLoadIncrement; }
+	static bool vfReset(const Quirks& quirks) { return quirks.vfReset; }
+	static bool clipping(const Quirks& quirks) { return quirks.clipping; }
+	static bool shifting(const Quirks& quirks) { return quirks.shifting; }
+};
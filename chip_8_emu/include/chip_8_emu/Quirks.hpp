@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Behaviours that differ between the CHIP-8 interpreters, some games depend on them to run properly
+struct Quirks
+{
+	bool saveLoadIncrement; // FX55 and FX65 increment I
+	bool vfReset;           // 8XY1, 8XY2 and 8XY3 reset VF
+	bool clipping;          // Sprites are clipped at the edges of the screen instead of wrapped
+	bool shifting;          // 8XY6 and 8XYE shift VY into VX instead of VX in place
+	bool displayWait;       // Only one sprite is drawn per frame
+
+	// Short form used by the tools, one letter per quirk in the order L V C S D, '-' when disabled
+	// For example "LVCSD" enables everything and "-V-S-" only vfReset and shifting
+	std::string toString() const;
+	static bool fromString(const std::string& text, Quirks& quirks);
+
+	// Bit i of the mask enables the ith quirk of the short form, to enumerate every combination
+	static Quirks fromMask(uint8_t mask);
+	uint8_t toMask() const;
+
+	static const uint8_t QUIRK_COUNT = 5;
+};
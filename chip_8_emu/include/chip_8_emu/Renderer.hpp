@@ -0,0 +1,14 @@
+#pragma once
+
+class Framebuffer;
+
+// Front-end that owns the window: presents frames and reports when the user closes it
+class Renderer
+{
+public:
+	virtual ~Renderer() {}
+
+	virtual bool isOpen() const = 0;
+	virtual void pollEvent() = 0;
+	virtual void present(const Framebuffer& framebuffer) = 0;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Ring buffer of the last saved states, one per frame
+// A full state is kept every keyframeInterval frames, the others are stored as a run length encoding
+// of their xor with that keyframe since only a few bytes change from frame to frame
+class Rewind
+{
+public:
+	Rewind(size_t capacity, size_t keyframeInterval);
+
+	void clear();
+	void capture(const std::vector<uint8_t>& state);
+	// Removes the most recent state and writes it in state, returns false if there is none left
+	bool rewind(std::vector<uint8_t>& state);
+
+	size_t size() const { return _count; }
+	size_t capacity() const { return _slots.size(); }
+	// Bytes used by the stored states
+	size_t memoryUsage() const;
+
+private:
+	struct Snapshot
+	{
+		bool isKeyframe;
+		size_t keyframe;       // Slot of the keyframe a delta is based on
+		std::vector<uint8_t> data;
+	};
+
+	size_t slotAt(size_t age) const;
+	void dropOldest();
+	static void encodeDelta(const std::vector<uint8_t>& state, const std::vector<uint8_t>& keyframe, std::vector<uint8_t>& delta);
+	static bool decodeDelta(const std::vector<uint8_t>& delta, const std::vector<uint8_t>& keyframe, std::vector<uint8_t>& state);
+
+	std::vector<Rewind::Snapshot> _slots;
+	size_t _keyframeInterval;
+	size_t _head;              // Slot of the next capture
+	size_t _count;
+	size_t _keyframe;          // Slot of the keyframe used by the next delta
+	size_t _framesSinceKeyframe;
+	bool _hasKeyframe;
+};
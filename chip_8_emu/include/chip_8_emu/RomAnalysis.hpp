@@ -0,0 +1,120 @@
+#pragma once
+
+#include "Platform.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class Memory;
+
+// Static analysis of a rom before it runs: follows every path from the start address to tell code from data,
+// recovers the control-flow graph and finds the stores that may write the code
+// Keys, timers and random numbers are unknown, both sides of every skip are taken, and returns go back after
+// every call. BNNN depends on V0 and is only reported as an indirect jump
+class RomAnalysis
+{
+public:
+	// Straight run of instructions entered at its first one, the successors of its last one follow it
+	struct Block
+	{
+		uint16_t begin;
+		uint32_t end;
+		std::vector<uint16_t> successors;
+	};
+
+	// Store whose bytes may land on the code, [begin, end) is the whole range it may write
+	struct CodeStore
+	{
+		uint16_t address;
+		uint32_t begin;
+		uint32_t end;
+	};
+
+	RomAnalysis();
+
+	// Analyses the memory of an initialized emulator, with the font and the rom of romSize bytes loaded
+	void analyze(const Memory& memory, size_t romSize, Platform::Type platform);
+
+	Platform::Type platform() const { return _platform; }
+	size_t romSize() const { return _romSize; }
+	// True when the memory is the one analyzed, byte for byte
+	bool matches(const Memory& memory) const;
+
+	bool isCode(uint16_t addr) const { return _byteKinds[addr & _addressMask] != RomAnalysis::ByteKind::Data; }
+	bool isInstruction(uint16_t addr) const { return _byteKinds[addr & _addressMask] == RomAnalysis::ByteKind::Instruction; }
+	// Without indirect jump nor store into the code, the code found is all the code that can run and it never changes
+	bool isComplete() const { return _indirectJumps.empty() && _codeStores.empty(); }
+	// Store proven to write data only, always false unless the analysis is complete
+	bool isDataStore(uint16_t addr) const;
+
+	const std::vector<RomAnalysis::Block>& blocks() const { return _blocks; }
+	const std::vector<uint16_t>& indirectJumps() const { return _indirectJumps; }
+	const std::vector<RomAnalysis::CodeStore>& codeStores() const { return _codeStores; }
+	size_t instructionCount() const;
+
+	// Listing of the rom with one line per instruction, data bytes grouped by 8 and a header before every block
+	void writeListing(std::ostream& stream) const;
+	void writeJson(std::ostream& stream) const;
+
+	// Mnemonic of an instruction, false for the opCodes the platform does not know
+	static bool disassemble(uint16_t opCode, Platform::Type platform, std::string& text);
+
+private:
+	enum ByteKind : uint8_t
+	{
+		Data,
+		Instruction,
+		// Inside an instruction, or the address following F000
+		Operand
+	};
+
+	// Values of a register or of I on every path reaching an instruction
+	struct Value
+	{
+		bool isKnown;
+		uint8_t value;
+	};
+
+	struct State
+	{
+		bool isReached;
+		// Set when the stack may be empty, a return then falls through to the next instruction
+		bool isStackEmpty;
+		// I is in [iBegin, iEnd]
+		uint32_t iBegin;
+		uint32_t iEnd;
+		RomAnalysis::Value registers[16];
+	};
+
+	static bool isValid(uint16_t opCode, Platform::Type platform);
+	uint16_t readOpCode(uint16_t addr) const;
+	uint8_t instructionSize(uint16_t addr) const;
+	std::string instructionText(uint16_t addr) const;
+	// Joins a state into the one of addr, returns true if it changed
+	bool merge(uint16_t addr, const RomAnalysis::State& state);
+	void execute(uint16_t addr, RomAnalysis::State& state) const;
+	void successors(uint16_t addr, std::vector<uint16_t>& targets) const;
+	// Range written by a store, empty for the other instructions
+	bool storeRange(uint16_t addr, uint32_t& begin, uint32_t& end) const;
+	void buildBlocks();
+	void findCodeStores();
+
+	static const uint16_t FULL_RANGE = 0xFFFF;
+	// Updates of the state of an instruction before its registers and I are widened to any value, so loops end
+	static const size_t MAX_UPDATES = 32;
+
+	Platform::Type _platform;
+	size_t _romSize;
+	uint16_t _addressMask;
+	std::vector<uint8_t> _memory;
+	std::vector<uint8_t> _byteKinds;
+	std::vector<RomAnalysis::State> _states;
+	std::vector<uint16_t> _updates;
+	std::vector<uint16_t> _returns;
+	std::vector<uint16_t> _calls;
+	std::vector<RomAnalysis::Block> _blocks;
+	std::vector<uint16_t> _indirectJumps;
+	std::vector<RomAnalysis::CodeStore> _codeStores;
+};
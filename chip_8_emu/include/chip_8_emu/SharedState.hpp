@@ -0,0 +1,243 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Shared memory segment where the emulator publishes the screen, the registers and the timers at the end of every frame,
+// for the overlays, analyzers and agents running in other processes
+// Header only, a reader includes this file alone: SharedStateReader maps the segment and reads the frames in place
+//
+// Each of the two frame slots is a seqlock. The producer fills the slot not published last, its sequence being odd
+// meanwhile, then publishes its index; a reader reads the published slot in place and checks its sequence did not
+// change, which only happens when the read takes longer than a frame. Neither side copies a frame or makes a system call
+struct SharedState
+{
+	static const uint32_t MAGIC = 0x53533843; // "C8SS"
+	static const uint32_t VERSION = 1;
+	static const size_t REGISTER_COUNT = 16;
+	static const size_t STACK_SIZE = 16;
+	// 128x64 pixels on 2 planes, 64 pixels per word
+	static const size_t MAX_WORDS = 128 / 64 * 64 * 2;
+
+	struct alignas(64) Frame
+	{
+		// Odd while the producer fills the slot
+		std::atomic<uint32_t> sequence;
+		uint8_t width;
+		uint8_t height;
+		uint8_t planeCount;
+		uint8_t stackSize;
+		// Starts at 1
+		uint64_t frame;
+		// Nanoseconds of std::chrono::steady_clock when published, a clock shared by the processes of a host
+		uint64_t time;
+		uint8_t registers[SharedState::REGISTER_COUNT];
+		uint16_t I;
+		uint16_t pc;
+		uint16_t stack[SharedState::STACK_SIZE];
+		uint8_t delayTimer;
+		uint8_t soundTimer;
+		// Rows as in Framebuffer, 64 pixels per word with the leftmost pixel in the highest bit, plane after plane
+		uint64_t rows[SharedState::MAX_WORDS];
+
+		size_t wordsPerRow() const { return (width + 63) / 64; }
+		bool isPixelOn(uint8_t x, uint8_t y, uint8_t plane = 0) const
+		{
+			return ((rows[(plane * height + y) * wordsPerRow() + x / 64] >> (63 - x % 64)) & 1) != 0;
+		}
+	};
+
+	uint32_t magic;
+	uint32_t version;
+	// Slot of the last frame published
+	std::atomic<uint32_t> latest;
+	// Set once the producer is gone
+	std::atomic<uint32_t> isClosed;
+	// Frames published, readers wait for it to change
+	std::atomic<uint64_t> frameCount;
+	// Last frame a reader acknowledged, for the producer to measure the round trip
+	std::atomic<uint64_t> acknowledgedFrame;
+	SharedState::Frame frames[2];
+
+	// The producer creates the segment, replacing any left by a producer that crashed, readers open it
+	// The handle is needed by unmap(), nullptr on failure
+	static SharedState* map(const std::string& name, bool isCreated, intptr_t& handle)
+	{
+		handle = 0;
+#ifdef _WIN32
+		std::string path = "Local\\" + name;
+		HANDLE mapping = isCreated
+			? CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, static_cast<DWORD>(sizeof(SharedState)), path.c_str())
+			: OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, path.c_str());
+		if (mapping == nullptr)
+		{
+			return nullptr;
+		}
+		void* data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(SharedState));
+		if (data == nullptr)
+		{
+			CloseHandle(mapping);
+			return nullptr;
+		}
+		handle = reinterpret_cast<intptr_t>(mapping);
+#else
+		std::string path = "/" + name;
+		if (isCreated)
+		{
+			shm_unlink(path.c_str());
+		}
+		int file = shm_open(path.c_str(), isCreated ? O_CREAT | O_EXCL | O_RDWR : O_RDWR, 0600);
+		if (file < 0)
+		{
+			return nullptr;
+		}
+		struct stat status;
+		bool isSized = isCreated ? ftruncate(file, sizeof(SharedState)) == 0
+			: fstat(file, &status) == 0 && static_cast<size_t>(status.st_size) >= sizeof(SharedState);
+		void* data = isSized ? mmap(nullptr, sizeof(SharedState), PROT_READ | PROT_WRITE, MAP_SHARED, file, 0) : MAP_FAILED;
+		close(file);
+		if (data == MAP_FAILED)
+		{
+			if (isCreated)
+			{
+				shm_unlink(path.c_str());
+			}
+			return nullptr;
+		}
+#endif
+		return static_cast<SharedState*>(data);
+	}
+
+	// The producer removes the name, readers already mapped keep the segment until they unmap it
+	static void unmap(SharedState* state, intptr_t handle, const std::string& name, bool isRemoved)
+	{
+#ifdef _WIN32
+		(void)name;
+		(void)isRemoved;
+		UnmapViewOfFile(state);
+		CloseHandle(reinterpret_cast<HANDLE>(handle));
+#else
+		(void)handle;
+		munmap(state, sizeof(SharedState));
+		if (isRemoved)
+		{
+			shm_unlink(("/" + name).c_str());
+		}
+#endif
+	}
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+	"Atomics in shared memory must not rely on a lock local to the process");
+
+// Reader side, in any number of processes
+class SharedStateReader
+{
+public:
+	SharedStateReader() :
+		_state(nullptr),
+		_handle(0)
+	{ }
+
+	~SharedStateReader()
+	{
+		close();
+	}
+
+	// False until the producer created the segment
+	bool open(const std::string& name)
+	{
+		close();
+		_state = SharedState::map(name, false, _handle);
+		if (_state != nullptr && (_state->magic != SharedState::MAGIC || _state->version != SharedState::VERSION))
+		{
+			close();
+		}
+		_name = name;
+		return _state != nullptr;
+	}
+
+	void close()
+	{
+		if (_state != nullptr)
+		{
+			SharedState::unmap(_state, _handle, _name, false);
+			_state = nullptr;
+		}
+	}
+
+	bool isOpen() const { return _state != nullptr; }
+	bool isProducerClosed() const { return _state->isClosed.load(std::memory_order_acquire) != 0; }
+	uint64_t frameCount() const { return _state->frameCount.load(std::memory_order_acquire); }
+
+	// Calls visit(const SharedState::Frame&) on the last frame in place, again if the producer overwrote it meanwhile:
+	// visit must only read the frame and forget what a call that is run again found. False before the first frame
+	template <typename Visitor>
+	bool read(Visitor visit) const
+	{
+		while (frameCount() > 0)
+		{
+			const SharedState::Frame& frame = _state->frames[_state->latest.load(std::memory_order_acquire) & 1];
+			uint32_t sequence = frame.sequence.load(std::memory_order_acquire);
+			if ((sequence & 1) != 0)
+			{
+				continue;
+			}
+			visit(frame);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (frame.sequence.load(std::memory_order_relaxed) == sequence)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Spins until more than count frames were published, yielding after a while so a host with less cores than
+	// spinning threads still runs the producer. False on timeout or once the producer is gone
+	bool waitFrame(uint64_t count, std::chrono::nanoseconds timeout) const
+	{
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+		for (uint32_t spin = 0; frameCount() <= count; spin++)
+		{
+			if (isProducerClosed() || ((spin & 0xFF) == 0 && std::chrono::steady_clock::now() >= deadline))
+			{
+				return false;
+			}
+			if (spin >= SharedStateReader::SPIN_COUNT)
+			{
+				std::this_thread::yield();
+			}
+		}
+		return true;
+	}
+
+	void acknowledge(uint64_t frame) { _state->acknowledgedFrame.store(frame, std::memory_order_release); }
+
+	// About a microsecond of spinning, shorter than a round trip through the scheduler
+	static const uint32_t SPIN_COUNT = 1024;
+
+private:
+	SharedState* _state;
+	intptr_t _handle;
+	std::string _name;
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "MachineState.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class CPU;
+class Framebuffer;
+struct SharedState;
+
+// Producer of the shared memory segment described in SharedState.hpp
+// publish() writes the frame straight into the segment, about 2KB in a hi-res two plane frame
+class SharedStateWriter
+{
+public:
+	SharedStateWriter();
+	~SharedStateWriter();
+
+	// Creates the segment, named /name under POSIX and Local\name under Windows
+	bool open(const std::string& name);
+	// Tells the readers the producer is gone and removes the name
+	void close();
+	bool isOpen() const { return _state != nullptr; }
+
+	// Hook of the emulator, once per emulated frame
+	void publish(const Framebuffer& framebuffer, const CPU& cpu);
+
+	uint64_t frameCount() const { return _frameCount; }
+	// Last frame a reader acknowledged, for the round trip benchmark
+	uint64_t acknowledgedFrame() const;
+
+private:
+	SharedState* _state;
+	intptr_t _handle;
+	std::string _name;
+	uint64_t _frameCount;
+	// Carries the registers out of the CPU, only its CPU fields are used
+	MachineState _registers;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// TCP sockets over the BSD sockets API or Winsock, for the servers and their clients
+// Handles are intptr_t so the system headers stay out of the other headers
+struct Socket
+{
+	struct PollEntry
+	{
+		intptr_t socket;
+		bool isWriteWanted;
+		// Set by poll()
+		bool isReadable;
+		bool isWritable;
+	};
+
+	// Starts Winsock, does nothing elsewhere
+	static bool startup();
+	// Only on localhost, none of the protocols served has authentication
+	static intptr_t listen(uint16_t port, int backlog);
+	static intptr_t connect(uint16_t port);
+	static intptr_t accept(intptr_t listener);
+	static void close(intptr_t socket);
+
+	// Small messages go out at once instead of waiting to be merged
+	static void setNoDelay(intptr_t socket);
+	static void setNonBlocking(intptr_t socket);
+
+	// Returns the bytes sent or received, 0 when a non-blocking socket would block
+	// and -1 when the connection is closed or broken
+	static int send(intptr_t socket, const void* data, size_t size);
+	static int receive(intptr_t socket, void* data, size_t size);
+	// Waits at most timeout milliseconds for data to read
+	static bool hasInput(intptr_t socket, int timeout);
+	// Waits at most timeout milliseconds for one of the sockets to be ready, returns how many are
+	static int poll(std::vector<Socket::PollEntry>& entries, int timeout);
+
+	static const intptr_t NO_SOCKET = -1;
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "Framebuffer.hpp"
+#include "TripleBuffer.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Streams the emulated screen to any number of viewers on localhost, over raw TCP or WebSocket for browsers
+// publish() only hands the frame to the network thread through a TripleBuffer, so the emulation never waits on a viewer:
+// the network thread polls every socket without blocking, sends the rows that changed since the previous frame and a
+// keyframe holding every row periodically, to the viewers joining and to the ones whose backlog got too large
+//
+// A raw viewer sends "C8SP" then reads messages preceded by their size on 32 bits, a WebSocket viewer sends the HTTP
+// upgrade request then reads each message as a binary message. All numbers are little endian, a message is:
+// type (1 keyframe, 2 delta), frame on 32 bits, width, height, plane count, row count, then per row its plane, its y
+// and its width / 8 bytes, leftmost pixel in the high bit, compressed with PackBits
+class SpectatorServer
+{
+public:
+	SpectatorServer();
+	~SpectatorServer();
+
+	// Starts the network thread on localhost:port
+	bool listen(uint16_t port);
+	// Sends the last frame published to every viewer then disconnects them
+	void close();
+	bool isListening() const { return _network.joinable(); }
+
+	// Hook of the emulator, once per emulated frame
+	void publish(const Framebuffer& framebuffer);
+
+	size_t viewerCount() const { return _viewerCount.load(std::memory_order_relaxed); }
+
+	// Statistics of the network thread, read once closed
+	size_t maxViewerCount() const { return _maxViewerCount; }
+	uint64_t broadcastCount() const { return _broadcastCount; }
+	uint64_t keyframeCount() const { return _keyframeCount; }
+	uint64_t deltaCount() const { return _deltaCount; }
+	uint64_t byteCount() const { return _byteCount; }
+	// Frames a viewer missed because too much was still waiting to be sent to it
+	uint64_t skippedFrameCount() const { return _skippedFrameCount; }
+	// Time of the network thread outside of poll()
+	double busySeconds() const { return std::chrono::duration<double>(_busyTime).count(); }
+
+	static const uint8_t MAGIC[4];
+	static const uint8_t KEYFRAME = 1;
+	static const uint8_t DELTA = 2;
+	// Larger than any keyframe, for the clients to reject anything else
+	static const size_t MAX_MESSAGE_SIZE = 64 * 1024;
+
+private:
+	enum Protocol : uint8_t
+	{
+		Handshake,
+		Raw,
+		WebSocket
+	};
+
+	struct Viewer
+	{
+		intptr_t socket;
+		Protocol protocol;
+		// Request received until the protocol is known, then the frames of a WebSocket viewer not read yet
+		std::string request;
+		std::vector<uint8_t> output;
+		size_t sentSize;
+		bool needsKeyframe;
+	};
+
+	struct Frame
+	{
+		Framebuffer framebuffer;
+		uint32_t index;
+	};
+
+	void runNetwork();
+	void acceptViewers();
+	// Returns false once the viewer is gone
+	bool readViewer(SpectatorServer::Viewer& viewer);
+	bool handshake(SpectatorServer::Viewer& viewer);
+	// Returns false on a close frame, whose answer is queued, or on a frame too large for a viewer
+	bool readWebSocket(SpectatorServer::Viewer& viewer);
+	bool flushViewer(SpectatorServer::Viewer& viewer);
+	// Sends the frame as a delta, or a keyframe to the viewers that need one, isForced ignores MAX_BACKLOG
+	void broadcast(const SpectatorServer::Frame& frame, bool isForced);
+	void sendKeyframe(SpectatorServer::Viewer& viewer);
+	void appendMessage(SpectatorServer::Viewer& viewer, const std::vector<uint8_t>& message);
+	void beginMessage(std::vector<uint8_t>& message, uint8_t type, const Framebuffer& framebuffer, uint32_t index) const;
+	void appendRow(std::vector<uint8_t>& message, const Framebuffer& framebuffer, uint8_t y, uint8_t plane) const;
+
+	static const size_t ROW_COUNT_OFFSET = 8;
+	// Viewers only send control frames, whose payload is at most 125 bytes
+	static const size_t MAX_CLIENT_FRAME_SIZE = 1024;
+	// Bytes waiting for a viewer above which it misses frames, then gets a keyframe once it caught up
+	static const size_t MAX_BACKLOG = 64 * 1024;
+	// 2 seconds, the longest a viewer that lost track waits for a full screen
+	static const uint32_t KEYFRAME_INTERVAL = 120;
+	// Milliseconds, a published frame waits at most this long for the network thread
+	static const int POLL_TIMEOUT = 2;
+	// Milliseconds given to the viewers to receive the last frame on close()
+	static const int CLOSE_TIMEOUT = 1000;
+
+	std::thread _network;
+	std::atomic<bool> _isClosing;
+	std::atomic<size_t> _viewerCount;
+
+	// Emulation side
+	TripleBuffer<SpectatorServer::Frame> _frames;
+	uint32_t _frameIndex;
+
+	// Network side
+	intptr_t _listener;
+	std::vector<SpectatorServer::Viewer> _viewers;
+	Framebuffer _sentFrame;
+	uint32_t _sentFrameIndex;
+	uint32_t _keyframeIndex;
+	bool _hasSentFrame;
+	std::vector<uint8_t> _delta;
+	std::vector<uint8_t> _keyframe;
+	bool _isKeyframeEncoded;
+	size_t _maxViewerCount;
+	uint64_t _broadcastCount;
+	uint64_t _keyframeCount;
+	uint64_t _deltaCount;
+	uint64_t _byteCount;
+	uint64_t _skippedFrameCount;
+	std::chrono::steady_clock::duration _busyTime;
+};
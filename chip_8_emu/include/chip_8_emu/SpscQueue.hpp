@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Lock-free bounded queue between one producer and one consumer thread
+// Capacity must be a power of two
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+	static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+	SpscQueue() :
+		_head(0),
+		_tail(0)
+	{ }
+
+	// Producer side, returns false when the queue is full
+	bool push(const T& value)
+	{
+		size_t tail = _tail.load(std::memory_order_relaxed);
+		if (tail - _head.load(std::memory_order_acquire) == Capacity)
+		{
+			return false;
+		}
+		_values[tail & (Capacity - 1)] = value;
+		_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side, returns false when the queue is empty
+	bool pop(T& value)
+	{
+		size_t head = _head.load(std::memory_order_relaxed);
+		if (head == _tail.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+		value = _values[head & (Capacity - 1)];
+		_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	T _values[Capacity];
+	// Kept on separate cache lines so both threads don't invalidate each other
+	alignas(64) std::atomic<size_t> _head;
+	alignas(64) std::atomic<size_t> _tail;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Little endian serialization of the machine state, appended to a byte buffer
+class StateWriter
+{
+public:
+	StateWriter(std::vector<uint8_t>& buffer);
+
+	void write8(uint8_t value);
+	void write16(uint16_t value);
+	void write32(uint32_t value);
+	void write64(uint64_t value);
+	void writeBytes(const void* data, size_t size);
+
+private:
+	std::vector<uint8_t>& _buffer;
+};
+
+// Reads what StateWriter wrote, reading past the end returns zeros and marks the reader as invalid
+class StateReader
+{
+public:
+	StateReader(const uint8_t* data, size_t size);
+
+	uint8_t read8();
+	uint16_t read16();
+	uint32_t read32();
+	uint64_t read64();
+	void readBytes(void* data, size_t size);
+
+	bool isValid() const { return _isValid; }
+	size_t remaining() const { return _size - _offset; }
+
+private:
+	const uint8_t* _data;
+	size_t _size;
+	size_t _offset;
+	bool _isValid;
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "AudioSink.hpp"
+#include <cstddef>
+#include <cstdint>
+
+// Renders the buzzer as signed 16 bits mono samples
+// The phase is kept between calls so consecutive buffers join without a click, and the volume
+// fades in and out over a few milliseconds when the buzzer starts or stops
+class ToneGenerator
+{
+public:
+	ToneGenerator(unsigned int sampleRate, double volume);
+
+	void render(const SoundState& state, int16_t* samples, size_t count);
+
+	unsigned int sampleRate() const { return _sampleRate; }
+
+	// Bits of the pattern played per second at this pitch
+	static double bitRate(uint8_t pitch);
+
+private:
+	unsigned int _sampleRate;
+	double _amplitude;
+	double _fadeStep;
+	// Position in the pattern, in bits
+	double _phase;
+	double _gain;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "CPU.hpp"
+#include "Platform.hpp"
+#include "Quirks.hpp"
+#include "TraceRecorder.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Reads a trace written by TraceRecorder one instruction at a time, through a buffer of a fixed size
+// so a trace of any length is streamed in constant memory
+class TraceReader
+{
+public:
+	// Instruction of the trace, with the registers and I after it ran
+	struct Record
+	{
+		uint64_t index;
+		// Frames started before this instruction, the first frame of the trace is frame 0
+		uint32_t frame;
+		bool isFrameStart;
+		uint16_t pc;
+		uint16_t opCode;
+		uint16_t I;
+		uint8_t registers[CPU::MAX_REGISTER];
+		// Bit i set when the instruction changed Vi
+		uint16_t changedRegisters;
+		bool isIndexChanged;
+		std::vector<TraceRecorder::Write> writes;
+	};
+
+	TraceReader();
+
+	bool open(const std::string& path);
+	// Reads the next instruction into record(), false at the end of the trace
+	// A trace ending in the middle of a record, as when the recording was interrupted, is truncated
+	bool next();
+	bool isTruncated() const { return _isTruncated; }
+	const TraceReader::Record& record() const { return _record; }
+
+	Platform::Type platform() const { return _platform; }
+	const Quirks& quirks() const { return _quirks; }
+
+private:
+	bool readByte(uint8_t& value);
+	bool readVarint(uint32_t& value);
+	static int16_t unzigzag(uint32_t value) { return static_cast<int16_t>((value >> 1) ^ (~(value & 1) + 1)); }
+
+	static const size_t BUFFER_SIZE = 0x100000;
+
+	std::ifstream _file;
+	std::vector<uint8_t> _buffer;
+	size_t _bufferBegin;
+	size_t _bufferEnd;
+	bool _isTruncated;
+	bool _hasFrame;
+	uint16_t _writeAddr;
+	uint64_t _recordCount;
+	TraceReader::Record _record;
+	Platform::Type _platform;
+	Quirks _quirks;
+};
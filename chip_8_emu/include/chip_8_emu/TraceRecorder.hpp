@@ -0,0 +1,113 @@
+#pragma once
+
+#include "CPU.hpp"
+#include "Platform.hpp"
+#include "Quirks.hpp"
+#include "SpscQueue.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Trace of every instruction executed: its address and opCode, the registers and I it changed and the bytes it wrote
+// Attached with Chip8::setTraceRecorder(), the CPU runs one instruction at a time and the recorder packs each of them
+// into a chunk of a ring, which a background thread writes to the file. The emulation only waits for the writer
+// when the whole ring is full, a trace is never missing a record
+//
+// The file starts with the magic, version, platform and quirks, then a record per instruction:
+//   flags            TraceRecorder::Flag bits of the fields that follow
+//   opCode           2 bytes, big endian as in memory
+//   pc               if PcJump: zigzag varint of pc - (previous pc + 2), the first record follows 0x200
+//   I                if IndexChange: zigzag varint of I - previous I
+//   registers        if RegisterChange: varint mask of the registers changed, then their new values in order
+//   writes           if MemoryWrite: varint count, then for each the zigzag varint of addr - (previous addr + 1) and the value
+// Every delta is computed on 16 bits and every value starts at 0, so a trace can start anywhere in a run
+class TraceRecorder
+{
+public:
+	enum Flag : uint8_t
+	{
+		PcJump = 1,
+		IndexChange = 2,
+		RegisterChange = 4,
+		MemoryWrite = 8,
+		// First instruction of a frame
+		FrameStart = 16
+	};
+
+	struct Write
+	{
+		uint16_t addr;
+		uint8_t value;
+	};
+
+	TraceRecorder();
+	~TraceRecorder();
+
+	// Starts the writer thread on a new file
+	bool open(const std::string& path, Platform::Type platform, const Quirks& quirks);
+	// Writes what is left in the ring and stops the writer thread, false if a write failed
+	bool close();
+	bool isOpen() const { return _writer.joinable(); }
+
+	// Hooks of the emulator, the writes go to the instruction recorded next
+	void beginFrame() { _isFrameStart = true; }
+	void recordWrite(uint16_t addr, uint8_t value);
+	void recordInstruction(uint16_t pc, uint16_t opCode, const uint8_t* registers, uint16_t I);
+
+	uint64_t instructionCount() const { return _instructionCount; }
+	uint64_t byteCount() const { return _byteCount; }
+	// Times the emulation waited for the writer to free a chunk
+	uint64_t stallCount() const { return _stallCount; }
+
+	static const uint16_t VERSION = 1;
+	static const uint8_t MAGIC[4];
+
+private:
+	// Chunk of the ring handed to the writer
+	struct Chunk
+	{
+		uint32_t index;
+		uint32_t size;
+	};
+
+	// Copies into the current chunk, handing it to the writer when full
+	void append(const uint8_t* data, size_t size);
+	void submitChunk();
+	void runWriter();
+
+	static size_t writeVarint(uint8_t* buffer, uint32_t value);
+	static uint32_t zigzag(int16_t value) { return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 15); }
+
+	static const size_t CHUNK_SIZE = 0x10000;
+	// 4MB between the emulation and the disk
+	static const size_t CHUNK_COUNT = 64;
+	// Flags, opCode, pc, I, mask and the 16 registers of one record, with room for a few writes
+	static const size_t MAX_RECORD_SIZE = 64;
+
+	std::ofstream _file;
+	std::vector<uint8_t> _chunks;
+	// Chunks filled by the emulation and indexes of the ones the writer is done with
+	SpscQueue<TraceRecorder::Chunk, TraceRecorder::CHUNK_COUNT> _filledChunks;
+	SpscQueue<uint32_t, TraceRecorder::CHUNK_COUNT> _freeChunks;
+	uint32_t _chunk;
+	size_t _chunkSize;
+	std::thread _writer;
+	std::atomic<bool> _isClosing;
+	std::atomic<bool> _hasWriteError;
+
+	// State of the previous record, the next one is encoded against it
+	uint16_t _pc;
+	uint16_t _I;
+	uint8_t _registers[CPU::MAX_REGISTER];
+	uint16_t _writeAddr;
+	bool _isFrameStart;
+	std::vector<TraceRecorder::Write> _writes;
+
+	uint64_t _instructionCount;
+	uint64_t _byteCount;
+	uint64_t _stallCount;
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free hand-off of the latest value between one writer and one reader thread
+// The writer fills back() and publishes it, the reader acquires the most recent published value in front()
+// Neither side ever waits, a value published twice before being acquired replaces the previous one
+template <typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer(const T& value) :
+		_buffers{ value, value, value },
+		_back(0),
+		_middle(1),
+		_front(2)
+	{ }
+
+	T& back() { return _buffers[_back]; }
+	const T& front() const { return _buffers[_front]; }
+
+	// Returns false if the previously published value was never acquired and got dropped
+	bool publish()
+	{
+		uint8_t previous = _middle.exchange(_back | TripleBuffer::FRESH_BIT, std::memory_order_acq_rel);
+		_back = previous & TripleBuffer::INDEX_MASK;
+		return (previous & TripleBuffer::FRESH_BIT) == 0;
+	}
+
+	// Returns false if nothing was published since the last call, front() is unchanged then
+	bool acquire()
+	{
+		// Only the reader clears the fresh bit, once seen it stays set until the exchange
+		if ((_middle.load(std::memory_order_relaxed) & TripleBuffer::FRESH_BIT) == 0)
+		{
+			return false;
+		}
+		uint8_t previous = _middle.exchange(_front, std::memory_order_acq_rel);
+		_front = previous & TripleBuffer::INDEX_MASK;
+		return true;
+	}
+
+private:
+	static const uint8_t INDEX_MASK = 0x03;
+	static const uint8_t FRESH_BIT = 0x04;
+
+	T _buffers[3];
+	uint8_t _back;                // Owned by the writer
+	std::atomic<uint8_t> _middle; // Index of the shared buffer and whether it holds an unread value
+	uint8_t _front;               // Owned by the reader
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "Framebuffer.hpp"
+#include "SpscQueue.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Animated GIF of the emulated screen, given the framebuffer at the end of every emulated frame
+// capture() only copies a frame that changed into a ring of slots, a background thread encodes it, so the emulation
+// never waits: when the encoder falls behind the frame is dropped and the previous image lasts longer
+// The delays follow the emulated frames, fast-forward and headless runs give the same animation as real time ones
+// The image is 128x64 pixels times the scale whatever the resolution, low resolution pixels being twice as large
+class VideoCapture
+{
+public:
+	VideoCapture();
+	~VideoCapture();
+
+	// Color of a pixel index, plane 0 giving bit 0, to set before open()
+	void setColor(uint8_t index, uint8_t red, uint8_t green, uint8_t blue);
+
+	// Waits for the encoder instead of dropping frames, for the runs that are not paced in real time
+	void setWaitEnabled(bool isEnabled) { _isWaitEnabled = isEnabled; }
+
+	// Starts the encoder thread on a new file
+	bool open(const std::string& path, size_t scale = 1);
+	// Encodes the frames left and ends the file, false if a write failed
+	bool close();
+	bool isOpen() const { return _encoder.joinable(); }
+
+	// Hook of the emulator, once per emulated frame
+	void capture(const Framebuffer& framebuffer);
+
+	uint64_t frameCount() const { return _frameCount; }
+	// Frames that changed the screen but found the ring full, always 0 when waiting is enabled
+	uint64_t droppedFrameCount() const { return _droppedFrameCount; }
+
+	static const size_t MAX_SCALE = 8;
+
+private:
+	struct Slot
+	{
+		Framebuffer framebuffer;
+		uint64_t frame;
+	};
+
+	void runEncoder();
+	// Pixel indexes of a frame on the 128x64 grid
+	void toImage(const Framebuffer& framebuffer, std::vector<uint8_t>& image) const;
+	// Writes the part of image that differs from _writtenImage, shown for delay hundredths of a second
+	void writeImage(const std::vector<uint8_t>& image, uint16_t delay, bool isFirst);
+	// GIF LZW code stream of the pixels, in sub-blocks
+	void writeLzw(const std::vector<uint8_t>& pixels);
+	void flush();
+	// Hundredths of a second from the first frame to the start of frame
+	static uint64_t frameTime(uint64_t frame) { return (frame * 100 + 30) / 60; }
+
+	static const size_t WIDTH = 128;
+	static const size_t HEIGHT = 64;
+	static const size_t COLOR_COUNT = 4;
+	// A bit more than 4 seconds of frames that all change
+	static const size_t SLOT_COUNT = 256;
+	// Most viewers slow down shorter delays, such images are merged into the next one
+	static const uint16_t MIN_DELAY = 2;
+
+	uint8_t _palette[VideoCapture::COLOR_COUNT * 3];
+	size_t _scale;
+	bool _isWaitEnabled;
+	std::ofstream _file;
+	std::thread _encoder;
+	std::atomic<bool> _isClosing;
+	std::atomic<bool> _hasWriteError;
+
+	// Emulation side: the last frame queued, to only queue the ones that changed
+	std::vector<VideoCapture::Slot> _slots;
+	SpscQueue<uint32_t, VideoCapture::SLOT_COUNT> _filledSlots;
+	SpscQueue<uint32_t, VideoCapture::SLOT_COUNT> _freeSlots;
+	Framebuffer _lastFrame;
+	bool _hasLastFrame;
+	uint64_t _frameCount;
+	uint64_t _droppedFrameCount;
+	// Frames captured until close(), read by the encoder once it is closing
+	std::atomic<uint64_t> _endFrame;
+
+	// Encoder side
+	std::vector<uint8_t> _writtenImage;
+	std::vector<uint8_t> _output;
+	std::vector<uint16_t> _lzwCodes;
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "AudioSink.hpp"
+#include "ToneGenerator.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Renders 1/60 of a second of sound per emulated frame and keeps it to be written as a WAV file
+// The samples follow the emulated time, a run as fast as possible gives the same file as a real time one
+class WavAudioSink : public AudioSink
+{
+public:
+	WavAudioSink(unsigned int sampleRate = 44100);
+
+	void update(const SoundState& state) override;
+
+	// 16 bits mono PCM
+	bool save(const std::string& path) const;
+
+	const std::vector<int16_t>& samples() const { return _samples; }
+
+private:
+	ToneGenerator _generator;
+	std::vector<int16_t> _samples;
+	// Fraction of a sample carried to the next frame when the rate is not a multiple of 60
+	double _pendingSamples;
+};
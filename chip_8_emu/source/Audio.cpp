@@ -1,39 +1,45 @@
 #include "Audio.hpp"
 
-static sf::Int16 squareWave(int sample, int freq, double amp)
+Audio::Audio(unsigned int sampleRate, size_t bufferSamples) :
+	_states(SoundState()),
+	_generator(sampleRate, 0.9),
+	_samples(bufferSamples),
+	_isStarted(false)
 {
-	int tpc = 44100 / freq; // ticks per cycle
-	int cyclepart = sample % tpc;
-	int halfcycle = tpc / 2;
-	sf::Int16 amplitude = static_cast<sf::Int16>(32767 * amp);
-	return cyclepart < halfcycle ? amplitude : 0;
+	unsigned int channelCount = 1;
+	initialize(channelCount, sampleRate);
 }
 
-Audio::Audio()
+Audio::~Audio()
 {
-	unsigned int channelCount = 1;
-	unsigned int sampleRate = 44100;
-	std::vector<sf::Int16> samples;
+	// The audio thread must not call onGetData() once the members are destroyed
+	stop();
+}
+
+void Audio::update(const SoundState& state)
+{
+	_states.back() = state;
+	_states.publish();
 
-	for (unsigned int i = 0; i < sampleRate; i++)
+	// Started on the first state so nothing is streamed when the audio is disabled
+	if (!_isStarted)
 	{
-		samples.push_back(squareWave(i, 440, 0.9));
+		play();
+		_isStarted = true;
 	}
-
-	_buffer.loadFromSamples(&samples[0], samples.size(), channelCount, sampleRate);
-	_sound.setBuffer(_buffer);
-	_sound.setLoop(true);
 }
 
-void Audio::playSound()
+bool Audio::onGetData(sf::SoundStream::Chunk& data)
 {
-	if (_sound.getStatus() != sf::SoundSource::Status::Playing)
-	{
-		_sound.play();
-	}
+	// Keeps the previous state when the emulation did not publish a new one
+	_states.acquire();
+	_generator.render(_states.front(), _samples.data(), _samples.size());
+	data.samples = _samples.data();
+	data.sampleCount = _samples.size();
+	return true;
 }
 
-void Audio::stopSound()
+void Audio::onSeek(sf::Time timeOffset)
 {
-	_sound.stop();
+	// A generated stream has no position
 }
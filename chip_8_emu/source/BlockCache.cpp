@@ -0,0 +1,65 @@
+#include "BlockCache.hpp"
+#include "Memory.hpp"
+
+BlockCache::BlockCache() :
+	_entries(Memory::MEMORY_SIZE, static_cast<int32_t>(BlockCache::NO_BLOCK))
+{ }
+
+const BlockCache::Block* BlockCache::find(uint16_t addr) const
+{
+	int32_t index = _entries[addr];
+	return index != BlockCache::NO_BLOCK ? &_blocks[index] : nullptr;
+}
+
+BlockCache::Block& BlockCache::insert(uint16_t addr)
+{
+	int32_t index;
+	if (!_freeBlocks.empty())
+	{
+		index = _freeBlocks.back();
+		_freeBlocks.pop_back();
+	}
+	else
+	{
+		index = static_cast<int32_t>(_blocks.size());
+		_blocks.emplace_back();
+	}
+
+	BlockCache::Block& block = _blocks[index];
+	block.begin = addr;
+	block.end = addr;
+	block.isValid = true;
+	block.ops.clear();
+	_entries[addr] = index;
+	return block;
+}
+
+bool BlockCache::invalidate(size_t begin, size_t end)
+{
+	bool isInvalidated = false;
+	for (size_t i = 0; i < _blocks.size(); i++)
+	{
+		BlockCache::Block& block = _blocks[i];
+		if (block.isValid && block.begin < end && begin < block.end)
+		{
+			block.isValid = false;
+			_entries[block.begin] = BlockCache::NO_BLOCK;
+			_freeBlocks.push_back(static_cast<int32_t>(i));
+			isInvalidated = true;
+		}
+	}
+	return isInvalidated;
+}
+
+void BlockCache::clear()
+{
+	_entries.assign(_entries.size(), static_cast<int32_t>(BlockCache::NO_BLOCK));
+	_blocks.clear();
+	_freeBlocks.clear();
+}
+
+void BlockCache::resize(size_t addressCount)
+{
+	_entries.resize(addressCount);
+	clear();
+}
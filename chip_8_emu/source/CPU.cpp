@@ -1,364 +1,820 @@
 #include "CPU.hpp"
 #include "Chip8.hpp"
-#include "Display.hpp"
+#include "Debugger.hpp"
+#include "Framebuffer.hpp"
 #include "Input.hpp"
+#include "MachineState.hpp"
 #include "Memory.hpp"
+#include "Profiler.hpp"
+#include "QuirkPolicy.hpp"
+#include "RomAnalysis.hpp"
+#include "State.hpp"
+#include "TraceRecorder.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 
 CPU::CPU(Chip8& emulator) :
 	_emulator(emulator),
 	_memory(emulator.memory()),
-	_display(emulator.display()),
+	_framebuffer(emulator.framebuffer()),
 	_input(emulator.input()),
+	_dataStores(Memory::MEMORY_SIZE, false),
+	_hasDataStores(false),
 	_pc(Chip8::ROM_START_ADDR),
 	_I(0),
+	_stackSize(0),
 	_delayTimer(0),
 	_soundTimer(0),
-	_drawThisFrame(false)
+	_randomState(0),
+	_planeMask(1),
+	_pitch(CPU::DEFAULT_PITCH),
+	_drawThisFrame(false),
+	_isHalted(false),
+	_dispatchMode(CPU::DispatchMode::BasicBlock),
+	_profiler(nullptr),
+	_debugger(nullptr),
+	_traceRecorder(nullptr),
+	_isIdleSkipEnabled(true),
+	_cycles(0),
+	_sideEffects(0),
+	_idlePeriod(0),
+	_idleCycleCount(0),
+	_quirks(Quirks::fromMask(0)),
+	_platform(Platform::Type::CosmacVip),
+	_isQuirkSpecializationEnabled(true),
+	_quirkProfile("runtime")
 {
 	memset(_registers, 0, CPU::MAX_REGISTER);
+	memset(_stack, 0, sizeof(_stack));
+	memset(_flagRegisters, 0, sizeof(_flagRegisters));
+	memset(_audioPattern, CPU::DEFAULT_PATTERN_BYTE, sizeof(_audioPattern));
+	memset(&_loopSnapshot, 0, sizeof(_loopSnapshot));
+	_loopSnapshot.target = CPU::NO_LOOP;
 	_memory.clear();
+	setSeed(0);
 }
 
 void CPU::initialize()
 {
-	addInstruction(0x0000, 0x0FFF, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// 0NNN: Unused
-	});
-	addInstruction(0xFFFF, 0x00E0, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// 00E0: Clears the screen
-		_display.clear();
-	});
-	addInstruction(0xFFFF, 0x00EE, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// 00EE: Returns from a subroutine
-		// Set pc to the the last address from the stack
-		if (!_stack.empty())
-		{
-			_pc = _stack.top();
-			_stack.pop();
-		}
-	});
-	addInstruction(0xF000, 0x1000, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// 1NNN: Jumps to address NNN
-		_pc = NNN;
-	});
-	addInstruction(0xF000, 0x2000, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// 2NNN: Calls subroutine at NNN
-		_stack.push(_pc);
-		_pc = NNN;
-	});
-	addInstruction(0xF000, 0x3000, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// 3XNN: Skips the next instruction if VX equals NN
-		if (_registers[X] == NN)
+	// Quirks are fixed once the rom is loaded, the handlers are picked for them
+	// Common profiles get handlers specialized at compile time, any other combination reads the quirks at runtime
+	_quirks = _emulator.quirks();
+	_platform = _emulator.platform();
+	_planeMask = 1;
+	_instructions.clear();
+	if (_isQuirkSpecializationEnabled && VipQuirkPolicy::matches(_quirks))
+	{
+		addInstructions<VipQuirkPolicy>();
+		_quirkProfile = "vip";
+	}
+	else if (_isQuirkSpecializationEnabled && SchipQuirkPolicy::matches(_quirks))
+	{
+		addInstructions<SchipQuirkPolicy>();
+		_quirkProfile = "schip";
+	}
+	else if (_isQuirkSpecializationEnabled && XoChipQuirkPolicy::matches(_quirks))
+	{
+		addInstructions<XoChipQuirkPolicy>();
+		_quirkProfile = "xochip";
+	}
+	else
+	{
+		addInstructions<RuntimeQuirkPolicy>();
+		_quirkProfile = "runtime";
+	}
+
+	buildDecodeTable();
+	nameProfilerInstructions();
+	_blockCache.resize(_memory.size());
+	_dataStores.assign(_memory.size(), false);
+	_hasDataStores = false;
+	_memory.clearCodeMarks();
+}
+
+template <typename Policy>
+void CPU::addInstructions()
+{
+	addInstruction(0x0000, 0x0FFF, &CPU::op0NNN, "0NNN");
+	addInstruction(0xFFFF, 0x00E0, &CPU::op00E0, "00E0");
+	addInstruction(0xFFFF, 0x00EE, &CPU::op00EE, "00EE");
+	addInstruction(0xF000, 0x1000, &CPU::op1NNN, "1NNN");
+	addInstruction(0xF000, 0x2000, &CPU::op2NNN, "2NNN");
+	addInstruction(0xF000, 0x3000, &CPU::op3XNN, "3XNN");
+	addInstruction(0xF000, 0x4000, &CPU::op4XNN, "4XNN");
+	addInstruction(0xF00F, 0x5000, &CPU::op5XY0, "5XY0");
+	addInstruction(0xF000, 0x6000, &CPU::op6XNN, "6XNN");
+	addInstruction(0xF000, 0x7000, &CPU::op7XNN, "7XNN");
+	addInstruction(0xF00F, 0x8000, &CPU::op8XY0, "8XY0");
+	addInstruction(0xF00F, 0x8001, &CPU::op8XY1<Policy>, "8XY1");
+	addInstruction(0xF00F, 0x8002, &CPU::op8XY2<Policy>, "8XY2");
+	addInstruction(0xF00F, 0x8003, &CPU::op8XY3<Policy>, "8XY3");
+	addInstruction(0xF00F, 0x8004, &CPU::op8XY4, "8XY4");
+	addInstruction(0xF00F, 0x8005, &CPU::op8XY5, "8XY5");
+	addInstruction(0xF00F, 0x8006, &CPU::op8XY6<Policy>, "8XY6");
+	addInstruction(0xF00F, 0x8007, &CPU::op8XY7, "8XY7");
+	addInstruction(0xF00F, 0x800E, &CPU::op8XYE<Policy>, "8XYE");
+	addInstruction(0xF00F, 0x9000, &CPU::op9XY0, "9XY0");
+	addInstruction(0xF000, 0xA000, &CPU::opANNN, "ANNN");
+	addInstruction(0xF000, 0xB000, &CPU::opBNNN, "BNNN");
+	addInstruction(0xF000, 0xC000, &CPU::opCXNN, "CXNN");
+	addInstruction(0xF000, 0xD000, &CPU::opDXYN<Policy>, "DXYN");
+	addInstruction(0xF0FF, 0xE09E, &CPU::opEX9E, "EX9E");
+	addInstruction(0xF0FF, 0xE0A1, &CPU::opEXA1, "EXA1");
+	addInstruction(0xF0FF, 0xF007, &CPU::opFX07, "FX07");
+	addInstruction(0xF0FF, 0xF00A, &CPU::opFX0A, "FX0A");
+	addInstruction(0xF0FF, 0xF015, &CPU::opFX15, "FX15");
+	addInstruction(0xF0FF, 0xF018, &CPU::opFX18, "FX18");
+	addInstruction(0xF0FF, 0xF01E, &CPU::opFX1E, "FX1E");
+	addInstruction(0xF0FF, 0xF029, &CPU::opFX29, "FX29");
+	addInstruction(0xF0FF, 0xF033, &CPU::opFX33, "FX33");
+	addInstruction(0xF0FF, 0xF055, &CPU::opFX55<Policy>, "FX55");
+	addInstruction(0xF0FF, 0xF065, &CPU::opFX65<Policy>, "FX65");
+
+	if (_platform == Platform::Type::CosmacVip)
+	{
+		return;
+	}
+
+	// SUPER-CHIP, DXY0 draws 16x16 sprites in DXYN
+	addInstruction(0xFFF0, 0x00C0, &CPU::op00CN, "00CN");
+	addInstruction(0xFFFF, 0x00FB, &CPU::op00FB, "00FB");
+	addInstruction(0xFFFF, 0x00FC, &CPU::op00FC, "00FC");
+	addInstruction(0xFFFF, 0x00FD, &CPU::op00FD, "00FD");
+	addInstruction(0xFFFF, 0x00FE, &CPU::op00FE, "00FE");
+	addInstruction(0xFFFF, 0x00FF, &CPU::op00FF, "00FF");
+	addInstruction(0xF0FF, 0xF030, &CPU::opFX30, "FX30");
+	addInstruction(0xF0FF, 0xF075, &CPU::opFX75, "FX75");
+	addInstruction(0xF0FF, 0xF085, &CPU::opFX85, "FX85");
+
+	if (_platform != Platform::Type::XoChip)
+	{
+		return;
+	}
+
+	// XO-CHIP
+	addInstruction(0xFFF0, 0x00D0, &CPU::op00DN, "00DN");
+	addInstruction(0xF00F, 0x5002, &CPU::op5XY2, "5XY2");
+	addInstruction(0xF00F, 0x5003, &CPU::op5XY3, "5XY3");
+	addInstruction(0xFFFF, 0xF000, &CPU::opF000, "F000");
+	addInstruction(0xF0FF, 0xF001, &CPU::opFN01, "FN01");
+	addInstruction(0xFFFF, 0xF002, &CPU::opF002, "F002");
+	addInstruction(0xF0FF, 0xF03A, &CPU::opFX3A, "FX3A");
+}
+
+void CPU::addInstruction(uint16_t mask, uint16_t code, CPU::Handler execute, const char* name)
+{
+	_instructions.emplace_back(CPU::Instruction(mask, code, execute, name));
+}
+
+void CPU::setProfiler(Profiler* profiler)
+{
+	_profiler = profiler;
+	nameProfilerInstructions();
+}
+
+void CPU::nameProfilerInstructions()
+{
+	if (_profiler != nullptr)
+	{
+		for (size_t i = 0; i < _instructions.size(); i++)
 		{
-			_pc += 2;
+			_profiler->setInstructionName(static_cast<uint8_t>(i), _instructions[i].name);
 		}
-	});
-	addInstruction(0xF000, 0x4000, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// 4XNN: Skips the next instruction if VX does not equal NN
-		if (_registers[X] != NN)
+	}
+}
+
+void CPU::buildDecodeTable()
+{
+	// Resolve every possible opCode once with the linear scan so both dispatch modes
+	// select exactly the same instruction, including the order in which masks overlap
+	_decodeTable.assign(CPU::OPCODE_COUNT, static_cast<uint8_t>(CPU::UNKNOWN_INSTRUCTION));
+	for (size_t opCode = 0; opCode < CPU::OPCODE_COUNT; opCode++)
+	{
+		const CPU::Instruction* instruction = getInstruction(static_cast<uint16_t>(opCode));
+		if (instruction != nullptr)
 		{
-			_pc += 2;
+			_decodeTable[opCode] = static_cast<uint8_t>(instruction - &_instructions[0]);
 		}
-	});
-	addInstruction(0xF00F, 0x5000, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// 5XY0: Skips the next instruction if VX equals VY
-		if (_registers[X] == _registers[Y])
+	}
+}
+
+const CPU::Instruction* CPU::getInstruction(uint16_t opCode) const
+{
+	for (size_t i = 0; i < _instructions.size(); i++)
+	{
+		const CPU::Instruction* instruction = &_instructions[i];
+		if ((instruction->mask & opCode) == instruction->code)
 		{
-			_pc += 2;
+			return instruction;
 		}
-	});
-	addInstruction(0xF000, 0x6000, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// 6XNN: Sets VX to NN
-		_registers[X] = NN;
-	});
-	addInstruction(0xF000, 0x7000, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// 7XNN: Adds NN to VX
-		_registers[X] += NN;
-	});
-	addInstruction(0xF00F, 0x8000, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// 8XY0: Sets VX to the value of VY
-		_registers[X] = _registers[Y];
-	});
-	addInstruction(0xF00F, 0x8001, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// 8XY1: Sets VX to VX or VY
-		_registers[X] |= _registers[Y];
-		if (_emulator.isVfResetEnabled())
+	}
+	return nullptr;
+}
+
+const CPU::Instruction* CPU::decodeInstruction(uint16_t opCode) const
+{
+	uint8_t index = _decodeTable[opCode];
+	return index != CPU::UNKNOWN_INSTRUCTION ? &_instructions[index] : nullptr;
+}
+
+bool CPU::tick()
+{
+	// Get the current opCode
+	uint16_t opCode = _memory.readOpCode(_pc);
+	
+	// Increment program counter
+	_pc += 2;
+
+	// Fetch the instruction
+	const CPU::Instruction* instruction = _dispatchMode == CPU::DispatchMode::Linear ? getInstruction(opCode) : decodeInstruction(opCode);
+
+	// Execute the instruction
+	if (instruction != nullptr)
+	{
+		// We preprocess opCode for convenience, they are not always used
+		 // NNN: address
+		uint16_t NNN = opCode & 0x0FFF;
+		// NN: 8 bit constant
+		uint8_t NN = opCode & 0x00FF;
+		// N: 4 bit constant
+		uint8_t N = opCode & 0x000F;
+		// X and Y: 4 bit register identifier
+		uint8_t X = (opCode & 0x0F00) >> 8;
+		uint8_t Y = (opCode & 0x00F0) >> 4;
+#ifdef CHIP8_ENABLE_PROFILER
+		if (_profiler != nullptr)
 		{
-			_registers[0xF] = 0;
+			_profiler->countInstruction(_pc - 2, static_cast<uint8_t>(instruction - &_instructions[0]));
 		}
-	});
-	addInstruction(0xF00F, 0x8002, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// 8XY2: Sets VX to VX and VY
-		_registers[X] &= _registers[Y];
-		if (_emulator.isVfResetEnabled())
+#endif
+		_cycles++;
+		(this->*instruction->execute)(NNN, NN, N, X, Y);
+	}
+	else
+	{
+		std::cout << "[ERROR] Unknown opCode [" << std::hex << opCode << "]" << std::endl;
+		_isHalted = true;
+		return false;
+	}
+
+	return !_isHalted;
+}
+
+bool CPU::run(size_t maxCycles, size_t& executed)
+{
+	// Keys and timers may have changed since the previous run, a loop is only compared within a run
+	_loopSnapshot.target = CPU::NO_LOOP;
+	_idlePeriod = 0;
+
+	bool isStepped = _traceRecorder != nullptr;
+#ifdef CHIP8_ENABLE_DEBUGGER
+	isStepped = isStepped || _debugger != nullptr;
+#endif
+	if (_isHalted)
+	{
+		// Nothing runs past 00FD, an unknown opCode or a stack overflow
+		executed = 0;
+		return false;
+	}
+	if (isStepped)
+	{
+		return runStepped(maxCycles, executed);
+	}
+
+	// Code written between two runs, by a debugger
+	if (_dispatchMode == CPU::DispatchMode::BasicBlock && _memory.hasCodeWrite())
+	{
+		invalidateWrittenBlocks();
+	}
+
+	executed = 0;
+	while (executed < maxCycles)
+	{
+		if (_dispatchMode == CPU::DispatchMode::BasicBlock)
 		{
-			_registers[0xF] = 0;
+			// Memory wraps around, so does the program counter
+			_pc &= _memory.addressMask();
+			const BlockCache::Block* block = _blockCache.find(_pc);
+			if (block == nullptr)
+			{
+				block = buildBlock(_pc);
+			}
+
+			size_t blockCycles = block != nullptr ? executeBlock(*block, maxCycles - executed) : 0;
+			executed += blockCycles;
+			if (_isHalted)
+			{
+				// The instruction that halted did not complete, as in tick()
+				executed--;
+				return false;
+			}
+
+			// FX33 and FX55 end their block, so a block never runs code it has overwritten
+			if (_memory.hasCodeWrite())
+			{
+				invalidateWrittenBlocks();
+			}
+
+			// Nothing to pre-decode or not enough cycles left for a fused op, fallback on a single instruction
+			if (blockCycles == 0)
+			{
+				if (!tick())
+				{
+					return false;
+				}
+				executed++;
+			}
 		}
-	});
-	addInstruction(0xF00F, 0x8003, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// BXY3: Sets VX to VX xor VY
-		_registers[X] ^= _registers[Y];
-		if (_emulator.isVfResetEnabled())
+		else
 		{
-			_registers[0xF] = 0;
+			if (!tick())
+			{
+				return false;
+			}
+			executed++;
 		}
-	});
-	addInstruction(0xF00F, 0x8004, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// 8XY4: Adds VY to VX.
-		// VF is set to 1 when there's an overflow, and to 0 when there is not
-		bool isOverflow = (_registers[X] + _registers[Y]) > 0xFF;
-		_registers[X] = _registers[X] + _registers[Y];
-		_registers[0xF] = isOverflow;
-	});
-	addInstruction(0xF00F, 0x8005, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// 8XY5: VY is subtracted from VX
-		// VF is set to 0 when there's an underflow, and 1 when there is not
-		bool isOverflow = _registers[X] >= _registers[Y];
-		_registers[X] = _registers[X] - _registers[Y];
-		_registers[0xF] = isOverflow;
-	});
-	addInstruction(0xF00F, 0x8006, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// 8XY6: Shifts VX to the right by 1
-		// Stores the least significant bit of VX prior to the shift into VF
-		bool isOverflow = _registers[X] & 0x01;
-		if (_emulator.isShiftingEnabled())
+
+		if (_idlePeriod > 0)
 		{
-			_registers[X] = _registers[Y];
+			skipIdleCycles(maxCycles, executed);
 		}
-		_registers[X] >>= 1;
-		_registers[0xF] = isOverflow;
-	});
-	addInstruction(0xF00F, 0x8007, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// 8XY7: Sets VX to VY minus VX
-		// VF is set to 0 when there's an underflow, and 1 when there is not
-		bool isOverflow = _registers[Y] >= _registers[X];
-		_registers[X] = _registers[Y] - _registers[X];
-		_registers[0xF] = isOverflow;
-	});
-	addInstruction(0xF00F, 0x800E, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// 8XYE: Shifts VX to the left by 1
-		// Sets VF to 1 if the most significant bit of VX prior to that shift was set, or to 0 if it was unset
-		bool isOverflow = (_registers[X] & 0x80) >> 7;
-		if (_emulator.isShiftingEnabled())
+
+		if (_drawThisFrame && _quirks.displayWait)
 		{
-			_registers[X] = _registers[Y];
+			break;
 		}
-		_registers[X] <<= 1;
-		_registers[0xF] = isOverflow;
-	});
-	addInstruction(0xF00F, 0x9000, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// 9XY0: Skips the next instruction if VX does not equal VY
-		if (_registers[X] != _registers[Y])
+	}
+	return true;
+}
+
+bool CPU::runStepped(size_t maxCycles, size_t& executed)
+{
+	executed = 0;
+	while (executed < maxCycles)
+	{
+#ifdef CHIP8_ENABLE_DEBUGGER
+		if (_debugger != nullptr && _debugger->shouldStop(_pc))
 		{
-			_pc += 2;
+			break;
 		}
-	});
-	addInstruction(0xF000, 0xA000, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// ANNN: Sets I to the address NNN
-		_I = NNN;
-	});
-	addInstruction(0xF000, 0xB000, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// BNNN: Jumps to the address NNN plus V0
-		_pc = _registers[0] + NNN;
-	});
-	addInstruction(0xF000, 0xC000, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// CXNN: Sets VX to the result of a bitwise and operation on a random number and NN
-		_registers[X] = rand() & NN;
-	});
-	addInstruction(0xF000, 0xD000, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// DXYN: Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N pixels.
-		// Each row of 8 pixels is read as bit-coded starting from memory location I
-		// I value does not change after the execution of this instruction.
-		// As described above, VF is set to 1 if any screen pixels are flipped from set to unset when the sprite is drawn, and to 0 if that does not happen.
-
-		uint8_t startX = _registers[X];
-		uint8_t startY = _registers[Y];
-		uint8_t height = N;
+#endif
 
-		_registers[0xF] = 0;
-
-		for (uint8_t y = 0; y < height; y++)
+		// Fetched before it runs, the instruction may overwrite itself
+		uint16_t pc = _pc;
+		uint16_t opCode = _traceRecorder != nullptr ? _memory.readOpCode(pc) : 0;
+		if (!tick())
 		{
-			uint8_t spriteY = _memory.read8(_I + y);
-
-			// Sprite are always 8 pixels wide
-			for (uint8_t x = 0; x < Chip8::SPRITE_WIDTH; x++)
+#ifdef CHIP8_ENABLE_DEBUGGER
+			if (_debugger != nullptr)
 			{
-				if (_emulator.isClippingEnabled())
+				uint16_t haltOpCode = _memory.readOpCode(pc);
+				if (haltOpCode == 0x00FD)
 				{
-					// A sprite will be clipped if its partially drawn outside of display
-					// but it will be wrapped around if all of the sprite is drawn outside of the display
-					if ((startX < 64 && startX + x > 63) || (startY < 32 && startY + y > 31))
-					{
-						continue;
-					}
-				}
-
-				uint8_t spritePixel = spriteY & (0x80 >> x);
-				if (spritePixel)
-				{
-					uint8_t posX = (startX + x) % _display.width();
-					uint8_t posY = (startY + y) % _display.height();
-					bool isPixelOn = _display.isPixelOn(posX, posY);
-
-					// Pixel is colliding so we set the flag
-					if (isPixelOn)
-					{
-						_registers[0xF] = 1;
-					}
-
-					// Flip the pixel color
-					_display.putPixel(posX, posY, !isPixelOn);
+					_debugger->stop(Debugger::StopReason::Exit);
+					return false;
 				}
+				// Stopped on the unknown opCode or the call, which can be patched or given room on the stack before resuming
+				_isHalted = false;
+				_pc = pc;
+				_debugger->stop((haltOpCode & 0xF000) == 0x2000 ? Debugger::StopReason::StackOverflow : Debugger::StopReason::Error);
+				return true;
 			}
+#endif
+			return false;
 		}
-		_drawThisFrame = true;
-	});
-	addInstruction(0xF0FF, 0xE09E, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// EX9E: Skips the next instruction if the key stored in VX is pressed
-		if (_input.isKeyDown(_registers[X]))
+		executed++;
+		if (_traceRecorder != nullptr)
 		{
-			_pc += 2;
+			_traceRecorder->recordInstruction(pc, opCode, _registers, _I);
 		}
-	});
-	addInstruction(0xF0FF, 0xE0A1, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// EXA1: Skips the next instruction if the key stored in VX is not pressed
-		if (!_input.isKeyDown(_registers[X]))
+#ifdef CHIP8_ENABLE_DEBUGGER
+		if (_debugger != nullptr)
 		{
-			_pc += 2;
+			_debugger->endInstruction();
 		}
-	});
-	addInstruction(0xF0FF, 0xF007, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// FX07: Sets VX to the value of the delay timer
-		_registers[X] = _delayTimer;
-	});
-	addInstruction(0xF0FF, 0xF00A, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// FX0A: A key press is awaited, and then stored in VX (blocking operation, all instruction halted until next key event)
-
-		bool isKeyPressed = false;
-		for (uint8_t i = 0; i < Input::INPUT_COUNT; i++)
+#endif
+
+		if (_drawThisFrame && _quirks.displayWait)
 		{
-			if (_input.getKeyState(i) == Input::KeyState::Released)
-			{
-				_registers[X] = i;
-				isKeyPressed = true;
-				break;
-			}
+			break;
 		}
+	}
+	return true;
+}
+
+void CPU::detectIdleLoop(uint16_t target)
+{
+	// Called on a backward jump, pc is past it
+	LoopSnapshot& snapshot = _loopSnapshot;
+	bool isSameState = snapshot.target == target
+		&& snapshot.jump == _pc
+		&& snapshot.sideEffects == _sideEffects
+		&& snapshot.I == _I
+		&& snapshot.stackSize == _stackSize
+		&& snapshot.delayTimer == _delayTimer
+		&& snapshot.soundTimer == _soundTimer
+		&& snapshot.randomState == _randomState
+		&& memcmp(snapshot.registers, _registers, sizeof(_registers)) == 0
+		&& memcmp(snapshot.stack, _stack, sizeof(_stack)) == 0;
+	if (isSameState)
+	{
+		_idlePeriod = static_cast<size_t>(_cycles - snapshot.cycles);
+		return;
+	}
+
+	snapshot.jump = _pc;
+	snapshot.target = target;
+	snapshot.cycles = _cycles;
+	snapshot.sideEffects = _sideEffects;
+	snapshot.I = _I;
+	snapshot.stackSize = _stackSize;
+	snapshot.delayTimer = _delayTimer;
+	snapshot.soundTimer = _soundTimer;
+	snapshot.randomState = _randomState;
+	memcpy(snapshot.registers, _registers, sizeof(_registers));
+	memcpy(snapshot.stack, _stack, sizeof(_stack));
+}
+
+void CPU::skipIdleCycles(size_t maxCycles, size_t& executed)
+{
+	// Only whole periods are skipped, the rest runs normally so the frame ends at the same point of the loop
+	size_t remaining = maxCycles - executed;
+	size_t skipped = remaining - remaining % _idlePeriod;
+	executed += skipped;
+	_cycles += skipped;
+	_idleCycleCount += skipped;
+	_idlePeriod = 0;
+
+#ifdef CHIP8_ENABLE_PROFILER
+	if (_profiler != nullptr)
+	{
+		_profiler->countIdleCycles(skipped);
+	}
+#endif
+}
+
+bool CPU::isBlockEnd(uint16_t opCode)
+{
+	switch (opCode & 0xF000)
+	{
+		case 0x0000:
+			return opCode != 0x00E0;
+		case 0x6000:
+		case 0x7000:
+		case 0x8000:
+		case 0xA000:
+		case 0xC000:
+			return false;
+		case 0xF000:
+			// Key wait loops on itself, BCD and register dump write memory
+			// F000 is followed by its address, which must not be decoded as an instruction
+			return opCode == 0xF000 || (opCode & 0x00FF) == 0x0A || (opCode & 0x00FF) == 0x33 || (opCode & 0x00FF) == 0x55;
+		default:
+			// Jumps, calls, skips and draws
+			return true;
+	}
+}
+
+const BlockCache::Block* CPU::buildBlock(uint16_t addr)
+{
+	uint16_t opCode = _memory.readOpCode(addr);
+	if (_decodeTable[opCode] == CPU::UNKNOWN_INSTRUCTION)
+	{
+		return nullptr;
+	}
 
-		if (!isKeyPressed)
+	BlockCache::Block& block = _blockCache.insert(addr);
+	// Wider than an address so the end of a 64KB memory does not wrap
+	size_t pc = addr;
+	while (block.ops.size() < CPU::MAX_BLOCK_SIZE && pc + 1 < _memory.size())
+	{
+		opCode = _memory.readOpCode(static_cast<uint16_t>(pc));
+		uint8_t instruction = _decodeTable[opCode];
+		if (instruction == CPU::UNKNOWN_INSTRUCTION)
 		{
-			_pc -= 2;
+			// Let tick() report it when the execution reaches it
+			break;
 		}
-	});
-	addInstruction(0xF0FF, 0xF015, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// FX15: Sets the delay timer to VX
-		_delayTimer = _registers[X];
-	});
-	addInstruction(0xF0FF, 0xF018, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// FX18: Sets the sound timer to VX
-		_soundTimer = _registers[X];
-	});
-	addInstruction(0xF0FF, 0xF01E, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// FX1E: Adds VX to I. VF is not affected
-		_I += _registers[X];
-	});
-	addInstruction(0xF0FF, 0xF029, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// FX29: Sets I to the location of the character in VX
-		// Characters 0-F are represented by a 4x5 font
-		_I = Chip8::FONT_START_ADDRESS + (_registers[X] * 5);
-	});
-	addInstruction(0xF0FF, 0xF033, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// FX33: Stores the binary-coded decimal representation of VX in I:
-		// - hundreds digit in memory at location in I,
-		// - tens digit at location I+1
-		// - ones digit at location I+2.
-		_memory.write8(_I, (_registers[X] / 100) % 10);
-		_memory.write8(_I + 1, (_registers[X] / 10) % 10);
-		_memory.write8(_I + 2, _registers[X] % 10);
-	});
-	addInstruction(0xF0FF, 0xF055, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// FX55: Stores from V0 to VX (including VX) in memory starting at address I
-		// The offset from I is increased by 1 for each value written, but I itself is left unmodified
-		for (uint8_t i = 0; i <= X; i++)
+		pc += 2;
+
+		BlockCache::Op op = {};
+		op.opCode = opCode;
+		op.next = static_cast<uint16_t>(pc);
+		op.NNN = opCode & 0x0FFF;
+		op.NN = opCode & 0x00FF;
+		op.N = opCode & 0x000F;
+		op.X = (opCode & 0x0F00) >> 8;
+		op.Y = (opCode & 0x00F0) >> 4;
+		op.kind = BlockCache::OpKind::Single;
+		op.cycles = 1;
+		op.instruction = instruction;
+
+		// Fuse with the previous instruction when they form a known pair
+		BlockCache::Op* previous = block.ops.empty() ? nullptr : &block.ops.back();
+		uint8_t fusedKind = BlockCache::OpKind::Single;
+		if (previous != nullptr && previous->kind == BlockCache::OpKind::Single)
 		{
-			_memory.write8(_I + i, _registers[i]);
+			uint16_t pair = (previous->opCode & 0xF000) | ((opCode & 0xF000) >> 4);
+			if (pair == 0x6600)
+			{
+				fusedKind = BlockCache::OpKind::LoadLoad;
+			}
+			else if (pair == 0x7300)
+			{
+				fusedKind = BlockCache::OpKind::AddSkipEqual;
+			}
+			else if (pair == 0xAD00)
+			{
+				fusedKind = BlockCache::OpKind::LoadIDraw;
+			}
 		}
 
-		if (_emulator.isSaveLoadIncrementEnabled())
+		if (fusedKind != BlockCache::OpKind::Single)
 		{
-			_I += X + 1;
+			previous->kind = fusedKind;
+			previous->cycles = 2;
+			previous->next = op.next;
+			previous->NN2 = op.NN;
+			previous->N2 = op.N;
+			previous->X2 = op.X;
+			previous->Y2 = op.Y;
+			previous->instruction2 = op.instruction;
 		}
-	});
-	addInstruction(0xF0FF, 0xF065, [&](uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y) {
-		// FX65: Fills from V0 to VX (including VX) with values from memory, starting at address I
-		// The offset from I is increased by 1 for each value read, but I itself is left unmodified
-		for (uint8_t i = 0; i <= X; i++)
+		else
 		{
-			_registers[i] = _memory.read8(_I + i);
+			block.ops.push_back(op);
 		}
 
-		if (_emulator.isSaveLoadIncrementEnabled())
+		if (isBlockEnd(opCode) && !_dataStores[pc - 2])
 		{
-			_I += X + 1;
+			break;
 		}
-	});
+	}
+	block.end = static_cast<uint32_t>(pc);
+	_memory.markCode(block.begin, block.end - block.begin);
+
+	return &block;
 }
 
-void CPU::addInstruction(uint16_t mask, uint16_t code, std::function<void(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)> execute)
+size_t CPU::executeBlock(const BlockCache::Block& block, size_t maxCycles)
 {
-	_instructions.emplace_back(CPU::Instruction(mask, code, execute));
+	size_t executed = 0;
+	for (const BlockCache::Op& op : block.ops)
+	{
+		if (executed + op.cycles > maxCycles)
+		{
+			break;
+		}
+		executed += op.cycles;
+		_cycles += op.cycles;
+
+		// As in tick(), pc points to the next instruction while executing
+		_pc = op.next;
+#ifdef CHIP8_ENABLE_PROFILER
+		if (_profiler != nullptr)
+		{
+			if (op.cycles == 2)
+			{
+				_profiler->countInstruction(op.next - 4, op.instruction);
+				_profiler->countInstruction(op.next - 2, op.instruction2);
+			}
+			else
+			{
+				_profiler->countInstruction(op.next - 2, op.instruction);
+			}
+		}
+#endif
+		switch (op.kind)
+		{
+			case BlockCache::OpKind::Single:
+				(this->*_instructions[op.instruction].execute)(op.NNN, op.NN, op.N, op.X, op.Y);
+				break;
+			case BlockCache::OpKind::LoadLoad:
+				_registers[op.X] = op.NN;
+				_registers[op.X2] = op.NN2;
+				break;
+			case BlockCache::OpKind::AddSkipEqual:
+				_registers[op.X] += op.NN;
+				if (_registers[op.X2] == op.NN2)
+				{
+					skipNextInstruction();
+				}
+				break;
+			case BlockCache::OpKind::LoadIDraw:
+				_I = op.NNN;
+				(this->*_instructions[op.instruction2].execute)(0, 0, op.N2, op.X2, op.Y2);
+				break;
+		}
+	}
+	return executed;
 }
 
-const CPU::Instruction* CPU::getInstruction(uint16_t opCode) const
+void CPU::invalidateWrittenBlocks()
 {
-	for (size_t i = 0; i < _instructions.size(); i++)
+	size_t begin;
+	size_t end;
+	_memory.takeCodeWrite(begin, end);
+	if (_blockCache.invalidate(begin, end))
 	{
-		const CPU::Instruction* instruction = &_instructions[i];
-		if ((instruction->mask & opCode) == instruction->code)
+		// The memory is no longer the one analyzed, nor are the blocks running past their stores
+		if (_hasDataStores)
 		{
-			return instruction;
+			clearBlocks();
+			return;
+		}
+
+		// Blocks may overlap, so the marks of the remaining ones are rebuilt
+		_memory.clearCodeMarks();
+		for (const BlockCache::Block& block : _blockCache.blocks())
+		{
+			if (block.isValid)
+			{
+				_memory.markCode(block.begin, block.end - block.begin);
+			}
 		}
 	}
-	return nullptr;
 }
 
-bool CPU::tick()
+void CPU::saveState(StateWriter& writer) const
 {
-	// Get the current opCode
-	uint16_t opCode = (_memory.read8(_pc) << 8) | _memory.read8(_pc + 1);
-	
-	// Increment program counter
-	_pc += 2;
+	writer.writeBytes(_registers, CPU::MAX_REGISTER);
+	writer.write16(_I);
+	writer.write16(_pc);
+	writer.write8(_stackSize);
+	for (size_t i = 0; i < CPU::STACK_SIZE; i++)
+	{
+		writer.write16(_stack[i]);
+	}
+	writer.write8(_delayTimer);
+	writer.write8(_soundTimer);
+	writer.write64(_randomState);
+	writer.writeBytes(_flagRegisters, CPU::FLAG_REGISTER_COUNT);
+	writer.write8(_planeMask);
+	writer.writeBytes(_audioPattern, CPU::AUDIO_PATTERN_SIZE);
+	writer.write8(_pitch);
+}
 
-	// Fetch the instruction
-	const CPU::Instruction* instruction = getInstruction(opCode);
+void CPU::loadState(StateReader& reader)
+{
+	reader.readBytes(_registers, CPU::MAX_REGISTER);
+	_I = reader.read16();
+	_pc = reader.read16();
+	_stackSize = reader.read8() % (CPU::STACK_SIZE + 1);
+	for (size_t i = 0; i < CPU::STACK_SIZE; i++)
+	{
+		_stack[i] = reader.read16();
+	}
+	_delayTimer = reader.read8();
+	_soundTimer = reader.read8();
+	_randomState = reader.read64();
+	reader.readBytes(_flagRegisters, CPU::FLAG_REGISTER_COUNT);
+	_planeMask = reader.read8();
+	reader.readBytes(_audioPattern, CPU::AUDIO_PATTERN_SIZE);
+	_pitch = reader.read8();
+	_isHalted = false;
 
-	// Execute the instruction
-	if (instruction != nullptr)
+	// The whole memory was replaced, nothing decoded before can be trusted
+	clearBlocks();
+}
+
+void CPU::saveState(MachineState& state) const
+{
+	memcpy(state.registers, _registers, sizeof(state.registers));
+	memcpy(state.flagRegisters, _flagRegisters, sizeof(state.flagRegisters));
+	state.I = _I;
+	state.pc = _pc;
+	memcpy(state.stack, _stack, sizeof(state.stack));
+	state.stackSize = _stackSize;
+	state.delayTimer = _delayTimer;
+	state.soundTimer = _soundTimer;
+	state.halted = _isHalted ? 1 : 0;
+	memset(state.reserved, 0, sizeof(state.reserved));
+	state.randomState = _randomState;
+}
+
+void CPU::loadState(const MachineState& state)
+{
+	memcpy(_registers, state.registers, sizeof(_registers));
+	memcpy(_flagRegisters, state.flagRegisters, sizeof(_flagRegisters));
+	_I = state.I;
+	_pc = state.pc;
+	memcpy(_stack, state.stack, sizeof(_stack));
+	_stackSize = state.stackSize % (CPU::STACK_SIZE + 1);
+	_delayTimer = state.delayTimer;
+	_soundTimer = state.soundTimer;
+	_randomState = state.randomState;
+	_isHalted = state.halted != 0;
+
+	// States are loaded once per step, the block cache is only dropped when it is in use
+	if (_dispatchMode == CPU::DispatchMode::BasicBlock)
 	{
-		// We preprocess opCode for convenience, they are not always used
-		 // NNN: address
-		uint16_t NNN = opCode & 0x0FFF;
-		// NN: 8 bit constant
-		uint8_t NN = opCode & 0x00FF;
-		// N: 4 bit constant
-		uint8_t N = opCode & 0x000F;
-		// X and Y: 4 bit register identifier
-		uint8_t X = (opCode & 0x0F00) >> 8;
-		uint8_t Y = (opCode & 0x00F0) >> 4;
-		instruction->execute(NNN, NN, N, X, Y);
+		clearBlocks();
 	}
-	else
+}
+
+size_t CPU::stateSize()
+{
+	// Registers, I, pc, stack size, stack, timers, random state, flag registers, plane mask, audio pattern and pitch
+	return CPU::MAX_REGISTER + 2 + 2 + 1 + CPU::STACK_SIZE * 2 + 2 + 8
+		+ CPU::FLAG_REGISTER_COUNT + 1 + CPU::AUDIO_PATTERN_SIZE + 1;
+}
+
+SoundState CPU::soundState() const
+{
+	SoundState state;
+	state.isActive = _soundTimer > 0;
+	state.pitch = _pitch;
+	memcpy(state.pattern, _audioPattern, sizeof(state.pattern));
+	return state;
+}
+
+void CPU::skipNextInstruction()
+{
+	// F000 NNNN is the only instruction of 4 bytes, skipping it jumps over its address as well
+	bool isLongInstruction = _platform == Platform::Type::XoChip && _memory.readOpCode(_pc) == 0xF000;
+	_pc += isLongInstruction ? 4 : 2;
+}
+
+void CPU::setDispatchMode(CPU::DispatchMode dispatchMode)
+{
+	if (dispatchMode == CPU::DispatchMode::BasicBlock && _dispatchMode != CPU::DispatchMode::BasicBlock)
+	{
+		clearBlocks();
+	}
+	_dispatchMode = dispatchMode;
+}
+
+bool CPU::loadAnalysis(const RomAnalysis& analysis)
+{
+	// The analysis follows the paths from the start of the rom with an empty stack
+	if (_dispatchMode != CPU::DispatchMode::BasicBlock || _pc != Chip8::ROM_START_ADDR || _stackSize != 0
+		|| analysis.platform() != _platform || !analysis.matches(_memory))
 	{
-		std::cout << "[ERROR] Unknown opCode [" << std::hex << opCode << "]" << std::endl;
 		return false;
 	}
 
+	clearBlocks();
+	for (size_t addr = 0; addr < _dataStores.size(); addr++)
+	{
+		_dataStores[addr] = analysis.isDataStore(static_cast<uint16_t>(addr));
+	}
+	_hasDataStores = analysis.isComplete();
+
+	// Blocks start where the analysis found one and after the instructions ending a block of the CPU
+	std::vector<uint16_t> pending;
+	for (const RomAnalysis::Block& block : analysis.blocks())
+	{
+		pending.push_back(block.begin);
+	}
+	while (!pending.empty())
+	{
+		uint16_t addr = pending.back();
+		pending.pop_back();
+		if (_blockCache.find(addr) != nullptr)
+		{
+			continue;
+		}
+		const BlockCache::Block* block = buildBlock(addr);
+		if (block != nullptr && block->end < _memory.size() && analysis.isInstruction(static_cast<uint16_t>(block->end)))
+		{
+			pending.push_back(static_cast<uint16_t>(block->end));
+		}
+	}
 	return true;
 }
 
+void CPU::clearBlocks()
+{
+	size_t begin;
+	size_t end;
+	_blockCache.clear();
+	std::fill(_dataStores.begin(), _dataStores.end(), false);
+	_hasDataStores = false;
+	_memory.clearCodeMarks();
+	_memory.takeCodeWrite(begin, end);
+}
+
+void CPU::setSeed(uint64_t seed)
+{
+	// Xorshift can't leave the zero state
+	_randomState = seed ^ 0x9E3779B97F4A7C15;
+	if (_randomState == 0)
+	{
+		_randomState = 0x9E3779B97F4A7C15;
+	}
+}
+
+uint8_t CPU::nextRandom()
+{
+	// Xorshift64*, keeping the high byte which has the best distribution
+	_randomState ^= _randomState >> 12;
+	_randomState ^= _randomState << 25;
+	_randomState ^= _randomState >> 27;
+	return static_cast<uint8_t>((_randomState * 0x2545F4914F6CDD1D) >> 56);
+}
+
 void CPU::updateTimers()
 {
 	// This timer is intended to be used for timing the events of games.
@@ -375,3 +831,520 @@ void CPU::updateTimers()
 		_soundTimer--;
 	}
 }
+
+void CPU::op0NNN(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 0NNN: Unused
+}
+
+void CPU::op00E0(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 00E0: Clears the screen, only the selected planes on XO-CHIP
+	_framebuffer.clear(_planeMask);
+	_sideEffects++;
+}
+
+void CPU::op00EE(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 00EE: Returns from a subroutine
+	// Set pc to the the last address from the stack
+	if (_stackSize > 0)
+	{
+		_pc = _stack[--_stackSize];
+	}
+}
+
+void CPU::op00CN(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 00CN: Scrolls the display down by N pixels
+	_framebuffer.scrollDown(N, _planeMask);
+	_drawThisFrame = true;
+	_sideEffects++;
+}
+
+void CPU::op00DN(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 00DN: Scrolls the display up by N pixels
+	_framebuffer.scrollUp(N, _planeMask);
+	_drawThisFrame = true;
+	_sideEffects++;
+}
+
+void CPU::op00FB(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 00FB: Scrolls the display right by 4 pixels
+	_framebuffer.scrollRight(CPU::SCROLL_PIXELS, _planeMask);
+	_drawThisFrame = true;
+	_sideEffects++;
+}
+
+void CPU::op00FC(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 00FC: Scrolls the display left by 4 pixels
+	_framebuffer.scrollLeft(CPU::SCROLL_PIXELS, _planeMask);
+	_drawThisFrame = true;
+	_sideEffects++;
+}
+
+void CPU::op00FD(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 00FD: Exits the interpreter
+	std::cout << "[EXIT] Exit instruction at [" << std::hex << _pc - 2 << "]" << std::endl;
+	_isHalted = true;
+}
+
+void CPU::op00FE(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 00FE: Switches to the 64x32 low resolution mode, the screen is cleared
+	_framebuffer.resize(Chip8::SCREEN_WIDTH, Chip8::SCREEN_HEIGHT, _framebuffer.planeCount());
+	_drawThisFrame = true;
+	_sideEffects++;
+}
+
+void CPU::op00FF(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 00FF: Switches to the 128x64 high resolution mode, the screen is cleared
+	_framebuffer.resize(Chip8::HIRES_SCREEN_WIDTH, Chip8::HIRES_SCREEN_HEIGHT, _framebuffer.planeCount());
+	_drawThisFrame = true;
+	_sideEffects++;
+}
+
+void CPU::op1NNN(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 1NNN: Jumps to address NNN
+	if (_isIdleSkipEnabled && NNN < _pc)
+	{
+		detectIdleLoop(NNN);
+	}
+	_pc = NNN;
+}
+
+void CPU::op2NNN(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 2NNN: Calls subroutine at NNN
+	if (_stackSize == CPU::STACK_SIZE)
+	{
+		std::cout << "[ERROR] Stack overflow at [" << std::hex << _pc - 2 << "]" << std::endl;
+		_isHalted = true;
+		return;
+	}
+	_stack[_stackSize++] = _pc;
+	_pc = NNN;
+}
+
+void CPU::op3XNN(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 3XNN: Skips the next instruction if VX equals NN
+	if (_registers[X] == NN)
+	{
+		skipNextInstruction();
+	}
+}
+
+void CPU::op4XNN(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 4XNN: Skips the next instruction if VX does not equal NN
+	if (_registers[X] != NN)
+	{
+		skipNextInstruction();
+	}
+}
+
+void CPU::op5XY0(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 5XY0: Skips the next instruction if VX equals VY
+	if (_registers[X] == _registers[Y])
+	{
+		skipNextInstruction();
+	}
+}
+
+void CPU::op5XY2(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 5XY2: Stores VX to VY (including VY) in memory starting at address I, in reverse order if X > Y
+	// I is left unmodified
+	int step = X <= Y ? 1 : -1;
+	for (uint8_t i = 0; i <= std::abs(X - Y); i++)
+	{
+		_memory.write8(_I + i, _registers[X + i * step]);
+	}
+	_sideEffects++;
+}
+
+void CPU::op5XY3(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 5XY3: Fills VX to VY (including VY) with values from memory starting at address I, in reverse order if X > Y
+	// I is left unmodified
+	int step = X <= Y ? 1 : -1;
+	for (uint8_t i = 0; i <= std::abs(X - Y); i++)
+	{
+		_registers[X + i * step] = _memory.read8(_I + i);
+	}
+}
+
+void CPU::op6XNN(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 6XNN: Sets VX to NN
+	_registers[X] = NN;
+}
+
+void CPU::op7XNN(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 7XNN: Adds NN to VX
+	_registers[X] += NN;
+}
+
+void CPU::op8XY0(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 8XY0: Sets VX to the value of VY
+	_registers[X] = _registers[Y];
+}
+
+template <typename Policy>
+void CPU::op8XY1(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 8XY1: Sets VX to VX or VY
+	_registers[X] |= _registers[Y];
+	if (Policy::vfReset(_quirks))
+	{
+		_registers[0xF] = 0;
+	}
+}
+
+template <typename Policy>
+void CPU::op8XY2(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 8XY2: Sets VX to VX and VY
+	_registers[X] &= _registers[Y];
+	if (Policy::vfReset(_quirks))
+	{
+		_registers[0xF] = 0;
+	}
+}
+
+template <typename Policy>
+void CPU::op8XY3(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 8XY3: Sets VX to VX xor VY
+	_registers[X] ^= _registers[Y];
+	if (Policy::vfReset(_quirks))
+	{
+		_registers[0xF] = 0;
+	}
+}
+
+void CPU::op8XY4(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 8XY4: Adds VY to VX.
+	// VF is set to 1 when there's an overflow, and to 0 when there is not
+	bool isOverflow = (_registers[X] + _registers[Y]) > 0xFF;
+	_registers[X] = _registers[X] + _registers[Y];
+	_registers[0xF] = isOverflow;
+}
+
+void CPU::op8XY5(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 8XY5: VY is subtracted from VX
+	// VF is set to 0 when there's an underflow, and 1 when there is not
+	bool isOverflow = _registers[X] >= _registers[Y];
+	_registers[X] = _registers[X] - _registers[Y];
+	_registers[0xF] = isOverflow;
+}
+
+template <typename Policy>
+void CPU::op8XY6(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 8XY6: Shifts VX to the right by 1
+	// Stores the least significant bit of VX prior to the shift into VF
+	bool isOverflow = _registers[X] & 0x01;
+	if (Policy::shifting(_quirks))
+	{
+		_registers[X] = _registers[Y];
+	}
+	_registers[X] >>= 1;
+	_registers[0xF] = isOverflow;
+}
+
+void CPU::op8XY7(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 8XY7: Sets VX to VY minus VX
+	// VF is set to 0 when there's an underflow, and 1 when there is not
+	bool isOverflow = _registers[Y] >= _registers[X];
+	_registers[X] = _registers[Y] - _registers[X];
+	_registers[0xF] = isOverflow;
+}
+
+template <typename Policy>
+void CPU::op8XYE(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 8XYE: Shifts VX to the left by 1
+	// Sets VF to 1 if the most significant bit of VX prior to that shift was set, or to 0 if it was unset
+	bool isOverflow = (_registers[X] & 0x80) >> 7;
+	if (Policy::shifting(_quirks))
+	{
+		_registers[X] = _registers[Y];
+	}
+	_registers[X] <<= 1;
+	_registers[0xF] = isOverflow;
+}
+
+void CPU::op9XY0(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// 9XY0: Skips the next instruction if VX does not equal VY
+	if (_registers[X] != _registers[Y])
+	{
+		skipNextInstruction();
+	}
+}
+
+void CPU::opANNN(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// ANNN: Sets I to the address NNN
+	_I = NNN;
+}
+
+void CPU::opBNNN(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// BNNN: Jumps to the address NNN plus V0
+	_pc = _registers[0] + NNN;
+}
+
+void CPU::opCXNN(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// CXNN: Sets VX to the result of a bitwise and operation on a random number and NN
+	_registers[X] = nextRandom() & NN;
+}
+
+template <typename Policy>
+void CPU::opDXYN(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// DXYN: Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N pixels.
+	// Each row of 8 pixels is read as bit-coded starting from memory location I
+	// I value does not change after the execution of this instruction.
+	// As described above, VF is set to 1 if any screen pixels are flipped from set to unset when the sprite is drawn, and to 0 if that does not happen.
+	// SUPER-CHIP and XO-CHIP draw a 16x16 sprite of two bytes per row when N is 0
+	// XO-CHIP draws on every selected plane, the sprite of a plane following the one of the previous plane in memory
+
+	uint8_t startX = _registers[X];
+	uint8_t startY = _registers[Y];
+	bool isBigSprite = N == 0 && _platform != Platform::Type::CosmacVip;
+	uint8_t width = isBigSprite ? CPU::BIG_SPRITE_SIZE : Chip8::SPRITE_WIDTH;
+	uint8_t height = isBigSprite ? CPU::BIG_SPRITE_SIZE : N;
+	uint8_t bytesPerRow = width / 8;
+	bool isClippingEnabled = Policy::clipping(_quirks);
+
+	_registers[0xF] = 0;
+
+	uint16_t spriteAddr = _I;
+	uint32_t drawnPixels = 0;
+	for (uint8_t plane = 0; plane < _framebuffer.planeCount(); plane++)
+	{
+		if ((_planeMask & (1 << plane)) == 0)
+		{
+			continue;
+		}
+
+		uint8_t y = 0;
+		for (; y < height; y++)
+		{
+			// A sprite will be clipped if it's partially drawn outside of display
+			// but it will be wrapped around if all of the sprite is drawn outside of the display
+			if (isClippingEnabled && startY < _framebuffer.height() && startY + y >= _framebuffer.height())
+			{
+				break;
+			}
+
+			// The whole row of the sprite is xored at once
+			uint8_t posY = (startY + y) % _framebuffer.height();
+			uint16_t rowAddr = spriteAddr + y * bytesPerRow;
+			uint32_t sprite = isBigSprite ? (_memory.read8(rowAddr) << 8) | _memory.read8(rowAddr + 1) : _memory.read8(rowAddr);
+			if (_framebuffer.xorRow(startX, posY, sprite, width, isClippingEnabled, plane))
+			{
+				// Pixel is colliding so we set the flag
+				_registers[0xF] = 1;
+			}
+		}
+		drawnPixels += y * width;
+		spriteAddr += height * bytesPerRow;
+	}
+	_drawThisFrame = true;
+	_sideEffects++;
+
+#ifdef CHIP8_ENABLE_PROFILER
+	if (_profiler != nullptr)
+	{
+		_profiler->countDraw(drawnPixels);
+	}
+#endif
+}
+
+void CPU::opEX9E(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// EX9E: Skips the next instruction if the key stored in VX is pressed
+	if (_input.isKeyDown(_registers[X] & 0x0F))
+	{
+		skipNextInstruction();
+	}
+}
+
+void CPU::opEXA1(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// EXA1: Skips the next instruction if the key stored in VX is not pressed
+	if (!_input.isKeyDown(_registers[X] & 0x0F))
+	{
+		skipNextInstruction();
+	}
+}
+
+void CPU::opF000(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// F000 NNNN: Sets I to the 16 bits address NNNN stored after the instruction
+	_I = _memory.readOpCode(_pc);
+	_pc += 2;
+}
+
+void CPU::opFN01(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// FN01: Selects the planes drawn, cleared and scrolled, bit i selecting plane i
+	_planeMask = X;
+	_sideEffects++;
+}
+
+void CPU::opF002(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// F002: Loads the 16 bytes audio pattern from memory starting at address I
+	for (uint8_t i = 0; i < CPU::AUDIO_PATTERN_SIZE; i++)
+	{
+		_audioPattern[i] = _memory.read8(_I + i);
+	}
+	_sideEffects++;
+}
+
+void CPU::opFX07(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// FX07: Sets VX to the value of the delay timer
+	_registers[X] = _delayTimer;
+}
+
+void CPU::opFX0A(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// FX0A: A key press is awaited, and then stored in VX (blocking operation, all instruction halted until next key event)
+
+	bool isKeyPressed = false;
+	for (uint8_t i = 0; i < Input::INPUT_COUNT; i++)
+	{
+		if (_input.getKeyState(i) == Input::KeyState::Released)
+		{
+			_registers[X] = i;
+			isKeyPressed = true;
+			break;
+		}
+	}
+
+	if (!isKeyPressed)
+	{
+		_pc -= 2;
+		// The keys won't change before the next frame, every cycle left would run this instruction again
+		if (_isIdleSkipEnabled)
+		{
+			_idlePeriod = 1;
+		}
+	}
+}
+
+void CPU::opFX15(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// FX15: Sets the delay timer to VX
+	_delayTimer = _registers[X];
+}
+
+void CPU::opFX18(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// FX18: Sets the sound timer to VX
+	_soundTimer = _registers[X];
+}
+
+void CPU::opFX1E(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// FX1E: Adds VX to I. VF is not affected
+	_I += _registers[X];
+}
+
+void CPU::opFX29(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// FX29: Sets I to the location of the character in VX
+	// Characters 0-F are represented by a 4x5 font
+	_I = Chip8::FONT_START_ADDRESS + (_registers[X] * 5);
+}
+
+void CPU::opFX30(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// FX30: Sets I to the location of the big character in VX
+	// Characters 0-F are represented by a 8x10 font
+	_I = Chip8::BIG_FONT_START_ADDRESS + ((_registers[X] & 0x0F) * CPU::BIG_FONT_CHARACTER_SIZE);
+}
+
+void CPU::opFX33(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// FX33: Stores the binary-coded decimal representation of VX in I:
+	// - hundreds digit in memory at location in I,
+	// - tens digit at location I+1
+	// - ones digit at location I+2.
+	_memory.write8(_I, (_registers[X] / 100) % 10);
+	_memory.write8(_I + 1, (_registers[X] / 10) % 10);
+	_memory.write8(_I + 2, _registers[X] % 10);
+	_sideEffects++;
+}
+
+void CPU::opFX3A(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// FX3A: Sets the pitch of the audio pattern to VX
+	_pitch = _registers[X];
+	_sideEffects++;
+}
+
+template <typename Policy>
+void CPU::opFX55(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// FX55: Stores from V0 to VX (including VX) in memory starting at address I
+	// The offset from I is increased by 1 for each value written, but I itself is left unmodified
+	for (uint8_t i = 0; i <= X; i++)
+	{
+		_memory.write8(_I + i, _registers[i]);
+	}
+
+	if (Policy::saveLoadIncrement(_quirks))
+	{
+		_I += X + 1;
+	}
+	_sideEffects++;
+}
+
+template <typename Policy>
+void CPU::opFX65(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// FX65: Fills from V0 to VX (including VX) with values from memory, starting at address I
+	// The offset from I is increased by 1 for each value read, but I itself is left unmodified
+	for (uint8_t i = 0; i <= X; i++)
+	{
+		_registers[i] = _memory.read8(_I + i);
+	}
+
+	if (Policy::saveLoadIncrement(_quirks))
+	{
+		_I += X + 1;
+	}
+}
+
+void CPU::opFX75(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// FX75: Stores from V0 to VX (including VX) in the flag registers, which are kept when the rom is restarted
+	memcpy(_flagRegisters, _registers, X + 1);
+	_sideEffects++;
+}
+
+void CPU::opFX85(uint16_t NNN, uint8_t NN, uint8_t N, uint8_t X, uint8_t Y)
+{
+	// FX85: Fills from V0 to VX (including VX) with values from the flag registers
+	memcpy(_registers, _flagRegisters, X + 1);
+}
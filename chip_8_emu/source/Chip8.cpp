@@ -1,95 +1,698 @@
 #include "Chip8.hpp"
-#include <SFML/System/Clock.hpp>
-#include <iostream>
+#include "AudioSink.hpp"
+#include "Debugger.hpp"
+#include "InputLog.hpp"
+#include "InputQueue.hpp"
+#include "InputSource.hpp"
+#include "MachineState.hpp"
+#include "Profiler.hpp"
+#include "Renderer.hpp"
+#include "SharedStateWriter.hpp"
+#include "SpectatorServer.hpp"
+#include "State.hpp"
+#include "TraceRecorder.hpp"
+#include "VideoCapture.hpp"
+#include <algorithm>
+#include <chrono>
 #include <fstream>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
 
-Chip8::Chip8(size_t cyclesPerFrame, bool saveLoadIncrement, bool vfReset, bool clipping, bool shifting, bool displayWait) :
-	_display(64, 32, 16, "CHIP 8"),
+Chip8::Chip8(size_t cyclesPerFrame, const Quirks& quirks) :
+	_framebuffer(Chip8::SCREEN_WIDTH, Chip8::SCREEN_HEIGHT),
 	_memory(),
 	_input(),
-	_audio(),
 	_cpu(*this),
+	_renderer(nullptr),
+	_audioSink(nullptr),
+	_inputSource(nullptr),
+	_inputLog(nullptr),
+	_profiler(nullptr),
+	_debugger(nullptr),
+	_traceRecorder(nullptr),
+	_videoCapture(nullptr),
+	_spectatorServer(nullptr),
+	_sharedStateWriter(nullptr),
 	_cyclesPerFrame(cyclesPerFrame),
-	_saveLoadIncrement(saveLoadIncrement),
-	_vfReset(vfReset),
-	_clipping(clipping),
-	_shifting(shifting),
-	_displayWait(displayWait),
-	_audioEnabled(true)
+	_quirks(quirks),
+	_platform(Platform::Type::CosmacVip),
+	_audioEnabled(true),
+	_isFastForward(false),
+	_fastForwardSpeed(0),
+	_cpuBudget(0.0),
+	_minCyclesPerFrame(cyclesPerFrame),
+	_maxCyclesPerFrame(cyclesPerFrame),
+	_frameSeconds(0.0),
+	_instructionCount(0),
+	_frameCount(0),
+	_suspendedCycles(0),
+	_isFrameSuspended(false),
+	_appliedKeys(0),
+	_hasInputTime(false),
+	_rewind(Chip8::REWIND_FRAMES, Chip8::REWIND_KEYFRAME_INTERVAL),
+	_rewindEnabled(false)
 { }
 
+static const uint8_t STATE_MAGIC[] = { 'C', '8', 'S', 'T' };
+
+void Chip8::setPlatform(Platform::Type platform)
+{
+	// Every platform starts in the low resolution mode
+	_platform = platform;
+	_memory.setSize(Platform::memorySize(platform));
+	_framebuffer.resize(Chip8::SCREEN_WIDTH, Chip8::SCREEN_HEIGHT, platform == Platform::Type::XoChip ? Framebuffer::MAX_PLANES : 1);
+	_rewind.clear();
+}
+
 void Chip8::initialize()
 {
 	loadFont();
 	_cpu.initialize();
+	_isFrameSuspended = false;
 }
 
 void Chip8::update()
 {
-	sf::Clock frameTimer;
-	sf::Clock clock;
-	size_t frames = 0;
-	bool isRunning = true;
-	const float frameDuration = 1.f / 60.f; // Use to run at 60Hz
+	typedef std::chrono::steady_clock Clock;
+
+	// The renderer only sees finished frames, a slow present never delays the emulation
+	TripleBuffer<Chip8::PresentedFrame> frames({ _framebuffer, Clock::time_point(), false });
+	InputQueue inputQueue;
+	std::atomic<bool> isRunning(true);
+	Chip8::EmulationStats stats;
+	stats.emulatedFrames = 0;
+	stats.droppedFrames = 0;
+	stats.cyclesPerFrame = _cyclesPerFrame;
+	std::thread emulation(&Chip8::runEmulationThread, this, std::ref(frames), std::ref(inputQueue), std::ref(isRunning), std::ref(stats));
 
-	while (_display.isOpen() && isRunning)
+	Clock::time_point clock = Clock::now();
+	uint64_t lastEmulatedFrames = 0;
+	uint64_t lastDroppedFrames = 0;
+	size_t presentedFrames = 0;
+	size_t latencyCount = 0;
+	Clock::duration latencyTotal = Clock::duration::zero();
+	Clock::duration latencyMax = Clock::duration::zero();
+	InputQueue::Snapshot lastSnapshot = { 0, 0, Clock::time_point() };
+	bool hasPendingSnapshot = false;
+
+	while (_renderer->isOpen() && isRunning)
 	{
-		_display.pollEvent();
+		_renderer->pollEvent();
+
+		// Every key event is sent with its time, polled sources are sampled and only their changes are sent
+		// A snapshot that does not fit is sent again on the next iteration
+		if (_inputSource != nullptr)
+		{
+			InputSource::Event event;
+			while (_inputSource->nextEvent(event))
+			{
+				InputQueue::Snapshot snapshot = { event.keys, event.hotkeys, event.time };
+				hasPendingSnapshot = !inputQueue.push(snapshot) || hasPendingSnapshot;
+				lastSnapshot = snapshot;
+			}
+
+			InputQueue::Snapshot snapshot = InputQueue::sample(*_inputSource);
+			if (snapshot != lastSnapshot || hasPendingSnapshot)
+			{
+				hasPendingSnapshot = !inputQueue.push(snapshot);
+				lastSnapshot = snapshot;
+			}
+		}
+
+		// Draw only when a new frame is ready
+		if (frames.acquire())
+		{
+			Clock::time_point renderStart = Clock::now();
+			_renderer->present(frames.front().framebuffer);
+			presentedFrames++;
+			Clock::time_point renderEnd = Clock::now();
+			if (_profiler != nullptr)
+			{
+				_profiler->addPhaseTime(Profiler::Phase::Render, renderEnd - renderStart);
+			}
+
+			// From the key event to the end of the present of the first frame run with it
+			if (frames.front().hasInput)
+			{
+				Clock::duration latency = renderEnd - frames.front().inputTime;
+				latencyTotal += latency;
+				latencyMax = std::max(latencyMax, latency);
+				latencyCount++;
+				if (_profiler != nullptr)
+				{
+					_profiler->addInputLatency(latency);
+				}
+			}
+		}
+		else
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		// Compute fps
+		if (Clock::now() - clock >= std::chrono::seconds(1))
+		{
+			uint64_t emulated = stats.emulatedFrames;
+			uint64_t dropped = stats.droppedFrames;
+			std::cout << std::dec << "[FPS] emulated: " << emulated - lastEmulatedFrames
+				<< " presented: " << presentedFrames
+				<< " dropped: " << dropped - lastDroppedFrames
+				<< " cycles/frame: " << stats.cyclesPerFrame;
+			if (latencyCount > 0)
+			{
+				std::cout << " input latency: " << std::chrono::duration<double, std::milli>(latencyTotal).count() / latencyCount
+					<< "ms (max " << std::chrono::duration<double, std::milli>(latencyMax).count() << "ms)";
+			}
+			std::cout << std::endl;
+			lastEmulatedFrames = emulated;
+			lastDroppedFrames = dropped;
+			presentedFrames = 0;
+			latencyCount = 0;
+			latencyTotal = Clock::duration::zero();
+			latencyMax = Clock::duration::zero();
+			clock = Clock::now();
+		}
+	}
 
-		_input.tick();
+	isRunning = false;
+	emulation.join();
+}
+
+bool Chip8::runFrame()
+{
+	return runFrame(_inputSource);
+}
 
-		frameTimer.restart();
-		for (size_t i = 0; i < _cyclesPerFrame; i++)
+void Chip8::runEmulationThread(TripleBuffer<Chip8::PresentedFrame>& frames, InputQueue& inputQueue, std::atomic<bool>& isRunning, Chip8::EmulationStats& stats)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	const Clock::duration frameDuration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / 60.0)); // Use to run at 60Hz
+	// Past this delay the schedule restarts instead of running a burst of frames to catch up
+	const Clock::duration maxLateness = frameDuration * 5;
+	Clock::time_point nextFrame = Clock::now();
+	Clock::time_point lastPoll = nextFrame;
+
+	bool wasSavePressed = false;
+	bool wasLoadPressed = false;
+	bool wasFastForwardPressed = false;
+
+	while (isRunning)
+	{
+		Clock::time_point frameStart = Clock::now();
+
+		// Hotkeys come from the snapshot polled on the previous frame
+		bool canGoBack = _inputLog == nullptr;
+		if (canGoBack && inputQueue.isHotkeyPressed(InputSource::Hotkey::Rewind))
+		{
+			// Rewind steps back one frame per frame while held
+			inputQueue.poll();
+			queueKeyChanges(inputQueue, lastPoll, frameStart);
+			rewindFrame();
+		}
+		else if (_inputLog != nullptr)
+		{
+			// A recording holds the keys of each frame, the changes are merged at its start as on replay
+			if (!runFrame(&inputQueue))
+			{
+				isRunning = false;
+			}
+		}
+		else
 		{
-			if (!_cpu.tick())
+			inputQueue.poll();
+			queueKeyChanges(inputQueue, lastPoll, frameStart);
+			if (!runFrame(nullptr))
 			{
-				// An error occured, stop execution
 				isRunning = false;
-				break;
 			}
+		}
+		lastPoll = frameStart;
 
-			// If "Display wait" option is enabled, we must draw only one sprite per frame
-			if (isDisplayWaitEnabled() && _cpu.drawThisFrame())
+		// Save and load trigger once per key press
+		bool isSavePressed = inputQueue.isHotkeyPressed(InputSource::Hotkey::SaveState);
+		bool isLoadPressed = canGoBack && inputQueue.isHotkeyPressed(InputSource::Hotkey::LoadState);
+		if (isSavePressed && !wasSavePressed)
+		{
+			if (saveStateToFile(statePath()))
 			{
-				break;
+				std::cout << "[STATE] Saved to '" << statePath() << "'" << std::endl;
 			}
 		}
+		if (isLoadPressed && !wasLoadPressed)
+		{
+			if (loadStateFromFile(statePath()))
+			{
+				std::cout << "[STATE] Loaded from '" << statePath() << "'" << std::endl;
+			}
+		}
+		wasSavePressed = isSavePressed;
+		wasLoadPressed = isLoadPressed;
 
-		// Wait to reach 60fps
-		sf::sleep(sf::seconds(std::max(frameDuration - frameTimer.getElapsedTime().asSeconds(), 0.f)));
+		// Fast forward is toggled
+		bool isFastForwardPressed = inputQueue.isHotkeyPressed(InputSource::Hotkey::FastForward);
+		if (isFastForwardPressed && !wasFastForwardPressed)
+		{
+			_isFastForward = !_isFastForward;
+		}
+		wasFastForwardPressed = isFastForwardPressed;
 
-		// Draw only when needed
-		if (_cpu.drawThisFrame())
+		if (_profiler != nullptr)
 		{
-			_display.display();
-			_cpu.setDrawThisFrame(false);
+			_profiler->addPhaseTime(Profiler::Phase::Cpu, Clock::now() - frameStart);
+			if (Profiler::takeReportRequest() && _profiler->writeReport(_profileReportPath))
+			{
+				std::cout << "[PROFILE] Report written to '" << _profileReportPath << "'" << std::endl;
+			}
 		}
 
-		if (_audioEnabled)
+		if (_cpu.drawThisFrame())
 		{
-			// Play audio before we update the timer
-			if (_cpu.isSoundTimerActive())
+			Chip8::PresentedFrame& frame = frames.back();
+			frame.framebuffer = _framebuffer;
+			frame.inputTime = _inputTime;
+			frame.hasInput = _hasInputTime;
+			_hasInputTime = false;
+			if (!frames.publish())
 			{
-				_audio.playSound();
+				stats.droppedFrames++;
+				// The dropped frame is back, the next frame presents its key change instead
+				if (frames.back().hasInput)
+				{
+					_inputTime = frames.back().inputTime;
+					_hasInputTime = true;
+				}
 			}
-			else
+		}
+		stats.emulatedFrames++;
+		stats.cyclesPerFrame = _cyclesPerFrame;
+
+		// Wait for the next 60Hz tick, the schedule is absolute so sleep jitter does not accumulate
+		// Fast forward shortens the tick, down to nothing when the speed is unlimited
+		size_t speed = _isFastForward ? _fastForwardSpeed : 1;
+		nextFrame += speed > 0 ? frameDuration / static_cast<Clock::rep>(speed) : Clock::duration::zero();
+		Clock::time_point now = Clock::now();
+		if (now - nextFrame > maxLateness)
+		{
+			nextFrame = now;
+		}
+		std::this_thread::sleep_until(nextFrame);
+		if (_profiler != nullptr)
+		{
+			_profiler->addPhaseTime(Profiler::Phase::Sleep, Clock::now() - now);
+		}
+	}
+}
+
+bool Chip8::runFrame(InputSource* inputSource)
+{
+	bool isRunning = true;
+
+	// The debugger stopped the CPU in the middle of the previous frame, which goes on from there
+	size_t executed = 0;
+	if (_isFrameSuspended)
+	{
+		executed = _suspendedCycles;
+		_isFrameSuspended = false;
+	}
+	else
+	{
+		// Without source, the keys are the ones of the last change applied until the next change is due
+		if (inputSource != nullptr)
+		{
+			_input.tick(inputSource);
+		}
+		else
+		{
+			_input.tick(_appliedKeys);
+		}
+		if (_inputLog != nullptr)
+		{
+			_inputLog->record(_frameCount, _input.keyMask());
+		}
+		_frameCount++;
+		if (_profiler != nullptr)
+		{
+			_profiler->countFrame();
+		}
+		if (_traceRecorder != nullptr)
+		{
+			_traceRecorder->beginFrame();
+		}
+
+		_cpu.setDrawThisFrame(false);
+	}
+	size_t resumedCycles = executed;
+
+	std::chrono::steady_clock::time_point frameStart;
+	if (_cpuBudget > 0.0)
+	{
+		frameStart = std::chrono::steady_clock::now();
+	}
+
+	// If "Display wait" option is enabled, the CPU stops after the first sprite drawn
+	// A key change splits the frame, the CPU runs up to the cycle of the change then takes the new keys
+	size_t changeCount = 0;
+	while (true)
+	{
+		for (; changeCount < _keyChanges.size() && _keyChanges[changeCount].cycle <= executed; changeCount++)
+		{
+			const Chip8::KeyChange& change = _keyChanges[changeCount];
+			_input.setKeys(change.keys);
+			_appliedKeys = change.keys;
+			if (!_hasInputTime)
 			{
-				_audio.stopSound();
+				_inputTime = change.time;
+				_hasInputTime = true;
 			}
 		}
 
-		// Update timer once per frame
-		_cpu.updateTimers();
+		size_t end = changeCount < _keyChanges.size() ? std::min(_keyChanges[changeCount].cycle, _cyclesPerFrame) : _cyclesPerFrame;
+		size_t runExecuted = 0;
+		bool hasRun = _cpu.run(end - executed, runExecuted);
+		executed += runExecuted;
+		if (!hasRun)
+		{
+			// An error occured, stop execution
+			isRunning = false;
+			break;
+		}
+		if (executed >= _cyclesPerFrame || (_cpu.drawThisFrame() && _quirks.displayWait))
+		{
+			break;
+		}
+		if (_debugger != nullptr && _debugger->isStopped())
+		{
+			_isFrameSuspended = true;
+			_suspendedCycles = executed;
+			break;
+		}
+	}
+	_instructionCount += executed - resumedCycles;
 
-		// Compute fps
-		if (clock.getElapsedTime().asSeconds() >= 1.f)
+	_keyChanges.erase(_keyChanges.begin(), _keyChanges.begin() + changeCount);
+	if (_isFrameSuspended)
+	{
+		// Timers, sound, rewind and the changes left wait for the end of the frame
+		return isRunning;
+	}
+	// Changes due after the CPU stopped are the first ones of the next frame
+	for (Chip8::KeyChange& change : _keyChanges)
+	{
+		change.cycle = 0;
+	}
+
+	if (_cpuBudget > 0.0)
+	{
+		adaptCyclesPerFrame(std::chrono::duration<double>(std::chrono::steady_clock::now() - frameStart).count());
+	}
+
+	if (_audioEnabled && _audioSink != nullptr)
+	{
+		// Sound state before we update the timer
+		_audioSink->update(_cpu.soundState());
+	}
+	if (_videoCapture != nullptr)
+	{
+		_videoCapture->capture(_framebuffer);
+	}
+	if (_spectatorServer != nullptr)
+	{
+		_spectatorServer->publish(_framebuffer);
+	}
+	if (_sharedStateWriter != nullptr)
+	{
+		_sharedStateWriter->publish(_framebuffer, _cpu);
+	}
+
+	// Update timer once per frame
+	_cpu.updateTimers();
+
+	if (_rewindEnabled)
+	{
+		saveState(_stateBuffer);
+		_rewind.capture(_stateBuffer);
+	}
+
+	return isRunning;
+}
+
+void Chip8::queueKeyChanges(const InputQueue& inputQueue, std::chrono::steady_clock::time_point windowStart, std::chrono::steady_clock::time_point windowEnd)
+{
+	// The frame stands for the time between two polls, a change is due at the same fraction of the cycles
+	// Earlier changes are due at the start and later ones, received while polling, at the start of the next frame
+	double windowSeconds = std::chrono::duration<double>(windowEnd - windowStart).count();
+	uint16_t keys = _keyChanges.empty() ? _appliedKeys : _keyChanges.back().keys;
+	for (const InputQueue::Snapshot& snapshot : inputQueue.snapshots())
+	{
+		// Hotkeys are not for the CPU
+		if (snapshot.keys == keys)
+		{
+			continue;
+		}
+		keys = snapshot.keys;
+
+		double fraction = windowSeconds > 0.0 ? std::chrono::duration<double>(snapshot.time - windowStart).count() / windowSeconds : 1.0;
+		fraction = std::min(std::max(fraction, 0.0), 1.0);
+		_keyChanges.push_back({ static_cast<size_t>(fraction * _cyclesPerFrame), snapshot.keys, snapshot.time });
+	}
+}
+
+void Chip8::setProfiler(Profiler* profiler, const std::string& reportPath)
+{
+	_profiler = profiler;
+	_profileReportPath = reportPath;
+	_cpu.setProfiler(profiler);
+}
+
+void Chip8::setDebugger(Debugger* debugger)
+{
+	_debugger = debugger;
+	_cpu.setDebugger(debugger);
+	_memory.setDebugger(debugger);
+}
+
+void Chip8::setTraceRecorder(TraceRecorder* traceRecorder)
+{
+	_traceRecorder = traceRecorder;
+	_cpu.setTraceRecorder(traceRecorder);
+	_memory.setTraceRecorder(traceRecorder);
+}
+
+void Chip8::setCpuBudget(double budget, size_t minCycles, size_t maxCycles)
+{
+	_cpuBudget = budget;
+	_minCyclesPerFrame = std::max<size_t>(1, minCycles);
+	_maxCyclesPerFrame = std::max(_minCyclesPerFrame, maxCycles);
+	_cyclesPerFrame = std::min(std::max(_cyclesPerFrame, _minCyclesPerFrame), _maxCyclesPerFrame);
+	_frameSeconds = 0.0;
+}
+
+void Chip8::adaptCyclesPerFrame(double frameSeconds)
+{
+	// Smoothed over a few frames so a single slow frame (page fault, preemption) does not count
+	_frameSeconds = _frameSeconds > 0.0 ? _frameSeconds * 0.9 + frameSeconds * 0.1 : frameSeconds;
+
+	// Backs off quickly when over budget and comes back slowly, to avoid oscillating around the budget
+	double budgetSeconds = _cpuBudget / 60.0;
+	if (_frameSeconds > budgetSeconds)
+	{
+		_cyclesPerFrame = std::max(_minCyclesPerFrame, _cyclesPerFrame - std::max<size_t>(1, _cyclesPerFrame / 8));
+	}
+	else if (_frameSeconds < budgetSeconds * 0.75)
+	{
+		_cyclesPerFrame = std::min(_maxCyclesPerFrame, _cyclesPerFrame + std::max<size_t>(1, _cyclesPerFrame / 32));
+	}
+}
+
+void Chip8::saveState(std::vector<uint8_t>& data) const
+{
+	data.clear();
+	StateWriter writer(data);
+	writer.writeBytes(STATE_MAGIC, sizeof(STATE_MAGIC));
+	writer.write16(Chip8::STATE_VERSION);
+	writer.write8(static_cast<uint8_t>(_platform));
+	_framebuffer.saveState(writer);
+	_memory.saveState(writer);
+	_cpu.saveState(writer);
+	_input.saveState(writer);
+}
+
+bool Chip8::loadState(const uint8_t* data, size_t size)
+{
+	StateReader reader(data, size);
+	uint8_t magic[sizeof(STATE_MAGIC)];
+	reader.readBytes(magic, sizeof(magic));
+	if (!reader.isValid() || !std::equal(magic, magic + sizeof(magic), STATE_MAGIC))
+	{
+		std::cout << "[ERROR] Not a save state" << std::endl;
+		return false;
+	}
+	uint16_t version = reader.read16();
+	if (version != Chip8::STATE_VERSION)
+	{
+		std::cout << "[ERROR] Unsupported save state version " << std::dec << version << std::endl;
+		return false;
+	}
+	if (reader.read8() != _platform)
+	{
+		std::cout << "[ERROR] Save state platform does not match" << std::endl;
+		return false;
+	}
+
+	// The resolution changes with the hi-res mode, the expected size follows the one stored in the state
+	size_t framebufferOffset = sizeof(STATE_MAGIC) + 2 + 1;
+	if (size < framebufferOffset + 3 || size != stateSize(data[framebufferOffset], data[framebufferOffset + 1], data[framebufferOffset + 2]))
+	{
+		std::cout << "[ERROR] Save state is truncated" << std::endl;
+		return false;
+	}
+
+	// Past the size check every read succeeds, nothing is applied when the resolution is not a valid one
+	if (!_framebuffer.loadState(reader))
+	{
+		std::cout << "[ERROR] Save state resolution is not valid" << std::endl;
+		return false;
+	}
+	_memory.loadState(reader);
+	_cpu.loadState(reader);
+	_input.loadState(reader);
+	// States are taken between frames
+	_isFrameSuspended = false;
+	_cpu.setDrawThisFrame(true);
+	return true;
+}
+
+bool Chip8::saveStateToFile(const std::string& path) const
+{
+	std::vector<uint8_t> data;
+	saveState(data);
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file.write(reinterpret_cast<const char*>(data.data()), data.size()))
+	{
+		std::cout << "[ERROR] Cannot write the save state '" << path << "'" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool Chip8::loadStateFromFile(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+	{
+		std::cout << "[ERROR] Cannot open the save state '" << path << "'" << std::endl;
+		return false;
+	}
+
+	std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	return loadState(data.data(), data.size());
+}
+
+bool Chip8::saveState(MachineState& state) const
+{
+	if (_memory.size() != MachineState::MEMORY_SIZE || !_framebuffer.saveState(state))
+	{
+		std::cout << "[ERROR] The machine does not fit a MachineState" << std::endl;
+		return false;
+	}
+
+	_memory.saveState(state);
+	_cpu.saveState(state);
+	_input.saveState(state);
+	return true;
+}
+
+bool Chip8::loadState(const MachineState& state)
+{
+	if (_memory.size() != MachineState::MEMORY_SIZE || !_framebuffer.loadState(state))
+	{
+		std::cout << "[ERROR] The MachineState does not fit the machine" << std::endl;
+		return false;
+	}
+
+	_memory.loadState(state);
+	_cpu.loadState(state);
+	_input.loadState(state);
+	_isFrameSuspended = false;
+	_cpu.setDrawThisFrame(true);
+	return true;
+}
+
+bool Chip8::step(MachineState& state, uint16_t keys, size_t frames)
+{
+	// The pc is past the instruction that stopped the machine, running the state again would go on after it
+	if (state.halted != 0)
+	{
+		return false;
+	}
+	if (!loadState(state))
+	{
+		return false;
+	}
+
+	// Held as if it was the last key change received
+	_appliedKeys = keys;
+	bool isRunning = true;
+	for (size_t i = 0; i < frames && isRunning; i++)
+	{
+		isRunning = runFrame(nullptr);
+	}
+	_appliedKeys = 0;
+
+	// Only the memory written by the frames differs from the state
+	_memory.saveWrites(state);
+	_framebuffer.saveState(state);
+	_cpu.saveState(state);
+	_input.saveState(state);
+	return isRunning;
+}
+
+size_t Chip8::step(MachineState* states, const uint16_t* keys, size_t count, size_t frames)
+{
+	size_t runningCount = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (step(states[i], keys[i], frames))
 		{
-			std::cout << std::dec << "[FPS] " << frames << std::endl;
-			frames = 0;
-			clock.restart();
+			runningCount++;
 		}
-		frames++;
 	}
+	return runningCount;
+}
+
+void Chip8::setRewindEnabled(bool rewindEnabled)
+{
+	_rewindEnabled = rewindEnabled;
+	_rewind.clear();
+}
+
+bool Chip8::rewindFrame()
+{
+	if (!_rewind.rewind(_rewindBuffer))
+	{
+		return false;
+	}
+	// The newest capture is the frame on screen, going back to it would change nothing
+	if (_rewindBuffer == _stateBuffer && !_rewind.rewind(_rewindBuffer))
+	{
+		return false;
+	}
+	_stateBuffer.swap(_rewindBuffer);
+	return loadState(_stateBuffer.data(), _stateBuffer.size());
+}
+
+size_t Chip8::stateSize(uint8_t width, uint8_t height, uint8_t planeCount) const
+{
+	// Magic, version, platform, framebuffer, memory, cpu and keys
+	return sizeof(STATE_MAGIC) + 2 + 1
+		+ Framebuffer::stateSize(width, height, planeCount)
+		+ _memory.size()
+		+ CPU::stateSize()
+		+ Input::INPUT_COUNT;
 }
 
 void Chip8::loadFont()
@@ -115,6 +718,31 @@ void Chip8::loadFont()
 	};
 
 	_memory.copyBuffer(Chip8::FONT_START_ADDRESS, &fontData[0], fontData.size());
+
+	if (_platform != Platform::Type::CosmacVip)
+	{
+		std::vector<uint8_t> bigFontData =
+		{
+			0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+			0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+			0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+			0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+			0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+			0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+			0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+			0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+			0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+			0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+			0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+			0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+			0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+			0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+			0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+			0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+		};
+
+		_memory.copyBuffer(Chip8::BIG_FONT_START_ADDRESS, &bigFontData[0], bigFontData.size());
+	}
 }
 
 bool Chip8::loadRom(const std::string& path)
@@ -132,13 +760,25 @@ bool Chip8::loadRom(const std::string& path)
 			std::vector<std::uint8_t> buffer(length);
 			file.read(reinterpret_cast<char*>(buffer.data()), length);
 
-			_memory.copyBuffer(Chip8::ROM_START_ADDR, &buffer[0], length);
-
 			file.close();
-	
-			return true;
+
+			_romPath = path;
+			return loadRom(&buffer[0], buffer.size());
 		}
 	}
 
 	return false;
 }
+
+bool Chip8::loadRom(const uint8_t* data, size_t size)
+{
+	if (size == 0 || size > _memory.size() - Chip8::ROM_START_ADDR)
+	{
+		return false;
+	}
+
+	_memory.copyBuffer(Chip8::ROM_START_ADDR, data, size);
+	_rewind.clear();
+	_frameCount = 0;
+	return true;
+}
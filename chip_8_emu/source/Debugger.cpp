@@ -0,0 +1,133 @@
+#include "Debugger.hpp"
+#include "Chip8.hpp"
+#include "Memory.hpp"
+#include <algorithm>
+
+Debugger::Debugger(Chip8& emulator) :
+	_emulator(emulator),
+	_breakpoints(Memory::MAX_MEMORY_SIZE, 0),
+	_stopReason(Debugger::StopReason::None),
+	_watchAddress(0),
+	_watchKind(Debugger::WatchKind::Access),
+	_isStepping(false),
+	_isResuming(false),
+	_isInterruptRequested(false)
+{
+}
+
+void Debugger::addBreakpoint(uint16_t addr)
+{
+	_breakpoints[addr] = 1;
+}
+
+void Debugger::removeBreakpoint(uint16_t addr)
+{
+	_breakpoints[addr] = 0;
+}
+
+void Debugger::addWatchpoint(uint16_t addr, size_t size, Debugger::WatchKind kind)
+{
+	_watches.push_back({ addr, size, kind });
+	_emulator.memory().addWatch(addr, size, kind != Debugger::WatchKind::Write, kind != Debugger::WatchKind::Read);
+}
+
+void Debugger::removeWatchpoint(uint16_t addr, size_t size, Debugger::WatchKind kind)
+{
+	std::vector<Debugger::Watch>::iterator it = std::find_if(_watches.begin(), _watches.end(), [&](const Debugger::Watch& watch)
+	{
+		return watch.addr == addr && watch.size == size && watch.kind == kind;
+	});
+	if (it != _watches.end())
+	{
+		_watches.erase(it);
+		// Watches may overlap, the marks of the remaining ones are set again
+		markWatches();
+	}
+}
+
+void Debugger::clear()
+{
+	std::fill(_breakpoints.begin(), _breakpoints.end(), 0);
+	_watches.clear();
+	markWatches();
+}
+
+void Debugger::resume()
+{
+	_stopReason = Debugger::StopReason::None;
+	_isStepping = false;
+	_isResuming = true;
+}
+
+void Debugger::step()
+{
+	resume();
+	_isStepping = true;
+}
+
+void Debugger::stop(Debugger::StopReason reason)
+{
+	if (_stopReason == Debugger::StopReason::None)
+	{
+		_stopReason = reason;
+	}
+}
+
+bool Debugger::shouldStop(uint16_t pc)
+{
+	if (_isInterruptRequested.load(std::memory_order_relaxed))
+	{
+		_isInterruptRequested = false;
+		stop(Debugger::StopReason::Interrupt);
+	}
+
+	bool isResuming = _isResuming;
+	_isResuming = false;
+	if (!isResuming && _breakpoints[pc] != 0)
+	{
+		stop(Debugger::StopReason::Breakpoint);
+	}
+	return isStopped();
+}
+
+void Debugger::endInstruction()
+{
+	if (_isStepping)
+	{
+		_isStepping = false;
+		stop(Debugger::StopReason::Step);
+	}
+}
+
+void Debugger::hitWatchpoint(uint16_t addr, bool isWrite)
+{
+	if (isStopped())
+	{
+		return;
+	}
+
+	// The first watch covering the byte for this access gives the kind reported
+	uint16_t addressMask = _emulator.memory().addressMask();
+	for (const Debugger::Watch& watch : _watches)
+	{
+		bool isCovered = ((addr - watch.addr) & addressMask) < watch.size;
+		bool isKind = watch.kind == Debugger::WatchKind::Access || (watch.kind == Debugger::WatchKind::Write) == isWrite;
+		if (isCovered && isKind)
+		{
+			_watchAddress = addr;
+			_watchKind = watch.kind;
+			stop(Debugger::StopReason::Watchpoint);
+			return;
+		}
+	}
+}
+
+void Debugger::markWatches()
+{
+	Memory& memory = _emulator.memory();
+	memory.clearWatches();
+	for (const Debugger::Watch& watch : _watches)
+	{
+		memory.addWatch(watch.addr, watch.size, watch.kind != Debugger::WatchKind::Write, watch.kind != Debugger::WatchKind::Read);
+	}
+}
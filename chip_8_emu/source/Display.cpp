@@ -1,62 +1,84 @@
 #include "Display.hpp"
+#include "Framebuffer.hpp"
+#include <algorithm>
+
+static const uint8_t BYTES_PER_TEXEL = 4;
 
 Display::Display(uint8_t width, uint8_t height, uint8_t pixelSize, const std::string& title) :
 	_window(sf::VideoMode(width * pixelSize, height * pixelSize), title),
+	_isShaderLoaded(false),
+	_planeCount(1),
 	_width(width),
 	_height(height),
 	_pixelSize(pixelSize),
-	_pixelColorOff(sf::Color::Black),
-	_pixelColorOn(sf::Color::White)
+	_palette{ sf::Color::Black, sf::Color::White, sf::Color(128, 128, 128), sf::Color(64, 64, 64) }
 {
-	_vertices.setPrimitiveType(sf::PrimitiveType::Quads);
-	_vertices.resize(_width * _height * 4);
-
-	for (uint8_t x = 0; x < _width; x++)
+	// Scaling and scanlines are done on the GPU, the emulation cost does not depend on the window size
+	const std::string cheapCrtFragmentShader = \
+		"#version 130\n" \
+		"uniform sampler2D texture;\n" \
+		"uniform float amount = 0.1;\n" \
+		"uniform float thickness = 2.0;\n" \
+		"uniform float spacing = 1.0;\n" \
+		"void main()\n" \
+		"{\n" \
+		"	vec4 pixel = texture2D(texture, gl_TexCoord[0].xy) * gl_Color;\n" \
+		"	if (mod(gl_FragCoord.y, round(thickness + spacing)) < round(spacing))\n" \
+		"		pixel = vec4(pixel.rgb * (1.0 - amount), pixel.a);\n" \
+		"	gl_FragColor = pixel;\n" \
+		"}\n" \
+		;
+	_isShaderLoaded = sf::Shader::isAvailable() && _shader.loadFromMemory(cheapCrtFragmentShader, sf::Shader::Fragment);
+	if (_isShaderLoaded)
 	{
-		for (uint8_t y = 0; y < _height; y++)
-		{
-			sf::Vertex* quad = &_vertices[(x + y * _width) * 4];
-			quad[0].position = sf::Vector2f(static_cast<float>(x * _pixelSize), static_cast<float>(y * _pixelSize));
-			quad[1].position = sf::Vector2f(static_cast<float>((x + 1) * _pixelSize), static_cast<float>(y * _pixelSize));
-			quad[2].position = sf::Vector2f(static_cast<float>((x + 1) * _pixelSize), static_cast<float>((y + 1) * _pixelSize));
-			quad[3].position = sf::Vector2f(static_cast<float>(x * _pixelSize), static_cast<float>((y + 1) * _pixelSize));
-
-			quad[0].color = _pixelColorOff;
-			quad[1].color = _pixelColorOff;
-			quad[2].color = _pixelColorOff;
-			quad[3].color = _pixelColorOff;
-		}
+		_shader.setUniform("texture", sf::Shader::CurrentTexture);
 	}
 
-	const std::string cheapCrtFragmentShader = \
-		"#version 130" \
-		"uniform float amount = 0.1;" \
-		"uniform float thickness = 2.0;" \
-		"uniform float spacing = 1.0;" \
-		"void main()" \
-		"{" \
-		"	vec4 pixel = gl_Color;" \
-		"	if (mod(gl_FragCoord.y, round(thickness + spacing)) < round(spacing))" \
-		"		pixel = vec4(pixel.rgb * (1.0 - amount), pixel.a);" \
-		"	gl_FragColor = pixel;" \
-		"}" \
-		;
-	_shader.loadFromMemory(cheapCrtFragmentShader, sf::Shader::Fragment);
+	resize(width, height, 1);
 }
 
-void Display::display()
+void Display::present(const Framebuffer& framebuffer)
 {
-	_window.draw(_vertices, &_shader);
-	_window.display();
-}
+	if (framebuffer.width() != _texture.getSize().x || framebuffer.height() != _texture.getSize().y || framebuffer.planeCount() != _planeCount)
+	{
+		resize(framebuffer.width(), framebuffer.height(), framebuffer.planeCount());
+	}
 
-void Display::clear()
-{
-	for (uint16_t i = 0; i < _width * _height * 4; i++)
+	// Rows are compared with what was last uploaded and the changed ones are sent as a single rectangle
+	size_t wordsPerRow = framebuffer.wordsPerRow();
+	int32_t firstDirtyRow = -1;
+	int32_t lastDirtyRow = -1;
+	for (uint8_t y = 0; y < framebuffer.height(); y++)
+	{
+		bool isDirty = false;
+		for (uint8_t plane = 0; plane < _planeCount; plane++)
+		{
+			const uint64_t* row = framebuffer.row(y, plane);
+			uint64_t* presentedRow = &_presentedRows[(plane * framebuffer.height() + y) * wordsPerRow];
+			if (!std::equal(row, row + wordsPerRow, presentedRow))
+			{
+				std::copy(row, row + wordsPerRow, presentedRow);
+				isDirty = true;
+			}
+		}
+
+		if (isDirty)
+		{
+			unpackRow(framebuffer, y);
+			firstDirtyRow = firstDirtyRow < 0 ? y : firstDirtyRow;
+			lastDirtyRow = y;
+		}
+	}
+
+	if (firstDirtyRow >= 0)
 	{
-		_vertices[i].color = _pixelColorOff;
+		size_t offset = firstDirtyRow * framebuffer.width() * BYTES_PER_TEXEL;
+		_texture.update(&_pixels[offset], framebuffer.width(), lastDirtyRow - firstDirtyRow + 1, 0, firstDirtyRow);
 	}
+
 	_window.clear();
+	_window.draw(_sprite, _isShaderLoaded ? &_shader : nullptr);
+	_window.display();
 }
 
 void Display::close()
@@ -78,30 +100,65 @@ void Display::pollEvent()
 		{
 			close();
 		}
+		else if (_eventHandler)
+		{
+			_eventHandler(event);
+		}
 	}
 }
 
-bool Display::isPixelOn(uint8_t x, uint8_t y) const
+void Display::setPixelColorOff(sf::Color color)
 {
-	return getPixel(x, y) == _pixelColorOn;
+	setPixelColor(0, color);
 }
 
-void Display::putPixel(uint8_t x, uint8_t y, bool isOn)
+void Display::setPixelColorOn(sf::Color color)
 {
-	putPixel(x, y, isOn ? _pixelColorOn : _pixelColorOff);
+	setPixelColor(1, color);
 }
 
-sf::Color Display::getPixel(uint8_t x, uint8_t y) const
+void Display::setPixelColor(uint8_t index, sf::Color color)
 {
-	return _vertices[(x + y * _width) * 4].color;
+	_palette[index & 0x03] = color;
+	resize(static_cast<uint8_t>(_texture.getSize().x), static_cast<uint8_t>(_texture.getSize().y), _planeCount);
 }
 
-void Display::putPixel(uint8_t x, uint8_t y, sf::Color color)
+void Display::resize(uint8_t width, uint8_t height, uint8_t planeCount)
 {
-	sf::Vertex* quad = &_vertices[(x + y * _width) * 4];
+	_texture.create(width, height);
+	_texture.setSmooth(false);
+	_sprite.setTexture(_texture, true);
+	_sprite.setScale(static_cast<float>(_width * _pixelSize) / width, static_cast<float>(_height * _pixelSize) / height);
 
-	quad[0].color = color;
-	quad[1].color = color;
-	quad[2].color = color;
-	quad[3].color = color;
+	// Every texel is reset to off and the rows are forgotten, so the next present uploads all of them
+	_pixels.resize(width * height * BYTES_PER_TEXEL);
+	for (size_t i = 0; i < _pixels.size(); i += BYTES_PER_TEXEL)
+	{
+		_pixels[i] = _palette[0].r;
+		_pixels[i + 1] = _palette[0].g;
+		_pixels[i + 2] = _palette[0].b;
+		_pixels[i + 3] = _palette[0].a;
+	}
+	_texture.update(_pixels.data());
+	_planeCount = planeCount;
+	_presentedRows.assign(planeCount * height * ((width + Framebuffer::WORD_BITS - 1) / Framebuffer::WORD_BITS), 0);
+}
+
+void Display::unpackRow(const Framebuffer& framebuffer, uint8_t y)
+{
+	sf::Uint8* texel = &_pixels[y * framebuffer.width() * BYTES_PER_TEXEL];
+	for (uint8_t x = 0; x < framebuffer.width(); x++, texel += BYTES_PER_TEXEL)
+	{
+		uint8_t index = 0;
+		for (uint8_t plane = 0; plane < _planeCount; plane++)
+		{
+			const uint64_t* row = framebuffer.row(y, plane);
+			index |= ((row[x / Framebuffer::WORD_BITS] >> (Framebuffer::WORD_BITS - 1 - x % Framebuffer::WORD_BITS)) & 1) << plane;
+		}
+		const sf::Color& color = _palette[index];
+		texel[0] = color.r;
+		texel[1] = color.g;
+		texel[2] = color.b;
+		texel[3] = color.a;
+	}
 }
@@ -0,0 +1,266 @@
+#include "Framebuffer.hpp"
+#include "MachineState.hpp"
+#include "State.hpp"
+#include <algorithm>
+#include <iterator>
+
+// Shifts bits aligned on the most significant bit of a word to the given pixel offset inside that word
+static uint64_t placeBits(uint64_t alignedBits, int offset)
+{
+	if (offset >= Framebuffer::WORD_BITS || offset <= -Framebuffer::WORD_BITS)
+	{
+		return 0;
+	}
+	return offset >= 0 ? alignedBits >> offset : alignedBits << -offset;
+}
+
+Framebuffer::Framebuffer(uint8_t width, uint8_t height, uint8_t planeCount)
+{
+	resize(width, height, planeCount);
+}
+
+void Framebuffer::resize(uint8_t width, uint8_t height, uint8_t planeCount)
+{
+	_width = width;
+	_height = height;
+	_planeCount = planeCount;
+	_wordsPerRow = (width + Framebuffer::WORD_BITS - 1) / Framebuffer::WORD_BITS;
+	uint8_t paddingBits = static_cast<uint8_t>(_wordsPerRow * Framebuffer::WORD_BITS - width);
+	_lastWordMask = ~uint64_t(0) << paddingBits;
+	_rows.assign(_wordsPerRow * height * planeCount, 0);
+}
+
+void Framebuffer::clear(uint8_t planeMask)
+{
+	size_t planeWords = _wordsPerRow * _height;
+	for (uint8_t plane = 0; plane < _planeCount; plane++)
+	{
+		if (planeMask & (1 << plane))
+		{
+			std::fill_n(_rows.begin() + plane * planeWords, planeWords, 0);
+		}
+	}
+}
+
+bool Framebuffer::isPixelOn(uint8_t x, uint8_t y, uint8_t plane) const
+{
+	return (row(y, plane)[x / Framebuffer::WORD_BITS] >> (Framebuffer::WORD_BITS - 1 - x % Framebuffer::WORD_BITS)) & 1;
+}
+
+void Framebuffer::putPixel(uint8_t x, uint8_t y, bool isOn, uint8_t plane)
+{
+	uint64_t& word = planeRow(y, plane)[x / Framebuffer::WORD_BITS];
+	uint64_t bit = uint64_t(1) << (Framebuffer::WORD_BITS - 1 - x % Framebuffer::WORD_BITS);
+	word = isOn ? word | bit : word & ~bit;
+}
+
+bool Framebuffer::xorRow(uint8_t x, uint8_t y, uint32_t sprite, uint8_t bitCount, bool clipping, uint8_t plane)
+{
+	// A sprite starting off screen is wrapped, so clipping only applies when it starts on screen
+	bool isClipped = clipping && x < _width;
+	int startX = x % _width;
+	uint64_t alignedBits = uint64_t(sprite) << (Framebuffer::WORD_BITS - bitCount);
+	uint64_t* row = planeRow(y, plane);
+	bool isColliding = false;
+
+	for (size_t i = 0; i < _wordsPerRow; i++)
+	{
+		int wordX = static_cast<int>(i) * Framebuffer::WORD_BITS;
+		uint64_t bits = placeBits(alignedBits, startX - wordX);
+		if (!isClipped)
+		{
+			// Pixels past the right edge come back on the left
+			bits |= placeBits(alignedBits, startX - _width - wordX);
+		}
+
+		isColliding |= (row[i] & bits) != 0;
+		row[i] ^= bits;
+	}
+	return isColliding;
+}
+
+void Framebuffer::scrollDown(uint8_t count, uint8_t planeMask)
+{
+	count = std::min(count, _height);
+	for (uint8_t plane = 0; plane < _planeCount; plane++)
+	{
+		if (planeMask & (1 << plane))
+		{
+			uint64_t* rows = planeRow(0, plane);
+			std::copy_backward(rows, rows + (_height - count) * _wordsPerRow, rows + _height * _wordsPerRow);
+			std::fill_n(rows, count * _wordsPerRow, 0);
+		}
+	}
+}
+
+void Framebuffer::scrollUp(uint8_t count, uint8_t planeMask)
+{
+	count = std::min(count, _height);
+	for (uint8_t plane = 0; plane < _planeCount; plane++)
+	{
+		if (planeMask & (1 << plane))
+		{
+			uint64_t* rows = planeRow(0, plane);
+			std::copy(rows + count * _wordsPerRow, rows + _height * _wordsPerRow, rows);
+			std::fill_n(rows + (_height - count) * _wordsPerRow, count * _wordsPerRow, 0);
+		}
+	}
+}
+
+void Framebuffer::scrollRight(uint8_t count, uint8_t planeMask)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	if (count >= Framebuffer::WORD_BITS || count >= _width)
+	{
+		clear(planeMask);
+		return;
+	}
+
+	for (uint8_t plane = 0; plane < _planeCount; plane++)
+	{
+		if (planeMask & (1 << plane))
+		{
+			// Each word takes the low bits of the word on its left, from the right so they are read before being shifted
+			uint64_t* row = planeRow(0, plane);
+			for (size_t y = 0; y < _height; y++, row += _wordsPerRow)
+			{
+				for (size_t i = _wordsPerRow - 1; i > 0; i--)
+				{
+					row[i] = (row[i] >> count) | (row[i - 1] << (Framebuffer::WORD_BITS - count));
+				}
+				row[0] >>= count;
+			}
+			clearPadding(plane);
+		}
+	}
+}
+
+void Framebuffer::scrollLeft(uint8_t count, uint8_t planeMask)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	if (count >= Framebuffer::WORD_BITS || count >= _width)
+	{
+		clear(planeMask);
+		return;
+	}
+
+	for (uint8_t plane = 0; plane < _planeCount; plane++)
+	{
+		if (planeMask & (1 << plane))
+		{
+			// The padding is always clear, so zeros come in past the right edge
+			uint64_t* row = planeRow(0, plane);
+			for (size_t y = 0; y < _height; y++, row += _wordsPerRow)
+			{
+				for (size_t i = 0; i + 1 < _wordsPerRow; i++)
+				{
+					row[i] = (row[i] << count) | (row[i + 1] >> (Framebuffer::WORD_BITS - count));
+				}
+				row[_wordsPerRow - 1] <<= count;
+			}
+		}
+	}
+}
+
+void Framebuffer::clearPadding(uint8_t plane)
+{
+	uint64_t* row = planeRow(0, plane);
+	for (size_t y = 0; y < _height; y++, row += _wordsPerRow)
+	{
+		row[_wordsPerRow - 1] &= _lastWordMask;
+	}
+}
+
+uint64_t Framebuffer::hash() const
+{
+	uint64_t hash = 0xCBF29CE484222325;
+	for (uint8_t size : { _width, _height })
+	{
+		hash ^= size;
+		hash *= 0x100000001B3;
+	}
+	for (uint64_t word : _rows)
+	{
+		for (uint8_t i = 0; i < sizeof(word); i++)
+		{
+			hash ^= (word >> (i * 8)) & 0xFF;
+			hash *= 0x100000001B3;
+		}
+	}
+	return hash;
+}
+
+void Framebuffer::saveState(StateWriter& writer) const
+{
+	writer.write8(_width);
+	writer.write8(_height);
+	writer.write8(_planeCount);
+	for (uint64_t word : _rows)
+	{
+		writer.write64(word);
+	}
+}
+
+bool Framebuffer::loadState(StateReader& reader)
+{
+	uint8_t width = reader.read8();
+	uint8_t height = reader.read8();
+	uint8_t planeCount = reader.read8();
+	if (width == 0 || height == 0 || planeCount == 0 || planeCount > Framebuffer::MAX_PLANES)
+	{
+		return false;
+	}
+
+	if (width != _width || height != _height || planeCount != _planeCount)
+	{
+		resize(width, height, planeCount);
+	}
+	for (uint64_t& word : _rows)
+	{
+		word = reader.read64();
+	}
+	return true;
+}
+
+bool Framebuffer::saveState(MachineState& state) const
+{
+	if (_planeCount != 1 || _width > MachineState::MAX_WIDTH || _height > MachineState::MAX_HEIGHT)
+	{
+		return false;
+	}
+
+	state.width = _width;
+	state.height = _height;
+	// The words past the resolution are cleared, two identical machines give identical states
+	std::copy(_rows.begin(), _rows.end(), state.framebuffer);
+	std::fill(state.framebuffer + _rows.size(), std::end(state.framebuffer), 0);
+	return true;
+}
+
+bool Framebuffer::loadState(const MachineState& state)
+{
+	if (state.width == 0 || state.height == 0 || state.width > MachineState::MAX_WIDTH || state.height > MachineState::MAX_HEIGHT)
+	{
+		return false;
+	}
+
+	if (state.width != _width || state.height != _height || _planeCount != 1)
+	{
+		resize(state.width, state.height, 1);
+	}
+	std::copy(state.framebuffer, state.framebuffer + _rows.size(), _rows.begin());
+	return true;
+}
+
+size_t Framebuffer::stateSize(uint8_t width, uint8_t height, uint8_t planeCount)
+{
+	// Resolution, plane count and rows
+	size_t wordsPerRow = (width + Framebuffer::WORD_BITS - 1) / Framebuffer::WORD_BITS;
+	return 3 + planeCount * height * wordsPerRow * 8;
+}
@@ -0,0 +1,595 @@
+#include "GdbServer.hpp"
+#include "Chip8.hpp"
+#include "Debugger.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// Registers as in the target description, V0 to VF, I, pc, the stack size, the stack and the timers
+static const char TARGET_XML[] =
+	"<?xml version=\"1.0\"?>"
+	"<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+	"<target version=\"1.0\"><feature name=\"org.chip8.cpu\">"
+	"<reg name=\"v0\" bitsize=\"8\" regnum=\"0\"/><reg name=\"v1\" bitsize=\"8\"/><reg name=\"v2\" bitsize=\"8\"/>"
+	"<reg name=\"v3\" bitsize=\"8\"/><reg name=\"v4\" bitsize=\"8\"/><reg name=\"v5\" bitsize=\"8\"/>"
+	"<reg name=\"v6\" bitsize=\"8\"/><reg name=\"v7\" bitsize=\"8\"/><reg name=\"v8\" bitsize=\"8\"/>"
+	"<reg name=\"v9\" bitsize=\"8\"/><reg name=\"va\" bitsize=\"8\"/><reg name=\"vb\" bitsize=\"8\"/>"
+	"<reg name=\"vc\" bitsize=\"8\"/><reg name=\"vd\" bitsize=\"8\"/><reg name=\"ve\" bitsize=\"8\"/>"
+	"<reg name=\"vf\" bitsize=\"8\"/>"
+	"<reg name=\"i\" bitsize=\"16\" type=\"data_ptr\"/><reg name=\"pc\" bitsize=\"16\" type=\"code_ptr\"/>"
+	"<reg name=\"sp\" bitsize=\"8\"/>"
+	"<reg name=\"s0\" bitsize=\"16\" type=\"code_ptr\"/><reg name=\"s1\" bitsize=\"16\" type=\"code_ptr\"/>"
+	"<reg name=\"s2\" bitsize=\"16\" type=\"code_ptr\"/><reg name=\"s3\" bitsize=\"16\" type=\"code_ptr\"/>"
+	"<reg name=\"s4\" bitsize=\"16\" type=\"code_ptr\"/><reg name=\"s5\" bitsize=\"16\" type=\"code_ptr\"/>"
+	"<reg name=\"s6\" bitsize=\"16\" type=\"code_ptr\"/><reg name=\"s7\" bitsize=\"16\" type=\"code_ptr\"/>"
+	"<reg name=\"s8\" bitsize=\"16\" type=\"code_ptr\"/><reg name=\"s9\" bitsize=\"16\" type=\"code_ptr\"/>"
+	"<reg name=\"s10\" bitsize=\"16\" type=\"code_ptr\"/><reg name=\"s11\" bitsize=\"16\" type=\"code_ptr\"/>"
+	"<reg name=\"s12\" bitsize=\"16\" type=\"code_ptr\"/><reg name=\"s13\" bitsize=\"16\" type=\"code_ptr\"/>"
+	"<reg name=\"s14\" bitsize=\"16\" type=\"code_ptr\"/><reg name=\"s15\" bitsize=\"16\" type=\"code_ptr\"/>"
+	"<reg name=\"dt\" bitsize=\"8\"/><reg name=\"st\" bitsize=\"8\"/>"
+	"</feature></target>";
+
+static const char* HEX_DIGITS = "0123456789abcdef";
+
+static void appendHex(std::string& text, uint32_t value, size_t bytes)
+{
+	// Registers are sent in the byte order of the target, little endian
+	for (size_t i = 0; i < bytes; i++)
+	{
+		uint8_t byte = static_cast<uint8_t>(value >> (i * 8));
+		text += HEX_DIGITS[byte >> 4];
+		text += HEX_DIGITS[byte & 0x0F];
+	}
+}
+
+static uint32_t parseHex(const std::string& text, size_t& offset)
+{
+	uint32_t value = 0;
+	for (; offset < text.size() && isxdigit(static_cast<unsigned char>(text[offset])); offset++)
+	{
+		char digit = text[offset];
+		value = (value << 4) | static_cast<uint32_t>(digit <= '9' ? digit - '0' : (digit | 0x20) - 'a' + 10);
+	}
+	return value;
+}
+
+static uint32_t parseLittleEndian(const std::string& hex, size_t bytes)
+{
+	uint32_t value = 0;
+	for (size_t i = 0; i < bytes && 2 * i + 1 < hex.size(); i++)
+	{
+		size_t offset = 0;
+		value |= parseHex(hex.substr(2 * i, 2), offset) << (i * 8);
+	}
+	return value;
+}
+
+GdbServer::GdbServer(Chip8& emulator, Debugger& debugger) :
+	_emulator(emulator),
+	_debugger(debugger),
+	_listener(Socket::NO_SOCKET),
+	_client(Socket::NO_SOCKET),
+	_isRunning(false),
+	_isAckEnabled(true),
+	_inputBegin(0),
+	_inputEnd(0)
+{
+	memset(&_registers, 0, sizeof(_registers));
+}
+
+GdbServer::~GdbServer()
+{
+	disconnect();
+	if (_listener != Socket::NO_SOCKET)
+	{
+		Socket::close(_listener);
+	}
+}
+
+bool GdbServer::listen(uint16_t port)
+{
+	if (!Socket::startup())
+	{
+		std::cout << "[ERROR] Cannot start the sockets" << std::endl;
+		return false;
+	}
+
+	_listener = Socket::listen(port, 1);
+	if (_listener == Socket::NO_SOCKET)
+	{
+		std::cout << "[ERROR] Cannot listen on the port " << std::dec << port << std::endl;
+		return false;
+	}
+
+	std::cout << "[GDB] Waiting for a client on localhost:" << std::dec << port << std::endl;
+	_client = Socket::accept(_listener);
+	if (_client == Socket::NO_SOCKET)
+	{
+		std::cout << "[ERROR] Cannot accept the client" << std::endl;
+		return false;
+	}
+	// Packets are small and answered one by one
+	Socket::setNoDelay(_client);
+	std::cout << "[GDB] Client connected" << std::endl;
+
+	_isRunning = false;
+	_isAckEnabled = true;
+	_inputBegin = 0;
+	_inputEnd = 0;
+	_debugger.stop(Debugger::StopReason::Interrupt);
+	_emulator.setDebugger(&_debugger);
+	return true;
+}
+
+bool GdbServer::poll()
+{
+	if (!isConnected())
+	{
+		return true;
+	}
+
+	if (_isRunning)
+	{
+		if (!_debugger.isStopped())
+		{
+			// Only an interrupt is sent while the execution runs
+			char byte;
+			while (hasInput())
+			{
+				if (!readByte(byte))
+				{
+					disconnect();
+					return true;
+				}
+				if (byte == 0x03)
+				{
+					_debugger.interrupt();
+				}
+			}
+			return true;
+		}
+
+		_isRunning = false;
+		sendPacket(stopReply());
+		if (_debugger.stopReason() == Debugger::StopReason::Exit)
+		{
+			disconnect();
+			return false;
+		}
+	}
+	return serve();
+}
+
+bool GdbServer::serve()
+{
+	std::string packet;
+	while (readPacket(packet))
+	{
+		bool isResumed = false;
+		if (!handlePacket(packet, isResumed))
+		{
+			disconnect();
+			return false;
+		}
+		if (isResumed)
+		{
+			_isRunning = true;
+			return true;
+		}
+		if (!isConnected())
+		{
+			// Detached, the execution goes on without the debugger
+			return true;
+		}
+	}
+
+	// Connection lost, the execution goes on without the debugger
+	disconnect();
+	return true;
+}
+
+bool GdbServer::hasInput()
+{
+	if (_inputBegin < _inputEnd)
+	{
+		return true;
+	}
+
+	return Socket::hasInput(_client, 0);
+}
+
+bool GdbServer::readByte(char& byte)
+{
+	if (_inputBegin == _inputEnd)
+	{
+		int received = Socket::receive(_client, _input, sizeof(_input));
+		if (received <= 0)
+		{
+			return false;
+		}
+		_inputBegin = 0;
+		_inputEnd = static_cast<size_t>(received);
+	}
+	byte = _input[_inputBegin++];
+	return true;
+}
+
+bool GdbServer::readPacket(std::string& packet)
+{
+	// $data#checksum, the acknowledgments and interrupts outside of a packet are skipped while stopped
+	char byte;
+	while (readByte(byte))
+	{
+		if (byte != '$')
+		{
+			continue;
+		}
+
+		packet.clear();
+		uint8_t sum = 0;
+		while (readByte(byte) && byte != '#')
+		{
+			packet += byte;
+			sum = static_cast<uint8_t>(sum + static_cast<uint8_t>(byte));
+		}
+		char checksum[3] = { 0, 0, 0 };
+		if (!readByte(checksum[0]) || !readByte(checksum[1]))
+		{
+			return false;
+		}
+
+		if (_isAckEnabled)
+		{
+			bool isValid = std::strtoul(checksum, nullptr, 16) == sum;
+			char ack = isValid ? '+' : '-';
+			Socket::send(_client, &ack, 1);
+			if (!isValid)
+			{
+				continue;
+			}
+		}
+		return true;
+	}
+	return false;
+}
+
+void GdbServer::sendPacket(const std::string& data)
+{
+	std::string packet = "$";
+	uint8_t sum = 0;
+	for (char byte : data)
+	{
+		// Characters of the framing are escaped
+		if (byte == '$' || byte == '#' || byte == '}' || byte == '*')
+		{
+			packet += '}';
+			sum = static_cast<uint8_t>(sum + '}');
+			byte ^= 0x20;
+		}
+		packet += byte;
+		sum = static_cast<uint8_t>(sum + static_cast<uint8_t>(byte));
+	}
+	packet += '#';
+	appendHex(packet, sum, 1);
+	Socket::send(_client, packet.data(), packet.size());
+}
+
+bool GdbServer::handlePacket(const std::string& packet, bool& isResumed)
+{
+	Memory& memory = _emulator.memory();
+	size_t offset = 1;
+	std::string reply;
+	char command = packet.empty() ? 0 : packet[0];
+	switch (command)
+	{
+		case '?':
+			reply = stopReply();
+			break;
+		case 'g':
+			for (size_t i = 0; i < GdbServer::REGISTER_COUNT; i++)
+			{
+				reply += readRegister(i);
+			}
+			break;
+		case 'G':
+		{
+			// Registers follow each other with their size, 1 byte for V0 to VF
+			bool isValid = true;
+			for (size_t i = 0; i < GdbServer::REGISTER_COUNT && isValid; i++)
+			{
+				size_t size = readRegister(i).size();
+				isValid = offset + size <= packet.size() && writeRegister(i, packet.substr(offset, size));
+				offset += size;
+			}
+			reply = isValid ? "OK" : "E01";
+			break;
+		}
+		case 'p':
+		{
+			size_t index = parseHex(packet, offset);
+			reply = index < GdbServer::REGISTER_COUNT ? readRegister(index) : "E01";
+			break;
+		}
+		case 'P':
+		{
+			size_t index = parseHex(packet, offset);
+			reply = index < GdbServer::REGISTER_COUNT && offset < packet.size() && writeRegister(index, packet.substr(offset + 1)) ? "OK" : "E01";
+			break;
+		}
+		case 'm':
+		{
+			uint32_t addr = parseHex(packet, offset);
+			offset++;
+			size_t size = parseHex(packet, offset);
+			size = size < GdbServer::MAX_READ_SIZE ? size : GdbServer::MAX_READ_SIZE;
+			for (size_t i = 0; i < size; i++)
+			{
+				appendHex(reply, memory.read8(static_cast<uint16_t>(addr + i)), 1);
+			}
+			break;
+		}
+		case 'M':
+		{
+			uint32_t addr = parseHex(packet, offset);
+			offset++;
+			size_t size = parseHex(packet, offset);
+			offset++;
+			if (offset + 2 * size > packet.size())
+			{
+				reply = "E01";
+				break;
+			}
+			// Blocks decoded from the bytes written are dropped before the execution resumes
+			for (size_t i = 0; i < size; i++)
+			{
+				memory.write8(static_cast<uint16_t>(addr + i), static_cast<uint8_t>(parseLittleEndian(packet.substr(offset + 2 * i, 2), 1)));
+			}
+			reply = "OK";
+			break;
+		}
+		case 'c':
+		case 's':
+		{
+			// Resumes at the address given, if any
+			if (offset < packet.size())
+			{
+				_emulator.cpu().saveState(_registers);
+				_registers.pc = static_cast<uint16_t>(parseHex(packet, offset));
+				_emulator.cpu().loadState(_registers);
+			}
+			if (command == 's')
+			{
+				_debugger.step();
+			}
+			else
+			{
+				_debugger.resume();
+			}
+			isResumed = true;
+			return true;
+		}
+		case 'Z':
+		case 'z':
+		{
+			// Z0 and Z1 are breakpoints, Z2 write, Z3 read and Z4 access watchpoints
+			char type = packet.size() > 1 ? packet[1] : 0;
+			offset = 3;
+			uint16_t addr = static_cast<uint16_t>(parseHex(packet, offset));
+			offset++;
+			size_t size = parseHex(packet, offset);
+			bool isInsert = command == 'Z';
+			if (type == '0' || type == '1')
+			{
+				if (isInsert)
+				{
+					_debugger.addBreakpoint(addr);
+				}
+				else
+				{
+					_debugger.removeBreakpoint(addr);
+				}
+				reply = "OK";
+			}
+			else if (type >= '2' && type <= '4')
+			{
+				Debugger::WatchKind kind = type == '2' ? Debugger::WatchKind::Write : type == '3' ? Debugger::WatchKind::Read : Debugger::WatchKind::Access;
+				if (isInsert)
+				{
+					_debugger.addWatchpoint(addr, size, kind);
+				}
+				else
+				{
+					_debugger.removeWatchpoint(addr, size, kind);
+				}
+				reply = "OK";
+			}
+			break;
+		}
+		case 'D':
+			sendPacket("OK");
+			disconnect();
+			return true;
+		case 'k':
+			return false;
+		case 'H':
+		case 'T':
+			// A single thread, always alive
+			reply = "OK";
+			break;
+		case 'q':
+			if (packet.compare(0, 10, "qSupported") == 0)
+			{
+				reply = "PacketSize=1000;qXfer:features:read+;QStartNoAckMode+";
+			}
+			else if (packet.compare(0, 31, "qXfer:features:read:target.xml:") == 0)
+			{
+				offset = 31;
+				size_t begin = parseHex(packet, offset);
+				offset++;
+				size_t size = parseHex(packet, offset);
+				size_t length = sizeof(TARGET_XML) - 1;
+				begin = std::min(begin, length);
+				size = std::min(size, length - begin);
+				reply = (begin + size < length ? "m" : "l") + std::string(TARGET_XML + begin, size);
+			}
+			else if (packet == "qAttached")
+			{
+				reply = "1";
+			}
+			else if (packet == "qfThreadInfo")
+			{
+				reply = "m1";
+			}
+			else if (packet == "qsThreadInfo")
+			{
+				reply = "l";
+			}
+			else if (packet == "qC")
+			{
+				reply = "QC1";
+			}
+			break;
+		case 'Q':
+			if (packet == "QStartNoAckMode")
+			{
+				sendPacket("OK");
+				_isAckEnabled = false;
+				return true;
+			}
+			break;
+		default:
+			// An empty reply tells the client the packet is not supported
+			break;
+	}
+	sendPacket(reply);
+	return true;
+}
+
+std::string GdbServer::stopReply() const
+{
+	std::string reply;
+	switch (_debugger.stopReason())
+	{
+		case Debugger::StopReason::Watchpoint:
+		{
+			const char* kinds[] = { "rwatch", "watch", "awatch" };
+			reply = std::string("T05") + kinds[_debugger.watchKind()] + ":";
+			appendHex(reply, _debugger.watchAddress() >> 8, 1);
+			appendHex(reply, _debugger.watchAddress() & 0xFF, 1);
+			reply += ";";
+			break;
+		}
+		case Debugger::StopReason::Error:
+			// SIGILL
+			reply = "S04";
+			break;
+		case Debugger::StopReason::StackOverflow:
+			// SIGSEGV
+			reply = "S0b";
+			break;
+		case Debugger::StopReason::Exit:
+			reply = "W00";
+			break;
+		case Debugger::StopReason::Interrupt:
+			// SIGINT
+			reply = "S02";
+			break;
+		default:
+			// SIGTRAP
+			reply = "S05";
+			break;
+	}
+	return reply;
+}
+
+std::string GdbServer::readRegister(size_t index)
+{
+	_emulator.cpu().saveState(_registers);
+	std::string hex;
+	if (index < 16)
+	{
+		appendHex(hex, _registers.registers[index], 1);
+	}
+	else if (index == 16)
+	{
+		appendHex(hex, _registers.I, 2);
+	}
+	else if (index == 17)
+	{
+		appendHex(hex, _registers.pc, 2);
+	}
+	else if (index == 18)
+	{
+		appendHex(hex, _registers.stackSize, 1);
+	}
+	else if (index < 35)
+	{
+		appendHex(hex, _registers.stack[index - 19], 2);
+	}
+	else
+	{
+		appendHex(hex, index == 35 ? _registers.delayTimer : _registers.soundTimer, 1);
+	}
+	return hex;
+}
+
+bool GdbServer::writeRegister(size_t index, const std::string& hex)
+{
+	// Read back first, so the other registers keep their value
+	size_t size = readRegister(index).size() / 2;
+	if (hex.size() < 2 * size)
+	{
+		return false;
+	}
+
+	uint32_t value = parseLittleEndian(hex, size);
+	if (index < 16)
+	{
+		_registers.registers[index] = static_cast<uint8_t>(value);
+	}
+	else if (index == 16)
+	{
+		_registers.I = static_cast<uint16_t>(value);
+	}
+	else if (index == 17)
+	{
+		_registers.pc = static_cast<uint16_t>(value);
+	}
+	else if (index == 18)
+	{
+		_registers.stackSize = static_cast<uint8_t>(value);
+	}
+	else if (index < 35)
+	{
+		_registers.stack[index - 19] = static_cast<uint16_t>(value);
+	}
+	else if (index == 35)
+	{
+		_registers.delayTimer = static_cast<uint8_t>(value);
+	}
+	else
+	{
+		_registers.soundTimer = static_cast<uint8_t>(value);
+	}
+	_emulator.cpu().loadState(_registers);
+	return true;
+}
+
+void GdbServer::disconnect()
+{
+	if (!isConnected())
+	{
+		return;
+	}
+
+	Socket::close(_client);
+	_client = Socket::NO_SOCKET;
+	_isRunning = false;
+	// The rom runs on from where it stopped
+	_debugger.clear();
+	_debugger.resume();
+	_emulator.setDebugger(nullptr);
+	std::cout << "[GDB] Client disconnected" << std::endl;
+}
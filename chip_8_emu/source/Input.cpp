@@ -1,33 +1,38 @@
 #include "Input.hpp"
-#include <cstring>
+#include "InputSource.hpp"
+#include "MachineState.hpp"
+#include "State.hpp"
 
 Input::Input()
 {
-	_bindings[0] = sf::Keyboard::Key::Num1;
-	_bindings[1] = sf::Keyboard::Key::Num2;
-	_bindings[2] = sf::Keyboard::Key::Num3;
-	_bindings[3] = sf::Keyboard::Key::Num4;
-	_bindings[4] = sf::Keyboard::Key::A;
-	_bindings[5] = sf::Keyboard::Key::Z;
-	_bindings[6] = sf::Keyboard::Key::E;
-	_bindings[7] = sf::Keyboard::Key::R;
-	_bindings[8] = sf::Keyboard::Key::Q;
-	_bindings[9] = sf::Keyboard::Key::S;
-	_bindings[10] = sf::Keyboard::Key::D;
-	_bindings[11] = sf::Keyboard::Key::F;
-	_bindings[12] = sf::Keyboard::Key::W;
-	_bindings[13] = sf::Keyboard::Key::X;
-	_bindings[14] = sf::Keyboard::Key::C;
-	_bindings[15] = sf::Keyboard::Key::V;
-	
-	memset(&_inputs, 0, Input::INPUT_COUNT);
+	for (uint8_t i = 0; i < Input::INPUT_COUNT; i++)
+	{
+		_inputs[i] = Input::KeyState::None;
+	}
 }
 
-void Input::tick()
+void Input::tick(InputSource* source)
+{
+	uint16_t keys = 0;
+	if (source != nullptr)
+	{
+		source->poll();
+		for (uint8_t i = 0; i < Input::INPUT_COUNT; i++)
+		{
+			if (source->isKeyPressed(i))
+			{
+				keys |= 1 << i;
+			}
+		}
+	}
+	tick(keys);
+}
+
+void Input::tick(uint16_t keys)
 {
 	for (uint8_t i = 0; i < Input::INPUT_COUNT; i++)
 	{
-		if (sf::Keyboard::isKeyPressed(_bindings[i]))
+		if ((keys >> i) & 1)
 		{
 			// KeyState::Pressed is set only one frame
 			// then it's set to KeyState::Down
@@ -42,6 +47,19 @@ void Input::tick()
 	}
 }
 
+void Input::setKeys(uint16_t keys)
+{
+	for (uint8_t i = 0; i < Input::INPUT_COUNT; i++)
+	{
+		bool isDown = (keys >> i) & 1;
+		if (isDown != isKeyDown(i))
+		{
+			// Pressed and Released last until the next tick
+			_inputs[i] = isDown ? Input::KeyState::Pressed : Input::KeyState::Released;
+		}
+	}
+}
+
 bool Input::isKeyDown(uint8_t keyCode) const
 {
 	return _inputs[keyCode] == Input::KeyState::Pressed || _inputs[keyCode] == Input::KeyState::Down;
@@ -51,3 +69,48 @@ Input::KeyState Input::getKeyState(uint8_t keyCode) const
 {
 	return _inputs[keyCode];
 }
+
+uint16_t Input::keyMask() const
+{
+	uint16_t mask = 0;
+	for (uint8_t i = 0; i < Input::INPUT_COUNT; i++)
+	{
+		if (isKeyDown(i))
+		{
+			mask |= 1 << i;
+		}
+	}
+	return mask;
+}
+
+void Input::saveState(StateWriter& writer) const
+{
+	for (uint8_t i = 0; i < Input::INPUT_COUNT; i++)
+	{
+		writer.write8(static_cast<uint8_t>(_inputs[i]));
+	}
+}
+
+void Input::loadState(StateReader& reader)
+{
+	for (uint8_t i = 0; i < Input::INPUT_COUNT; i++)
+	{
+		_inputs[i] = static_cast<Input::KeyState>(reader.read8() & 0x03);
+	}
+}
+
+void Input::saveState(MachineState& state) const
+{
+	for (uint8_t i = 0; i < Input::INPUT_COUNT; i++)
+	{
+		state.keys[i] = static_cast<uint8_t>(_inputs[i]);
+	}
+}
+
+void Input::loadState(const MachineState& state)
+{
+	for (uint8_t i = 0; i < Input::INPUT_COUNT; i++)
+	{
+		_inputs[i] = static_cast<Input::KeyState>(state.keys[i] & 0x03);
+	}
+}
@@ -0,0 +1,113 @@
+#include "InputLog.hpp"
+#include "State.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+static const uint8_t INPUT_LOG_MAGIC[] = { 'C', '8', 'I', 'N' };
+
+InputLog::InputLog() :
+	seed(0),
+	cyclesPerFrame(0),
+	quirks(Quirks::fromMask(0)),
+	platform(Platform::Type::CosmacVip),
+	frameCount(0)
+{ }
+
+void InputLog::clear()
+{
+	_events.clear();
+	frameCount = 0;
+}
+
+void InputLog::record(uint32_t frame, uint16_t keys)
+{
+	uint16_t previous = _events.empty() ? 0 : _events.back().keys;
+	if (keys != previous)
+	{
+		_events.push_back({ frame, keys });
+	}
+	frameCount = std::max(frameCount, frame + 1);
+}
+
+uint16_t InputLog::keysAt(uint32_t frame, size_t& cursor) const
+{
+	// The cursor remembers the last event so a replay in order walks the log once
+	if (cursor > 0 && (cursor > _events.size() || _events[cursor - 1].frame > frame))
+	{
+		cursor = 0;
+	}
+	while (cursor < _events.size() && _events[cursor].frame <= frame)
+	{
+		cursor++;
+	}
+	return cursor > 0 ? _events[cursor - 1].keys : 0;
+}
+
+bool InputLog::save(const std::string& path) const
+{
+	std::vector<uint8_t> data;
+	StateWriter writer(data);
+	writer.writeBytes(INPUT_LOG_MAGIC, sizeof(INPUT_LOG_MAGIC));
+	writer.write16(InputLog::VERSION);
+	writer.write64(seed);
+	writer.write32(static_cast<uint32_t>(cyclesPerFrame));
+	writer.write8(quirks.toMask());
+	writer.write8(static_cast<uint8_t>(platform));
+	writer.write32(frameCount);
+	writer.write32(static_cast<uint32_t>(_events.size()));
+	for (const InputLog::Event& event : _events)
+	{
+		writer.write32(event.frame);
+		writer.write16(event.keys);
+	}
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file.write(reinterpret_cast<const char*>(data.data()), data.size()))
+	{
+		std::cout << "[ERROR] Cannot write the input log '" << path << "'" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool InputLog::load(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+	{
+		std::cout << "[ERROR] Cannot open the input log '" << path << "'" << std::endl;
+		return false;
+	}
+	std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	StateReader reader(data.data(), data.size());
+	uint8_t magic[sizeof(INPUT_LOG_MAGIC)];
+	reader.readBytes(magic, sizeof(magic));
+	uint16_t version = reader.read16();
+	if (!std::equal(magic, magic + sizeof(magic), INPUT_LOG_MAGIC) || version == 0 || version > InputLog::VERSION)
+	{
+		std::cout << "[ERROR] '" << path << "' is not a supported input log" << std::endl;
+		return false;
+	}
+
+	seed = reader.read64();
+	cyclesPerFrame = reader.read32();
+	quirks = Quirks::fromMask(reader.read8());
+	platform = version >= 2 ? static_cast<Platform::Type>(reader.read8() % (Platform::Type::XoChip + 1)) : Platform::Type::CosmacVip;
+	frameCount = reader.read32();
+	uint32_t eventCount = reader.read32();
+	if (eventCount > reader.remaining() / 6)
+	{
+		std::cout << "[ERROR] The input log '" << path << "' is truncated" << std::endl;
+		return false;
+	}
+
+	_events.resize(eventCount);
+	for (InputLog::Event& event : _events)
+	{
+		event.frame = reader.read32();
+		event.keys = reader.read16();
+	}
+	return reader.isValid();
+}
@@ -0,0 +1,61 @@
+#include "InputQueue.hpp"
+#include "Input.hpp"
+
+InputQueue::InputQueue() :
+	_current({ 0, 0, std::chrono::steady_clock::time_point() }),
+	_latest({ 0, 0, std::chrono::steady_clock::time_point() })
+{
+	_snapshots.reserve(InputQueue::CAPACITY);
+}
+
+InputQueue::Snapshot InputQueue::sample(InputSource& source)
+{
+	source.poll();
+
+	InputQueue::Snapshot snapshot = { 0, 0, std::chrono::steady_clock::now() };
+	for (uint8_t i = 0; i < Input::INPUT_COUNT; i++)
+	{
+		if (source.isKeyPressed(i))
+		{
+			snapshot.keys |= 1 << i;
+		}
+	}
+	for (uint8_t hotkey = 0; hotkey < InputSource::Hotkey::HotkeyCount; hotkey++)
+	{
+		if (source.isHotkeyPressed(static_cast<InputSource::Hotkey>(hotkey)))
+		{
+			snapshot.hotkeys |= 1 << hotkey;
+		}
+	}
+	return snapshot;
+}
+
+bool InputQueue::push(const InputQueue::Snapshot& snapshot)
+{
+	return _queue.push(snapshot);
+}
+
+void InputQueue::poll()
+{
+	// A key released since the last poll is still reported pressed for this frame, then takes its latest state
+	_current = _latest;
+	_snapshots.clear();
+	InputQueue::Snapshot snapshot;
+	while (_queue.pop(snapshot))
+	{
+		_current.keys |= snapshot.keys;
+		_current.hotkeys |= snapshot.hotkeys;
+		_latest = snapshot;
+		_snapshots.push_back(snapshot);
+	}
+}
+
+bool InputQueue::isKeyPressed(uint8_t keyCode) const
+{
+	return (_current.keys >> keyCode) & 1;
+}
+
+bool InputQueue::isHotkeyPressed(InputSource::Hotkey hotkey) const
+{
+	return (_current.hotkeys >> hotkey) & 1;
+}
@@ -0,0 +1,24 @@
+#include "InputReplay.hpp"
+#include "InputLog.hpp"
+
+InputReplay::InputReplay(const InputLog& log) :
+	_log(log),
+	_frame(0),
+	_cursor(0),
+	_keys(0)
+{ }
+
+void InputReplay::poll()
+{
+	_keys = _log.keysAt(_frame++, _cursor);
+}
+
+bool InputReplay::isKeyPressed(uint8_t keyCode) const
+{
+	return (_keys >> keyCode) & 1;
+}
+
+bool InputReplay::isFinished() const
+{
+	return _frame >= _log.frameCount;
+}
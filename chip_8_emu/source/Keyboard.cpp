@@ -0,0 +1,131 @@
+#include "Keyboard.hpp"
+
+const char* Keyboard::DEFAULT_LAYOUT = "1234AZERQSDFWXCV";
+
+Keyboard::Keyboard() :
+	_keys(0),
+	_hotkeys(0),
+	_nextEvent(0)
+{
+	setBindings(Keyboard::DEFAULT_LAYOUT);
+	_hotkeyBindings[InputSource::Hotkey::SaveState] = sf::Keyboard::Key::F5;
+	_hotkeyBindings[InputSource::Hotkey::LoadState] = sf::Keyboard::Key::F9;
+	_hotkeyBindings[InputSource::Hotkey::Rewind] = sf::Keyboard::Key::BackSpace;
+	_hotkeyBindings[InputSource::Hotkey::FastForward] = sf::Keyboard::Key::Tab;
+}
+
+void Keyboard::handleEvent(const sf::Event& event)
+{
+	if (event.type == sf::Event::LostFocus)
+	{
+		// Keys released in another window are never reported
+		setKeys(0, 0);
+		return;
+	}
+	if (event.type != sf::Event::KeyPressed && event.type != sf::Event::KeyReleased)
+	{
+		return;
+	}
+
+	// Repeated presses of a held key change nothing
+	bool isPressed = event.type == sf::Event::KeyPressed;
+	uint16_t keys = _keys;
+	uint8_t hotkeys = _hotkeys;
+	for (uint8_t i = 0; i < Input::INPUT_COUNT; i++)
+	{
+		if (_bindings[i] == event.key.code)
+		{
+			keys = isPressed ? keys | (1 << i) : keys & ~(1 << i);
+		}
+	}
+	for (uint8_t hotkey = 0; hotkey < InputSource::Hotkey::HotkeyCount; hotkey++)
+	{
+		if (_hotkeyBindings[hotkey] == event.key.code)
+		{
+			hotkeys = isPressed ? hotkeys | (1 << hotkey) : hotkeys & ~(1 << hotkey);
+		}
+	}
+	setKeys(keys, hotkeys);
+}
+
+void Keyboard::setKeys(uint16_t keys, uint8_t hotkeys)
+{
+	if (keys == _keys && hotkeys == _hotkeys)
+	{
+		return;
+	}
+
+	_keys = keys;
+	_hotkeys = hotkeys;
+	_events.push_back({ keys, hotkeys, std::chrono::steady_clock::now() });
+}
+
+bool Keyboard::setBindings(const std::string& layout)
+{
+	if (layout.size() != Input::INPUT_COUNT)
+	{
+		return false;
+	}
+
+	sf::Keyboard::Key bindings[Input::INPUT_COUNT];
+	for (uint8_t i = 0; i < Input::INPUT_COUNT; i++)
+	{
+		char c = layout[i];
+		if (c >= 'a' && c <= 'z')
+		{
+			c = c - 'a' + 'A';
+		}
+
+		if (c >= 'A' && c <= 'Z')
+		{
+			bindings[i] = static_cast<sf::Keyboard::Key>(sf::Keyboard::Key::A + (c - 'A'));
+		}
+		else if (c >= '0' && c <= '9')
+		{
+			bindings[i] = static_cast<sf::Keyboard::Key>(sf::Keyboard::Key::Num0 + (c - '0'));
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	for (uint8_t i = 0; i < Input::INPUT_COUNT; i++)
+	{
+		setBinding(i, bindings[i]);
+	}
+	return true;
+}
+
+void Keyboard::setBinding(uint8_t keyCode, sf::Keyboard::Key key)
+{
+	_bindings[keyCode] = key;
+}
+
+void Keyboard::setHotkeyBinding(InputSource::Hotkey hotkey, sf::Keyboard::Key key)
+{
+	_hotkeyBindings[hotkey] = key;
+}
+
+bool Keyboard::isKeyPressed(uint8_t keyCode) const
+{
+	return (_keys >> keyCode) & 1;
+}
+
+bool Keyboard::isHotkeyPressed(InputSource::Hotkey hotkey) const
+{
+	return (_hotkeys >> hotkey) & 1;
+}
+
+bool Keyboard::nextEvent(InputSource::Event& event)
+{
+	if (_nextEvent == _events.size())
+	{
+		_events.clear();
+		_nextEvent = 0;
+		return false;
+	}
+
+	event = _events[_nextEvent++];
+	return true;
+}
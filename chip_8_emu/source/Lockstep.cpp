@@ -0,0 +1,754 @@
+#include "Lockstep.hpp"
+#include <algorithm>
+#include <bitset>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CHIP8_LOCKSTEP_SSE2
+#endif
+
+// Byte operations on as many lanes as a SIMD register holds, masks are 0xFF where true and 0 where false
+#if defined(__AVX2__)
+struct LaneVector
+{
+	typedef __m256i Type;
+	static const size_t WIDTH = 32;
+
+	static const char* name() { return "avx2"; }
+	static Type load(const uint8_t* data) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data)); }
+	static void store(uint8_t* data, Type a) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(data), a); }
+	static Type set(uint8_t value) { return _mm256_set1_epi8(static_cast<char>(value)); }
+	static Type bitAnd(Type a, Type b) { return _mm256_and_si256(a, b); }
+	static Type bitOr(Type a, Type b) { return _mm256_or_si256(a, b); }
+	static Type bitXor(Type a, Type b) { return _mm256_xor_si256(a, b); }
+	static Type add(Type a, Type b) { return _mm256_add_epi8(a, b); }
+	static Type sub(Type a, Type b) { return _mm256_sub_epi8(a, b); }
+	// Unsigned, 0 where b is greater than a
+	static Type subSaturated(Type a, Type b) { return _mm256_subs_epu8(a, b); }
+	static Type equal(Type a, Type b) { return _mm256_cmpeq_epi8(a, b); }
+	// Bytes are shifted as words, the bits coming from the neighbour byte are cleared
+	static Type shiftRight1(Type a) { return _mm256_and_si256(_mm256_srli_epi16(a, 1), _mm256_set1_epi8(0x7F)); }
+	static Type shiftRight7(Type a) { return _mm256_and_si256(_mm256_srli_epi16(a, 7), _mm256_set1_epi8(0x01)); }
+	// a where the mask is set, b elsewhere
+	static Type select(Type mask, Type a, Type b) { return _mm256_blendv_epi8(b, a, mask); }
+	static size_t count(Type mask) { return std::bitset<32>(static_cast<uint32_t>(_mm256_movemask_epi8(mask))).count(); }
+};
+#elif defined(CHIP8_LOCKSTEP_SSE2)
+struct LaneVector
+{
+	typedef __m128i Type;
+	static const size_t WIDTH = 16;
+
+	static const char* name() { return "sse2"; }
+	static Type load(const uint8_t* data) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(data)); }
+	static void store(uint8_t* data, Type a) { _mm_storeu_si128(reinterpret_cast<__m128i*>(data), a); }
+	static Type set(uint8_t value) { return _mm_set1_epi8(static_cast<char>(value)); }
+	static Type bitAnd(Type a, Type b) { return _mm_and_si128(a, b); }
+	static Type bitOr(Type a, Type b) { return _mm_or_si128(a, b); }
+	static Type bitXor(Type a, Type b) { return _mm_xor_si128(a, b); }
+	static Type add(Type a, Type b) { return _mm_add_epi8(a, b); }
+	static Type sub(Type a, Type b) { return _mm_sub_epi8(a, b); }
+	static Type subSaturated(Type a, Type b) { return _mm_subs_epu8(a, b); }
+	static Type equal(Type a, Type b) { return _mm_cmpeq_epi8(a, b); }
+	static Type shiftRight1(Type a) { return _mm_and_si128(_mm_srli_epi16(a, 1), _mm_set1_epi8(0x7F)); }
+	static Type shiftRight7(Type a) { return _mm_and_si128(_mm_srli_epi16(a, 7), _mm_set1_epi8(0x01)); }
+	// No blend before SSE4.1
+	static Type select(Type mask, Type a, Type b) { return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)); }
+	static size_t count(Type mask) { return std::bitset<16>(static_cast<uint32_t>(_mm_movemask_epi8(mask))).count(); }
+};
+#else
+// One lane at a time on hosts without SSE2
+struct LaneVector
+{
+	typedef uint8_t Type;
+	static const size_t WIDTH = 1;
+
+	static const char* name() { return "none"; }
+	static Type load(const uint8_t* data) { return *data; }
+	static void store(uint8_t* data, Type a) { *data = a; }
+	static Type set(uint8_t value) { return value; }
+	static Type bitAnd(Type a, Type b) { return a & b; }
+	static Type bitOr(Type a, Type b) { return a | b; }
+	static Type bitXor(Type a, Type b) { return a ^ b; }
+	static Type add(Type a, Type b) { return static_cast<Type>(a + b); }
+	static Type sub(Type a, Type b) { return static_cast<Type>(a - b); }
+	static Type subSaturated(Type a, Type b) { return a > b ? static_cast<Type>(a - b) : 0; }
+	static Type equal(Type a, Type b) { return a == b ? 0xFF : 0; }
+	static Type shiftRight1(Type a) { return a >> 1; }
+	static Type shiftRight7(Type a) { return a >> 7; }
+	static Type select(Type mask, Type a, Type b) { return (mask & a) | (~mask & b); }
+	static size_t count(Type mask) { return mask >> 7; }
+};
+#endif
+
+Lockstep::Lockstep(size_t cyclesPerFrame, const Quirks& quirks, Platform::Type platform) :
+	_cyclesPerFrame(cyclesPerFrame),
+	_quirks(quirks),
+	_platform(platform),
+	_laneCount(0),
+	_stride(0),
+	_groupSize(0),
+	_groupCycles(0),
+	_joinAddressCount(0),
+	_isDiverged(false),
+	_codeDirtyBegin(MachineState::MEMORY_SIZE),
+	_codeDirtyEnd(0),
+	_vectorCycleCount(0),
+	_scalarCycleCount(0)
+{
+	memset(&_transfer, 0, sizeof(_transfer));
+}
+
+const char* Lockstep::instructionSet()
+{
+	return LaneVector::name();
+}
+
+bool Lockstep::load(const MachineState* states, size_t count)
+{
+	// Cores are kept from a load to the next, each one builds a decode table
+	while (_cores.size() < count)
+	{
+		_cores.emplace_back(_cyclesPerFrame, _quirks);
+		Chip8& core = _cores.back();
+		core.setPlatform(_platform);
+		core.initialize();
+		// A core runs a few instructions at a time from a memory replaced on every load, blocks would not pay off
+		core.cpu().setDispatchMode(CPU::DispatchMode::Table);
+	}
+
+	_laneCount = count;
+	_stride = (count + LaneVector::WIDTH - 1) / LaneVector::WIDTH * LaneVector::WIDTH;
+	_lanes.assign(count, Lane());
+	_registers.assign(MachineState::REGISTER_COUNT * _stride, 0);
+	_I.assign(_stride, 0);
+	_pc.assign(_stride, 0);
+	_delayTimer.assign(_stride, 0);
+	_soundTimer.assign(_stride, 0);
+	_cyclesLeft.assign(_stride, 0);
+	_mask.assign(_stride, 0);
+	_frameMask.assign(_stride, 0);
+	_skip.assign(_stride, 0);
+	_codeDirtyBegin = MachineState::MEMORY_SIZE;
+	_codeDirtyEnd = 0;
+	_vectorCycleCount = 0;
+	_scalarCycleCount = 0;
+	if (count == 0)
+	{
+		return true;
+	}
+
+	_code.assign(states[0].memory, states[0].memory + MachineState::MEMORY_SIZE);
+	for (size_t lane = 0; lane < count; lane++)
+	{
+		if (!_cores[lane].loadState(states[lane]))
+		{
+			_laneCount = 0;
+			_stride = 0;
+			return false;
+		}
+		pullLane(lane);
+		_lanes[lane].isRunning = states[lane].halted == 0;
+
+		// From the first to the last byte differing from the first lane
+		const uint8_t* memory = states[lane].memory;
+		size_t begin = 0;
+		size_t end = MachineState::MEMORY_SIZE;
+		while (begin < end && memory[begin] == _code[begin])
+		{
+			begin++;
+		}
+		while (end > begin && memory[end - 1] == _code[end - 1])
+		{
+			end--;
+		}
+		if (begin < end)
+		{
+			_codeDirtyBegin = std::min(_codeDirtyBegin, begin);
+			_codeDirtyEnd = std::max(_codeDirtyEnd, end);
+		}
+	}
+	return true;
+}
+
+void Lockstep::save(MachineState* states) const
+{
+	for (size_t lane = 0; lane < _laneCount; lane++)
+	{
+		// The CPU of the core is only up to date around the instructions it runs
+		_cores[lane].saveState(states[lane]);
+		storeLane(lane, states[lane]);
+	}
+}
+
+size_t Lockstep::run(const uint16_t* keys, size_t frames)
+{
+	for (size_t frame = 0; frame < frames; frame++)
+	{
+		startFrame(keys);
+		uint16_t pc;
+		size_t leader;
+		while (findGroup(pc, leader))
+		{
+			// Scanning the lanes after every instruction would cost more than running a lone lane on its core,
+			// unless it may join other lanes
+			if (_groupSize == 1 && (_isDiverged || _joinAddressCount == 0))
+			{
+				runLane(leader, _cyclesLeft[leader]);
+			}
+			else if (runGroup(pc))
+			{
+				stepGroup(pc);
+			}
+		}
+		endFrame();
+	}
+
+	size_t runningCount = 0;
+	for (const Lockstep::Lane& lane : _lanes)
+	{
+		runningCount += lane.isRunning ? 1 : 0;
+	}
+	return runningCount;
+}
+
+Lockstep::OpKind Lockstep::opKind(uint16_t opCode)
+{
+	uint8_t NN = opCode & 0x00FF;
+	uint8_t N = opCode & 0x000F;
+	switch (opCode & 0xF000)
+	{
+		case 0x0000:
+			return opCode == 0x00EE ? Lockstep::OpKind::Return : Lockstep::OpKind::Scalar;
+		case 0x1000:
+			return Lockstep::OpKind::Jump;
+		case 0x2000:
+			return Lockstep::OpKind::Call;
+		case 0x3000:
+		case 0x4000:
+			return Lockstep::OpKind::Skip;
+		case 0x5000:
+		case 0x9000:
+			return N == 0 ? Lockstep::OpKind::Skip : Lockstep::OpKind::Scalar;
+		case 0x6000:
+		case 0x7000:
+		case 0xA000:
+			return Lockstep::OpKind::Register;
+		case 0x8000:
+			return N <= 0x7 || N == 0xE ? Lockstep::OpKind::Register : Lockstep::OpKind::Scalar;
+		case 0xF000:
+			return NN == 0x07 || NN == 0x15 || NN == 0x18 || NN == 0x1E ? Lockstep::OpKind::Register : Lockstep::OpKind::Scalar;
+		default:
+			return Lockstep::OpKind::Scalar;
+	}
+}
+
+bool Lockstep::isSharedCode(uint16_t pc) const
+{
+	// Both bytes are read with the address wrapped around the memory, as the CPU does
+	size_t first = pc & (MachineState::MEMORY_SIZE - 1);
+	size_t second = (pc + 1) & (MachineState::MEMORY_SIZE - 1);
+	return (first < _codeDirtyBegin || first >= _codeDirtyEnd) && (second < _codeDirtyBegin || second >= _codeDirtyEnd);
+}
+
+uint16_t Lockstep::sharedOpCode(uint16_t pc) const
+{
+	return (_code[pc & (MachineState::MEMORY_SIZE - 1)] << 8) | _code[(pc + 1) & (MachineState::MEMORY_SIZE - 1)];
+}
+
+void Lockstep::startFrame(const uint16_t* keys)
+{
+	// As Chip8::runFrame() with the keys held since the last change
+	for (size_t lane = 0; lane < _laneCount; lane++)
+	{
+		bool isRunning = _lanes[lane].isRunning;
+		if (isRunning)
+		{
+			_cores[lane].input().tick(keys[lane]);
+			_cores[lane].cpu().setDrawThisFrame(false);
+		}
+		_cyclesLeft[lane] = isRunning ? _cyclesPerFrame : 0;
+		_frameMask[lane] = isRunning ? 0xFF : 0;
+	}
+}
+
+void Lockstep::endFrame()
+{
+	// Timers step once per frame, even on a lane stopped by an error during the frame
+	LaneVector::Type one = LaneVector::set(1);
+	for (size_t i = 0; i < _stride; i += LaneVector::WIDTH)
+	{
+		LaneVector::Type mask = LaneVector::load(&_frameMask[i]);
+		LaneVector::Type delayTimer = LaneVector::load(&_delayTimer[i]);
+		LaneVector::Type soundTimer = LaneVector::load(&_soundTimer[i]);
+		LaneVector::store(&_delayTimer[i], LaneVector::select(mask, LaneVector::subSaturated(delayTimer, one), delayTimer));
+		LaneVector::store(&_soundTimer[i], LaneVector::select(mask, LaneVector::subSaturated(soundTimer, one), soundTimer));
+	}
+}
+
+bool Lockstep::findGroup(uint16_t& pc, size_t& leader)
+{
+	// The lane with the most cycles left goes first, the lowest address on a tie, so the lanes split by a skip
+	// meet again at the instruction after it
+	leader = _laneCount;
+	for (size_t lane = 0; lane < _laneCount; lane++)
+	{
+		size_t cycles = _cyclesLeft[lane];
+		if (cycles > 0 && (leader == _laneCount || cycles > _cyclesLeft[leader] || (cycles == _cyclesLeft[leader] && _pc[lane] < _pc[leader])))
+		{
+			leader = lane;
+		}
+	}
+	if (leader == _laneCount)
+	{
+		return false;
+	}
+
+	pc = _pc[leader];
+	_groupSize = 0;
+	_groupCycles = _cyclesLeft[leader];
+	_joinAddressCount = 0;
+	_isDiverged = false;
+	for (size_t lane = 0; lane < _laneCount; lane++)
+	{
+		size_t cycles = _cyclesLeft[lane];
+		bool isInGroup = cycles > 0 && _pc[lane] == pc;
+		_mask[lane] = isInGroup ? 0xFF : 0;
+		if (isInGroup)
+		{
+			_groupSize++;
+			_groupCycles = std::min(_groupCycles, cycles);
+		}
+		else if (cycles > 0 && !_isDiverged && !isJoinAddress(_pc[lane]))
+		{
+			if (_joinAddressCount == Lockstep::MAX_JOIN_ADDRESSES)
+			{
+				_isDiverged = true;
+			}
+			else
+			{
+				_joinAddresses[_joinAddressCount++] = _pc[lane];
+			}
+		}
+	}
+	return true;
+}
+
+bool Lockstep::isJoinAddress(uint16_t pc) const
+{
+	return std::find(_joinAddresses, _joinAddresses + _joinAddressCount, pc) != _joinAddresses + _joinAddressCount;
+}
+
+bool Lockstep::runGroup(uint16_t& pc)
+{
+	size_t executed = 0;
+	bool isIdle = false;
+	bool isStopped = false;
+	while (executed < _groupCycles && !isJoinAddress(pc))
+	{
+		if (!isSharedCode(pc))
+		{
+			isStopped = true;
+			break;
+		}
+
+		uint16_t opCode = sharedOpCode(pc);
+		bool isGrouped = true;
+		switch (opKind(opCode))
+		{
+			case Lockstep::OpKind::Register:
+				executeRegisters(opCode);
+				pc += 2;
+				break;
+			case Lockstep::OpKind::Jump:
+				// Nothing changes until the end of the frame on a jump to itself
+				isIdle = (opCode & 0x0FFF) == pc;
+				pc = opCode & 0x0FFF;
+				break;
+			case Lockstep::OpKind::Call:
+				isGrouped = callGroup(pc);
+				break;
+			case Lockstep::OpKind::Return:
+				isGrouped = returnGroup(pc);
+				break;
+			case Lockstep::OpKind::Skip:
+			{
+				// Lanes that disagree run the skip one by one and split
+				size_t skipCount = compareSkip(opCode);
+				isGrouped = skipCount == 0 || skipCount == _groupSize;
+				if (isGrouped)
+				{
+					pc += skipCount != 0 ? 4 : 2;
+				}
+				break;
+			}
+			default:
+				isGrouped = false;
+				break;
+		}
+		if (!isGrouped)
+		{
+			isStopped = true;
+			break;
+		}
+		if (isIdle)
+		{
+			break;
+		}
+		executed++;
+	}
+
+	for (size_t lane = 0; lane < _laneCount; lane++)
+	{
+		if (_mask[lane] != 0)
+		{
+			_vectorCycleCount += isIdle ? _cyclesLeft[lane] : executed;
+			_cyclesLeft[lane] = isIdle ? 0 : _cyclesLeft[lane] - executed;
+			_pc[lane] = pc;
+		}
+	}
+	return isStopped;
+}
+
+void Lockstep::stepGroup(uint16_t pc)
+{
+	uint16_t opCode = isSharedCode(pc) ? sharedOpCode(pc) : 0;
+	Lockstep::OpKind kind = isSharedCode(pc) ? opKind(opCode) : Lockstep::OpKind::Scalar;
+	if (kind == Lockstep::OpKind::Skip)
+	{
+		compareSkip(opCode);
+	}
+	size_t runLength = kind == Lockstep::OpKind::Scalar ? scalarRunLength(pc) : 1;
+
+	uint16_t next = pc + 2;
+	for (size_t lane = 0; lane < _laneCount; lane++)
+	{
+		if (_mask[lane] == 0)
+		{
+			continue;
+		}
+
+		Lockstep::Lane& state = _lanes[lane];
+		if (kind == Lockstep::OpKind::Skip)
+		{
+			_pc[lane] = _skip[lane] != 0 ? next + 2 : next;
+		}
+		else if (kind == Lockstep::OpKind::Call && state.stackSize < MachineState::STACK_SIZE)
+		{
+			state.stack[state.stackSize++] = next;
+			_pc[lane] = opCode & 0x0FFF;
+		}
+		else if (kind == Lockstep::OpKind::Return)
+		{
+			// Nothing to return to is ignored
+			_pc[lane] = state.stackSize > 0 ? state.stack[--state.stackSize] : next;
+		}
+		else
+		{
+			// The core reports the stack overflows
+			runLane(lane, std::min(runLength, _cyclesLeft[lane]));
+			continue;
+		}
+		_cyclesLeft[lane]--;
+		_vectorCycleCount++;
+	}
+}
+
+size_t Lockstep::scalarRunLength(uint16_t pc) const
+{
+	// A lane going to its core once for several instructions saves copying its registers back and forth,
+	// the run stops before the jumps and skips where the lanes may meet again
+	size_t length = 0;
+	size_t runLength = 1;
+	for (uint16_t addr = pc; length < Lockstep::MAX_SCALAR_RUN && isSharedCode(addr); addr += 2)
+	{
+		Lockstep::OpKind kind = opKind(sharedOpCode(addr));
+		if (kind != Lockstep::OpKind::Scalar && kind != Lockstep::OpKind::Register)
+		{
+			break;
+		}
+		length++;
+		if (kind == Lockstep::OpKind::Scalar)
+		{
+			runLength = length;
+		}
+	}
+	return runLength;
+}
+
+void Lockstep::executeRegisters(uint16_t opCode)
+{
+	typedef LaneVector::Type Vector;
+	uint16_t NNN = opCode & 0x0FFF;
+	uint8_t NN = opCode & 0x00FF;
+	uint8_t N = opCode & 0x000F;
+	uint8_t X = (opCode & 0x0F00) >> 8;
+	uint8_t Y = (opCode & 0x00F0) >> 4;
+	uint8_t* vx = registers(X);
+	uint8_t* vy = registers(Y);
+	uint8_t* vf = registers(0xF);
+	const uint8_t* mask = _mask.data();
+	const Vector zero = LaneVector::set(0);
+	const Vector one = LaneVector::set(1);
+
+	switch (opCode & 0xF000)
+	{
+		case 0x6000:
+		{
+			Vector value = LaneVector::set(NN);
+			for (size_t i = 0; i < _stride; i += LaneVector::WIDTH)
+			{
+				LaneVector::store(vx + i, LaneVector::select(LaneVector::load(mask + i), value, LaneVector::load(vx + i)));
+			}
+			break;
+		}
+		case 0x7000:
+		{
+			Vector value = LaneVector::set(NN);
+			for (size_t i = 0; i < _stride; i += LaneVector::WIDTH)
+			{
+				LaneVector::store(vx + i, LaneVector::add(LaneVector::load(vx + i), LaneVector::bitAnd(LaneVector::load(mask + i), value)));
+			}
+			break;
+		}
+		case 0x8000:
+			for (size_t i = 0; i < _stride; i += LaneVector::WIDTH)
+			{
+				// Same results as the handlers of the CPU, VF is written last and taken from VX before the shifts
+				Vector x = LaneVector::load(vx + i);
+				Vector y = LaneVector::load(vy + i);
+				Vector result = y;
+				Vector flag = zero;
+				bool hasFlag = true;
+				switch (N)
+				{
+					case 0x0:
+						hasFlag = false;
+						break;
+					case 0x1:
+						result = LaneVector::bitOr(x, y);
+						hasFlag = _quirks.vfReset;
+						break;
+					case 0x2:
+						result = LaneVector::bitAnd(x, y);
+						hasFlag = _quirks.vfReset;
+						break;
+					case 0x3:
+						result = LaneVector::bitXor(x, y);
+						hasFlag = _quirks.vfReset;
+						break;
+					case 0x4:
+						// Carry when the sum wrapped below VX
+						result = LaneVector::add(x, y);
+						flag = LaneVector::bitXor(LaneVector::bitAnd(LaneVector::equal(LaneVector::subSaturated(x, result), zero), one), one);
+						break;
+					case 0x5:
+						result = LaneVector::sub(x, y);
+						flag = LaneVector::bitAnd(LaneVector::equal(LaneVector::subSaturated(y, x), zero), one);
+						break;
+					case 0x6:
+						result = LaneVector::shiftRight1(_quirks.shifting ? y : x);
+						flag = LaneVector::bitAnd(x, one);
+						break;
+					case 0x7:
+						result = LaneVector::sub(y, x);
+						flag = LaneVector::bitAnd(LaneVector::equal(LaneVector::subSaturated(x, y), zero), one);
+						break;
+					default:
+						result = _quirks.shifting ? LaneVector::add(y, y) : LaneVector::add(x, x);
+						flag = LaneVector::shiftRight7(x);
+						break;
+				}
+
+				Vector laneMask = LaneVector::load(mask + i);
+				LaneVector::store(vx + i, LaneVector::select(laneMask, result, x));
+				if (hasFlag)
+				{
+					LaneVector::store(vf + i, LaneVector::select(laneMask, flag, LaneVector::load(vf + i)));
+				}
+			}
+			break;
+		case 0xA000:
+			for (size_t i = 0; i < _stride; i++)
+			{
+				_I[i] = mask[i] != 0 ? NNN : _I[i];
+			}
+			break;
+		default:
+			// FX07, FX15, FX18 and FX1E
+			if (NN == 0x1E)
+			{
+				for (size_t i = 0; i < _stride; i++)
+				{
+					_I[i] += mask[i] & vx[i];
+				}
+				break;
+			}
+			uint8_t* destination = NN == 0x07 ? vx : NN == 0x15 ? _delayTimer.data() : _soundTimer.data();
+			const uint8_t* source = NN == 0x07 ? _delayTimer.data() : vx;
+			for (size_t i = 0; i < _stride; i += LaneVector::WIDTH)
+			{
+				LaneVector::store(destination + i, LaneVector::select(LaneVector::load(mask + i), LaneVector::load(source + i), LaneVector::load(destination + i)));
+			}
+			break;
+	}
+}
+
+size_t Lockstep::compareSkip(uint16_t opCode)
+{
+	typedef LaneVector::Type Vector;
+	uint8_t X = (opCode & 0x0F00) >> 8;
+	uint8_t Y = (opCode & 0x00F0) >> 4;
+	const uint8_t* vx = registers(X);
+	const uint8_t* vy = registers(Y);
+	// 3XNN and 5XY0 skip on equal, 4XNN and 9XY0 on different, 5XY0 and 9XY0 compare to VY
+	bool isSkipOnEqual = (opCode & 0xF000) == 0x3000 || (opCode & 0xF000) == 0x5000;
+	bool isRegister = (opCode & 0xF000) == 0x5000 || (opCode & 0xF000) == 0x9000;
+	Vector value = LaneVector::set(opCode & 0x00FF);
+	Vector inverse = LaneVector::set(isSkipOnEqual ? 0 : 0xFF);
+
+	size_t skipCount = 0;
+	for (size_t i = 0; i < _stride; i += LaneVector::WIDTH)
+	{
+		Vector equal = LaneVector::equal(LaneVector::load(vx + i), isRegister ? LaneVector::load(vy + i) : value);
+		Vector skip = LaneVector::bitAnd(LaneVector::load(&_mask[i]), LaneVector::bitXor(equal, inverse));
+		LaneVector::store(&_skip[i], skip);
+		skipCount += LaneVector::count(skip);
+	}
+	return skipCount;
+}
+
+bool Lockstep::callGroup(uint16_t& pc)
+{
+	for (size_t lane = 0; lane < _laneCount; lane++)
+	{
+		if (_mask[lane] != 0 && _lanes[lane].stackSize == MachineState::STACK_SIZE)
+		{
+			return false;
+		}
+	}
+
+	for (size_t lane = 0; lane < _laneCount; lane++)
+	{
+		if (_mask[lane] != 0)
+		{
+			Lockstep::Lane& state = _lanes[lane];
+			state.stack[state.stackSize++] = pc + 2;
+		}
+	}
+	pc = sharedOpCode(pc) & 0x0FFF;
+	return true;
+}
+
+bool Lockstep::returnGroup(uint16_t& pc)
+{
+	size_t first = std::find(_mask.begin(), _mask.begin() + _laneCount, 0xFF) - _mask.begin();
+	const Lockstep::Lane& firstState = _lanes[first];
+	uint16_t target = firstState.stackSize > 0 ? firstState.stack[firstState.stackSize - 1] : 0;
+	for (size_t lane = first; lane < _laneCount; lane++)
+	{
+		const Lockstep::Lane& state = _lanes[lane];
+		if (_mask[lane] != 0 && (state.stackSize == 0 || state.stack[state.stackSize - 1] != target))
+		{
+			return false;
+		}
+	}
+
+	for (size_t lane = first; lane < _laneCount; lane++)
+	{
+		if (_mask[lane] != 0)
+		{
+			_lanes[lane].stackSize--;
+		}
+	}
+	pc = target;
+	return true;
+}
+
+void Lockstep::runLane(size_t lane, size_t maxCycles)
+{
+	Chip8& core = _cores[lane];
+	pushLane(lane);
+	size_t executed = 0;
+	bool isRunning = core.cpu().run(maxCycles, executed);
+	pullLane(lane);
+	_scalarCycleCount += executed;
+	_cyclesLeft[lane] -= std::min(executed, _cyclesLeft[lane]);
+
+	// FX0A waiting for a key would run again on every cycle left, the keys don't change before the next frame
+	uint16_t opCode = (core.memory().read8(_pc[lane]) << 8) | core.memory().read8(_pc[lane] + 1);
+	bool isWaitingKey = (opCode & 0xF0FF) == 0xF00A;
+	for (uint8_t key = 0; key < Input::INPUT_COUNT && isWaitingKey; key++)
+	{
+		isWaitingKey = core.input().getKeyState(key) != Input::KeyState::Released;
+	}
+	if (!isRunning)
+	{
+		_lanes[lane].isRunning = false;
+		_cyclesLeft[lane] = 0;
+	}
+	else if ((core.cpu().drawThisFrame() && _quirks.displayWait) || isWaitingKey)
+	{
+		_cyclesLeft[lane] = 0;
+	}
+
+	// Code written by a lane is no longer read from the shared copy
+	size_t begin;
+	size_t end;
+	core.memory().writeRange(begin, end);
+	if (begin < end)
+	{
+		_codeDirtyBegin = std::min(_codeDirtyBegin, begin);
+		_codeDirtyEnd = std::max(_codeDirtyEnd, end);
+	}
+}
+
+void Lockstep::storeLane(size_t lane, MachineState& state) const
+{
+	const Lockstep::Lane& source = _lanes[lane];
+	for (size_t i = 0; i < MachineState::REGISTER_COUNT; i++)
+	{
+		state.registers[i] = _registers[i * _stride + lane];
+	}
+	memcpy(state.flagRegisters, source.flagRegisters, sizeof(state.flagRegisters));
+	state.I = _I[lane];
+	state.pc = _pc[lane];
+	memcpy(state.stack, source.stack, sizeof(state.stack));
+	state.stackSize = source.stackSize;
+	state.delayTimer = _delayTimer[lane];
+	state.soundTimer = _soundTimer[lane];
+	state.halted = source.isRunning ? 0 : 1;
+	state.randomState = source.randomState;
+}
+
+void Lockstep::loadLane(size_t lane, const MachineState& state)
+{
+	Lockstep::Lane& destination = _lanes[lane];
+	for (size_t i = 0; i < MachineState::REGISTER_COUNT; i++)
+	{
+		_registers[i * _stride + lane] = state.registers[i];
+	}
+	memcpy(destination.flagRegisters, state.flagRegisters, sizeof(destination.flagRegisters));
+	_I[lane] = state.I;
+	_pc[lane] = state.pc;
+	memcpy(destination.stack, state.stack, sizeof(destination.stack));
+	destination.stackSize = state.stackSize;
+	_delayTimer[lane] = state.delayTimer;
+	_soundTimer[lane] = state.soundTimer;
+	destination.randomState = state.randomState;
+}
+
+void Lockstep::pushLane(size_t lane)
+{
+	storeLane(lane, _transfer);
+	_cores[lane].cpu().loadState(_transfer);
+}
+
+void Lockstep::pullLane(size_t lane)
+{
+	_cores[lane].cpu().saveState(_transfer);
+	loadLane(lane, _transfer);
+}
@@ -1,22 +1,173 @@
 #include "Memory.hpp"
+#include "Debugger.hpp"
+#include "MachineState.hpp"
+#include "State.hpp"
+#include "TraceRecorder.hpp"
+#include <algorithm>
 #include <cstring>
 
+Memory::Memory() :
+	_debugger(nullptr),
+	_traceRecorder(nullptr),
+	_codeWriteBegin(Memory::MAX_MEMORY_SIZE),
+	_codeWriteEnd(0),
+	_writeBegin(0),
+	_writeEnd(Memory::MAX_MEMORY_SIZE)
+{
+	setSize(Memory::MEMORY_SIZE);
+}
+
+void Memory::setSize(size_t size)
+{
+	_data.assign(size, 0);
+	_marks.assign(size, _traceRecorder != nullptr ? Memory::Mark::TraceWrite : 0);
+	_addressMask = static_cast<uint16_t>(size - 1);
+	_writeBegin = 0;
+	_writeEnd = size;
+	recordWrite(0, size);
+}
+
 uint8_t Memory::read8(uint16_t addr) const
 {
+	// Addresses wrap around like the 12 bits address bus of the original machine
+	addr &= _addressMask;
+#ifdef CHIP8_ENABLE_DEBUGGER
+	// The marks are only looked up while a debugger is attached
+	if (_debugger != nullptr && (_marks[addr] & Memory::Mark::ReadWatch) != 0)
+	{
+		_debugger->hitWatchpoint(addr, false);
+	}
+#endif
 	return _data[addr];
 }
 
 void Memory::write8(uint16_t addr, uint8_t value)
 {
+	addr &= _addressMask;
 	_data[addr] = value;
+	_writeBegin = std::min<size_t>(_writeBegin, addr);
+	_writeEnd = std::max<size_t>(_writeEnd, addr + 1);
+	if (_marks[addr] != 0)
+	{
+		if ((_marks[addr] & Memory::Mark::Code) != 0)
+		{
+			recordWrite(addr, 1);
+		}
+#ifdef CHIP8_ENABLE_DEBUGGER
+		if (_debugger != nullptr && (_marks[addr] & Memory::Mark::WriteWatch) != 0)
+		{
+			_debugger->hitWatchpoint(addr, true);
+		}
+#endif
+		if ((_marks[addr] & Memory::Mark::TraceWrite) != 0 && _traceRecorder != nullptr)
+		{
+			_traceRecorder->recordWrite(addr, value);
+		}
+	}
 }
 
-void Memory::copyBuffer(uint16_t addr, uint8_t* buffer, size_t size)
+void Memory::copyBuffer(uint16_t addr, const uint8_t* buffer, size_t size)
 {
 	memcpy(&_data[addr], buffer, size);
+	_writeBegin = std::min<size_t>(_writeBegin, addr);
+	_writeEnd = std::max<size_t>(_writeEnd, addr + size);
+	recordWrite(addr, size);
 }
 
 void Memory::clear()
 {
-	memset(_data, 0, Memory::MEMORY_SIZE);
+	std::fill(_data.begin(), _data.end(), 0);
+	_writeBegin = 0;
+	_writeEnd = _data.size();
+	recordWrite(0, _data.size());
+}
+
+void Memory::saveState(StateWriter& writer) const
+{
+	writer.writeBytes(_data.data(), _data.size());
+}
+
+void Memory::loadState(StateReader& reader)
+{
+	reader.readBytes(_data.data(), _data.size());
+	_writeBegin = 0;
+	_writeEnd = _data.size();
+	recordWrite(0, _data.size());
+}
+
+void Memory::saveState(MachineState& state) const
+{
+	memcpy(state.memory, _data.data(), sizeof(state.memory));
+}
+
+void Memory::loadState(const MachineState& state)
+{
+	memcpy(_data.data(), state.memory, sizeof(state.memory));
+	_writeBegin = _data.size();
+	_writeEnd = 0;
+}
+
+void Memory::saveWrites(MachineState& state) const
+{
+	if (_writeBegin < _writeEnd)
+	{
+		memcpy(state.memory + _writeBegin, &_data[_writeBegin], std::min(_writeEnd, sizeof(state.memory)) - _writeBegin);
+	}
+}
+
+void Memory::markCode(uint16_t addr, size_t size)
+{
+	size_t end = addr + std::min(size, _marks.size() - addr);
+	for (size_t i = addr; i < end; i++)
+	{
+		_marks[i] |= Memory::Mark::Code;
+	}
+}
+
+void Memory::clearCodeMarks()
+{
+	for (uint8_t& mark : _marks)
+	{
+		mark &= ~Memory::Mark::Code;
+	}
+}
+
+void Memory::takeCodeWrite(size_t& begin, size_t& end)
+{
+	begin = _codeWriteBegin;
+	end = _codeWriteEnd;
+	_codeWriteBegin = Memory::MAX_MEMORY_SIZE;
+	_codeWriteEnd = 0;
+}
+
+void Memory::addWatch(uint16_t addr, size_t size, bool isRead, bool isWrite)
+{
+	uint8_t watches = (isRead ? Memory::Mark::ReadWatch : 0) | (isWrite ? Memory::Mark::WriteWatch : 0);
+	for (size_t i = 0; i < size; i++)
+	{
+		_marks[(addr + i) & _addressMask] |= watches;
+	}
+}
+
+void Memory::clearWatches()
+{
+	for (uint8_t& mark : _marks)
+	{
+		mark &= ~(Memory::Mark::ReadWatch | Memory::Mark::WriteWatch);
+	}
+}
+
+void Memory::setTraceRecorder(TraceRecorder* traceRecorder)
+{
+	_traceRecorder = traceRecorder;
+	for (uint8_t& mark : _marks)
+	{
+		mark = traceRecorder != nullptr ? mark | Memory::Mark::TraceWrite : mark & ~Memory::Mark::TraceWrite;
+	}
+}
+
+void Memory::recordWrite(size_t addr, size_t size)
+{
+	_codeWriteBegin = std::min(_codeWriteBegin, addr);
+	_codeWriteEnd = std::max(_codeWriteEnd, addr + size);
 }
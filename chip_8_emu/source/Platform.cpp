@@ -0,0 +1,39 @@
+#include "Platform.hpp"
+
+static const char* PLATFORM_NAMES[] = { "vip", "schip", "xochip" };
+
+const char* Platform::name(Platform::Type type)
+{
+	return PLATFORM_NAMES[type];
+}
+
+bool Platform::fromString(const std::string& text, Platform::Type& type)
+{
+	for (uint8_t i = 0; i < sizeof(PLATFORM_NAMES) / sizeof(PLATFORM_NAMES[0]); i++)
+	{
+		if (text == PLATFORM_NAMES[i])
+		{
+			type = static_cast<Platform::Type>(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+Quirks Platform::quirks(Platform::Type type)
+{
+	switch (type)
+	{
+		case Platform::Type::SuperChip:
+			return { false, false, true, false, false };
+		case Platform::Type::XoChip:
+			return { true, false, false, true, false };
+		default:
+			return { true, true, true, true, true };
+	}
+}
+
+size_t Platform::memorySize(Platform::Type type)
+{
+	return type == Platform::Type::XoChip ? 0x10000 : 0x1000;
+}
@@ -0,0 +1,230 @@
+#include "Profiler.hpp"
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+static volatile std::sig_atomic_t reportRequested = 0;
+
+static const char* PHASE_NAMES[] = { "cpu", "render", "sleep" };
+
+static std::string addressToString(uint16_t pc)
+{
+	static const char* digits = "0123456789ABCDEF";
+	// Three digits as long as the address fits the 4KB memory
+	std::string text = pc > 0xFFF ? "0x0000" : "0x000";
+	for (size_t i = text.size() - 1; i >= 2; i--, pc >>= 4)
+	{
+		text[i] = digits[pc & 0xF];
+	}
+	return text;
+}
+
+Profiler::Profiler() :
+	_pcCounts(Memory::MAX_MEMORY_SIZE, 0)
+{
+	reset();
+}
+
+void Profiler::reset()
+{
+	std::fill(_pcCounts.begin(), _pcCounts.end(), 0);
+	memset(_instructionCounts, 0, sizeof(_instructionCounts));
+	_drawCalls = 0;
+	_drawPixels = 0;
+	_frames = 0;
+	_idleCycles = 0;
+	for (size_t i = 0; i < Profiler::PhaseCount; i++)
+	{
+		_phaseNanoseconds[i] = 0;
+	}
+	_inputLatencyCount = 0;
+	_inputLatencyNanoseconds = 0;
+	_maxInputLatencyNanoseconds = 0;
+}
+
+void Profiler::addPhaseTime(Profiler::Phase phase, std::chrono::steady_clock::duration duration)
+{
+	_phaseNanoseconds[phase].fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(), std::memory_order_relaxed);
+}
+
+void Profiler::addInputLatency(std::chrono::steady_clock::duration latency)
+{
+	// Only one thread adds latencies, the maximum needs no compare and swap
+	int64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count();
+	_inputLatencyCount.fetch_add(1, std::memory_order_relaxed);
+	_inputLatencyNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+	if (nanoseconds > _maxInputLatencyNanoseconds.load(std::memory_order_relaxed))
+	{
+		_maxInputLatencyNanoseconds.store(nanoseconds, std::memory_order_relaxed);
+	}
+}
+
+void Profiler::setInstructionName(uint8_t instruction, const std::string& name)
+{
+	_instructionNames[instruction] = name;
+}
+
+uint64_t Profiler::instructionCount() const
+{
+	uint64_t count = 0;
+	for (uint64_t instructionCount : _instructionCounts)
+	{
+		count += instructionCount;
+	}
+	return count;
+}
+
+// Addresses sorted by decreasing execution count, only the ones executed at least once
+static std::vector<uint16_t> hotspots(const uint64_t* pcCounts, size_t maxCount)
+{
+	std::vector<uint16_t> addresses;
+	for (size_t pc = 0; pc < Memory::MAX_MEMORY_SIZE; pc++)
+	{
+		if (pcCounts[pc] > 0)
+		{
+			addresses.push_back(static_cast<uint16_t>(pc));
+		}
+	}
+	std::stable_sort(addresses.begin(), addresses.end(), [&](uint16_t a, uint16_t b) { return pcCounts[a] > pcCounts[b]; });
+	if (addresses.size() > maxCount)
+	{
+		addresses.resize(maxCount);
+	}
+	return addresses;
+}
+
+void Profiler::writeJson(std::ostream& stream) const
+{
+	stream << std::dec << "{" << std::endl;
+	stream << "  \"frames\": " << _frames << "," << std::endl;
+	stream << "  \"instructions\": " << instructionCount() << "," << std::endl;
+	stream << "  \"idleCycles\": " << _idleCycles << "," << std::endl;
+	stream << "  \"draw\": { \"calls\": " << _drawCalls << ", \"pixels\": " << _drawPixels << " }," << std::endl;
+
+	stream << "  \"phases\": {";
+	for (size_t i = 0; i < Profiler::PhaseCount; i++)
+	{
+		stream << (i > 0 ? ", " : " ") << "\"" << PHASE_NAMES[i] << "Seconds\": " << _phaseNanoseconds[i] / 1e9;
+	}
+	stream << " }," << std::endl;
+
+	uint64_t latencyCount = _inputLatencyCount;
+	stream << "  \"inputLatency\": { \"count\": " << latencyCount
+		<< ", \"averageSeconds\": " << (latencyCount > 0 ? _inputLatencyNanoseconds / 1e9 / latencyCount : 0.0)
+		<< ", \"maxSeconds\": " << _maxInputLatencyNanoseconds / 1e9 << " }," << std::endl;
+
+	stream << "  \"opCodes\": {";
+	bool isFirst = true;
+	for (size_t i = 0; i < Profiler::MAX_INSTRUCTIONS; i++)
+	{
+		if (_instructionCounts[i] > 0)
+		{
+			stream << (isFirst ? " " : ", ") << "\"" << _instructionNames[i] << "\": " << _instructionCounts[i];
+			isFirst = false;
+		}
+	}
+	stream << " }," << std::endl;
+
+	// The full map is sparse, only executed addresses are listed
+	stream << "  \"pc\": {";
+	isFirst = true;
+	for (size_t pc = 0; pc < Memory::MAX_MEMORY_SIZE; pc++)
+	{
+		if (_pcCounts[pc] > 0)
+		{
+			stream << (isFirst ? " " : ", ") << "\"" << addressToString(static_cast<uint16_t>(pc)) << "\": " << _pcCounts[pc];
+			isFirst = false;
+		}
+	}
+	stream << " }," << std::endl;
+
+	stream << "  \"hotspots\": [";
+	std::vector<uint16_t> addresses = hotspots(_pcCounts.data(), Profiler::HOTSPOT_COUNT);
+	for (size_t i = 0; i < addresses.size(); i++)
+	{
+		stream << (i > 0 ? ", " : " ") << "\"" << addressToString(addresses[i]) << "\"";
+	}
+	stream << " ]" << std::endl;
+	stream << "}" << std::endl;
+}
+
+void Profiler::writeCsv(std::ostream& stream) const
+{
+	// One metric per line: section, key, value
+	stream << std::dec << "section,key,value" << std::endl;
+	stream << "total,frames," << _frames << std::endl;
+	stream << "total,instructions," << instructionCount() << std::endl;
+	stream << "total,idleCycles," << _idleCycles << std::endl;
+	stream << "draw,calls," << _drawCalls << std::endl;
+	stream << "draw,pixels," << _drawPixels << std::endl;
+	for (size_t i = 0; i < Profiler::PhaseCount; i++)
+	{
+		stream << "phase," << PHASE_NAMES[i] << "Seconds," << _phaseNanoseconds[i] / 1e9 << std::endl;
+	}
+	uint64_t latencyCount = _inputLatencyCount;
+	stream << "inputLatency,count," << latencyCount << std::endl;
+	stream << "inputLatency,averageSeconds," << (latencyCount > 0 ? _inputLatencyNanoseconds / 1e9 / latencyCount : 0.0) << std::endl;
+	stream << "inputLatency,maxSeconds," << _maxInputLatencyNanoseconds / 1e9 << std::endl;
+	for (size_t i = 0; i < Profiler::MAX_INSTRUCTIONS; i++)
+	{
+		if (_instructionCounts[i] > 0)
+		{
+			stream << "opCode," << _instructionNames[i] << "," << _instructionCounts[i] << std::endl;
+		}
+	}
+	for (size_t pc = 0; pc < Memory::MAX_MEMORY_SIZE; pc++)
+	{
+		if (_pcCounts[pc] > 0)
+		{
+			stream << "pc," << addressToString(static_cast<uint16_t>(pc)) << "," << _pcCounts[pc] << std::endl;
+		}
+	}
+}
+
+bool Profiler::writeReport(const std::string& path) const
+{
+	std::ofstream file(path);
+	if (!file.is_open())
+	{
+		std::cout << "[ERROR] Cannot write the profile '" << path << "'" << std::endl;
+		return false;
+	}
+
+	bool isCsv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+	if (isCsv)
+	{
+		writeCsv(file);
+	}
+	else
+	{
+		writeJson(file);
+	}
+	return file.good();
+}
+
+#ifdef SIGUSR1
+static void onReportSignal(int)
+{
+	reportRequested = 1;
+}
+#endif
+
+void Profiler::installSignalHandler()
+{
+#ifdef SIGUSR1
+	std::signal(SIGUSR1, onReportSignal);
+#endif
+}
+
+bool Profiler::takeReportRequest()
+{
+	if (reportRequested == 0)
+	{
+		return false;
+	}
+	reportRequested = 0;
+	return true;
+}
@@ -0,0 +1,59 @@
+#include "Quirks.hpp"
+
+static const char QUIRK_LETTERS[] = "LVCSD";
+
+std::string Quirks::toString() const
+{
+	const bool flags[Quirks::QUIRK_COUNT] = { saveLoadIncrement, vfReset, clipping, shifting, displayWait };
+
+	std::string text;
+	for (uint8_t i = 0; i < Quirks::QUIRK_COUNT; i++)
+	{
+		text += flags[i] ? QUIRK_LETTERS[i] : '-';
+	}
+	return text;
+}
+
+bool Quirks::fromString(const std::string& text, Quirks& quirks)
+{
+	if (text.size() != Quirks::QUIRK_COUNT)
+	{
+		return false;
+	}
+
+	uint8_t mask = 0;
+	for (uint8_t i = 0; i < Quirks::QUIRK_COUNT; i++)
+	{
+		if (text[i] == QUIRK_LETTERS[i])
+		{
+			mask |= 1 << i;
+		}
+		else if (text[i] != '-')
+		{
+			return false;
+		}
+	}
+
+	quirks = Quirks::fromMask(mask);
+	return true;
+}
+
+Quirks Quirks::fromMask(uint8_t mask)
+{
+	Quirks quirks;
+	quirks.saveLoadIncrement = (mask & 0x01) != 0;
+	quirks.vfReset = (mask & 0x02) != 0;
+	quirks.clipping = (mask & 0x04) != 0;
+	quirks.shifting = (mask & 0x08) != 0;
+	quirks.displayWait = (mask & 0x10) != 0;
+	return quirks;
+}
+
+uint8_t Quirks::toMask() const
+{
+	return (saveLoadIncrement ? 0x01 : 0)
+		| (vfReset ? 0x02 : 0)
+		| (clipping ? 0x04 : 0)
+		| (shifting ? 0x08 : 0)
+		| (displayWait ? 0x10 : 0);
+}
@@ -0,0 +1,193 @@
+#include "Rewind.hpp"
+
+// Deltas are a sequence of (zero run, literal count, literals) with both counts stored as varints
+static void writeVarint(std::vector<uint8_t>& data, size_t value)
+{
+	while (value >= 0x80)
+	{
+		data.push_back(static_cast<uint8_t>(value | 0x80));
+		value >>= 7;
+	}
+	data.push_back(static_cast<uint8_t>(value));
+}
+
+static bool readVarint(const std::vector<uint8_t>& data, size_t& offset, size_t& value)
+{
+	value = 0;
+	for (size_t shift = 0; offset < data.size() && shift < sizeof(size_t) * 8; shift += 7)
+	{
+		uint8_t byte = data[offset++];
+		value |= static_cast<size_t>(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+Rewind::Rewind(size_t capacity, size_t keyframeInterval) :
+	_slots(capacity > 0 ? capacity : 1),
+	_keyframeInterval(keyframeInterval > 0 ? keyframeInterval : 1),
+	_head(0),
+	_count(0),
+	_keyframe(0),
+	_framesSinceKeyframe(0),
+	_hasKeyframe(false)
+{ }
+
+void Rewind::clear()
+{
+	_head = 0;
+	_count = 0;
+	_hasKeyframe = false;
+}
+
+void Rewind::capture(const std::vector<uint8_t>& state)
+{
+	if (_count == _slots.size())
+	{
+		dropOldest();
+	}
+
+	// The keyframe could have been dropped to make room
+	bool isKeyframe = !_hasKeyframe || _framesSinceKeyframe >= _keyframeInterval || _slots[_keyframe].data.size() != state.size();
+
+	// Buffers of the slots are reused, once the ring is full capturing does not allocate
+	Rewind::Snapshot& snapshot = _slots[_head];
+	snapshot.isKeyframe = isKeyframe;
+	if (isKeyframe)
+	{
+		snapshot.keyframe = _head;
+		snapshot.data.assign(state.begin(), state.end());
+		_keyframe = _head;
+		_framesSinceKeyframe = 0;
+		_hasKeyframe = true;
+	}
+	else
+	{
+		snapshot.keyframe = _keyframe;
+		encodeDelta(state, _slots[_keyframe].data, snapshot.data);
+	}
+
+	_framesSinceKeyframe++;
+	_head = (_head + 1) % _slots.size();
+	_count++;
+}
+
+bool Rewind::rewind(std::vector<uint8_t>& state)
+{
+	if (_count == 0)
+	{
+		return false;
+	}
+
+	size_t slot = slotAt(0);
+	const Rewind::Snapshot& snapshot = _slots[slot];
+	bool isValid = true;
+	if (snapshot.isKeyframe)
+	{
+		state.assign(snapshot.data.begin(), snapshot.data.end());
+	}
+	else
+	{
+		isValid = decodeDelta(snapshot.data, _slots[snapshot.keyframe].data, state);
+	}
+
+	_head = slot;
+	_count--;
+
+	// Execution resumes from an older state, the next capture starts a new keyframe
+	_hasKeyframe = false;
+	return isValid;
+}
+
+size_t Rewind::memoryUsage() const
+{
+	size_t usage = 0;
+	for (size_t i = 0; i < _count; i++)
+	{
+		usage += _slots[slotAt(i)].data.size();
+	}
+	return usage;
+}
+
+size_t Rewind::slotAt(size_t age) const
+{
+	// Age 0 is the most recent capture
+	return (_head + _slots.size() - 1 - age) % _slots.size();
+}
+
+void Rewind::dropOldest()
+{
+	// Deltas can't be rebuilt without their keyframe so they go along with it
+	do
+	{
+		_count--;
+	}
+	while (_count > 0 && !_slots[slotAt(_count - 1)].isKeyframe);
+
+	if (_count == 0)
+	{
+		_hasKeyframe = false;
+	}
+}
+
+void Rewind::encodeDelta(const std::vector<uint8_t>& state, const std::vector<uint8_t>& keyframe, std::vector<uint8_t>& delta)
+{
+	delta.clear();
+	size_t size = state.size();
+	size_t i = 0;
+	while (i < size)
+	{
+		size_t zeroStart = i;
+		while (i < size && state[i] == keyframe[i])
+		{
+			i++;
+		}
+		if (i == size)
+		{
+			break;
+		}
+
+		// A literal run ends on two unchanged bytes, a single one is cheaper to store inline
+		size_t literalStart = i;
+		while (i < size && (state[i] != keyframe[i] || (i + 1 < size && state[i + 1] != keyframe[i + 1])))
+		{
+			i++;
+		}
+
+		writeVarint(delta, literalStart - zeroStart);
+		writeVarint(delta, i - literalStart);
+		for (size_t j = literalStart; j < i; j++)
+		{
+			delta.push_back(state[j] ^ keyframe[j]);
+		}
+	}
+}
+
+bool Rewind::decodeDelta(const std::vector<uint8_t>& delta, const std::vector<uint8_t>& keyframe, std::vector<uint8_t>& state)
+{
+	state.assign(keyframe.begin(), keyframe.end());
+	size_t offset = 0;
+	size_t position = 0;
+	while (offset < delta.size())
+	{
+		size_t zeroRun;
+		size_t literalCount;
+		if (!readVarint(delta, offset, zeroRun) || !readVarint(delta, offset, literalCount))
+		{
+			return false;
+		}
+		position += zeroRun;
+		if (position + literalCount > state.size() || offset + literalCount > delta.size())
+		{
+			return false;
+		}
+		for (size_t j = 0; j < literalCount; j++)
+		{
+			state[position++] ^= delta[offset++];
+		}
+	}
+	return true;
+}
@@ -0,0 +1,794 @@
+#include "RomAnalysis.hpp"
+#include "Chip8.hpp"
+#include "Memory.hpp"
+#include <algorithm>
+#include <cstdlib>
+
+static std::string hexToString(uint32_t value, size_t digits)
+{
+	static const char* hexDigits = "0123456789ABCDEF";
+	std::string text(digits, '0');
+	for (size_t i = digits; i > 0; i--, value >>= 4)
+	{
+		text[i - 1] = hexDigits[value & 0xF];
+	}
+	return text;
+}
+
+static std::string addressToString(uint32_t addr)
+{
+	// Three digits as long as the address fits the 4KB memory
+	return "0x" + hexToString(addr, addr > 0xFFF ? 4 : 3);
+}
+
+RomAnalysis::RomAnalysis() :
+	_platform(Platform::Type::CosmacVip),
+	_romSize(0),
+	_addressMask(0)
+{ }
+
+void RomAnalysis::analyze(const Memory& memory, size_t romSize, Platform::Type platform)
+{
+	_platform = platform;
+	_romSize = romSize;
+	_addressMask = memory.addressMask();
+	_memory.resize(memory.size());
+	for (size_t addr = 0; addr < _memory.size(); addr++)
+	{
+		_memory[addr] = memory.read8(static_cast<uint16_t>(addr));
+	}
+	_byteKinds.assign(_memory.size(), RomAnalysis::ByteKind::Data);
+	_states.assign(_memory.size(), RomAnalysis::State());
+	_updates.assign(_memory.size(), 0);
+	_returns.clear();
+	_calls.clear();
+	_indirectJumps.clear();
+
+	// Registers and I are whatever the CPU holds when it starts, only the stack is known to be empty
+	RomAnalysis::State entry = {};
+	entry.isReached = true;
+	entry.isStackEmpty = true;
+	entry.iBegin = 0;
+	entry.iEnd = RomAnalysis::FULL_RANGE;
+	uint16_t start = Chip8::ROM_START_ADDR;
+	std::vector<uint16_t> pending(1, start);
+	merge(start, entry);
+
+	std::vector<uint16_t> targets;
+	while (!pending.empty())
+	{
+		uint16_t addr = pending.back();
+		pending.pop_back();
+		RomAnalysis::State state = _states[addr];
+		uint16_t opCode = readOpCode(addr);
+		uint8_t size = instructionSize(addr);
+		_byteKinds[addr] = RomAnalysis::ByteKind::Instruction;
+		for (uint8_t i = 1; i < size; i++)
+		{
+			uint8_t& kind = _byteKinds[(addr + i) & _addressMask];
+			kind = std::max<uint8_t>(kind, RomAnalysis::ByteKind::Operand);
+		}
+
+		// Unknown opCodes stop the execution
+		if (!isValid(opCode, _platform))
+		{
+			continue;
+		}
+
+		if ((opCode & 0xF000) == 0xB000)
+		{
+			if (std::find(_indirectJumps.begin(), _indirectJumps.end(), addr) == _indirectJumps.end())
+			{
+				_indirectJumps.push_back(addr);
+			}
+			continue;
+		}
+
+		if ((opCode & 0xF000) == 0x2000)
+		{
+			// A new call site or one reached from the top level adds a place to return to, the returns run again
+			bool isNewCall = std::find(_calls.begin(), _calls.end(), addr) == _calls.end();
+			if (isNewCall)
+			{
+				_calls.push_back(addr);
+			}
+			if (isNewCall || state.isStackEmpty)
+			{
+				pending.insert(pending.end(), _returns.begin(), _returns.end());
+			}
+			state.isStackEmpty = false;
+		}
+
+		if (opCode == 0x00EE)
+		{
+			if (std::find(_returns.begin(), _returns.end(), addr) == _returns.end())
+			{
+				_returns.push_back(addr);
+			}
+			// The stack is back to what it was at the call
+			for (uint16_t call : _calls)
+			{
+				RomAnalysis::State returned = state;
+				returned.isStackEmpty = _states[call].isStackEmpty;
+				uint16_t target = (call + 2) & _addressMask;
+				if (merge(target, returned))
+				{
+					pending.push_back(target);
+				}
+			}
+			if (state.isStackEmpty && merge((addr + 2) & _addressMask, state))
+			{
+				pending.push_back((addr + 2) & _addressMask);
+			}
+			continue;
+		}
+
+		execute(addr, state);
+		successors(addr, targets);
+		for (uint16_t target : targets)
+		{
+			if (merge(target, state))
+			{
+				pending.push_back(target);
+			}
+		}
+	}
+
+	std::sort(_indirectJumps.begin(), _indirectJumps.end());
+	buildBlocks();
+	findCodeStores();
+}
+
+bool RomAnalysis::matches(const Memory& memory) const
+{
+	if (memory.size() != _memory.size())
+	{
+		return false;
+	}
+	for (size_t addr = 0; addr < _memory.size(); addr++)
+	{
+		if (memory.read8(static_cast<uint16_t>(addr)) != _memory[addr])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool RomAnalysis::isDataStore(uint16_t addr) const
+{
+	uint32_t begin;
+	uint32_t end;
+	return isComplete() && isInstruction(addr) && storeRange(addr & _addressMask, begin, end);
+}
+
+size_t RomAnalysis::instructionCount() const
+{
+	return std::count(_byteKinds.begin(), _byteKinds.end(), static_cast<uint8_t>(RomAnalysis::ByteKind::Instruction));
+}
+
+uint16_t RomAnalysis::readOpCode(uint16_t addr) const
+{
+	return (_memory[addr & _addressMask] << 8) | _memory[(addr + 1) & _addressMask];
+}
+
+bool RomAnalysis::isValid(uint16_t opCode, Platform::Type platform)
+{
+	// Same instructions as CPU::addInstructions() for the platform
+	bool isSchip = platform != Platform::Type::CosmacVip;
+	bool isXoChip = platform == Platform::Type::XoChip;
+	uint8_t NN = opCode & 0x00FF;
+	uint8_t N = opCode & 0x000F;
+	switch (opCode & 0xF000)
+	{
+		case 0x0000:
+			return opCode == 0x00E0 || opCode == 0x00EE
+				|| (isSchip && ((opCode & 0xFFF0) == 0x00C0 || (opCode >= 0x00FB && opCode <= 0x00FF)))
+				|| (isXoChip && (opCode & 0xFFF0) == 0x00D0);
+		case 0x5000:
+			return N == 0 || (isXoChip && (N == 2 || N == 3));
+		case 0x8000:
+			return N <= 7 || N == 0xE;
+		case 0x9000:
+			return N == 0;
+		case 0xE000:
+			return NN == 0x9E || NN == 0xA1;
+		case 0xF000:
+			switch (NN)
+			{
+				case 0x07:
+				case 0x0A:
+				case 0x15:
+				case 0x18:
+				case 0x1E:
+				case 0x29:
+				case 0x33:
+				case 0x55:
+				case 0x65:
+					return true;
+				case 0x30:
+				case 0x75:
+				case 0x85:
+					return isSchip;
+				case 0x00:
+				case 0x02:
+					return isXoChip && (opCode & 0x0F00) == 0;
+				case 0x01:
+				case 0x3A:
+					return isXoChip;
+				default:
+					return false;
+			}
+		default:
+			return true;
+	}
+}
+
+uint8_t RomAnalysis::instructionSize(uint16_t addr) const
+{
+	// F000 is followed by its 16 bits address
+	return _platform == Platform::Type::XoChip && readOpCode(addr) == 0xF000 ? 4 : 2;
+}
+
+std::string RomAnalysis::instructionText(uint16_t addr) const
+{
+	std::string text;
+	if (!disassemble(readOpCode(addr), _platform, text))
+	{
+		return "???";
+	}
+	// The address loaded by F000 follows it
+	return instructionSize(addr) == 4 ? "LD I, 0x" + hexToString(readOpCode(addr + 2), 4) : text;
+}
+
+bool RomAnalysis::merge(uint16_t addr, const RomAnalysis::State& state)
+{
+	RomAnalysis::State& current = _states[addr];
+	if (!current.isReached)
+	{
+		current = state;
+		return true;
+	}
+
+	bool isChanged = false;
+	if (state.isStackEmpty && !current.isStackEmpty)
+	{
+		current.isStackEmpty = true;
+		isChanged = true;
+	}
+	if (state.iBegin < current.iBegin || state.iEnd > current.iEnd)
+	{
+		current.iBegin = std::min(current.iBegin, state.iBegin);
+		current.iEnd = std::max(current.iEnd, state.iEnd);
+		isChanged = true;
+	}
+	for (size_t i = 0; i < 16; i++)
+	{
+		RomAnalysis::Value& value = current.registers[i];
+		if (value.isKnown && (!state.registers[i].isKnown || state.registers[i].value != value.value))
+		{
+			value.isKnown = false;
+			isChanged = true;
+		}
+	}
+
+	// A loop stepping I or a register would go through each value, it takes any value instead
+	if (isChanged && ++_updates[addr] > RomAnalysis::MAX_UPDATES)
+	{
+		current.iBegin = 0;
+		current.iEnd = RomAnalysis::FULL_RANGE;
+		for (RomAnalysis::Value& value : current.registers)
+		{
+			value.isKnown = false;
+		}
+	}
+	return isChanged;
+}
+
+void RomAnalysis::execute(uint16_t addr, RomAnalysis::State& state) const
+{
+	uint16_t opCode = readOpCode(addr);
+	uint16_t NNN = opCode & 0x0FFF;
+	uint8_t NN = opCode & 0x00FF;
+	uint8_t N = opCode & 0x000F;
+	uint8_t X = (opCode & 0x0F00) >> 8;
+	uint8_t Y = (opCode & 0x00F0) >> 4;
+	RomAnalysis::Value* registers = state.registers;
+	const RomAnalysis::Value unknown = { false, 0 };
+
+	switch (opCode & 0xF000)
+	{
+		case 0x5000:
+			// 5XY3 loads VX to VY from memory
+			if (N == 3)
+			{
+				for (uint8_t i = std::min(X, Y); i <= std::max(X, Y); i++)
+				{
+					registers[i] = unknown;
+				}
+			}
+			break;
+		case 0x6000:
+			registers[X] = { true, NN };
+			break;
+		case 0x7000:
+			registers[X].value += NN;
+			break;
+		case 0x8000:
+		{
+			RomAnalysis::Value x = registers[X];
+			RomAnalysis::Value y = registers[Y];
+			RomAnalysis::Value result = unknown;
+			if (N == 0)
+			{
+				result = y;
+			}
+			else if (N <= 3 && x.isKnown && y.isKnown)
+			{
+				result = { true, static_cast<uint8_t>(N == 1 ? x.value | y.value : N == 2 ? x.value & y.value : x.value ^ y.value) };
+			}
+			registers[X] = result;
+			// Carries, borrows and the VF reset quirk
+			if (N != 0)
+			{
+				registers[0xF] = unknown;
+			}
+			break;
+		}
+		case 0xA000:
+			state.iBegin = NNN;
+			state.iEnd = NNN;
+			break;
+		case 0xC000:
+			registers[X] = unknown;
+			break;
+		case 0xD000:
+			registers[0xF] = unknown;
+			break;
+		case 0xF000:
+			switch (NN)
+			{
+				case 0x00:
+					state.iBegin = readOpCode(addr + 2);
+					state.iEnd = state.iBegin;
+					break;
+				case 0x07:
+				case 0x0A:
+					registers[X] = unknown;
+					break;
+				case 0x1E:
+					state.iBegin += registers[X].isKnown ? registers[X].value : 0;
+					state.iEnd += registers[X].isKnown ? registers[X].value : 0xFF;
+					break;
+				case 0x29:
+					state.iBegin = Chip8::FONT_START_ADDRESS + (registers[X].isKnown ? registers[X].value * 5 : 0);
+					state.iEnd = Chip8::FONT_START_ADDRESS + (registers[X].isKnown ? registers[X].value : 0xFF) * 5;
+					break;
+				case 0x30:
+					state.iBegin = Chip8::BIG_FONT_START_ADDRESS + (registers[X].isKnown ? (registers[X].value & 0x0F) * 10 : 0);
+					state.iEnd = Chip8::BIG_FONT_START_ADDRESS + (registers[X].isKnown ? registers[X].value & 0x0F : 0x0F) * 10;
+					break;
+				case 0x55:
+				case 0x65:
+				case 0x85:
+					if (NN != 0x55)
+					{
+						for (uint8_t i = 0; i <= X; i++)
+						{
+							registers[i] = unknown;
+						}
+					}
+					// Moved past the registers with the save and load quirk, which may be either way
+					if (NN != 0x85)
+					{
+						state.iEnd += X + 1;
+					}
+					break;
+			}
+			break;
+	}
+
+	// I is 16 bits wide and wraps around
+	if (state.iEnd > RomAnalysis::FULL_RANGE)
+	{
+		state.iBegin = 0;
+		state.iEnd = RomAnalysis::FULL_RANGE;
+	}
+}
+
+void RomAnalysis::successors(uint16_t addr, std::vector<uint16_t>& targets) const
+{
+	targets.clear();
+	uint16_t opCode = readOpCode(addr);
+	uint16_t next = (addr + instructionSize(addr)) & _addressMask;
+	if (!isValid(opCode, _platform) || opCode == 0x00FD)
+	{
+		return;
+	}
+
+	if (opCode == 0x00EE)
+	{
+		for (uint16_t call : _calls)
+		{
+			targets.push_back((call + 2) & _addressMask);
+		}
+		if (_states[addr].isStackEmpty)
+		{
+			targets.push_back(next);
+		}
+		return;
+	}
+
+	uint8_t N = opCode & 0x000F;
+	switch (opCode & 0xF000)
+	{
+		case 0x1000:
+		case 0x2000:
+			targets.push_back(opCode & 0x0FFF);
+			return;
+		case 0xB000:
+			return;
+		case 0x5000:
+		case 0x9000:
+			if (N != 0)
+			{
+				break;
+			}
+			// Fallthrough
+		case 0x3000:
+		case 0x4000:
+		case 0xE000:
+			targets.push_back(next);
+			targets.push_back((next + instructionSize(next)) & _addressMask);
+			return;
+	}
+	targets.push_back(next);
+}
+
+bool RomAnalysis::storeRange(uint16_t addr, uint32_t& begin, uint32_t& end) const
+{
+	uint16_t opCode = readOpCode(addr);
+	uint8_t X = (opCode & 0x0F00) >> 8;
+	uint8_t Y = (opCode & 0x00F0) >> 4;
+	uint32_t size;
+	if ((opCode & 0xF0FF) == 0xF033)
+	{
+		size = 3;
+	}
+	else if ((opCode & 0xF0FF) == 0xF055)
+	{
+		size = X + 1;
+	}
+	else if ((opCode & 0xF00F) == 0x5002 && _platform == Platform::Type::XoChip)
+	{
+		size = std::abs(X - Y) + 1;
+	}
+	else
+	{
+		return false;
+	}
+
+	const RomAnalysis::State& state = _states[addr];
+	begin = state.iBegin;
+	end = state.iEnd + size;
+	// Addresses past the memory wrap around
+	if (end > _memory.size())
+	{
+		begin = 0;
+		end = static_cast<uint32_t>(_memory.size());
+	}
+	return true;
+}
+
+void RomAnalysis::buildBlocks()
+{
+	// A block starts where the path from the start comes in and at every target of a jump, a call, a skip or a return
+	std::vector<bool> isLeader(_memory.size(), false);
+	isLeader[Chip8::ROM_START_ADDR] = true;
+	std::vector<uint16_t> targets;
+	for (size_t addr = 0; addr < _memory.size(); addr++)
+	{
+		if (_byteKinds[addr] != RomAnalysis::ByteKind::Instruction)
+		{
+			continue;
+		}
+		successors(static_cast<uint16_t>(addr), targets);
+		uint16_t next = (addr + instructionSize(static_cast<uint16_t>(addr))) & _addressMask;
+		if (targets.size() != 1 || targets[0] != next)
+		{
+			for (uint16_t target : targets)
+			{
+				isLeader[target] = true;
+			}
+		}
+	}
+
+	_blocks.clear();
+	for (size_t begin = 0; begin < _memory.size(); begin++)
+	{
+		if (!isLeader[begin])
+		{
+			continue;
+		}
+
+		RomAnalysis::Block block;
+		block.begin = static_cast<uint16_t>(begin);
+		uint16_t addr = block.begin;
+		while (true)
+		{
+			successors(addr, targets);
+			uint16_t next = (addr + instructionSize(addr)) & _addressMask;
+			if (targets.size() != 1 || targets[0] != next || isLeader[next] || next <= addr || !isInstruction(next))
+			{
+				block.end = addr + instructionSize(addr);
+				block.successors = targets;
+				break;
+			}
+			addr = next;
+		}
+		_blocks.push_back(block);
+	}
+}
+
+void RomAnalysis::findCodeStores()
+{
+	// Code bytes before each address, so any range is checked at once
+	std::vector<uint32_t> codeBefore(_memory.size() + 1, 0);
+	for (size_t addr = 0; addr < _memory.size(); addr++)
+	{
+		codeBefore[addr + 1] = codeBefore[addr] + (_byteKinds[addr] != RomAnalysis::ByteKind::Data ? 1 : 0);
+	}
+
+	_codeStores.clear();
+	for (size_t addr = 0; addr < _memory.size(); addr++)
+	{
+		uint32_t begin;
+		uint32_t end;
+		if (_byteKinds[addr] == RomAnalysis::ByteKind::Instruction && storeRange(static_cast<uint16_t>(addr), begin, end) && codeBefore[end] > codeBefore[begin])
+		{
+			_codeStores.push_back({ static_cast<uint16_t>(addr), begin, end });
+		}
+	}
+}
+
+bool RomAnalysis::disassemble(uint16_t opCode, Platform::Type platform, std::string& text)
+{
+	if (!isValid(opCode, platform))
+	{
+		return false;
+	}
+
+	std::string NNN = "0x" + hexToString(opCode & 0x0FFF, 3);
+	std::string NN = "0x" + hexToString(opCode & 0x00FF, 2);
+	std::string N = std::to_string(opCode & 0x000F);
+	std::string X = "V" + hexToString((opCode & 0x0F00) >> 8, 1);
+	std::string Y = "V" + hexToString((opCode & 0x00F0) >> 4, 1);
+	static const char* aluNames[] = { "LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN" };
+
+	switch (opCode & 0xF000)
+	{
+		case 0x0000:
+			switch (opCode & 0x00F0)
+			{
+				case 0x00C0:
+					text = "SCD " + N;
+					return true;
+				case 0x00D0:
+					text = "SCU " + N;
+					return true;
+			}
+			switch (opCode)
+			{
+				case 0x00E0: text = "CLS"; break;
+				case 0x00EE: text = "RET"; break;
+				case 0x00FB: text = "SCR"; break;
+				case 0x00FC: text = "SCL"; break;
+				case 0x00FD: text = "EXIT"; break;
+				case 0x00FE: text = "LOW"; break;
+				default: text = "HIGH"; break;
+			}
+			return true;
+		case 0x1000: text = "JP " + NNN; return true;
+		case 0x2000: text = "CALL " + NNN; return true;
+		case 0x3000: text = "SE " + X + ", " + NN; return true;
+		case 0x4000: text = "SNE " + X + ", " + NN; return true;
+		case 0x5000:
+			text = (opCode & 0x000F) == 0 ? "SE " + X + ", " + Y : ((opCode & 0x000F) == 2 ? "SAVE " : "LOAD ") + X + "-" + Y;
+			return true;
+		case 0x6000: text = "LD " + X + ", " + NN; return true;
+		case 0x7000: text = "ADD " + X + ", " + NN; return true;
+		case 0x8000: text = std::string((opCode & 0x000F) == 0xE ? "SHL" : aluNames[opCode & 0x000F]) + " " + X + ", " + Y; return true;
+		case 0x9000: text = "SNE " + X + ", " + Y; return true;
+		case 0xA000: text = "LD I, " + NNN; return true;
+		case 0xB000: text = "JP V0, " + NNN; return true;
+		case 0xC000: text = "RND " + X + ", " + NN; return true;
+		case 0xD000: text = "DRW " + X + ", " + Y + ", " + N; return true;
+		case 0xE000: text = ((opCode & 0x00FF) == 0x9E ? "SKP " : "SKNP ") + X; return true;
+	}
+
+	switch (opCode & 0x00FF)
+	{
+		case 0x00: text = "LD I, long"; break;
+		case 0x01: text = "PLANE " + std::to_string((opCode & 0x0F00) >> 8); break;
+		case 0x02: text = "AUDIO"; break;
+		case 0x07: text = "LD " + X + ", DT"; break;
+		case 0x0A: text = "LD " + X + ", K"; break;
+		case 0x15: text = "LD DT, " + X; break;
+		case 0x18: text = "LD ST, " + X; break;
+		case 0x1E: text = "ADD I, " + X; break;
+		case 0x29: text = "LD F, " + X; break;
+		case 0x30: text = "LD HF, " + X; break;
+		case 0x33: text = "LD B, " + X; break;
+		case 0x3A: text = "PITCH " + X; break;
+		case 0x55: text = "LD [I], " + X; break;
+		case 0x65: text = "LD " + X + ", [I]"; break;
+		case 0x75: text = "LD R, " + X; break;
+		default: text = "LD " + X + ", R"; break;
+	}
+	return true;
+}
+
+void RomAnalysis::writeListing(std::ostream& stream) const
+{
+	size_t storeCount = _codeStores.size();
+	stream << "; " << Platform::name(_platform) << " rom of " << std::dec << _romSize << " bytes, "
+		<< instructionCount() << " instructions in " << _blocks.size() << " blocks" << std::endl;
+	if (isComplete())
+	{
+		stream << "; complete: every instruction that can run is listed and none of them is ever written" << std::endl;
+	}
+	else
+	{
+		stream << "; incomplete: " << _indirectJumps.size() << " indirect jumps, " << storeCount << " stores may write code" << std::endl;
+	}
+
+	// Code anywhere in memory, data only within the rom
+	size_t romEnd = Chip8::ROM_START_ADDR + _romSize;
+	size_t blockIndex = 0;
+	std::vector<uint8_t> data;
+	size_t dataBegin = 0;
+	for (size_t addr = 0; addr <= _memory.size(); )
+	{
+		bool isInstructionStart = addr < _memory.size() && _byteKinds[addr] == RomAnalysis::ByteKind::Instruction;
+		bool isData = addr >= Chip8::ROM_START_ADDR && addr < romEnd && _byteKinds[addr] == RomAnalysis::ByteKind::Data;
+		if (!data.empty() && (!isData || data.size() == 8))
+		{
+			stream << addressToString(static_cast<uint32_t>(dataBegin)) << "  db ";
+			for (size_t i = 0; i < data.size(); i++)
+			{
+				stream << (i > 0 ? ", " : "") << "0x" << hexToString(data[i], 2);
+			}
+			stream << std::endl;
+			data.clear();
+		}
+		if (addr == _memory.size())
+		{
+			break;
+		}
+
+		if (isData)
+		{
+			dataBegin = data.empty() ? addr : dataBegin;
+			data.push_back(_memory[addr]);
+			addr++;
+			continue;
+		}
+		if (!isInstructionStart)
+		{
+			addr++;
+			continue;
+		}
+
+		for (; blockIndex < _blocks.size() && _blocks[blockIndex].begin <= addr; blockIndex++)
+		{
+			if (_blocks[blockIndex].begin == addr)
+			{
+				const RomAnalysis::Block& block = _blocks[blockIndex];
+				stream << std::endl << "; block " << addressToString(block.begin) << "-" << addressToString(block.end) << " ->";
+				for (size_t i = 0; i < block.successors.size(); i++)
+				{
+					stream << (i > 0 ? ", " : " ") << addressToString(block.successors[i]);
+				}
+				stream << (block.successors.empty() ? " none" : "") << std::endl;
+			}
+		}
+
+		uint16_t opCode = readOpCode(static_cast<uint16_t>(addr));
+		uint8_t size = instructionSize(static_cast<uint16_t>(addr));
+		std::string text = instructionText(static_cast<uint16_t>(addr));
+		std::string comment = isValid(opCode, _platform) ? "" : "unknown opCode, halts";
+		if ((opCode & 0xF000) == 0xB000)
+		{
+			comment = "indirect jump";
+		}
+		for (const RomAnalysis::CodeStore& store : _codeStores)
+		{
+			if (store.address == addr)
+			{
+				comment = "may write code in " + addressToString(store.begin) + "-" + addressToString(store.end);
+			}
+		}
+
+		std::string bytes = hexToString(opCode, 4) + (size == 4 ? " " + hexToString(readOpCode(static_cast<uint16_t>(addr + 2)), 4) : "");
+		stream << addressToString(static_cast<uint32_t>(addr)) << "  " << bytes << std::string(11 - bytes.size(), ' ') << text;
+		if (!comment.empty())
+		{
+			stream << std::string(text.size() < 20 ? 20 - text.size() : 1, ' ') << "; " << comment;
+		}
+		stream << std::endl;
+
+		// Instructions overlapping this one are listed as well
+		size_t next = addr + 1;
+		while (next < addr + size && next < _memory.size() && _byteKinds[next] != RomAnalysis::ByteKind::Instruction)
+		{
+			next++;
+		}
+		addr = next;
+	}
+}
+
+void RomAnalysis::writeJson(std::ostream& stream) const
+{
+	stream << std::dec << "{" << std::endl;
+	stream << "  \"platform\": \"" << Platform::name(_platform) << "\"," << std::endl;
+	stream << "  \"romSize\": " << _romSize << "," << std::endl;
+	stream << "  \"complete\": " << (isComplete() ? "true" : "false") << "," << std::endl;
+
+	// Runs of code anywhere in memory and of data within the rom
+	stream << "  \"regions\": [";
+	size_t romEnd = Chip8::ROM_START_ADDR + _romSize;
+	bool isFirst = true;
+	for (size_t begin = 0; begin < _memory.size(); )
+	{
+		bool isCodeRegion = _byteKinds[begin] != RomAnalysis::ByteKind::Data;
+		size_t end = begin + 1;
+		while (end < _memory.size() && (_byteKinds[end] != RomAnalysis::ByteKind::Data) == isCodeRegion && (isCodeRegion || end < romEnd))
+		{
+			end++;
+		}
+		if (isCodeRegion || (begin >= Chip8::ROM_START_ADDR && begin < romEnd))
+		{
+			stream << (isFirst ? " " : ", ") << "{ \"begin\": \"" << addressToString(static_cast<uint32_t>(begin)) << "\", \"end\": \""
+				<< addressToString(static_cast<uint32_t>(end)) << "\", \"kind\": \"" << (isCodeRegion ? "code" : "data") << "\" }";
+			isFirst = false;
+		}
+		begin = end;
+	}
+	stream << " ]," << std::endl;
+
+	stream << "  \"blocks\": [" << std::endl;
+	for (size_t i = 0; i < _blocks.size(); i++)
+	{
+		const RomAnalysis::Block& block = _blocks[i];
+		stream << "    { \"begin\": \"" << addressToString(block.begin) << "\", \"end\": \"" << addressToString(block.end) << "\", \"successors\": [";
+		for (size_t j = 0; j < block.successors.size(); j++)
+		{
+			stream << (j > 0 ? ", " : " ") << "\"" << addressToString(block.successors[j]) << "\"";
+		}
+		stream << (block.successors.empty() ? "" : " ") << "], \"instructions\": [";
+		for (uint32_t addr = block.begin; addr < block.end; addr += instructionSize(static_cast<uint16_t>(addr)))
+		{
+			stream << (addr > block.begin ? ", " : " ") << "{ \"address\": \"" << addressToString(addr) << "\", \"opCode\": \""
+				<< hexToString(readOpCode(static_cast<uint16_t>(addr)), 4) << "\", \"text\": \"" << instructionText(static_cast<uint16_t>(addr)) << "\" }";
+		}
+		stream << " ] }" << (i + 1 < _blocks.size() ? "," : "") << std::endl;
+	}
+	stream << "  ]," << std::endl;
+
+	stream << "  \"indirectJumps\": [";
+	for (size_t i = 0; i < _indirectJumps.size(); i++)
+	{
+		stream << (i > 0 ? ", " : " ") << "\"" << addressToString(_indirectJumps[i]) << "\"";
+	}
+	stream << (_indirectJumps.empty() ? "" : " ") << "]," << std::endl;
+
+	stream << "  \"codeStores\": [";
+	for (size_t i = 0; i < _codeStores.size(); i++)
+	{
+		const RomAnalysis::CodeStore& store = _codeStores[i];
+		stream << (i > 0 ? ", " : " ") << "{ \"address\": \"" << addressToString(store.address) << "\", \"begin\": \""
+			<< addressToString(store.begin) << "\", \"end\": \"" << addressToString(store.end) << "\" }";
+	}
+	stream << (_codeStores.empty() ? "" : " ") << "]" << std::endl;
+	stream << "}" << std::endl;
+}
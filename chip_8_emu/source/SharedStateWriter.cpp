@@ -0,0 +1,88 @@
+#include "SharedStateWriter.hpp"
+#include "CPU.hpp"
+#include "Framebuffer.hpp"
+#include "SharedState.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+SharedStateWriter::SharedStateWriter() :
+	_state(nullptr),
+	_handle(0),
+	_frameCount(0)
+{
+	memset(&_registers, 0, sizeof(_registers));
+}
+
+SharedStateWriter::~SharedStateWriter()
+{
+	close();
+}
+
+bool SharedStateWriter::open(const std::string& name)
+{
+	close();
+
+	_state = SharedState::map(name, true, _handle);
+	if (_state == nullptr)
+	{
+		std::cout << "[ERROR] Cannot create the shared memory '" << name << "'" << std::endl;
+		return false;
+	}
+	_name = name;
+	_frameCount = 0;
+	// The segment starts zeroed, readers refuse it until the magic is set
+	_state->version = SharedState::VERSION;
+	std::atomic_thread_fence(std::memory_order_release);
+	_state->magic = SharedState::MAGIC;
+	return true;
+}
+
+void SharedStateWriter::close()
+{
+	if (_state == nullptr)
+	{
+		return;
+	}
+
+	_state->isClosed.store(1, std::memory_order_release);
+	SharedState::unmap(_state, _handle, _name, true);
+	_state = nullptr;
+}
+
+void SharedStateWriter::publish(const Framebuffer& framebuffer, const CPU& cpu)
+{
+	// The slot not published last, readers may still be reading the other one
+	uint32_t slot = (_state->latest.load(std::memory_order_relaxed) + 1) & 1;
+	SharedState::Frame& frame = _state->frames[slot];
+	uint32_t sequence = frame.sequence.load(std::memory_order_relaxed);
+	frame.sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	cpu.saveState(_registers);
+	frame.width = framebuffer.width();
+	frame.height = framebuffer.height();
+	frame.planeCount = framebuffer.planeCount();
+	frame.stackSize = _registers.stackSize;
+	frame.frame = _frameCount + 1;
+	frame.time = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	memcpy(frame.registers, _registers.registers, sizeof(frame.registers));
+	frame.I = _registers.I;
+	frame.pc = _registers.pc;
+	memcpy(frame.stack, _registers.stack, sizeof(frame.stack));
+	frame.delayTimer = _registers.delayTimer;
+	frame.soundTimer = _registers.soundTimer;
+	// The planes are contiguous in the framebuffer as in the slot
+	size_t wordCount = std::min<size_t>(framebuffer.wordsPerRow() * framebuffer.height() * framebuffer.planeCount(), static_cast<size_t>(SharedState::MAX_WORDS));
+	memcpy(frame.rows, framebuffer.row(0), wordCount * sizeof(uint64_t));
+
+	frame.sequence.store(sequence + 2, std::memory_order_release);
+	_state->latest.store(slot, std::memory_order_release);
+	_state->frameCount.store(++_frameCount, std::memory_order_release);
+}
+
+uint64_t SharedStateWriter::acknowledgedFrame() const
+{
+	return _state->acknowledgedFrame.load(std::memory_order_acquire);
+}
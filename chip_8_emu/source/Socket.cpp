@@ -0,0 +1,184 @@
+#include "Socket.hpp"
+#include <cstring>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET SocketHandle;
+typedef int SocketLength;
+typedef WSAPOLLFD PollDescriptor;
+static const int SEND_FLAGS = 0;
+static bool isWouldBlock() { return WSAGetLastError() == WSAEWOULDBLOCK; }
+static bool isInterrupted() { return false; }
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int SocketHandle;
+typedef socklen_t SocketLength;
+typedef pollfd PollDescriptor;
+// A client gone while data is sent must not raise SIGPIPE
+#ifdef MSG_NOSIGNAL
+static const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+static const int SEND_FLAGS = 0;
+#endif
+static bool isWouldBlock() { return errno == EAGAIN || errno == EWOULDBLOCK; }
+// A signal handled meanwhile, such as the SIGUSR1 of the profiler, interrupts the call before any byte moved
+static bool isInterrupted() { return errno == EINTR; }
+#endif
+
+static SocketHandle toHandle(intptr_t socket)
+{
+	return static_cast<SocketHandle>(socket);
+}
+
+static sockaddr_in loopbackAddress(uint16_t port)
+{
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons(port);
+	return address;
+}
+
+bool Socket::startup()
+{
+#ifdef _WIN32
+	WSADATA data;
+	return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+#else
+	return true;
+#endif
+}
+
+intptr_t Socket::listen(uint16_t port, int backlog)
+{
+	sockaddr_in address = loopbackAddress(port);
+	intptr_t listener = static_cast<intptr_t>(socket(AF_INET, SOCK_STREAM, 0));
+	if (listener == Socket::NO_SOCKET)
+	{
+		return Socket::NO_SOCKET;
+	}
+
+	int isReused = 1;
+	setsockopt(toHandle(listener), SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&isReused), sizeof(isReused));
+	if (bind(toHandle(listener), reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+		|| ::listen(toHandle(listener), backlog) != 0)
+	{
+		Socket::close(listener);
+		return Socket::NO_SOCKET;
+	}
+	return listener;
+}
+
+intptr_t Socket::connect(uint16_t port)
+{
+	sockaddr_in address = loopbackAddress(port);
+	intptr_t client = static_cast<intptr_t>(socket(AF_INET, SOCK_STREAM, 0));
+	if (client != Socket::NO_SOCKET && ::connect(toHandle(client), reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+	{
+		Socket::close(client);
+		return Socket::NO_SOCKET;
+	}
+	return client;
+}
+
+intptr_t Socket::accept(intptr_t listener)
+{
+	sockaddr_in address;
+	SocketLength addressSize = sizeof(address);
+	return static_cast<intptr_t>(::accept(toHandle(listener), reinterpret_cast<sockaddr*>(&address), &addressSize));
+}
+
+void Socket::close(intptr_t socket)
+{
+#ifdef _WIN32
+	closesocket(toHandle(socket));
+#else
+	::close(toHandle(socket));
+#endif
+}
+
+void Socket::setNoDelay(intptr_t socket)
+{
+	int isNoDelay = 1;
+	setsockopt(toHandle(socket), IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&isNoDelay), sizeof(isNoDelay));
+}
+
+void Socket::setNonBlocking(intptr_t socket)
+{
+#ifdef _WIN32
+	u_long isNonBlocking = 1;
+	ioctlsocket(toHandle(socket), FIONBIO, &isNonBlocking);
+#else
+	fcntl(toHandle(socket), F_SETFL, fcntl(toHandle(socket), F_GETFL, 0) | O_NONBLOCK);
+#endif
+}
+
+int Socket::send(intptr_t socket, const void* data, size_t size)
+{
+	int sent;
+	do
+	{
+		sent = static_cast<int>(::send(toHandle(socket), static_cast<const char*>(data), static_cast<int>(size), SEND_FLAGS));
+	}
+	while (sent < 0 && isInterrupted());
+	if (sent < 0)
+	{
+		return isWouldBlock() ? 0 : -1;
+	}
+	return sent;
+}
+
+int Socket::receive(intptr_t socket, void* data, size_t size)
+{
+	int received;
+	do
+	{
+		received = static_cast<int>(recv(toHandle(socket), static_cast<char*>(data), static_cast<int>(size), 0));
+	}
+	while (received < 0 && isInterrupted());
+	if (received < 0)
+	{
+		return isWouldBlock() ? 0 : -1;
+	}
+	// 0 is the end of the stream, the peer closed the connection
+	return received > 0 ? received : -1;
+}
+
+bool Socket::hasInput(intptr_t socket, int timeout)
+{
+	std::vector<Socket::PollEntry> entries = { { socket, false, false, false } };
+	return Socket::poll(entries, timeout) > 0 && entries[0].isReadable;
+}
+
+int Socket::poll(std::vector<Socket::PollEntry>& entries, int timeout)
+{
+	std::vector<PollDescriptor> descriptors(entries.size());
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		descriptors[i].fd = toHandle(entries[i].socket);
+		descriptors[i].events = static_cast<short>(POLLIN | (entries[i].isWriteWanted ? POLLOUT : 0));
+		descriptors[i].revents = 0;
+	}
+
+#ifdef _WIN32
+	int count = WSAPoll(descriptors.data(), static_cast<ULONG>(descriptors.size()), timeout);
+#else
+	int count = ::poll(descriptors.data(), static_cast<nfds_t>(descriptors.size()), timeout);
+#endif
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		// Errors and hang-ups are readable, the receive that follows reports them
+		entries[i].isReadable = (descriptors[i].revents & (POLLIN | POLLERR | POLLHUP)) != 0;
+		entries[i].isWritable = (descriptors[i].revents & POLLOUT) != 0;
+	}
+	return count;
+}
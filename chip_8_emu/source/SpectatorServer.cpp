@@ -0,0 +1,654 @@
+#include "SpectatorServer.hpp"
+#include "Socket.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+
+const uint8_t SpectatorServer::MAGIC[4] = { 'C', '8', 'S', 'P' };
+const int SpectatorServer::CLOSE_TIMEOUT;
+
+static uint32_t rotateLeft(uint32_t value, uint32_t count)
+{
+	return (value << count) | (value >> (32 - count));
+}
+
+// Only hashes the key of the WebSocket handshake, which is short
+static void sha1(const std::string& text, uint8_t digest[20])
+{
+	uint32_t hash[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+	std::string data = text + '\x80';
+	while (data.size() % 64 != 56)
+	{
+		data += '\0';
+	}
+	uint64_t bitCount = static_cast<uint64_t>(text.size()) * 8;
+	for (int i = 7; i >= 0; i--)
+	{
+		data += static_cast<char>(bitCount >> (i * 8));
+	}
+
+	for (size_t chunk = 0; chunk < data.size(); chunk += 64)
+	{
+		uint32_t words[80];
+		for (size_t i = 0; i < 16; i++)
+		{
+			const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&data[chunk + i * 4]);
+			words[i] = (bytes[0] << 24) | (bytes[1] << 16) | (bytes[2] << 8) | bytes[3];
+		}
+		for (size_t i = 16; i < 80; i++)
+		{
+			words[i] = rotateLeft(words[i - 3] ^ words[i - 8] ^ words[i - 14] ^ words[i - 16], 1);
+		}
+
+		uint32_t a = hash[0];
+		uint32_t b = hash[1];
+		uint32_t c = hash[2];
+		uint32_t d = hash[3];
+		uint32_t e = hash[4];
+		for (size_t i = 0; i < 80; i++)
+		{
+			uint32_t f;
+			uint32_t k;
+			if (i < 20)
+			{
+				f = (b & c) | (~b & d);
+				k = 0x5A827999;
+			}
+			else if (i < 40)
+			{
+				f = b ^ c ^ d;
+				k = 0x6ED9EBA1;
+			}
+			else if (i < 60)
+			{
+				f = (b & c) | (b & d) | (c & d);
+				k = 0x8F1BBCDC;
+			}
+			else
+			{
+				f = b ^ c ^ d;
+				k = 0xCA62C1D6;
+			}
+			uint32_t next = rotateLeft(a, 5) + f + e + k + words[i];
+			e = d;
+			d = c;
+			c = rotateLeft(b, 30);
+			b = a;
+			a = next;
+		}
+		hash[0] += a;
+		hash[1] += b;
+		hash[2] += c;
+		hash[3] += d;
+		hash[4] += e;
+	}
+
+	for (size_t i = 0; i < 20; i++)
+	{
+		digest[i] = static_cast<uint8_t>(hash[i / 4] >> (24 - (i % 4) * 8));
+	}
+}
+
+static std::string toBase64(const uint8_t* data, size_t size)
+{
+	static const char DIGITS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	std::string text;
+	for (size_t i = 0; i < size; i += 3)
+	{
+		uint32_t group = data[i] << 16;
+		group |= i + 1 < size ? data[i + 1] << 8 : 0;
+		group |= i + 2 < size ? data[i + 2] : 0;
+		text += DIGITS[(group >> 18) & 0x3F];
+		text += DIGITS[(group >> 12) & 0x3F];
+		text += i + 1 < size ? DIGITS[(group >> 6) & 0x3F] : '=';
+		text += i + 2 < size ? DIGITS[group & 0x3F] : '=';
+	}
+	return text;
+}
+
+// PackBits: a header n below 128 is followed by n + 1 bytes as is, one above by a byte repeated 257 - n times
+static void packBits(const uint8_t* bytes, size_t size, std::vector<uint8_t>& output)
+{
+	size_t i = 0;
+	while (i < size)
+	{
+		size_t run = 1;
+		while (i + run < size && run < 128 && bytes[i + run] == bytes[i])
+		{
+			run++;
+		}
+		if (run >= 2)
+		{
+			output.push_back(static_cast<uint8_t>(257 - run));
+			output.push_back(bytes[i]);
+			i += run;
+			continue;
+		}
+
+		size_t start = i;
+		while (i < size && i - start < 128 && (i + 1 >= size || bytes[i] != bytes[i + 1]))
+		{
+			i++;
+		}
+		output.push_back(static_cast<uint8_t>(i - start - 1));
+		output.insert(output.end(), bytes + start, bytes + i);
+	}
+}
+
+SpectatorServer::SpectatorServer() :
+	_isClosing(false),
+	_viewerCount(0),
+	_frames({ Framebuffer(128, 64, Framebuffer::MAX_PLANES), 0 }),
+	_frameIndex(0),
+	_listener(Socket::NO_SOCKET),
+	_sentFrame(128, 64, Framebuffer::MAX_PLANES),
+	_sentFrameIndex(0),
+	_keyframeIndex(0),
+	_hasSentFrame(false),
+	_isKeyframeEncoded(false),
+	_maxViewerCount(0),
+	_broadcastCount(0),
+	_keyframeCount(0),
+	_deltaCount(0),
+	_byteCount(0),
+	_skippedFrameCount(0),
+	_busyTime(0)
+{
+}
+
+SpectatorServer::~SpectatorServer()
+{
+	close();
+}
+
+bool SpectatorServer::listen(uint16_t port)
+{
+	close();
+
+	if (!Socket::startup())
+	{
+		std::cout << "[ERROR] Cannot start the sockets" << std::endl;
+		return false;
+	}
+	_listener = Socket::listen(port, 128);
+	if (_listener == Socket::NO_SOCKET)
+	{
+		std::cout << "[ERROR] Cannot listen on the port " << std::dec << port << std::endl;
+		return false;
+	}
+	Socket::setNonBlocking(_listener);
+	std::cout << "[SPECTATE] Streaming the screen on localhost:" << std::dec << port << std::endl;
+
+	_hasSentFrame = false;
+	_maxViewerCount = 0;
+	_broadcastCount = 0;
+	_keyframeCount = 0;
+	_deltaCount = 0;
+	_byteCount = 0;
+	_skippedFrameCount = 0;
+	_busyTime = std::chrono::steady_clock::duration(0);
+	_isClosing = false;
+	_network = std::thread(&SpectatorServer::runNetwork, this);
+	return true;
+}
+
+void SpectatorServer::close()
+{
+	if (!isListening())
+	{
+		return;
+	}
+
+	_isClosing.store(true, std::memory_order_release);
+	_network.join();
+}
+
+void SpectatorServer::publish(const Framebuffer& framebuffer)
+{
+	// Frames published faster than the network thread takes them replace each other
+	SpectatorServer::Frame& frame = _frames.back();
+	frame.framebuffer = framebuffer;
+	frame.index = _frameIndex++;
+	_frames.publish();
+}
+
+void SpectatorServer::runNetwork()
+{
+	std::vector<Socket::PollEntry> entries;
+	while (true)
+	{
+		// Read before the frame, so the last one published before close() is sent
+		bool isClosing = _isClosing.load(std::memory_order_acquire);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		bool hasFrame = _frames.acquire();
+		if (hasFrame)
+		{
+			broadcast(_frames.front(), isClosing);
+		}
+		for (size_t i = 0; i < _viewers.size(); i++)
+		{
+			if (!flushViewer(_viewers[i]))
+			{
+				_viewers[i--] = std::move(_viewers.back());
+				_viewers.pop_back();
+			}
+		}
+		_viewerCount.store(_viewers.size(), std::memory_order_relaxed);
+		_busyTime += std::chrono::steady_clock::now() - start;
+		if (isClosing && !hasFrame)
+		{
+			break;
+		}
+
+		entries.clear();
+		entries.push_back({ _listener, false, false, false });
+		for (const SpectatorServer::Viewer& viewer : _viewers)
+		{
+			entries.push_back({ viewer.socket, viewer.sentSize < viewer.output.size(), false, false });
+		}
+		Socket::poll(entries, SpectatorServer::POLL_TIMEOUT);
+
+		start = std::chrono::steady_clock::now();
+		// Viewers are removed from the end, the entries of the ones left keep their index
+		for (size_t i = _viewers.size(); i-- > 0;)
+		{
+			if (entries[i + 1].isReadable && !readViewer(_viewers[i]))
+			{
+				_viewers[i] = std::move(_viewers.back());
+				_viewers.pop_back();
+			}
+		}
+		if (entries[0].isReadable)
+		{
+			acceptViewers();
+		}
+		_busyTime += std::chrono::steady_clock::now() - start;
+	}
+
+	// Every viewer ends on the last frame, however far behind it was
+	for (SpectatorServer::Viewer& viewer : _viewers)
+	{
+		if (viewer.protocol != SpectatorServer::Protocol::Handshake && viewer.needsKeyframe && _hasSentFrame)
+		{
+			sendKeyframe(viewer);
+		}
+	}
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SpectatorServer::CLOSE_TIMEOUT);
+	while (std::chrono::steady_clock::now() < deadline)
+	{
+		entries.clear();
+		for (size_t i = 0; i < _viewers.size(); i++)
+		{
+			if (!flushViewer(_viewers[i]))
+			{
+				_viewers[i--] = std::move(_viewers.back());
+				_viewers.pop_back();
+			}
+			else if (_viewers[i].sentSize < _viewers[i].output.size())
+			{
+				entries.push_back({ _viewers[i].socket, true, false, false });
+			}
+		}
+		if (entries.empty())
+		{
+			break;
+		}
+		Socket::poll(entries, SpectatorServer::POLL_TIMEOUT);
+	}
+
+	for (const SpectatorServer::Viewer& viewer : _viewers)
+	{
+		Socket::close(viewer.socket);
+	}
+	_viewers.clear();
+	_viewerCount = 0;
+	Socket::close(_listener);
+	_listener = Socket::NO_SOCKET;
+}
+
+void SpectatorServer::acceptViewers()
+{
+	while (true)
+	{
+		intptr_t socket = Socket::accept(_listener);
+		if (socket == Socket::NO_SOCKET)
+		{
+			return;
+		}
+		Socket::setNonBlocking(socket);
+		// Deltas are small and due at once
+		Socket::setNoDelay(socket);
+		_viewers.push_back({ socket, SpectatorServer::Protocol::Handshake, std::string(), std::vector<uint8_t>(), 0, true });
+		_maxViewerCount = std::max(_maxViewerCount, _viewers.size());
+	}
+}
+
+bool SpectatorServer::readViewer(SpectatorServer::Viewer& viewer)
+{
+	char input[1024];
+	int received;
+	while ((received = Socket::receive(viewer.socket, input, sizeof(input))) > 0)
+	{
+		// Nothing is expected from a raw viewer once streaming
+		if (viewer.protocol == SpectatorServer::Protocol::Raw)
+		{
+			continue;
+		}
+		viewer.request.append(input, received);
+		if (viewer.protocol == SpectatorServer::Protocol::Handshake && !handshake(viewer))
+		{
+			received = -1;
+			break;
+		}
+		if (viewer.protocol == SpectatorServer::Protocol::WebSocket && !readWebSocket(viewer))
+		{
+			// The answer to a close goes out before the connection ends, as far as the socket buffer takes it
+			if (flushViewer(viewer))
+			{
+				Socket::close(viewer.socket);
+			}
+			return false;
+		}
+	}
+
+	if (received < 0)
+	{
+		Socket::close(viewer.socket);
+		return false;
+	}
+	return true;
+}
+
+bool SpectatorServer::readWebSocket(SpectatorServer::Viewer& viewer)
+{
+	// Client frames are masked: opCode, size on 7, 16 or 64 bits big endian, mask, payload
+	std::string& input = viewer.request;
+	while (input.size() >= 2)
+	{
+		uint8_t opCode = static_cast<uint8_t>(input[0]) & 0x0F;
+		bool isMasked = (static_cast<uint8_t>(input[1]) & 0x80) != 0;
+		uint64_t size = static_cast<uint8_t>(input[1]) & 0x7F;
+		size_t sizeBytes = size == 126 ? 2 : size == 127 ? 8 : 0;
+		size_t headerSize = 2 + sizeBytes + (isMasked ? 4 : 0);
+		if (input.size() < headerSize)
+		{
+			return true;
+		}
+		if (sizeBytes > 0)
+		{
+			size = 0;
+			for (size_t i = 0; i < sizeBytes; i++)
+			{
+				size = (size << 8) | static_cast<uint8_t>(input[2 + i]);
+			}
+		}
+		if (size > SpectatorServer::MAX_CLIENT_FRAME_SIZE)
+		{
+			return false;
+		}
+		if (input.size() < headerSize + size)
+		{
+			return true;
+		}
+
+		if (opCode == 0x8)
+		{
+			// Close, answered with a close echoing the status code, unmasked from a server
+			const char* mask = input.data() + headerSize - 4;
+			uint8_t statusSize = size >= 2 ? 2 : 0;
+			viewer.output.push_back(0x88);
+			viewer.output.push_back(statusSize);
+			for (uint8_t i = 0; i < statusSize; i++)
+			{
+				viewer.output.push_back(static_cast<uint8_t>(input[headerSize + i] ^ (isMasked ? mask[i] : 0)));
+			}
+			return false;
+		}
+		// Pings, pongs and messages are ignored
+		input.erase(0, headerSize + size);
+	}
+	return true;
+}
+
+bool SpectatorServer::handshake(SpectatorServer::Viewer& viewer)
+{
+	const std::string& request = viewer.request;
+	if (request.size() < sizeof(SpectatorServer::MAGIC))
+	{
+		return true;
+	}
+
+	if (memcmp(request.data(), SpectatorServer::MAGIC, sizeof(SpectatorServer::MAGIC)) == 0)
+	{
+		viewer.protocol = SpectatorServer::Protocol::Raw;
+	}
+	else if (request.compare(0, 4, "GET ") == 0)
+	{
+		size_t end = request.find("\r\n\r\n");
+		if (end == std::string::npos)
+		{
+			// Browsers send a few hundred bytes
+			return request.size() < 8192;
+		}
+
+		std::string lowerRequest = request.substr(0, end + 2);
+		std::transform(lowerRequest.begin(), lowerRequest.end(), lowerRequest.begin(), [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+		const std::string KEY_HEADER = "\r\nsec-websocket-key:";
+		size_t keyStart = lowerRequest.find(KEY_HEADER);
+		if (keyStart == std::string::npos)
+		{
+			return false;
+		}
+		keyStart += KEY_HEADER.size();
+		size_t keyEnd = lowerRequest.find("\r\n", keyStart);
+		std::string key = request.substr(keyStart, keyEnd - keyStart);
+		key.erase(0, key.find_first_not_of(" \t"));
+		key.erase(key.find_last_not_of(" \t") + 1);
+
+		uint8_t digest[20];
+		sha1(key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11", digest);
+		std::string response = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: "
+			+ toBase64(digest, sizeof(digest)) + "\r\n\r\n";
+		viewer.output.insert(viewer.output.end(), response.begin(), response.end());
+		viewer.protocol = SpectatorServer::Protocol::WebSocket;
+		// What follows the request is the first frames of the client
+		viewer.request.erase(0, end + 4);
+	}
+	else
+	{
+		return false;
+	}
+
+	if (viewer.protocol == SpectatorServer::Protocol::Raw)
+	{
+		viewer.request.clear();
+		viewer.request.shrink_to_fit();
+	}
+	// Viewers joining while the emulation is paused see the screen at once
+	if (_hasSentFrame)
+	{
+		sendKeyframe(viewer);
+	}
+	return true;
+}
+
+bool SpectatorServer::flushViewer(SpectatorServer::Viewer& viewer)
+{
+	while (viewer.sentSize < viewer.output.size())
+	{
+		int sent = Socket::send(viewer.socket, viewer.output.data() + viewer.sentSize, viewer.output.size() - viewer.sentSize);
+		if (sent < 0)
+		{
+			Socket::close(viewer.socket);
+			return false;
+		}
+		if (sent == 0)
+		{
+			// The socket buffer is full, the rest waits for poll() to find it writable
+			return true;
+		}
+		viewer.sentSize += sent;
+		_byteCount += sent;
+	}
+	viewer.output.clear();
+	viewer.sentSize = 0;
+	return true;
+}
+
+void SpectatorServer::broadcast(const SpectatorServer::Frame& frame, bool isForced)
+{
+	const Framebuffer& framebuffer = frame.framebuffer;
+	bool isKeyframe = !_hasSentFrame || framebuffer.width() != _sentFrame.width() || framebuffer.height() != _sentFrame.height()
+		|| framebuffer.planeCount() != _sentFrame.planeCount() || frame.index - _keyframeIndex >= SpectatorServer::KEYFRAME_INTERVAL;
+
+	// Rows that changed since the last frame sent, a frame that changed nothing sends nothing
+	_delta.clear();
+	uint8_t rowCount = 0;
+	if (!isKeyframe)
+	{
+		beginMessage(_delta, SpectatorServer::DELTA, framebuffer, frame.index);
+		size_t rowSize = framebuffer.wordsPerRow() * sizeof(uint64_t);
+		for (uint8_t plane = 0; plane < framebuffer.planeCount(); plane++)
+		{
+			for (uint8_t y = 0; y < framebuffer.height(); y++)
+			{
+				if (memcmp(framebuffer.row(y, plane), _sentFrame.row(y, plane), rowSize) != 0)
+				{
+					appendRow(_delta, framebuffer, y, plane);
+					rowCount++;
+				}
+			}
+		}
+		_delta[SpectatorServer::ROW_COUNT_OFFSET] = rowCount;
+	}
+
+	_sentFrame = framebuffer;
+	_sentFrameIndex = frame.index;
+	_hasSentFrame = true;
+	_isKeyframeEncoded = false;
+	_broadcastCount++;
+	if (isKeyframe)
+	{
+		_keyframeIndex = frame.index;
+	}
+
+	for (SpectatorServer::Viewer& viewer : _viewers)
+	{
+		if (viewer.protocol == SpectatorServer::Protocol::Handshake)
+		{
+			continue;
+		}
+
+		bool isBehind = viewer.output.size() - viewer.sentSize > SpectatorServer::MAX_BACKLOG && !isForced;
+		if (isBehind)
+		{
+			// The deltas it misses are replaced by a keyframe once its backlog is sent
+			_skippedFrameCount++;
+			viewer.needsKeyframe = true;
+		}
+		else if (isKeyframe || viewer.needsKeyframe)
+		{
+			sendKeyframe(viewer);
+		}
+		else if (rowCount > 0)
+		{
+			appendMessage(viewer, _delta);
+			_deltaCount++;
+		}
+	}
+}
+
+void SpectatorServer::sendKeyframe(SpectatorServer::Viewer& viewer)
+{
+	// Encoded once per frame, for all the viewers needing it
+	if (!_isKeyframeEncoded)
+	{
+		_keyframe.clear();
+		beginMessage(_keyframe, SpectatorServer::KEYFRAME, _sentFrame, _sentFrameIndex);
+		_keyframe[SpectatorServer::ROW_COUNT_OFFSET] = static_cast<uint8_t>(_sentFrame.height() * _sentFrame.planeCount());
+		for (uint8_t plane = 0; plane < _sentFrame.planeCount(); plane++)
+		{
+			for (uint8_t y = 0; y < _sentFrame.height(); y++)
+			{
+				appendRow(_keyframe, _sentFrame, y, plane);
+			}
+		}
+		_isKeyframeEncoded = true;
+	}
+	appendMessage(viewer, _keyframe);
+	viewer.needsKeyframe = false;
+	_keyframeCount++;
+}
+
+void SpectatorServer::appendMessage(SpectatorServer::Viewer& viewer, const std::vector<uint8_t>& message)
+{
+	// What was sent is dropped, the backlog alone stays
+	if (viewer.sentSize > 0)
+	{
+		viewer.output.erase(viewer.output.begin(), viewer.output.begin() + viewer.sentSize);
+		viewer.sentSize = 0;
+	}
+
+	std::vector<uint8_t>& output = viewer.output;
+	uint64_t size = message.size();
+	if (viewer.protocol == SpectatorServer::Protocol::WebSocket)
+	{
+		// Final binary message, unmasked from a server, its size on 7, 16 or 64 bits big endian
+		output.push_back(0x82);
+		if (size < 126)
+		{
+			output.push_back(static_cast<uint8_t>(size));
+		}
+		else if (size <= UINT16_MAX)
+		{
+			output.push_back(126);
+			output.push_back(static_cast<uint8_t>(size >> 8));
+			output.push_back(static_cast<uint8_t>(size));
+		}
+		else
+		{
+			output.push_back(127);
+			for (int i = 7; i >= 0; i--)
+			{
+				output.push_back(static_cast<uint8_t>(size >> (i * 8)));
+			}
+		}
+	}
+	else
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			output.push_back(static_cast<uint8_t>(size >> (i * 8)));
+		}
+	}
+	output.insert(output.end(), message.begin(), message.end());
+}
+
+void SpectatorServer::beginMessage(std::vector<uint8_t>& message, uint8_t type, const Framebuffer& framebuffer, uint32_t index) const
+{
+	message.push_back(type);
+	for (int i = 0; i < 4; i++)
+	{
+		message.push_back(static_cast<uint8_t>(index >> (i * 8)));
+	}
+	message.push_back(framebuffer.width());
+	message.push_back(framebuffer.height());
+	message.push_back(framebuffer.planeCount());
+	// Row count, set once the rows are appended
+	message.push_back(0);
+}
+
+void SpectatorServer::appendRow(std::vector<uint8_t>& message, const Framebuffer& framebuffer, uint8_t y, uint8_t plane) const
+{
+	uint8_t bytes[256 / 8];
+	size_t size = (framebuffer.width() + 7) / 8;
+	const uint64_t* words = framebuffer.row(y, plane);
+	for (size_t i = 0; i < size; i++)
+	{
+		bytes[i] = static_cast<uint8_t>(words[i / 8] >> (56 - (i % 8) * 8));
+	}
+	message.push_back(plane);
+	message.push_back(y);
+	packBits(bytes, size, message);
+}
@@ -0,0 +1,89 @@
+#include "State.hpp"
+#include <cstring>
+
+StateWriter::StateWriter(std::vector<uint8_t>& buffer) :
+	_buffer(buffer)
+{ }
+
+void StateWriter::write8(uint8_t value)
+{
+	_buffer.push_back(value);
+}
+
+void StateWriter::write16(uint16_t value)
+{
+	_buffer.push_back(static_cast<uint8_t>(value));
+	_buffer.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+void StateWriter::write32(uint32_t value)
+{
+	write16(static_cast<uint16_t>(value));
+	write16(static_cast<uint16_t>(value >> 16));
+}
+
+void StateWriter::write64(uint64_t value)
+{
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		_buffer.push_back(static_cast<uint8_t>(value >> (i * 8)));
+	}
+}
+
+void StateWriter::writeBytes(const void* data, size_t size)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	_buffer.insert(_buffer.end(), bytes, bytes + size);
+}
+
+StateReader::StateReader(const uint8_t* data, size_t size) :
+	_data(data),
+	_size(size),
+	_offset(0),
+	_isValid(true)
+{ }
+
+uint8_t StateReader::read8()
+{
+	if (_offset >= _size)
+	{
+		_isValid = false;
+		return 0;
+	}
+	return _data[_offset++];
+}
+
+uint16_t StateReader::read16()
+{
+	uint16_t low = read8();
+	return low | (read8() << 8);
+}
+
+uint32_t StateReader::read32()
+{
+	uint32_t low = read16();
+	return low | (uint32_t(read16()) << 16);
+}
+
+uint64_t StateReader::read64()
+{
+	uint64_t value = 0;
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		value |= uint64_t(read8()) << (i * 8);
+	}
+	return value;
+}
+
+void StateReader::readBytes(void* data, size_t size)
+{
+	if (size > remaining())
+	{
+		_isValid = false;
+		memset(data, 0, size);
+		_offset = _size;
+		return;
+	}
+	memcpy(data, &_data[_offset], size);
+	_offset += size;
+}
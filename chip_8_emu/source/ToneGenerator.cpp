@@ -0,0 +1,39 @@
+#include "ToneGenerator.hpp"
+#include <algorithm>
+#include <cmath>
+
+// Long enough to remove the click of a square wave starting at full amplitude
+static const double FADE_SECONDS = 0.002;
+
+ToneGenerator::ToneGenerator(unsigned int sampleRate, double volume) :
+	_sampleRate(sampleRate),
+	_amplitude(32767.0 * std::min(std::max(volume, 0.0), 1.0)),
+	_fadeStep(1.0 / (FADE_SECONDS * sampleRate)),
+	_phase(0.0),
+	_gain(0.0)
+{ }
+
+void ToneGenerator::render(const SoundState& state, int16_t* samples, size_t count)
+{
+	double bitsPerSample = ToneGenerator::bitRate(state.pitch) / _sampleRate;
+	double targetGain = state.isActive ? 1.0 : 0.0;
+	for (size_t i = 0; i < count; i++)
+	{
+		_gain = _gain < targetGain ? std::min(targetGain, _gain + _fadeStep) : std::max(targetGain, _gain - _fadeStep);
+
+		size_t bit = static_cast<size_t>(_phase);
+		bool isHigh = (state.pattern[bit / 8] >> (7 - bit % 8)) & 1;
+		samples[i] = static_cast<int16_t>((isHigh ? _amplitude : -_amplitude) * _gain);
+
+		_phase += bitsPerSample;
+		if (_phase >= SoundState::PATTERN_BITS)
+		{
+			_phase = std::fmod(_phase, static_cast<double>(SoundState::PATTERN_BITS));
+		}
+	}
+}
+
+double ToneGenerator::bitRate(uint8_t pitch)
+{
+	return 4000.0 * std::pow(2.0, (pitch - 64) / 48.0);
+}
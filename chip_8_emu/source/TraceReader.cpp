@@ -0,0 +1,184 @@
+#include "TraceReader.hpp"
+#include "Chip8.hpp"
+#include "State.hpp"
+#include <algorithm>
+#include <iostream>
+
+TraceReader::TraceReader() :
+	_buffer(TraceReader::BUFFER_SIZE),
+	_bufferBegin(0),
+	_bufferEnd(0),
+	_isTruncated(false),
+	_hasFrame(false),
+	_writeAddr(0),
+	_recordCount(0),
+	_platform(Platform::Type::CosmacVip),
+	_quirks(Quirks::fromMask(0))
+{
+	_record = {};
+}
+
+bool TraceReader::open(const std::string& path)
+{
+	_file.open(path, std::ios::binary);
+	if (!_file.is_open())
+	{
+		std::cout << "[ERROR] Cannot open the trace '" << path << "'" << std::endl;
+		return false;
+	}
+
+	uint8_t data[sizeof(TraceRecorder::MAGIC) + 4] = {};
+	_file.read(reinterpret_cast<char*>(data), sizeof(data));
+	StateReader reader(data, static_cast<size_t>(_file.gcount()));
+	uint8_t magic[sizeof(TraceRecorder::MAGIC)];
+	reader.readBytes(magic, sizeof(magic));
+	uint16_t version = reader.read16();
+	uint8_t platform = reader.read8();
+	uint8_t quirks = reader.read8();
+	if (!reader.isValid() || !std::equal(magic, magic + sizeof(magic), TraceRecorder::MAGIC) || version == 0 || version > TraceRecorder::VERSION)
+	{
+		std::cout << "[ERROR] '" << path << "' is not a supported trace" << std::endl;
+		return false;
+	}
+	_platform = static_cast<Platform::Type>(platform % (Platform::Type::XoChip + 1));
+	_quirks = Quirks::fromMask(quirks);
+
+	// Same starting point as the recorder
+	_bufferBegin = 0;
+	_bufferEnd = 0;
+	_isTruncated = false;
+	_hasFrame = false;
+	_writeAddr = 0;
+	_recordCount = 0;
+	_record = {};
+	_record.pc = Chip8::ROM_START_ADDR - 2;
+	return true;
+}
+
+bool TraceReader::next()
+{
+	uint8_t flags;
+	if (!readByte(flags))
+	{
+		// End of the trace, between two records
+		return false;
+	}
+
+	// Any read failing from here ends the trace in the middle of a record
+	_isTruncated = true;
+	TraceReader::Record& record = _record;
+	record.index = _recordCount++;
+	record.isFrameStart = (flags & TraceRecorder::Flag::FrameStart) != 0;
+	if (record.isFrameStart)
+	{
+		record.frame += _hasFrame ? 1 : 0;
+		_hasFrame = true;
+	}
+
+	uint8_t high;
+	uint8_t low;
+	if (!readByte(high) || !readByte(low))
+	{
+		return false;
+	}
+	record.opCode = static_cast<uint16_t>((high << 8) | low);
+
+	uint32_t value = 0;
+	uint16_t pc = record.pc + 2;
+	if ((flags & TraceRecorder::Flag::PcJump) != 0)
+	{
+		if (!readVarint(value))
+		{
+			return false;
+		}
+		pc += unzigzag(value);
+	}
+	record.pc = pc;
+
+	record.isIndexChanged = (flags & TraceRecorder::Flag::IndexChange) != 0;
+	if (record.isIndexChanged)
+	{
+		if (!readVarint(value))
+		{
+			return false;
+		}
+		record.I += unzigzag(value);
+	}
+
+	record.changedRegisters = 0;
+	if ((flags & TraceRecorder::Flag::RegisterChange) != 0)
+	{
+		if (!readVarint(value))
+		{
+			return false;
+		}
+		record.changedRegisters = static_cast<uint16_t>(value);
+		for (size_t i = 0; i < CPU::MAX_REGISTER; i++)
+		{
+			if ((record.changedRegisters & (1u << i)) != 0 && !readByte(record.registers[i]))
+			{
+				return false;
+			}
+		}
+	}
+
+	record.writes.clear();
+	if ((flags & TraceRecorder::Flag::MemoryWrite) != 0)
+	{
+		uint32_t count;
+		if (!readVarint(count))
+		{
+			return false;
+		}
+		for (uint32_t i = 0; i < count; i++)
+		{
+			TraceRecorder::Write write;
+			if (!readVarint(value) || !readByte(write.value))
+			{
+				return false;
+			}
+			write.addr = static_cast<uint16_t>(_writeAddr + 1 + unzigzag(value));
+			_writeAddr = write.addr;
+			record.writes.push_back(write);
+		}
+	}
+
+	_isTruncated = false;
+	return true;
+}
+
+bool TraceReader::readByte(uint8_t& value)
+{
+	if (_bufferBegin == _bufferEnd)
+	{
+		_file.read(reinterpret_cast<char*>(_buffer.data()), _buffer.size());
+		_bufferBegin = 0;
+		_bufferEnd = static_cast<size_t>(_file.gcount());
+		if (_bufferEnd == 0)
+		{
+			return false;
+		}
+	}
+	value = _buffer[_bufferBegin++];
+	return true;
+}
+
+bool TraceReader::readVarint(uint32_t& value)
+{
+	value = 0;
+	// 16 bits deltas and masks take 3 bytes at most
+	for (uint32_t shift = 0; shift < 21; shift += 7)
+	{
+		uint8_t byte;
+		if (!readByte(byte))
+		{
+			return false;
+		}
+		value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
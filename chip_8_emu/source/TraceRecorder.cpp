@@ -0,0 +1,239 @@
+#include "TraceRecorder.hpp"
+#include "Chip8.hpp"
+#include "State.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+const uint8_t TraceRecorder::MAGIC[4] = { 'C', '8', 'T', 'R' };
+
+TraceRecorder::TraceRecorder() :
+	_chunk(0),
+	_chunkSize(0),
+	_isClosing(false),
+	_hasWriteError(false),
+	_pc(0),
+	_I(0),
+	_writeAddr(0),
+	_isFrameStart(false),
+	_instructionCount(0),
+	_byteCount(0),
+	_stallCount(0)
+{
+	std::fill(_registers, _registers + CPU::MAX_REGISTER, 0);
+	// FX55 writes at most 16 bytes, more only come from a debugger writing between two instructions
+	_writes.reserve(CPU::MAX_REGISTER);
+}
+
+TraceRecorder::~TraceRecorder()
+{
+	close();
+}
+
+bool TraceRecorder::open(const std::string& path, Platform::Type platform, const Quirks& quirks)
+{
+	close();
+
+	_file.open(path, std::ios::binary | std::ios::trunc);
+	std::vector<uint8_t> header;
+	StateWriter writer(header);
+	writer.writeBytes(TraceRecorder::MAGIC, sizeof(TraceRecorder::MAGIC));
+	writer.write16(TraceRecorder::VERSION);
+	writer.write8(static_cast<uint8_t>(platform));
+	writer.write8(quirks.toMask());
+	if (!_file.write(reinterpret_cast<const char*>(header.data()), header.size()))
+	{
+		std::cout << "[ERROR] Cannot write the trace '" << path << "'" << std::endl;
+		_file.close();
+		return false;
+	}
+
+	_pc = Chip8::ROM_START_ADDR - 2;
+	_I = 0;
+	std::fill(_registers, _registers + CPU::MAX_REGISTER, 0);
+	_writeAddr = 0;
+	_isFrameStart = false;
+	_writes.clear();
+	_instructionCount = 0;
+	_byteCount = header.size();
+	_stallCount = 0;
+
+	// The emulation fills chunk 0 first, the writer hands the others back as it writes them
+	_chunks.resize(TraceRecorder::CHUNK_SIZE * TraceRecorder::CHUNK_COUNT);
+	uint32_t index;
+	while (_freeChunks.pop(index))
+	{
+	}
+	for (uint32_t i = 1; i < TraceRecorder::CHUNK_COUNT; i++)
+	{
+		_freeChunks.push(i);
+	}
+	_chunk = 0;
+	_chunkSize = 0;
+	_isClosing = false;
+	_hasWriteError = false;
+	_writer = std::thread(&TraceRecorder::runWriter, this);
+	return true;
+}
+
+bool TraceRecorder::close()
+{
+	if (!isOpen())
+	{
+		return true;
+	}
+
+	// The last chunk is partial, it is never given back so no free chunk is needed
+	_filledChunks.push({ _chunk, static_cast<uint32_t>(_chunkSize) });
+	_isClosing.store(true, std::memory_order_release);
+	_writer.join();
+	_file.close();
+	if (_hasWriteError || _file.fail())
+	{
+		std::cout << "[ERROR] Cannot write the trace, it is incomplete" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void TraceRecorder::recordWrite(uint16_t addr, uint8_t value)
+{
+	_writes.push_back({ addr, value });
+}
+
+void TraceRecorder::recordInstruction(uint16_t pc, uint16_t opCode, const uint8_t* registers, uint16_t I)
+{
+	uint8_t record[TraceRecorder::MAX_RECORD_SIZE];
+	uint8_t flags = _isFrameStart ? TraceRecorder::Flag::FrameStart : 0;
+	size_t size = 1;
+	record[size++] = static_cast<uint8_t>(opCode >> 8);
+	record[size++] = static_cast<uint8_t>(opCode);
+
+	uint16_t expectedPc = _pc + 2;
+	if (pc != expectedPc)
+	{
+		flags |= TraceRecorder::Flag::PcJump;
+		size += writeVarint(record + size, zigzag(static_cast<int16_t>(pc - expectedPc)));
+	}
+	if (I != _I)
+	{
+		flags |= TraceRecorder::Flag::IndexChange;
+		size += writeVarint(record + size, zigzag(static_cast<int16_t>(I - _I)));
+	}
+
+	uint32_t changed = 0;
+	for (size_t i = 0; i < CPU::MAX_REGISTER; i++)
+	{
+		changed |= static_cast<uint32_t>(registers[i] != _registers[i]) << i;
+	}
+	if (changed != 0)
+	{
+		flags |= TraceRecorder::Flag::RegisterChange;
+		size += writeVarint(record + size, changed);
+		for (size_t i = 0; i < CPU::MAX_REGISTER; i++)
+		{
+			if ((changed & (1u << i)) != 0)
+			{
+				record[size++] = registers[i];
+				_registers[i] = registers[i];
+			}
+		}
+	}
+
+	if (!_writes.empty())
+	{
+		flags |= TraceRecorder::Flag::MemoryWrite;
+		size += writeVarint(record + size, static_cast<uint32_t>(_writes.size()));
+	}
+	record[0] = flags;
+	for (const TraceRecorder::Write& write : _writes)
+	{
+		if (size + 4 > TraceRecorder::MAX_RECORD_SIZE)
+		{
+			append(record, size);
+			size = 0;
+		}
+		size += writeVarint(record + size, zigzag(static_cast<int16_t>(write.addr - (_writeAddr + 1))));
+		record[size++] = write.value;
+		_writeAddr = write.addr;
+	}
+	_writes.clear();
+	append(record, size);
+
+	_pc = pc;
+	_I = I;
+	_isFrameStart = false;
+	_instructionCount++;
+}
+
+void TraceRecorder::append(const uint8_t* data, size_t size)
+{
+	_byteCount += size;
+	while (size > 0)
+	{
+		size_t count = std::min(size, TraceRecorder::CHUNK_SIZE - _chunkSize);
+		memcpy(&_chunks[_chunk * TraceRecorder::CHUNK_SIZE + _chunkSize], data, count);
+		_chunkSize += count;
+		data += count;
+		size -= count;
+		if (_chunkSize == TraceRecorder::CHUNK_SIZE)
+		{
+			submitChunk();
+		}
+	}
+}
+
+void TraceRecorder::submitChunk()
+{
+	// At most CHUNK_COUNT chunks exist, the queue of the filled ones is never full
+	_filledChunks.push({ _chunk, static_cast<uint32_t>(_chunkSize) });
+	if (!_freeChunks.pop(_chunk))
+	{
+		// The disk is slower than the emulation, it waits rather than losing records
+		_stallCount++;
+		while (!_freeChunks.pop(_chunk))
+		{
+			std::this_thread::yield();
+		}
+	}
+	_chunkSize = 0;
+}
+
+void TraceRecorder::runWriter()
+{
+	while (true)
+	{
+		// Read before the queue, so nothing submitted before close() can be missed
+		bool isClosing = _isClosing.load(std::memory_order_acquire);
+		TraceRecorder::Chunk chunk;
+		if (_filledChunks.pop(chunk))
+		{
+			if (!_file.write(reinterpret_cast<const char*>(&_chunks[chunk.index * TraceRecorder::CHUNK_SIZE]), chunk.size))
+			{
+				_hasWriteError = true;
+			}
+			_freeChunks.push(chunk.index);
+		}
+		else if (isClosing)
+		{
+			return;
+		}
+		else
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+}
+
+size_t TraceRecorder::writeVarint(uint8_t* buffer, uint32_t value)
+{
+	size_t size = 0;
+	while (value >= 0x80)
+	{
+		buffer[size++] = static_cast<uint8_t>(value | 0x80);
+		value >>= 7;
+	}
+	buffer[size++] = static_cast<uint8_t>(value);
+	return size;
+}
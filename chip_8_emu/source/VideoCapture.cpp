@@ -0,0 +1,361 @@
+#include "VideoCapture.hpp"
+#include "State.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+const size_t VideoCapture::MAX_SCALE;
+
+VideoCapture::VideoCapture() :
+	_palette{ 0, 0, 0, 255, 255, 255, 128, 128, 128, 64, 64, 64 },
+	_scale(1),
+	_isWaitEnabled(false),
+	_isClosing(false),
+	_hasWriteError(false),
+	_lastFrame(VideoCapture::WIDTH, VideoCapture::HEIGHT),
+	_hasLastFrame(false),
+	_frameCount(0),
+	_droppedFrameCount(0),
+	_endFrame(0)
+{
+	// Slots are as large as any frame, copying one into them never allocates
+	_slots.resize(VideoCapture::SLOT_COUNT, { Framebuffer(VideoCapture::WIDTH, VideoCapture::HEIGHT, Framebuffer::MAX_PLANES), 0 });
+}
+
+VideoCapture::~VideoCapture()
+{
+	close();
+}
+
+void VideoCapture::setColor(uint8_t index, uint8_t red, uint8_t green, uint8_t blue)
+{
+	uint8_t* color = &_palette[(index % VideoCapture::COLOR_COUNT) * 3];
+	color[0] = red;
+	color[1] = green;
+	color[2] = blue;
+}
+
+bool VideoCapture::open(const std::string& path, size_t scale)
+{
+	close();
+
+	_file.open(path, std::ios::binary | std::ios::trunc);
+	if (!_file.is_open())
+	{
+		std::cout << "[ERROR] Cannot write the video '" << path << "'" << std::endl;
+		return false;
+	}
+	_scale = std::min(std::max<size_t>(scale, 1), VideoCapture::MAX_SCALE);
+
+	// Header, logical screen with a global table of 4 colors and the extension looping the animation forever
+	_output.clear();
+	StateWriter writer(_output);
+	writer.writeBytes("GIF89a", 6);
+	writer.write16(static_cast<uint16_t>(VideoCapture::WIDTH * _scale));
+	writer.write16(static_cast<uint16_t>(VideoCapture::HEIGHT * _scale));
+	writer.write8(0x91);
+	writer.write8(0);
+	writer.write8(0);
+	writer.writeBytes(_palette, sizeof(_palette));
+	writer.writeBytes("\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00", 19);
+	flush();
+
+	uint32_t index;
+	while (_filledSlots.pop(index))
+	{
+	}
+	while (_freeSlots.pop(index))
+	{
+	}
+	for (uint32_t i = 0; i < VideoCapture::SLOT_COUNT; i++)
+	{
+		_freeSlots.push(i);
+	}
+	_hasLastFrame = false;
+	_frameCount = 0;
+	_droppedFrameCount = 0;
+	_isClosing = false;
+	_hasWriteError = false;
+	_encoder = std::thread(&VideoCapture::runEncoder, this);
+	return true;
+}
+
+bool VideoCapture::close()
+{
+	if (!isOpen())
+	{
+		return true;
+	}
+
+	_endFrame = _frameCount;
+	_isClosing.store(true, std::memory_order_release);
+	_encoder.join();
+
+	_output.clear();
+	_output.push_back(0x3B);
+	flush();
+	_file.close();
+	if (_hasWriteError || _file.fail())
+	{
+		std::cout << "[ERROR] Cannot write the video, it is incomplete" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void VideoCapture::capture(const Framebuffer& framebuffer)
+{
+	uint64_t frame = _frameCount++;
+
+	// Most frames show the same screen as the previous one, its image simply lasts longer
+	if (_hasLastFrame && framebuffer.width() == _lastFrame.width() && framebuffer.planeCount() == _lastFrame.planeCount()
+		&& memcmp(framebuffer.row(0), _lastFrame.row(0), framebuffer.wordsPerRow() * framebuffer.height() * framebuffer.planeCount() * sizeof(uint64_t)) == 0)
+	{
+		return;
+	}
+
+	uint32_t index;
+	if (!_freeSlots.pop(index))
+	{
+		if (!_isWaitEnabled)
+		{
+			// Compared again on the next frame, which is queued once a slot is free
+			_droppedFrameCount++;
+			return;
+		}
+		while (!_freeSlots.pop(index))
+		{
+			std::this_thread::yield();
+		}
+	}
+	_slots[index].framebuffer = framebuffer;
+	_slots[index].frame = frame;
+	_filledSlots.push(index);
+	_lastFrame = framebuffer;
+	_hasLastFrame = true;
+}
+
+void VideoCapture::runEncoder()
+{
+	// An image is written once the next one tells how long it lasts
+	std::vector<uint8_t> pending(VideoCapture::WIDTH * VideoCapture::HEIGHT);
+	uint64_t pendingFrame = 0;
+	bool hasPending = false;
+	bool isFirst = true;
+	std::vector<uint8_t> image(pending.size());
+
+	while (true)
+	{
+		// Read before the queue, so nothing captured before close() can be missed
+		bool isClosing = _isClosing.load(std::memory_order_acquire);
+		uint32_t index;
+		if (_filledSlots.pop(index))
+		{
+			const VideoCapture::Slot& slot = _slots[index];
+			toImage(slot.framebuffer, image);
+			uint64_t frame = slot.frame;
+			_freeSlots.push(index);
+
+			uint64_t delay = hasPending ? frameTime(frame) - frameTime(pendingFrame) : 0;
+			if (hasPending && delay >= VideoCapture::MIN_DELAY)
+			{
+				writeImage(pending, static_cast<uint16_t>(std::min<uint64_t>(delay, UINT16_MAX)), isFirst);
+				isFirst = false;
+				pendingFrame = frame;
+			}
+			else if (!hasPending)
+			{
+				pendingFrame = frame;
+			}
+			// A shorter image is replaced by this one, which starts at its time
+			pending.swap(image);
+			hasPending = true;
+		}
+		else if (isClosing)
+		{
+			break;
+		}
+		else
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	if (hasPending)
+	{
+		uint64_t delay = std::max<uint64_t>(frameTime(_endFrame) - frameTime(pendingFrame), VideoCapture::MIN_DELAY);
+		writeImage(pending, static_cast<uint16_t>(std::min<uint64_t>(delay, UINT16_MAX)), isFirst);
+	}
+}
+
+void VideoCapture::toImage(const Framebuffer& framebuffer, std::vector<uint8_t>& image) const
+{
+	// Low resolution pixels cover 2x2 pixels of the grid
+	size_t shift = framebuffer.width() < VideoCapture::WIDTH ? 1 : 0;
+	for (size_t y = 0; y < VideoCapture::HEIGHT; y++)
+	{
+		for (size_t x = 0; x < VideoCapture::WIDTH; x++)
+		{
+			uint8_t color = 0;
+			for (uint8_t plane = 0; plane < framebuffer.planeCount(); plane++)
+			{
+				color |= framebuffer.isPixelOn(static_cast<uint8_t>(x >> shift), static_cast<uint8_t>(y >> shift), plane) << plane;
+			}
+			image[y * VideoCapture::WIDTH + x] = color;
+		}
+	}
+}
+
+void VideoCapture::writeImage(const std::vector<uint8_t>& image, uint16_t delay, bool isFirst)
+{
+	// Only the rectangle holding the pixels that changed is encoded, the rest of the previous image stays
+	size_t left = 0;
+	size_t top = 0;
+	size_t right = VideoCapture::WIDTH;
+	size_t bottom = VideoCapture::HEIGHT;
+	if (!isFirst)
+	{
+		left = VideoCapture::WIDTH;
+		right = 0;
+		bottom = 0;
+		top = VideoCapture::HEIGHT;
+		for (size_t y = 0; y < VideoCapture::HEIGHT; y++)
+		{
+			for (size_t x = 0; x < VideoCapture::WIDTH; x++)
+			{
+				if (image[y * VideoCapture::WIDTH + x] != _writtenImage[y * VideoCapture::WIDTH + x])
+				{
+					left = std::min(left, x);
+					right = std::max(right, x + 1);
+					top = std::min(top, y);
+					bottom = y + 1;
+				}
+			}
+		}
+		if (left >= right)
+		{
+			// Merged images may end up as the one already shown, a single pixel keeps the delay
+			left = 0;
+			right = 1;
+			top = 0;
+			bottom = 1;
+		}
+	}
+	_writtenImage = image;
+
+	_output.clear();
+	StateWriter writer(_output);
+	// Graphic control extension: the image stays under the next one, for delay hundredths of a second
+	writer.write8(0x21);
+	writer.write8(0xF9);
+	writer.write8(4);
+	writer.write8(0x04);
+	writer.write16(delay);
+	writer.write8(0);
+	writer.write8(0);
+	// Image descriptor, with the colors of the global table
+	writer.write8(0x2C);
+	writer.write16(static_cast<uint16_t>(left * _scale));
+	writer.write16(static_cast<uint16_t>(top * _scale));
+	writer.write16(static_cast<uint16_t>((right - left) * _scale));
+	writer.write16(static_cast<uint16_t>((bottom - top) * _scale));
+	writer.write8(0);
+
+	std::vector<uint8_t> pixels;
+	pixels.reserve((right - left) * (bottom - top) * _scale * _scale);
+	for (size_t y = top * _scale; y < bottom * _scale; y++)
+	{
+		for (size_t x = left * _scale; x < right * _scale; x++)
+		{
+			pixels.push_back(image[(y / _scale) * VideoCapture::WIDTH + x / _scale]);
+		}
+	}
+	writeLzw(pixels);
+	flush();
+}
+
+void VideoCapture::writeLzw(const std::vector<uint8_t>& pixels)
+{
+	// Codes of 3 to 12 bits over the 4 colors, each entry of the dictionary is a known string plus one color
+	const uint32_t MIN_CODE_SIZE = 2;
+	const uint32_t CLEAR_CODE = 1 << MIN_CODE_SIZE;
+	const uint32_t MAX_CODE = 4095;
+	_lzwCodes.assign((MAX_CODE + 1) * VideoCapture::COLOR_COUNT, 0);
+
+	std::vector<uint8_t> data;
+	uint32_t bits = 0;
+	uint32_t bitCount = 0;
+	uint32_t codeSize = MIN_CODE_SIZE + 1;
+	auto writeCode = [&](uint32_t code, uint32_t size)
+	{
+		bits |= code << bitCount;
+		bitCount += size;
+		while (bitCount >= 8)
+		{
+			data.push_back(static_cast<uint8_t>(bits));
+			bits >>= 8;
+			bitCount -= 8;
+		}
+	};
+
+	writeCode(CLEAR_CODE, codeSize);
+	uint32_t lastCode = CLEAR_CODE + 1;
+	uint32_t code = pixels[0];
+	for (size_t i = 1; i < pixels.size(); i++)
+	{
+		uint16_t& next = _lzwCodes[code * VideoCapture::COLOR_COUNT + pixels[i]];
+		if (next != 0)
+		{
+			code = next;
+			continue;
+		}
+
+		writeCode(code, codeSize);
+		next = static_cast<uint16_t>(++lastCode);
+		if (lastCode >= (1u << codeSize))
+		{
+			codeSize++;
+		}
+		if (lastCode == MAX_CODE)
+		{
+			// The dictionary is full, it starts over
+			writeCode(CLEAR_CODE, codeSize);
+			std::fill(_lzwCodes.begin(), _lzwCodes.end(), 0);
+			codeSize = MIN_CODE_SIZE + 1;
+			lastCode = CLEAR_CODE + 1;
+		}
+		code = pixels[i];
+	}
+	writeCode(code, codeSize);
+	// Reading the last code adds an entry to the dictionary of the decoder, which may widen the codes before the
+	// end of information code
+	if (lastCode + 1 >= (1u << codeSize) && codeSize < 12)
+	{
+		codeSize++;
+	}
+	writeCode(CLEAR_CODE + 1, codeSize);
+	if (bitCount > 0)
+	{
+		data.push_back(static_cast<uint8_t>(bits));
+	}
+
+	// Sub-blocks of at most 255 bytes, ended by an empty one
+	_output.push_back(static_cast<uint8_t>(MIN_CODE_SIZE));
+	for (size_t offset = 0; offset < data.size(); offset += 255)
+	{
+		size_t size = std::min<size_t>(255, data.size() - offset);
+		_output.push_back(static_cast<uint8_t>(size));
+		_output.insert(_output.end(), data.begin() + offset, data.begin() + offset + size);
+	}
+	_output.push_back(0);
+}
+
+void VideoCapture::flush()
+{
+	if (!_file.write(reinterpret_cast<const char*>(_output.data()), _output.size()))
+	{
+		_hasWriteError = true;
+	}
+	_output.clear();
+}
@@ -0,0 +1,54 @@
+#include "WavAudioSink.hpp"
+#include "State.hpp"
+#include <fstream>
+#include <iostream>
+
+static const double FRAMES_PER_SECOND = 60.0;
+
+WavAudioSink::WavAudioSink(unsigned int sampleRate) :
+	_generator(sampleRate, 0.5),
+	_pendingSamples(0.0)
+{ }
+
+void WavAudioSink::update(const SoundState& state)
+{
+	_pendingSamples += _generator.sampleRate() / FRAMES_PER_SECOND;
+	size_t count = static_cast<size_t>(_pendingSamples);
+	_pendingSamples -= count;
+
+	size_t offset = _samples.size();
+	_samples.resize(offset + count);
+	_generator.render(state, &_samples[offset], count);
+}
+
+bool WavAudioSink::save(const std::string& path) const
+{
+	// RIFF header followed by the fmt and data chunks, everything is little endian
+	uint32_t dataSize = static_cast<uint32_t>(_samples.size() * 2);
+	std::vector<uint8_t> data;
+	StateWriter writer(data);
+	writer.writeBytes(reinterpret_cast<const uint8_t*>("RIFF"), 4);
+	writer.write32(36 + dataSize);
+	writer.writeBytes(reinterpret_cast<const uint8_t*>("WAVEfmt "), 8);
+	writer.write32(16);
+	writer.write16(1); // PCM
+	writer.write16(1); // Mono
+	writer.write32(_generator.sampleRate());
+	writer.write32(_generator.sampleRate() * 2);
+	writer.write16(2);
+	writer.write16(16);
+	writer.writeBytes(reinterpret_cast<const uint8_t*>("data"), 4);
+	writer.write32(dataSize);
+	for (int16_t sample : _samples)
+	{
+		writer.write16(static_cast<uint16_t>(sample));
+	}
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file.write(reinterpret_cast<const char*>(data.data()), data.size()))
+	{
+		std::cout << "[ERROR] Cannot write the audio '" << path << "'" << std::endl;
+		return false;
+	}
+	return true;
+}
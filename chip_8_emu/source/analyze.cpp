@@ -0,0 +1,93 @@
+#include "Chip8.hpp"
+#include "RomAnalysis.hpp"
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Disassembles a rom without running it: the listing goes to stdout, the control-flow graph and regions to JSON
+
+static void printUsage()
+{
+	std::cout << "Usage: chip8_analyze <rom> [--platform vip|schip|xochip] [--json analysis.json] [--quiet]" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	std::string romPath;
+	std::string jsonPath;
+	bool isQuiet = false;
+	Platform::Type platform = Platform::Type::CosmacVip;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--platform" && hasValue)
+		{
+			if (!Platform::fromString(argv[++i], platform))
+			{
+				printUsage();
+				return 1;
+			}
+		}
+		else if (arg == "--json" && hasValue)
+		{
+			jsonPath = argv[++i];
+		}
+		else if (arg == "--quiet")
+		{
+			// Only the JSON is written
+			isQuiet = true;
+		}
+		else if (arg.compare(0, 2, "--") != 0 && romPath.empty())
+		{
+			romPath = arg;
+		}
+		else
+		{
+			printUsage();
+			return 1;
+		}
+	}
+
+	if (romPath.empty())
+	{
+		printUsage();
+		return 1;
+	}
+
+	std::ifstream file(romPath, std::ios::binary);
+	std::vector<uint8_t> rom((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	// The memory is laid out by the emulator, with the font the rom may jump or point into
+	Chip8 emulator(0, Platform::quirks(platform));
+	emulator.setPlatform(platform);
+	if (!file.is_open() || !emulator.loadRom(rom.data(), rom.size()))
+	{
+		std::cout << "[ERROR] An error occured while loading the rom '" << romPath << "'" << std::endl;
+		return 1;
+	}
+	emulator.initialize();
+
+	RomAnalysis analysis;
+	analysis.analyze(emulator.memory(), rom.size(), platform);
+
+	if (!isQuiet)
+	{
+		analysis.writeListing(std::cout);
+	}
+
+	if (!jsonPath.empty())
+	{
+		std::ofstream json(jsonPath);
+		analysis.writeJson(json);
+		if (!json.good())
+		{
+			std::cout << "[ERROR] Cannot write the analysis to '" << jsonPath << "'" << std::endl;
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,518 @@
+#include "Chip8.hpp"
+#include "Debugger.hpp"
+#include "Lockstep.hpp"
+#include "MachineState.hpp"
+#include "Profiler.hpp"
+#include "RomAnalysis.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct BenchRom
+{
+	std::string name;
+	std::vector<uint8_t> data;
+	Platform::Type platform;
+};
+
+struct BenchConfig
+{
+	size_t frames;
+	size_t cyclesPerFrame;
+	size_t warmupRuns;
+	size_t runs;
+	bool displayWait;
+	CPU::DispatchMode dispatchMode;
+	bool profile;
+	// Debugger attached without breakpoints, every instruction then goes through its checks
+	bool debugger;
+	bool runtimeQuirks;
+	bool idleSkip;
+	// States stepped per frame by Chip8::step(), 0 runs the emulator directly
+	size_t stepBatch;
+	// Lanes run side by side by a Lockstep, 0 runs the emulator directly
+	size_t lockstepLanes;
+	// Blocks decoded from a static analysis before the timing starts, basic block dispatch only
+	bool analysis;
+};
+
+struct BenchRun
+{
+	uint64_t instructions;
+	size_t frames;
+	double seconds;
+	// Lockstep only, instructions run on all the lanes of a group at once and lanes ending unlike Chip8::step()
+	uint64_t vectorInstructions;
+	size_t mismatchedLanes;
+};
+
+static BenchRom makeRom(const std::string& name, const std::vector<uint16_t>& opCodes, Platform::Type platform = Platform::Type::CosmacVip)
+{
+	BenchRom rom;
+	rom.name = name;
+	rom.platform = platform;
+	for (uint16_t opCode : opCodes)
+	{
+		rom.data.push_back(static_cast<uint8_t>(opCode >> 8));
+		rom.data.push_back(static_cast<uint8_t>(opCode & 0xFF));
+	}
+	return rom;
+}
+
+// Endless loops hammering a single opCode class, so the cost of each class can be compared
+static std::vector<BenchRom> syntheticRoms()
+{
+	std::vector<BenchRom> roms;
+
+	// 6XNN, 7XNN and 8XYN arithmetic
+	roms.push_back(makeRom("synthetic-alu", {
+		0x6001, 0x6102, 0x6203,
+		0x8014, 0x8125, 0x8231, 0x8302, 0x8413, 0x8546, 0x864E, 0x8707, 0x7801, 0x8980,
+		0x1206
+	}));
+
+	// 2NNN, 00EE, 1NNN and the skips
+	roms.push_back(makeRom("synthetic-flow", {
+		0x2208, 0x4000, 0x1200, 0x1200,
+		0x7001, 0x3000, 0x5010, 0x00EE, 0x00EE
+	}));
+
+	// ANNN, FX1E, FX29, FX33, FX55 and FX65
+	roms.push_back(makeRom("synthetic-memory", {
+		0xA300, 0x6A7B, 0xFA33, 0xF255, 0xF265, 0xF029, 0xA300, 0xF01E, 0x7001, 0x1200
+	}));
+
+	// FX29 and DXYN with a clear every 256 sprites
+	roms.push_back(makeRom("synthetic-draw", {
+		0x00E0, 0xF229, 0xD015, 0x7003, 0x7101, 0x7201, 0x6F0F, 0x82F2, 0x3100, 0x1202, 0x1200
+	}));
+
+	// FX07, FX15 and FX18
+	roms.push_back(makeRom("synthetic-timers", {
+		0x6005, 0xF015, 0xF107, 0xF018, 0x1202
+	}));
+
+	// SUPER-CHIP 128x64 mode, FX30, 16x16 DXY0 and the scrolls
+	roms.push_back(makeRom("synthetic-hires", {
+		0x00FF, 0x6000,
+		0xF030, 0xD120, 0x7103, 0x7201, 0x00C1, 0x00FB, 0x00FC, 0x7001, 0x1204
+	}, Platform::Type::SuperChip));
+
+	return roms;
+}
+
+static bool loadFile(const std::string& path, BenchRom& rom)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	rom.data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	size_t separator = path.find_last_of("/\\");
+	rom.name = separator == std::string::npos ? path : path.substr(separator + 1);
+	return !rom.data.empty();
+}
+
+// Same keys as the lanes got, frame by frame, through Chip8::step()
+static size_t countMismatchedLanes(Chip8& emulator, const MachineState& root, const std::vector<MachineState>& lanes, const std::vector<uint16_t>& keys)
+{
+	size_t mismatchedLanes = 0;
+	size_t frames = keys.size() / lanes.size();
+	for (size_t lane = 0; lane < lanes.size(); lane++)
+	{
+		MachineState expected = root;
+		bool isRunning = true;
+		for (size_t frame = 0; frame < frames && isRunning; frame++)
+		{
+			isRunning = emulator.step(expected, keys[frame * lanes.size() + lane], 1);
+		}
+		if (memcmp(&expected, &lanes[lane], sizeof(MachineState)) != 0)
+		{
+			mismatchedLanes++;
+		}
+	}
+	return mismatchedLanes;
+}
+
+static bool runOnce(const BenchRom& rom, const BenchConfig& config, bool isChecked, BenchRun& run)
+{
+	Quirks quirks = Platform::quirks(rom.platform);
+	quirks.displayWait = config.displayWait;
+	Chip8 emulator(config.cyclesPerFrame, quirks);
+	emulator.setPlatform(rom.platform);
+	if (!emulator.loadRom(rom.data.data(), rom.data.size()))
+	{
+		return false;
+	}
+	emulator.cpu().setQuirkSpecializationEnabled(!config.runtimeQuirks);
+	emulator.cpu().setIdleSkipEnabled(config.idleSkip);
+	emulator.initialize();
+	emulator.cpu().setDispatchMode(config.dispatchMode);
+	if (config.analysis && config.dispatchMode == CPU::DispatchMode::BasicBlock)
+	{
+		RomAnalysis analysis;
+		analysis.analyze(emulator.memory(), rom.data.size(), rom.platform);
+		if (!emulator.cpu().loadAnalysis(analysis))
+		{
+			return false;
+		}
+	}
+	Profiler profiler;
+	if (config.profile)
+	{
+		emulator.setProfiler(&profiler, "");
+	}
+	Debugger debugger(emulator);
+	if (config.debugger)
+	{
+		emulator.setDebugger(&debugger);
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	run.frames = 0;
+	run.vectorInstructions = 0;
+	run.mismatchedLanes = 0;
+	if (config.lockstepLanes > 0)
+	{
+		// Lanes of the same rom with their own random keys, drifting apart as a population of agents does
+		MachineState root;
+		if (!emulator.saveState(root))
+		{
+			return false;
+		}
+		std::vector<MachineState> lanes(config.lockstepLanes, root);
+		Lockstep lockstep(config.cyclesPerFrame, quirks, rom.platform);
+		if (!lockstep.load(lanes.data(), lanes.size()))
+		{
+			return false;
+		}
+		// Creating the lane cores is not timed
+		start = std::chrono::steady_clock::now();
+		std::vector<uint16_t> keys(config.frames * config.lockstepLanes);
+		uint32_t random = 0x9E3779B9;
+		for (size_t frame = 0; frame < config.frames; frame++)
+		{
+			uint16_t* frameKeys = &keys[frame * config.lockstepLanes];
+			for (size_t i = 0; i < config.lockstepLanes; i++)
+			{
+				random ^= random << 13;
+				random ^= random >> 17;
+				random ^= random << 5;
+				frameKeys[i] = static_cast<uint16_t>(random >> 16);
+			}
+			lockstep.run(frameKeys, 1);
+			run.frames += config.lockstepLanes;
+		}
+		run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		run.vectorInstructions = lockstep.vectorCycleCount();
+		run.instructions = lockstep.vectorCycleCount() + lockstep.scalarCycleCount();
+
+		// Outside of the timing, every lane must end as the scalar core leaves it
+		if (isChecked)
+		{
+			lockstep.save(lanes.data());
+			run.mismatchedLanes = countMismatchedLanes(emulator, root, lanes, keys);
+		}
+		return true;
+	}
+	else if (config.stepBatch > 0)
+	{
+		// Search-like branching: every frame, each state of the batch is cloned from a random parent of the
+		// previous batch and stepped with random keys, a frame of each state counts as a frame
+		MachineState root;
+		if (!emulator.saveState(root))
+		{
+			return false;
+		}
+		std::vector<MachineState> states(config.stepBatch, root);
+		std::vector<MachineState> clones(config.stepBatch);
+		std::vector<uint16_t> keys(config.stepBatch);
+		uint32_t random = 0x9E3779B9;
+		for (size_t frame = 0; frame < config.frames; frame++)
+		{
+			for (size_t i = 0; i < config.stepBatch; i++)
+			{
+				random ^= random << 13;
+				random ^= random >> 17;
+				random ^= random << 5;
+				clones[i] = states[random % config.stepBatch];
+				keys[i] = static_cast<uint16_t>(random >> 16);
+			}
+			emulator.step(clones.data(), keys.data(), config.stepBatch, 1);
+			states.swap(clones);
+			run.frames += config.stepBatch;
+		}
+	}
+	else
+	{
+		while (run.frames < config.frames && emulator.runFrame())
+		{
+			run.frames++;
+		}
+	}
+	run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	run.instructions = emulator.instructionCount();
+	return true;
+}
+
+static double median(std::vector<double> values)
+{
+	std::sort(values.begin(), values.end());
+	size_t middle = values.size() / 2;
+	return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2.0;
+}
+
+static const char* dispatchModeName(CPU::DispatchMode dispatchMode)
+{
+	switch (dispatchMode)
+	{
+		case CPU::DispatchMode::Linear:
+			return "linear";
+		case CPU::DispatchMode::BasicBlock:
+			return "block";
+		default:
+			return "table";
+	}
+}
+
+// Rom names come from the command line, quotes, backslashes and control characters would break the report
+static std::string escapeJson(const std::string& text)
+{
+	static const char HEX_DIGITS[] = "0123456789abcdef";
+	std::string escaped;
+	for (char character : text)
+	{
+		uint8_t byte = static_cast<uint8_t>(character);
+		if (character == '"' || character == '\\')
+		{
+			escaped += '\\';
+			escaped += character;
+		}
+		else if (byte < 0x20)
+		{
+			escaped += "\\u00";
+			escaped += HEX_DIGITS[byte >> 4];
+			escaped += HEX_DIGITS[byte & 0xF];
+		}
+		else
+		{
+			escaped += character;
+		}
+	}
+	return escaped;
+}
+
+static void printUsage()
+{
+	std::cout << "Usage: chip8_bench [--frames N] [--cycles N] [--warmup N] [--runs N] [--dispatch linear|table|block] [--no-display-wait] [--profile] [--debugger] [--runtime-quirks] [--no-idle-skip] [--step N] [--lockstep N] [--analysis] [--platform vip|schip|xochip] [--no-synthetic] [--output file] [rom...]" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	BenchConfig config = { 3000, 1000, 1, 5, true, CPU::DispatchMode::BasicBlock, false, false, false, true, 0, 0, false };
+	bool useSynthetic = true;
+	Platform::Type platform = Platform::Type::CosmacVip;
+	std::string outputPath;
+	std::vector<BenchRom> roms;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--frames" && hasValue)
+		{
+			config.frames = std::strtoul(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--cycles" && hasValue)
+		{
+			config.cyclesPerFrame = std::strtoul(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--warmup" && hasValue)
+		{
+			config.warmupRuns = std::strtoul(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--runs" && hasValue)
+		{
+			config.runs = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (arg == "--dispatch" && hasValue)
+		{
+			const char* mode = argv[++i];
+			config.dispatchMode = std::strcmp(mode, "linear") == 0 ? CPU::DispatchMode::Linear : std::strcmp(mode, "block") == 0 ? CPU::DispatchMode::BasicBlock : CPU::DispatchMode::Table;
+		}
+		else if (arg == "--no-display-wait")
+		{
+			config.displayWait = false;
+		}
+		else if (arg == "--runtime-quirks")
+		{
+			// Measures the gain of the handlers specialized for the quirks
+			config.runtimeQuirks = true;
+		}
+		else if (arg == "--no-idle-skip")
+		{
+			// Runs the busy waits instruction by instruction, the synthetic loops are idle otherwise
+			config.idleSkip = false;
+		}
+		else if (arg == "--step" && hasValue)
+		{
+			// Measures cloned frame steps of MachineState batches, the frames are per state of the batch
+			config.stepBatch = std::strtoul(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--lockstep" && hasValue)
+		{
+			// Measures lanes run side by side, the frames are per lane, and checks every lane against Chip8::step()
+			config.lockstepLanes = std::strtoul(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--analysis")
+		{
+			// Measures basic blocks decoded ahead from the static analysis of the rom
+			config.analysis = true;
+		}
+		else if (arg == "--profile")
+		{
+			// Measures the overhead of the profiler
+			config.profile = true;
+		}
+		else if (arg == "--debugger")
+		{
+			// Measures the overhead of an attached debugger
+			config.debugger = true;
+		}
+		else if (arg == "--platform" && hasValue && Platform::fromString(argv[i + 1], platform))
+		{
+			// Platform of the roms given as files
+			i++;
+		}
+		else if (arg == "--output" && hasValue)
+		{
+			outputPath = argv[++i];
+		}
+		else if (arg == "--no-synthetic")
+		{
+			useSynthetic = false;
+		}
+		else if (arg.compare(0, 2, "--") == 0)
+		{
+			printUsage();
+			return 1;
+		}
+		else
+		{
+			BenchRom rom;
+			if (!loadFile(arg, rom))
+			{
+				std::cerr << "[ERROR] An error occured while loading the rom '" << arg << "'" << std::endl;
+				return 1;
+			}
+			roms.push_back(rom);
+		}
+	}
+
+	for (BenchRom& rom : roms)
+	{
+		rom.platform = platform;
+	}
+	if (useSynthetic)
+	{
+		std::vector<BenchRom> synthetic = syntheticRoms();
+		roms.insert(roms.end(), synthetic.begin(), synthetic.end());
+	}
+
+	// Report is written as JSON so runs can be archived and compared across builds
+	// Writing it to a file keeps it clean of the errors the CPU prints on stdout
+	std::ofstream outputFile;
+	if (!outputPath.empty())
+	{
+		outputFile.open(outputPath);
+		if (!outputFile.is_open())
+		{
+			std::cerr << "[ERROR] Cannot write the report to '" << outputPath << "'" << std::endl;
+			return 1;
+		}
+	}
+	std::ostream& report = outputPath.empty() ? std::cout : outputFile;
+
+	report << std::dec << "{" << std::endl;
+	report << "  \"config\": { \"frames\": " << config.frames
+		<< ", \"cyclesPerFrame\": " << config.cyclesPerFrame
+		<< ", \"warmupRuns\": " << config.warmupRuns
+		<< ", \"runs\": " << config.runs
+		<< ", \"displayWait\": " << (config.displayWait ? "true" : "false")
+		<< ", \"dispatch\": \"" << dispatchModeName(config.dispatchMode) << "\""
+		<< ", \"profile\": " << (config.profile ? "true" : "false")
+		<< ", \"debugger\": " << (config.debugger ? "true" : "false")
+		<< ", \"runtimeQuirks\": " << (config.runtimeQuirks ? "true" : "false")
+		<< ", \"idleSkip\": " << (config.idleSkip ? "true" : "false")
+		<< ", \"step\": " << config.stepBatch
+		<< ", \"lockstep\": " << config.lockstepLanes
+		<< ", \"analysis\": " << (config.analysis ? "true" : "false")
+		<< ", \"instructionSet\": \"" << Lockstep::instructionSet() << "\" }," << std::endl;
+	report << "  \"results\": [" << std::endl;
+
+	for (size_t r = 0; r < roms.size(); r++)
+	{
+		const BenchRom& rom = roms[r];
+		BenchRun run;
+		bool isValid = true;
+
+		for (size_t i = 0; i < config.warmupRuns && isValid; i++)
+		{
+			isValid = runOnce(rom, config, false, run);
+		}
+
+		std::vector<double> instructionsPerSecond;
+		std::vector<double> framesPerSecond;
+		uint64_t instructions = 0;
+		uint64_t vectorInstructions = 0;
+		size_t frames = 0;
+		size_t mismatchedLanes = 0;
+		for (size_t i = 0; i < config.runs && isValid; i++)
+		{
+			// Runs are identical, checking the first one is enough
+			isValid = runOnce(rom, config, i == 0, run);
+			double seconds = std::max(run.seconds, 1e-9);
+			instructionsPerSecond.push_back(run.instructions / seconds);
+			framesPerSecond.push_back(run.frames / seconds);
+			instructions = run.instructions;
+			vectorInstructions = run.vectorInstructions;
+			frames = run.frames;
+			mismatchedLanes += run.mismatchedLanes;
+		}
+
+		report << std::dec << "    { \"rom\": \"" << escapeJson(rom.name) << "\"";
+		if (isValid)
+		{
+			double ips = median(instructionsPerSecond);
+			report << ", \"frames\": " << frames
+				<< ", \"instructions\": " << instructions
+				<< ", \"instructionsPerSecond\": " << static_cast<uint64_t>(ips)
+				<< ", \"nsPerInstruction\": " << (ips > 0.0 ? 1e9 / ips : 0.0)
+				<< ", \"framesPerSecond\": " << static_cast<uint64_t>(median(framesPerSecond))
+				<< ", \"bestInstructionsPerSecond\": " << static_cast<uint64_t>(*std::max_element(instructionsPerSecond.begin(), instructionsPerSecond.end()))
+				<< ", \"completed\": " << (frames == config.frames * std::max<size_t>(1, config.stepBatch + config.lockstepLanes) ? "true" : "false");
+			if (config.lockstepLanes > 0)
+			{
+				report << ", \"vectorShare\": " << (instructions > 0 ? static_cast<double>(vectorInstructions) / instructions : 0.0)
+					<< ", \"mismatchedLanes\": " << mismatchedLanes;
+			}
+		}
+		else
+		{
+			report << ", \"error\": \"" << (config.stepBatch + config.lockstepLanes > 0 ? "rom does not fit in memory or a MachineState" : "rom does not fit in memory") << "\"";
+		}
+		report << " }" << (r + 1 < roms.size() ? "," : "") << std::endl;
+	}
+
+	report << "  ]" << std::endl;
+	report << "}" << std::endl;
+
+	return 0;
+}
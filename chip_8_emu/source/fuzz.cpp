@@ -0,0 +1,503 @@
+#include "Chip8.hpp"
+#include "InputSource.hpp"
+#include "Lockstep.hpp"
+#include "MachineState.hpp"
+#include "RomAnalysis.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Differential test of the dispatch paths: random roms run on the Linear dispatch with the handlers reading the
+// quirks at runtime and without idle skip, the reference, then on every faster path, which must end each frame
+// in the same state. The seeds are fixed so a failure is reproduced with --seed
+
+struct FuzzCase
+{
+	uint64_t seed;
+	std::vector<uint8_t> rom;
+	Platform::Type platform;
+	Quirks quirks;
+	size_t cyclesPerFrame;
+	// Keys held during each frame
+	std::vector<uint16_t> keys;
+};
+
+struct FuzzConfig
+{
+	uint64_t firstSeed;
+	size_t seedCount;
+	size_t frames;
+};
+
+// Keys of the frame being run
+class FuzzKeys : public InputSource
+{
+public:
+	bool isKeyPressed(uint8_t keyCode) const override { return ((keys >> keyCode) & 1) != 0; }
+
+	uint16_t keys = 0;
+};
+
+static void printUsage()
+{
+	std::cout << "Usage: chip8_fuzz [--seeds N] [--seed S] [--frames N]" << std::endl;
+}
+
+static uint16_t randomOpCode(std::mt19937_64& random, size_t wordCount, Platform::Type platform)
+{
+	auto pick = [&random](uint32_t count) { return static_cast<uint16_t>(random() % count); };
+	uint16_t target = static_cast<uint16_t>(Chip8::ROM_START_ADDR + 2 * pick(static_cast<uint32_t>(wordCount)));
+	uint16_t X = pick(16) << 8;
+	uint16_t Y = pick(16) << 4;
+	uint16_t NN = pick(256);
+
+	switch (pick(28))
+	{
+		case 0: return 0x00E0;
+		case 1: return 0x00EE;
+		case 2: return 0x1000 | target;
+		// As many returns as calls, so the stack rarely overflows
+		case 3: return pick(2) != 0 ? 0x2000 | target : 0x00EE;
+		// Few values, so the skips are taken as often as not
+		case 4: return 0x3000 | X | pick(4);
+		case 5: return 0x4000 | X | pick(4);
+		case 6: return 0x5000 | X | Y;
+		case 7: return 0x6000 | X | NN;
+		case 8: return 0x7000 | X | NN;
+		case 9:
+		case 10:
+		{
+			const uint16_t OPERATIONS[] = { 0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE };
+			return 0x8000 | X | Y | OPERATIONS[pick(9)];
+		}
+		case 11: return 0x9000 | X | Y;
+		// Data past the rom most of the time, the code itself otherwise so stores may overwrite it
+		case 12: return 0xA000 | (pick(8) != 0 ? 0x300 + pick(0x100) : target);
+		case 13: return 0xB000 | (target - pick(16));
+		case 14: return 0xC000 | X | NN;
+		case 15:
+		case 16: return 0xD000 | X | Y | pick(16);
+		case 17: return pick(2) != 0 ? 0xE09E | X : 0xE0A1 | X;
+		case 18:
+		{
+			const uint16_t OPERATIONS[] = { 0x07, 0x0A, 0x15, 0x18, 0x1E, 0x29 };
+			return 0xF000 | X | OPERATIONS[pick(6)];
+		}
+		case 19: return 0xF033 | X;
+		case 20: return 0xF055 | X;
+		case 21: return 0xF065 | X;
+		// Backward jumps and short loops on the timers, for the idle loop detection
+		case 22: return 0x1000 | target;
+		case 23: return 0xF007 | X;
+		case 24:
+			if (platform != Platform::Type::CosmacVip)
+			{
+				const uint16_t OPERATIONS[] = { static_cast<uint16_t>(0x00C0 | pick(16)), 0x00FB, 0x00FC, 0x00FE, 0x00FF,
+					static_cast<uint16_t>(0xF030 | X), static_cast<uint16_t>(0xF075 | X), static_cast<uint16_t>(0xF085 | X) };
+				return OPERATIONS[pick(8)];
+			}
+			return 0x7000 | X | 1;
+		case 25:
+			if (platform == Platform::Type::XoChip)
+			{
+				const uint16_t OPERATIONS[] = { static_cast<uint16_t>(0x00D0 | pick(16)), static_cast<uint16_t>(0x5002 | X | Y),
+					static_cast<uint16_t>(0x5003 | X | Y), static_cast<uint16_t>(0xF001 | (pick(4) << 8)), 0xF000 };
+				return OPERATIONS[pick(5)];
+			}
+			return 0x6000 | X | NN;
+		default: return 0x7000 | X | 1;
+	}
+}
+
+static FuzzCase makeCase(uint64_t seed, size_t frames)
+{
+	std::mt19937_64 random(seed);
+	FuzzCase fuzzCase;
+	fuzzCase.seed = seed;
+	fuzzCase.platform = static_cast<Platform::Type>(random() % 3);
+	// The quirks of the platform half of the time, the ones the specialized handlers are built for
+	fuzzCase.quirks = random() % 2 == 0 ? Platform::quirks(fuzzCase.platform)
+		: Quirks::fromMask(static_cast<uint8_t>(random() % (1 << Quirks::QUIRK_COUNT)));
+	fuzzCase.cyclesPerFrame = 1 + random() % 200;
+
+	// Ends on a jump to the start, so the execution only leaves the rom through a jump or a return
+	size_t wordCount = 16 + random() % 112;
+	std::vector<uint16_t> opCodes;
+	while (opCodes.size() + 1 < wordCount)
+	{
+		uint16_t X = static_cast<uint16_t>(random() % 16) << 8;
+		uint16_t loop = static_cast<uint16_t>(0x1000 | (Chip8::ROM_START_ADDR + 2 * opCodes.size()));
+		switch (random() % 24)
+		{
+			// Waits on the delay timer and on a key, the loops the idle skip detects
+			case 0:
+				opCodes.insert(opCodes.end(), { static_cast<uint16_t>(0xF007 | X), static_cast<uint16_t>(0x3000 | X), loop });
+				break;
+			case 1:
+				opCodes.insert(opCodes.end(), { static_cast<uint16_t>(0xE09E | X), loop });
+				break;
+			default:
+				opCodes.push_back(randomOpCode(random, wordCount, fuzzCase.platform));
+				break;
+		}
+	}
+	opCodes.resize(wordCount - 1);
+	opCodes.push_back(0x1000 | Chip8::ROM_START_ADDR);
+	for (uint16_t opCode : opCodes)
+	{
+		fuzzCase.rom.push_back(static_cast<uint8_t>(opCode >> 8));
+		fuzzCase.rom.push_back(static_cast<uint8_t>(opCode & 0xFF));
+	}
+
+	// Keys held for a few frames then changed, including no key at all
+	uint16_t keys = 0;
+	for (size_t i = 0; i < frames; i++)
+	{
+		if (random() % 8 == 0)
+		{
+			keys = random() % 2 == 0 ? 0 : static_cast<uint16_t>(random());
+		}
+		fuzzCase.keys.push_back(keys);
+	}
+	return fuzzCase;
+}
+
+static void loadCase(Chip8& emulator, const FuzzCase& fuzzCase)
+{
+	emulator.setPlatform(fuzzCase.platform);
+	emulator.loadRom(fuzzCase.rom.data(), fuzzCase.rom.size());
+	emulator.initialize();
+	emulator.setSeed(fuzzCase.seed);
+}
+
+// State after every frame, and whether the frame ran without error
+struct FuzzTrace
+{
+	std::vector<std::vector<uint8_t>> states;
+	std::vector<uint64_t> instructionCounts;
+	std::vector<MachineState> machineStates;
+	bool isRunning;
+};
+
+// Runs the frames, or until an error stops the execution
+static FuzzTrace runCase(Chip8& emulator, const FuzzCase& fuzzCase, bool hasMachineStates)
+{
+	FuzzKeys input;
+	emulator.setInputSource(&input);
+	FuzzTrace trace;
+	trace.isRunning = true;
+	for (size_t frame = 0; frame < fuzzCase.keys.size() && trace.isRunning; frame++)
+	{
+		input.keys = fuzzCase.keys[frame];
+		trace.isRunning = emulator.runFrame();
+		trace.states.emplace_back();
+		emulator.saveState(trace.states.back());
+		trace.instructionCounts.push_back(emulator.instructionCount());
+		if (hasMachineStates)
+		{
+			trace.machineStates.emplace_back();
+			emulator.saveState(trace.machineStates.back());
+		}
+	}
+	emulator.setInputSource(nullptr);
+	return trace;
+}
+
+static bool hasMachineState(Platform::Type platform)
+{
+	return Platform::memorySize(platform) == MachineState::MEMORY_SIZE;
+}
+
+static FuzzTrace runReference(const FuzzCase& fuzzCase)
+{
+	Chip8 emulator(fuzzCase.cyclesPerFrame, fuzzCase.quirks);
+	emulator.cpu().setQuirkSpecializationEnabled(false);
+	emulator.cpu().setIdleSkipEnabled(false);
+	loadCase(emulator, fuzzCase);
+	emulator.cpu().setDispatchMode(CPU::DispatchMode::Linear);
+	return runCase(emulator, fuzzCase, hasMachineState(fuzzCase.platform));
+}
+
+// Each path returns the frame of its first difference with the reference, NO_DIFFERENCE when there is none
+// and NOT_APPLICABLE when the case does not exercise it
+static const size_t NO_DIFFERENCE = SIZE_MAX;
+static const size_t NOT_APPLICABLE = SIZE_MAX - 1;
+
+// Frame of the first difference, or NO_DIFFERENCE when the traces are the same
+static size_t compareTraces(const FuzzTrace& reference, const FuzzTrace& trace)
+{
+	size_t frameCount = reference.states.size();
+	for (size_t frame = 0; frame < frameCount; frame++)
+	{
+		if (frame >= trace.states.size() || trace.states[frame] != reference.states[frame]
+			|| trace.instructionCounts[frame] != reference.instructionCounts[frame])
+		{
+			return frame;
+		}
+	}
+	return trace.states.size() == frameCount && trace.isRunning == reference.isRunning ? NO_DIFFERENCE : frameCount - 1;
+}
+
+static size_t runDispatch(const FuzzCase& fuzzCase, const FuzzTrace& reference, CPU::DispatchMode dispatchMode)
+{
+	Chip8 emulator(fuzzCase.cyclesPerFrame, fuzzCase.quirks);
+	emulator.cpu().setQuirkSpecializationEnabled(false);
+	emulator.cpu().setIdleSkipEnabled(false);
+	loadCase(emulator, fuzzCase);
+	emulator.cpu().setDispatchMode(dispatchMode);
+	return compareTraces(reference, runCase(emulator, fuzzCase, false));
+}
+
+static size_t runTable(const FuzzCase& fuzzCase, const FuzzTrace& reference)
+{
+	return runDispatch(fuzzCase, reference, CPU::DispatchMode::Table);
+}
+
+static size_t runBlock(const FuzzCase& fuzzCase, const FuzzTrace& reference)
+{
+	return runDispatch(fuzzCase, reference, CPU::DispatchMode::BasicBlock);
+}
+
+// Table dispatch with the handlers specialized for the quirks of the platform, when the case uses them
+static size_t runSpecialized(const FuzzCase& fuzzCase, const FuzzTrace& reference)
+{
+	Chip8 emulator(fuzzCase.cyclesPerFrame, fuzzCase.quirks);
+	emulator.cpu().setIdleSkipEnabled(false);
+	loadCase(emulator, fuzzCase);
+	if (std::string(emulator.cpu().quirkProfile()) == "runtime")
+	{
+		return NOT_APPLICABLE;
+	}
+	emulator.cpu().setDispatchMode(CPU::DispatchMode::Table);
+	return compareTraces(reference, runCase(emulator, fuzzCase, false));
+}
+
+// Basic blocks with the idle loops skipped, the configuration of the front-end
+static size_t runIdleSkip(const FuzzCase& fuzzCase, const FuzzTrace& reference)
+{
+	Chip8 emulator(fuzzCase.cyclesPerFrame, fuzzCase.quirks);
+	loadCase(emulator, fuzzCase);
+	emulator.cpu().setDispatchMode(CPU::DispatchMode::BasicBlock);
+	return compareTraces(reference, runCase(emulator, fuzzCase, false));
+}
+
+// Basic blocks decoded up front from a static analysis of the rom, the stores proven to write data only staying
+// inside their block when the analysis is complete
+static size_t runAnalysis(const FuzzCase& fuzzCase, const FuzzTrace& reference)
+{
+	Chip8 emulator(fuzzCase.cyclesPerFrame, fuzzCase.quirks);
+	loadCase(emulator, fuzzCase);
+	RomAnalysis analysis;
+	analysis.analyze(emulator.memory(), fuzzCase.rom.size(), fuzzCase.platform);
+	emulator.cpu().setDispatchMode(CPU::DispatchMode::BasicBlock);
+	if (!emulator.cpu().loadAnalysis(analysis))
+	{
+		return 0;
+	}
+	return compareTraces(reference, runCase(emulator, fuzzCase, false));
+}
+
+// States stepped one frame at a time by Chip8::step(), interleaved with another state so nothing leaks between them
+static size_t runStep(const FuzzCase& fuzzCase, const FuzzTrace& reference)
+{
+	if (!hasMachineState(fuzzCase.platform))
+	{
+		return NOT_APPLICABLE;
+	}
+
+	Chip8 emulator(fuzzCase.cyclesPerFrame, fuzzCase.quirks);
+	loadCase(emulator, fuzzCase);
+	emulator.cpu().setDispatchMode(CPU::DispatchMode::Table);
+	// Garbage before the save, which must write every byte so equal machines compare equal
+	MachineState state;
+	memset(&state, 0xA5, sizeof(state));
+	emulator.saveState(state);
+	MachineState decoy = state;
+
+	size_t frameCount = reference.machineStates.size();
+	for (size_t frame = 0; frame < frameCount; frame++)
+	{
+		bool isRunning = emulator.step(state, fuzzCase.keys[frame], 1);
+		if (memcmp(&state, &reference.machineStates[frame], sizeof(state)) != 0
+			|| isRunning != (frame + 1 < frameCount || reference.isRunning))
+		{
+			return frame;
+		}
+		emulator.step(decoy, static_cast<uint16_t>(~fuzzCase.keys[frame]), 1);
+	}
+
+	// A state that stopped stays stopped, stepping it again, twice, changes nothing
+	MachineState stopped = state;
+	for (size_t i = 0; i < 2 && !reference.isRunning; i++)
+	{
+		if (emulator.step(state, static_cast<uint16_t>(~0), 1) || memcmp(&state, &stopped, sizeof(state)) != 0)
+		{
+			return frameCount;
+		}
+	}
+	return NO_DIFFERENCE;
+}
+
+// Lanes of a Lockstep, each one against its state stepped on the reference. Some lanes start with another register
+// value and every lane but the first holds other keys, so the lanes split and join again
+static size_t runLockstep(const FuzzCase& fuzzCase, const FuzzTrace& reference)
+{
+	if (!hasMachineState(fuzzCase.platform))
+	{
+		return NOT_APPLICABLE;
+	}
+
+	Chip8 emulator(fuzzCase.cyclesPerFrame, fuzzCase.quirks);
+	emulator.cpu().setQuirkSpecializationEnabled(false);
+	emulator.cpu().setIdleSkipEnabled(false);
+	loadCase(emulator, fuzzCase);
+	emulator.cpu().setDispatchMode(CPU::DispatchMode::Linear);
+	MachineState root;
+	emulator.saveState(root);
+
+	std::mt19937_64 random(fuzzCase.seed);
+	size_t laneCount = 1 + random() % 24;
+	std::vector<MachineState> expected(laneCount, root);
+	for (size_t lane = 1; lane < laneCount; lane++)
+	{
+		if (random() % 2 == 0)
+		{
+			expected[lane].registers[random() % MachineState::REGISTER_COUNT] = static_cast<uint8_t>(random() % 4);
+		}
+	}
+	std::vector<uint16_t> laneKeyMasks(laneCount, 0);
+	for (size_t lane = 1; lane < laneCount; lane++)
+	{
+		laneKeyMasks[lane] = random() % 2 == 0 ? 0 : static_cast<uint16_t>(random());
+	}
+
+	// Every lane has its own reference, lane 0 being the one of the case
+	(void)reference;
+	Lockstep lockstep(fuzzCase.cyclesPerFrame, fuzzCase.quirks, fuzzCase.platform);
+	if (!lockstep.load(expected.data(), laneCount))
+	{
+		return 0;
+	}
+	std::vector<MachineState> states(laneCount);
+	std::vector<uint16_t> keys(laneCount);
+	std::vector<bool> isRunning(laneCount, true);
+	for (size_t frame = 0; frame < fuzzCase.keys.size(); frame++)
+	{
+		for (size_t lane = 0; lane < laneCount; lane++)
+		{
+			keys[lane] = fuzzCase.keys[frame] ^ laneKeyMasks[lane];
+			if (isRunning[lane])
+			{
+				isRunning[lane] = emulator.step(expected[lane], keys[lane], 1);
+			}
+		}
+		lockstep.run(keys.data(), 1);
+		lockstep.save(states.data());
+		for (size_t lane = 0; lane < laneCount; lane++)
+		{
+			if (lockstep.isLaneRunning(lane) != isRunning[lane] || memcmp(&states[lane], &expected[lane], sizeof(MachineState)) != 0)
+			{
+				return frame;
+			}
+		}
+	}
+
+	// Saved and loaded again, the lanes that stopped stay stopped
+	if (!lockstep.load(states.data(), laneCount))
+	{
+		return fuzzCase.keys.size();
+	}
+	lockstep.run(keys.data(), 1);
+	std::vector<MachineState> reloaded(laneCount);
+	lockstep.save(reloaded.data());
+	for (size_t lane = 0; lane < laneCount; lane++)
+	{
+		if (!isRunning[lane] && (lockstep.isLaneRunning(lane) || memcmp(&reloaded[lane], &states[lane], sizeof(MachineState)) != 0))
+		{
+			return fuzzCase.keys.size();
+		}
+	}
+	return NO_DIFFERENCE;
+}
+
+struct FuzzPath
+{
+	const char* name;
+	size_t (*run)(const FuzzCase& fuzzCase, const FuzzTrace& reference);
+};
+
+static const FuzzPath PATHS[] = {
+	{ "table", runTable },
+	{ "block", runBlock },
+	{ "specialized", runSpecialized },
+	{ "idle-skip", runIdleSkip },
+	{ "analysis", runAnalysis },
+	{ "step", runStep },
+	{ "lockstep", runLockstep }
+};
+
+int main(int argc, char* argv[])
+{
+	FuzzConfig config = { 1, 200, 120 };
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--seeds" && hasValue)
+		{
+			config.seedCount = std::strtoul(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--seed" && hasValue)
+		{
+			config.firstSeed = std::strtoull(argv[++i], nullptr, 10);
+			config.seedCount = 1;
+		}
+		else if (arg == "--frames" && hasValue)
+		{
+			config.frames = std::max<size_t>(std::strtoul(argv[++i], nullptr, 10), 1);
+		}
+		else
+		{
+			printUsage();
+			return 1;
+		}
+	}
+
+	size_t failureCount = 0;
+	std::vector<size_t> caseCounts(sizeof(PATHS) / sizeof(PATHS[0]), 0);
+	for (uint64_t seed = config.firstSeed; seed < config.firstSeed + config.seedCount; seed++)
+	{
+		FuzzCase fuzzCase = makeCase(seed, config.frames);
+		FuzzTrace reference = runReference(fuzzCase);
+		for (size_t i = 0; i < caseCounts.size(); i++)
+		{
+			const FuzzPath& path = PATHS[i];
+			size_t frame = path.run(fuzzCase, reference);
+			if (frame == NOT_APPLICABLE)
+			{
+				continue;
+			}
+			caseCounts[i]++;
+			if (frame != NO_DIFFERENCE)
+			{
+				std::cout << std::dec << "[FAIL] " << path.name << " seed " << seed << " " << Platform::name(fuzzCase.platform)
+					<< ":" << fuzzCase.quirks.toString() << " " << fuzzCase.cyclesPerFrame << " cycles/frame, differs at frame " << frame << std::endl;
+				failureCount++;
+			}
+		}
+	}
+
+	std::cout << std::dec << "[FUZZ] seeds: " << config.seedCount << " frames: " << config.frames;
+	for (size_t i = 0; i < caseCounts.size(); i++)
+	{
+		std::cout << " " << PATHS[i].name << ": " << caseCounts[i];
+	}
+	std::cout << " failures: " << failureCount << std::endl;
+	return failureCount == 0 ? 0 : 1;
+}
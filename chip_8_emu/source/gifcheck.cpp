@@ -0,0 +1,463 @@
+#include "Framebuffer.hpp"
+#include "VideoCapture.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+// Round trip of VideoCapture: random screens are captured into a GIF, which is read back with a strict LZW decoder
+// and composed image by image, each image must show the screen captured at its time. Solid rectangles of every size
+// give code streams ending on both sides of a change of code size. The seeds are fixed so a failure is reproduced
+// with --seed
+
+struct GifCase
+{
+	uint64_t seed;
+	size_t scale;
+	// Each screen differs from the previous one and is captured as an image of its own
+	std::vector<Framebuffer> screens;
+};
+
+struct GifConfig
+{
+	uint64_t firstSeed;
+	size_t seedCount;
+	size_t screens;
+	std::string path;
+};
+
+// Emulated frames per screen, enough for the encoder to keep every screen instead of merging the short ones
+static const size_t FRAMES_PER_SCREEN = 3;
+static const uint16_t SCREEN_DELAY = 5;
+static const size_t MAX_CODE_COUNT = 4096;
+
+static void printUsage()
+{
+	std::cout << "Usage: chip8_gifcheck [--seeds N] [--seed S] [--screens N] [--output file.gif]" << std::endl;
+}
+
+static void fillRectangle(Framebuffer& framebuffer, std::mt19937_64& random, bool isNoise)
+{
+	auto pick = [&random](size_t count) { return static_cast<uint8_t>(random() % count); };
+	uint8_t left = pick(framebuffer.width());
+	uint8_t top = pick(framebuffer.height());
+	uint8_t right = static_cast<uint8_t>(left + 1 + pick(framebuffer.width() - left));
+	uint8_t bottom = static_cast<uint8_t>(top + 1 + pick(framebuffer.height() - top));
+	uint8_t color = pick(1u << framebuffer.planeCount());
+	size_t density = 1 + pick(7);
+	for (uint8_t y = top; y < bottom; y++)
+	{
+		for (uint8_t x = left; x < right; x++)
+		{
+			if (isNoise)
+			{
+				color = pick(8) < density ? pick(1u << framebuffer.planeCount()) : 0;
+			}
+			for (uint8_t plane = 0; plane < framebuffer.planeCount(); plane++)
+			{
+				framebuffer.putPixel(x, y, ((color >> plane) & 1) != 0, plane);
+			}
+		}
+	}
+}
+
+static GifCase makeCase(uint64_t seed, size_t screenCount)
+{
+	std::mt19937_64 random(seed);
+	GifCase gifCase;
+	gifCase.seed = seed;
+	gifCase.scale = 1 + seed % VideoCapture::MAX_SCALE;
+
+	// Low resolution, high resolution and XO-CHIP screens, the first one is blank
+	uint8_t planeCount = random() % 3 == 0 ? 2 : 1;
+	bool isHires = planeCount == 2 || random() % 2 == 0;
+	Framebuffer framebuffer(isHires ? 128 : 64, isHires ? 64 : 32, planeCount);
+	gifCase.screens.push_back(framebuffer);
+	while (gifCase.screens.size() < screenCount)
+	{
+		switch (random() % 8)
+		{
+			case 0:
+				framebuffer.clear();
+				break;
+			case 1:
+			case 2:
+			case 3:
+				fillRectangle(framebuffer, random, true);
+				break;
+			default:
+				fillRectangle(framebuffer, random, false);
+				break;
+		}
+		// An unchanged screen is not captured, a pixel is flipped instead
+		if (framebuffer.hash() == gifCase.screens.back().hash())
+		{
+			uint8_t x = static_cast<uint8_t>(random() % framebuffer.width());
+			uint8_t y = static_cast<uint8_t>(random() % framebuffer.height());
+			framebuffer.putPixel(x, y, !framebuffer.isPixelOn(x, y));
+		}
+		gifCase.screens.push_back(framebuffer);
+	}
+	return gifCase;
+}
+
+// Color index of a pixel of the image, as VideoCapture::toImage() scaled
+static uint8_t expectedColor(const Framebuffer& framebuffer, size_t scale, size_t x, size_t y)
+{
+	size_t shift = framebuffer.width() < 128 ? 1 : 0;
+	uint8_t color = 0;
+	for (uint8_t plane = 0; plane < framebuffer.planeCount(); plane++)
+	{
+		color |= framebuffer.isPixelOn(static_cast<uint8_t>((x / scale) >> shift), static_cast<uint8_t>((y / scale) >> shift), plane) << plane;
+	}
+	return color;
+}
+
+class GifReader
+{
+public:
+	GifReader(const std::vector<uint8_t>& data) : _data(data), _offset(0) { }
+
+	bool read8(uint8_t& value)
+	{
+		if (_offset >= _data.size())
+		{
+			return false;
+		}
+		value = _data[_offset++];
+		return true;
+	}
+
+	bool read16(uint16_t& value)
+	{
+		uint8_t low;
+		uint8_t high;
+		if (!read8(low) || !read8(high))
+		{
+			return false;
+		}
+		value = static_cast<uint16_t>(low | (high << 8));
+		return true;
+	}
+
+	bool skip(size_t size)
+	{
+		if (_data.size() - _offset < size)
+		{
+			return false;
+		}
+		_offset += size;
+		return true;
+	}
+
+	// Concatenates the sub-blocks up to the empty one
+	bool readSubBlocks(std::vector<uint8_t>& bytes)
+	{
+		uint8_t size;
+		while (read8(size))
+		{
+			if (size == 0)
+			{
+				return true;
+			}
+			if (_data.size() - _offset < size)
+			{
+				return false;
+			}
+			bytes.insert(bytes.end(), _data.begin() + _offset, _data.begin() + _offset + size);
+			_offset += size;
+		}
+		return false;
+	}
+
+	bool isAtEnd() const { return _offset == _data.size(); }
+
+private:
+	const std::vector<uint8_t>& _data;
+	size_t _offset;
+};
+
+// Decodes a code stream exactly as large as pixelCount, the end of information code must come right after the last
+// pixel and only the padding of its byte may follow
+static bool decodeLzw(const std::vector<uint8_t>& bytes, uint8_t minCodeSize, size_t pixelCount, std::vector<uint8_t>& pixels, std::string& error)
+{
+	if (minCodeSize < 2 || minCodeSize > 8)
+	{
+		error = "invalid minimum code size";
+		return false;
+	}
+	const uint32_t clearCode = 1u << minCodeSize;
+	const uint32_t endCode = clearCode + 1;
+	std::vector<uint16_t> prefixes(MAX_CODE_COUNT);
+	std::vector<uint8_t> suffixes(MAX_CODE_COUNT);
+	std::vector<uint8_t> firsts(MAX_CODE_COUNT);
+	std::vector<uint16_t> lengths(MAX_CODE_COUNT);
+	for (uint32_t code = 0; code < clearCode; code++)
+	{
+		suffixes[code] = firsts[code] = static_cast<uint8_t>(code);
+		lengths[code] = 1;
+	}
+
+	uint32_t codeSize = minCodeSize + 1;
+	uint32_t nextCode = endCode + 1;
+	uint32_t previous = MAX_CODE_COUNT;
+	size_t bitOffset = 0;
+	pixels.clear();
+	while (true)
+	{
+		if (bitOffset + codeSize > bytes.size() * 8)
+		{
+			error = "no end of information code";
+			return false;
+		}
+		uint32_t code = 0;
+		for (uint32_t bit = 0; bit < codeSize; bit++, bitOffset++)
+		{
+			code |= ((bytes[bitOffset / 8] >> (bitOffset % 8)) & 1u) << bit;
+		}
+
+		if (code == clearCode)
+		{
+			codeSize = minCodeSize + 1;
+			nextCode = endCode + 1;
+			previous = MAX_CODE_COUNT;
+			continue;
+		}
+		if (code == endCode)
+		{
+			break;
+		}
+		if (code > nextCode || (code == nextCode && previous == MAX_CODE_COUNT))
+		{
+			error = "code " + std::to_string(code) + " past the table of " + std::to_string(nextCode) + " codes";
+			return false;
+		}
+
+		if (previous != MAX_CODE_COUNT && nextCode < MAX_CODE_COUNT)
+		{
+			// The entry of the previous string plus the first color of this one, which is itself when it is that entry
+			prefixes[nextCode] = static_cast<uint16_t>(previous);
+			suffixes[nextCode] = code == nextCode ? firsts[previous] : firsts[code];
+			firsts[nextCode] = firsts[previous];
+			lengths[nextCode] = static_cast<uint16_t>(lengths[previous] + 1);
+			nextCode++;
+			if (nextCode == (1u << codeSize) && codeSize < 12)
+			{
+				codeSize++;
+			}
+		}
+
+		size_t end = pixels.size() + lengths[code];
+		if (end > pixelCount)
+		{
+			error = "more pixels than the image";
+			return false;
+		}
+		pixels.resize(end);
+		for (uint32_t entry = code; entry >= clearCode; entry = prefixes[entry])
+		{
+			pixels[--end] = suffixes[entry];
+		}
+		pixels[--end] = static_cast<uint8_t>(code >= clearCode ? firsts[code] : code);
+		previous = code;
+	}
+
+	if (pixels.size() != pixelCount)
+	{
+		error = std::to_string(pixels.size()) + " pixels instead of " + std::to_string(pixelCount);
+		return false;
+	}
+	if ((bitOffset + 7) / 8 != bytes.size())
+	{
+		error = "data after the end of information code";
+		return false;
+	}
+	return true;
+}
+
+// Empty when the file shows the screens of the case one after the other, otherwise what went wrong
+static std::string checkGif(const GifCase& gifCase, const std::vector<uint8_t>& data)
+{
+	GifReader reader(data);
+	const size_t width = 128 * gifCase.scale;
+	const size_t height = 64 * gifCase.scale;
+	uint16_t screenWidth;
+	uint16_t screenHeight;
+	uint8_t flags;
+	if (!reader.skip(6) || !reader.read16(screenWidth) || !reader.read16(screenHeight) || !reader.read8(flags) || !reader.skip(2))
+	{
+		return "truncated header";
+	}
+	if (screenWidth != width || screenHeight != height || (flags & 0x80) == 0)
+	{
+		return "unexpected logical screen";
+	}
+	reader.skip(3u << ((flags & 0x07) + 1));
+
+	std::vector<uint8_t> canvas(width * height, 0);
+	std::vector<uint8_t> bytes;
+	std::vector<uint8_t> pixels;
+	size_t imageCount = 0;
+	uint16_t delay = 0;
+	uint8_t introducer;
+	while (reader.read8(introducer) && introducer != 0x3B)
+	{
+		if (introducer == 0x21)
+		{
+			uint8_t label;
+			bytes.clear();
+			if (!reader.read8(label) || !reader.readSubBlocks(bytes))
+			{
+				return "truncated extension";
+			}
+			if (label == 0xF9 && bytes.size() == 4)
+			{
+				delay = static_cast<uint16_t>(bytes[1] | (bytes[2] << 8));
+			}
+			continue;
+		}
+		if (introducer != 0x2C)
+		{
+			return "unknown block " + std::to_string(introducer);
+		}
+
+		uint16_t left;
+		uint16_t top;
+		uint16_t imageWidth;
+		uint16_t imageHeight;
+		uint8_t imageFlags;
+		uint8_t minCodeSize;
+		bytes.clear();
+		if (!reader.read16(left) || !reader.read16(top) || !reader.read16(imageWidth) || !reader.read16(imageHeight)
+			|| !reader.read8(imageFlags) || !reader.read8(minCodeSize) || !reader.readSubBlocks(bytes))
+		{
+			return "truncated image " + std::to_string(imageCount);
+		}
+		if (imageFlags != 0 || left + imageWidth > width || top + imageHeight > height)
+		{
+			return "unexpected descriptor of image " + std::to_string(imageCount);
+		}
+		std::string error;
+		if (!decodeLzw(bytes, minCodeSize, static_cast<size_t>(imageWidth) * imageHeight, pixels, error))
+		{
+			return "image " + std::to_string(imageCount) + " of " + std::to_string(imageWidth) + "x" + std::to_string(imageHeight) + ": " + error;
+		}
+		for (size_t y = 0; y < imageHeight; y++)
+		{
+			std::copy(pixels.begin() + y * imageWidth, pixels.begin() + (y + 1) * imageWidth, canvas.begin() + (top + y) * width + left);
+		}
+
+		if (imageCount >= gifCase.screens.size())
+		{
+			return "more images than screens";
+		}
+		const Framebuffer& screen = gifCase.screens[imageCount];
+		for (size_t y = 0; y < height; y++)
+		{
+			for (size_t x = 0; x < width; x++)
+			{
+				if (canvas[y * width + x] != expectedColor(screen, gifCase.scale, x, y))
+				{
+					return "image " + std::to_string(imageCount) + " differs at " + std::to_string(x) + "," + std::to_string(y);
+				}
+			}
+		}
+		if (imageCount + 1 < gifCase.screens.size() && delay != SCREEN_DELAY)
+		{
+			return "image " + std::to_string(imageCount) + " lasts " + std::to_string(delay) + " hundredths";
+		}
+		imageCount++;
+	}
+
+	if (introducer != 0x3B || !reader.isAtEnd())
+	{
+		return "no trailer at the end of the file";
+	}
+	if (imageCount != gifCase.screens.size())
+	{
+		return std::to_string(imageCount) + " images for " + std::to_string(gifCase.screens.size()) + " screens";
+	}
+	return "";
+}
+
+static std::string runCase(const GifCase& gifCase, const std::string& path)
+{
+	VideoCapture capture;
+	capture.setWaitEnabled(true);
+	if (!capture.open(path, gifCase.scale))
+	{
+		return "cannot open the video";
+	}
+	for (const Framebuffer& screen : gifCase.screens)
+	{
+		for (size_t frame = 0; frame < FRAMES_PER_SCREEN; frame++)
+		{
+			capture.capture(screen);
+		}
+	}
+	if (!capture.close())
+	{
+		return "cannot close the video";
+	}
+
+	std::ifstream file(path, std::ios::binary);
+	std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	return checkGif(gifCase, data);
+}
+
+int main(int argc, char* argv[])
+{
+	GifConfig config = { 1, 200, 24, "chip8_gifcheck.gif" };
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--seeds" && hasValue)
+		{
+			config.seedCount = std::strtoul(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--seed" && hasValue)
+		{
+			config.firstSeed = std::strtoull(argv[++i], nullptr, 10);
+			config.seedCount = 1;
+		}
+		else if (arg == "--screens" && hasValue)
+		{
+			config.screens = std::max<size_t>(std::strtoul(argv[++i], nullptr, 10), 1);
+		}
+		else if (arg == "--output" && hasValue)
+		{
+			config.path = argv[++i];
+		}
+		else
+		{
+			printUsage();
+			return 1;
+		}
+	}
+
+	size_t failureCount = 0;
+	for (uint64_t seed = config.firstSeed; seed < config.firstSeed + config.seedCount; seed++)
+	{
+		GifCase gifCase = makeCase(seed, config.screens);
+		std::string error = runCase(gifCase, config.path);
+		if (!error.empty())
+		{
+			std::cout << "[FAIL] seed " << seed << " scale " << gifCase.scale << " " << static_cast<int>(gifCase.screens[0].width())
+				<< "x" << static_cast<int>(gifCase.screens[0].height()) << "x" << static_cast<int>(gifCase.screens[0].planeCount())
+				<< ": " << error << std::endl;
+			failureCount++;
+		}
+	}
+	std::remove(config.path.c_str());
+
+	std::cout << "[GIF] seeds: " << config.seedCount << " screens: " << config.screens << " failures: " << failureCount << std::endl;
+	return failureCount == 0 ? 0 : 1;
+}
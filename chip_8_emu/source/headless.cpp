@@ -0,0 +1,331 @@
+#include "Chip8.hpp"
+#include "Debugger.hpp"
+#include "GdbServer.hpp"
+#include "InputLog.hpp"
+#include "InputReplay.hpp"
+#include "Profiler.hpp"
+#include "SharedStateWriter.hpp"
+#include "SpectatorServer.hpp"
+#include "TraceRecorder.hpp"
+#include "VideoCapture.hpp"
+#include "WavAudioSink.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+
+static void printUsage()
+{
+	std::cout << "Usage: chip8_headless <rom> [frames] [--platform vip|schip|xochip] [--seed N] [--replay log] [--profile report.json|report.csv] [--wav audio.wav] [--gdb port] [--trace file.trace] [--capture video.gif] [--capture-scale N] [--spectate port] [--spectate-viewers N] [--shared-state name]" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	std::string romPath;
+	std::string replayPath;
+	std::string profilePath;
+	std::string wavPath;
+	std::string tracePath;
+	std::string capturePath;
+	std::string sharedStateName;
+	size_t captureScale = 4;
+	size_t frameCount = 600;
+	bool hasFrameCount = false;
+	uint64_t seed = 0;
+	uint16_t gdbPort = 0;
+	uint16_t spectatePort = 0;
+	size_t spectateViewerCount = 0;
+	Platform::Type platform = Platform::Type::CosmacVip;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--platform" && hasValue)
+		{
+			if (!Platform::fromString(argv[++i], platform))
+			{
+				printUsage();
+				return 1;
+			}
+		}
+		else if (arg == "--seed" && hasValue)
+		{
+			seed = std::strtoull(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--replay" && hasValue)
+		{
+			replayPath = argv[++i];
+		}
+		else if (arg == "--profile" && hasValue)
+		{
+			profilePath = argv[++i];
+		}
+		else if (arg == "--wav" && hasValue)
+		{
+			wavPath = argv[++i];
+		}
+		else if (arg == "--trace" && hasValue)
+		{
+			tracePath = argv[++i];
+		}
+		else if (arg == "--capture" && hasValue)
+		{
+			capturePath = argv[++i];
+		}
+		else if (arg == "--capture-scale" && hasValue)
+		{
+			captureScale = std::strtoul(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--spectate" && hasValue)
+		{
+			spectatePort = static_cast<uint16_t>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (arg == "--spectate-viewers" && hasValue)
+		{
+			spectateViewerCount = std::strtoul(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--shared-state" && hasValue)
+		{
+			sharedStateName = argv[++i];
+		}
+		else if (arg == "--gdb" && hasValue)
+		{
+			gdbPort = static_cast<uint16_t>(std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (arg.compare(0, 2, "--") == 0)
+		{
+			printUsage();
+			return 1;
+		}
+		else if (romPath.empty())
+		{
+			romPath = arg;
+		}
+		else
+		{
+			frameCount = std::strtoul(arg.c_str(), nullptr, 10);
+			hasFrameCount = true;
+		}
+	}
+
+	if (romPath.empty())
+	{
+		printUsage();
+		return 0;
+	}
+
+	// A replay runs with the configuration it was recorded with
+	InputLog log;
+	size_t cyclesPerFrame = 60;
+	Quirks quirks = Platform::quirks(platform);
+	if (!replayPath.empty())
+	{
+		if (!log.load(replayPath))
+		{
+			return 1;
+		}
+		seed = log.seed;
+		cyclesPerFrame = log.cyclesPerFrame;
+		quirks = log.quirks;
+		platform = log.platform;
+		frameCount = hasFrameCount ? frameCount : log.frameCount;
+	}
+
+	Chip8 emulator(cyclesPerFrame, quirks);
+	emulator.setPlatform(platform);
+	InputReplay replay(log);
+	if (!replayPath.empty())
+	{
+		emulator.setInputSource(&replay);
+	}
+
+	if (!emulator.loadRom(romPath))
+	{
+		std::cout << "[ERROR] An error occured while loading the rom '" << romPath << "'" << std::endl;
+		return 1;
+	}
+	emulator.initialize();
+	emulator.setSeed(seed);
+
+	// Sound follows the emulated time, 1/60 of a second per frame
+	WavAudioSink wav;
+	if (!wavPath.empty())
+	{
+		emulator.setAudioSink(&wav);
+	}
+
+	Profiler profiler;
+	if (!profilePath.empty())
+	{
+		emulator.setProfiler(&profiler, profilePath);
+		Profiler::installSignalHandler();
+	}
+
+	// Every instruction from the first one, compared to another run with chip8_tracediff
+	TraceRecorder trace;
+	if (!tracePath.empty())
+	{
+		if (!trace.open(tracePath, platform, quirks))
+		{
+			return 1;
+		}
+		emulator.setTraceRecorder(&trace);
+	}
+
+	// The animation follows the emulated time, 1/60 of a second per frame as the sound
+	VideoCapture capture;
+	if (!capturePath.empty())
+	{
+		if (!capture.open(capturePath, captureScale))
+		{
+			return 1;
+		}
+		// Nothing paces the frames here, every one of them is kept
+		capture.setWaitEnabled(true);
+		emulator.setVideoCapture(&capture);
+	}
+
+	// Frames run in real time for the viewers, once the ones awaited are connected
+	SpectatorServer spectator;
+	if (spectatePort != 0)
+	{
+		if (!spectator.listen(spectatePort))
+		{
+			return 1;
+		}
+		while (spectator.viewerCount() < spectateViewerCount)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		emulator.setSpectatorServer(&spectator);
+	}
+
+	// Other processes read the screen and the registers of every frame in place
+	SharedStateWriter sharedState;
+	if (!sharedStateName.empty())
+	{
+		if (!sharedState.open(sharedStateName))
+		{
+			return 1;
+		}
+		emulator.setSharedStateWriter(&sharedState);
+	}
+
+	// The rom waits for GDB to attach and runs until it detaches, with no frame limit unless one is given
+	Debugger debugger(emulator);
+	GdbServer gdb(emulator, debugger);
+	if (gdbPort != 0)
+	{
+#ifndef CHIP8_ENABLE_DEBUGGER
+		std::cout << "[ERROR] The debugger hooks are compiled out, configure with -DCHIP8_ENABLE_DEBUGGER=ON" << std::endl;
+		return 1;
+#endif
+		if (!gdb.listen(gdbPort))
+		{
+			return 1;
+		}
+		frameCount = hasFrameCount ? frameCount : SIZE_MAX;
+	}
+
+	// No renderer nor sleep, frames are chained as fast as the machine allows unless spectated
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	size_t frames = 0;
+	while (frames < frameCount)
+	{
+		if (spectatePort != 0)
+		{
+			std::this_thread::sleep_until(start + std::chrono::microseconds(frames * 1000000 / 60));
+		}
+		bool isRunning = emulator.runFrame();
+		// GDB is told why the execution stopped, in the middle of a frame or for good
+		if (!gdb.poll() || !isRunning)
+		{
+			break;
+		}
+		if (frameCount == SIZE_MAX && !gdb.isConnected())
+		{
+			// Without a frame count the rom ends with the session
+			break;
+		}
+		if (!emulator.isFrameSuspended())
+		{
+			frames++;
+		}
+		if (!profilePath.empty() && Profiler::takeReportRequest())
+		{
+			profiler.writeReport(profilePath);
+		}
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << std::dec << "[HEADLESS] frames: " << frames
+		<< " instructions: " << emulator.instructionCount()
+		<< " seconds: " << seconds
+		<< " frames/s: " << (seconds > 0.0 ? frames / seconds : 0.0)
+		<< " instructions/s: " << (seconds > 0.0 ? emulator.instructionCount() / seconds : 0.0)
+		<< " hash: " << std::hex << emulator.framebuffer().hash() << std::dec << std::endl;
+
+	if (!tracePath.empty())
+	{
+		emulator.setTraceRecorder(nullptr);
+		if (!trace.close())
+		{
+			return 1;
+		}
+		std::cout << "[TRACE] instructions: " << trace.instructionCount()
+			<< " bytes: " << trace.byteCount()
+			<< " bytes/instruction: " << (trace.instructionCount() > 0 ? static_cast<double>(trace.byteCount()) / trace.instructionCount() : 0.0)
+			<< " stalls: " << trace.stallCount() << std::endl;
+	}
+
+	if (!capturePath.empty())
+	{
+		emulator.setVideoCapture(nullptr);
+		if (!capture.close())
+		{
+			return 1;
+		}
+		std::cout << "[CAPTURE] frames: " << capture.frameCount() << " dropped: " << capture.droppedFrameCount() << std::endl;
+	}
+
+	if (!sharedStateName.empty())
+	{
+		emulator.setSharedStateWriter(nullptr);
+		sharedState.close();
+		std::cout << "[SHARED] frames: " << sharedState.frameCount() << std::endl;
+	}
+
+	if (spectatePort != 0)
+	{
+		emulator.setSpectatorServer(nullptr);
+		spectator.close();
+		std::cout << "[SPECTATE] viewers: " << spectator.maxViewerCount()
+			<< " frames: " << spectator.broadcastCount()
+			<< " keyframes: " << spectator.keyframeCount()
+			<< " deltas: " << spectator.deltaCount()
+			<< " skipped: " << spectator.skippedFrameCount()
+			<< " bytes: " << spectator.byteCount()
+			<< " busy ms: " << spectator.busySeconds() * 1000.0
+			<< " busy us/frame/viewer: " << (spectator.broadcastCount() > 0 && spectator.maxViewerCount() > 0
+				? spectator.busySeconds() * 1000000.0 / spectator.broadcastCount() / spectator.maxViewerCount() : 0.0) << std::endl;
+	}
+
+	if (!profilePath.empty())
+	{
+		profiler.addPhaseTime(Profiler::Phase::Cpu, std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds)));
+		if (!profiler.writeReport(profilePath))
+		{
+			return 1;
+		}
+	}
+
+	if (!wavPath.empty() && !wav.save(wavPath))
+	{
+		return 1;
+	}
+
+	return frames == frameCount || frameCount == SIZE_MAX ? 0 : 1;
+}
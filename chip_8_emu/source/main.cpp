@@ -1,23 +1,187 @@
+#include "Audio.hpp"
 #include "Chip8.hpp"
+#include "Display.hpp"
+#include "InputLog.hpp"
+#include "Keyboard.hpp"
+#include "Profiler.hpp"
+#include "SharedStateWriter.hpp"
+#include "SpectatorServer.hpp"
+#include "VideoCapture.hpp"
+#include <cstdlib>
 #include <iostream>
+#include <string>
 
 int main(int argc, char* argv[])
 {
 	if (argc < 2)
 	{
 		std::cout << "Provide the rom as first argument." << std::endl;
+		std::cout << "Usage: chip_8_emu <rom> [--platform vip|schip|xochip] [--seed N] [--keys 1234AZERQSDFWXCV] [--record log] [--turbo N] [--cpu-budget F] [--audio-buffer samples] [--profile report.json|report.csv] [--capture video.gif] [--capture-scale N] [--spectate port] [--shared-state name]" << std::endl;
 		return 0;
 	}
 
-	Chip8 emulator(60, true, true, true, true, true);
-	emulator.display().setPixelColorOff(sf::Color(35, 145, 157, 255));
-	emulator.display().setPixelColorOn(sf::Color(180, 252, 252, 255));
-	emulator.display().clear();
-	emulator.setAudioEnabled(false);
+	Platform::Type platform = Platform::Type::CosmacVip;
+	uint64_t seed = 0;
+	size_t fastForwardSpeed = 0;
+	double cpuBudget = 0.0;
+	size_t audioBufferSamples = 0;
+	std::string keyLayout = Keyboard::DEFAULT_LAYOUT;
+	std::string recordPath;
+	std::string profilePath;
+	std::string capturePath;
+	size_t captureScale = 4;
+	uint16_t spectatePort = 0;
+	std::string sharedStateName;
+	for (int i = 2; i + 1 < argc; i += 2)
+	{
+		std::string arg = argv[i];
+		if (arg == "--platform")
+		{
+			if (!Platform::fromString(argv[i + 1], platform))
+			{
+				std::cout << "[ERROR] Unknown platform '" << argv[i + 1] << "'" << std::endl;
+				return 1;
+			}
+		}
+		else if (arg == "--seed")
+		{
+			seed = std::strtoull(argv[i + 1], nullptr, 10);
+		}
+		else if (arg == "--keys")
+		{
+			keyLayout = argv[i + 1];
+		}
+		else if (arg == "--record")
+		{
+			recordPath = argv[i + 1];
+		}
+		else if (arg == "--profile")
+		{
+			profilePath = argv[i + 1];
+		}
+		else if (arg == "--capture")
+		{
+			capturePath = argv[i + 1];
+		}
+		else if (arg == "--capture-scale")
+		{
+			captureScale = std::strtoul(argv[i + 1], nullptr, 10);
+		}
+		else if (arg == "--spectate")
+		{
+			spectatePort = static_cast<uint16_t>(std::strtoul(argv[i + 1], nullptr, 10));
+		}
+		else if (arg == "--shared-state")
+		{
+			sharedStateName = argv[i + 1];
+		}
+		else if (arg == "--turbo")
+		{
+			fastForwardSpeed = std::strtoul(argv[i + 1], nullptr, 10);
+		}
+		else if (arg == "--cpu-budget")
+		{
+			cpuBudget = std::strtod(argv[i + 1], nullptr);
+		}
+		else if (arg == "--audio-buffer")
+		{
+			audioBufferSamples = std::strtoul(argv[i + 1], nullptr, 10);
+		}
+	}
+
+	Keyboard keyboard;
+	// Keys of the keypad from 0 to F
+	if (!keyboard.setBindings(keyLayout))
+	{
+		std::cout << "[ERROR] Key layout '" << keyLayout << "' is not 16 letters or digits" << std::endl;
+		return 1;
+	}
+
+	Display display(Chip8::SCREEN_WIDTH, Chip8::SCREEN_HEIGHT, 16, "CHIP 8");
+	// Colors of the pixel indexes, on screen and in the captured video
+	const sf::Color palette[] = { sf::Color(35, 145, 157, 255), sf::Color(180, 252, 252, 255), sf::Color(252, 180, 80, 255), sf::Color(255, 255, 255, 255) };
+	VideoCapture capture;
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		display.setPixelColor(i, palette[i]);
+		capture.setColor(i, palette[i].r, palette[i].g, palette[i].b);
+	}
+	display.setEventHandler([&keyboard](const sf::Event& event) { keyboard.handleEvent(event); });
+	// Sound is off unless a buffer size is given
+	Audio audio(44100, audioBufferSamples > 0 ? audioBufferSamples : 512);
+
+	const size_t cyclesPerFrame = 60;
+	const Quirks quirks = Platform::quirks(platform);
+	Chip8 emulator(cyclesPerFrame, quirks);
+	emulator.setPlatform(platform);
+	emulator.setRenderer(&display);
+	emulator.setAudioSink(&audio);
+	emulator.setInputSource(&keyboard);
+	emulator.setAudioEnabled(audioBufferSamples > 0);
+	emulator.setRewindEnabled(true);
+	emulator.setFastForwardSpeed(fastForwardSpeed);
+	if (cpuBudget > 0.0 && recordPath.empty())
+	{
+		// Never below a quarter of the nominal speed, a recording needs a fixed count to be replayed
+		emulator.setCpuBudget(cpuBudget, cyclesPerFrame / 4, cyclesPerFrame);
+	}
+
+	// Recording logs the keys of every frame so chip8_headless --replay can reproduce the session
+	InputLog log;
+	log.seed = seed;
+	log.cyclesPerFrame = cyclesPerFrame;
+	log.quirks = quirks;
+	log.platform = platform;
+	if (!recordPath.empty())
+	{
+		emulator.setInputLog(&log);
+		emulator.setRewindEnabled(false);
+	}
+
+	// Written on exit, or on SIGUSR1 while running
+	Profiler profiler;
+	if (!profilePath.empty())
+	{
+		emulator.setProfiler(&profiler, profilePath);
+		Profiler::installSignalHandler();
+	}
+
+	// Encoded on its own thread, the emulation only copies the frames that changed
+	if (!capturePath.empty())
+	{
+		if (!capture.open(capturePath, captureScale))
+		{
+			return 1;
+		}
+		emulator.setVideoCapture(&capture);
+	}
+
+	// Viewers on localhost follow the screen with chip8_spectate or a WebSocket page
+	SpectatorServer spectator;
+	if (spectatePort != 0)
+	{
+		if (!spectator.listen(spectatePort))
+		{
+			return 1;
+		}
+		emulator.setSpectatorServer(&spectator);
+	}
+
+	// Overlays and agents read the screen and the registers from their own process, with SharedStateReader
+	SharedStateWriter sharedState;
+	if (!sharedStateName.empty())
+	{
+		if (!sharedState.open(sharedStateName))
+		{
+			return 1;
+		}
+		emulator.setSharedStateWriter(&sharedState);
+	}
 
 	if (emulator.loadRom(argv[1]))
 	{
 		emulator.initialize();
+		emulator.setSeed(seed);
 		emulator.update();
 	}
 	else
@@ -25,5 +189,37 @@ int main(int argc, char* argv[])
 		std::cout << "[ERROR] An error occured while loading the rom '" << argv[1] << "'" << std::endl;
 	}
 
+	if (!capturePath.empty())
+	{
+		emulator.setVideoCapture(nullptr);
+		if (capture.close())
+		{
+			std::cout << "[CAPTURE] " << capture.frameCount() << " frames written to '" << capturePath << "'" << std::endl;
+		}
+	}
+
+	if (!sharedStateName.empty())
+	{
+		emulator.setSharedStateWriter(nullptr);
+		sharedState.close();
+	}
+
+	if (spectatePort != 0)
+	{
+		emulator.setSpectatorServer(nullptr);
+		spectator.close();
+		std::cout << "[SPECTATE] " << spectator.maxViewerCount() << " viewers at most, " << spectator.byteCount() << " bytes sent" << std::endl;
+	}
+
+	if (!profilePath.empty() && profiler.writeReport(profilePath))
+	{
+		std::cout << "[PROFILE] Report written to '" << profilePath << "'" << std::endl;
+	}
+
+	if (!recordPath.empty() && log.save(recordPath))
+	{
+		std::cout << "[RECORD] " << log.frameCount << " frames written to '" << recordPath << "'" << std::endl;
+	}
+
 	return 0;
 }
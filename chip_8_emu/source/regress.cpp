@@ -0,0 +1,416 @@
+#include "Chip8.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Runs every rom of a manifest under the listed quirk combinations on a thread pool
+// and compares the final framebuffer against a stored hash or a golden image
+//
+// Manifest lines: <rom> <frames> [<platform>:]<quirks|*> [<hash>|<image.pbm>]
+// Paths are relative to the manifest, '*' expands to every quirk combination and '#' starts a comment
+// The platform is vip when omitted
+
+struct RegressionRom
+{
+	std::string path;
+	std::vector<uint8_t> data;
+};
+
+struct RegressionJob
+{
+	size_t line;
+	size_t rom;
+	size_t frames;
+	Platform::Type platform;
+	Quirks quirks;
+	std::string expected;
+
+	bool isPassed;
+	uint64_t hash;
+	size_t differentPixels;
+	double seconds;
+	std::string error;
+	std::vector<bool> pixels;
+	uint8_t width;
+	uint8_t height;
+};
+
+struct RegressionConfig
+{
+	std::string manifestPath;
+	std::string dumpDirectory;
+	size_t threads;
+	size_t cyclesPerFrame;
+	bool update;
+};
+
+static std::string directoryOf(const std::string& path)
+{
+	size_t separator = path.find_last_of("/\\");
+	return separator == std::string::npos ? std::string() : path.substr(0, separator + 1);
+}
+
+static std::string fileNameOf(const std::string& path)
+{
+	size_t separator = path.find_last_of("/\\");
+	return separator == std::string::npos ? path : path.substr(separator + 1);
+}
+
+static bool endsWith(const std::string& text, const std::string& suffix)
+{
+	return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static bool readFile(const std::string& path, std::vector<uint8_t>& data)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+	{
+		return false;
+	}
+	data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return true;
+}
+
+// Plain PBM (P1): "P1 <width> <height>" followed by one 0/1 digit per pixel, 1 being set
+static bool readPbm(const std::string& path, size_t width, size_t height, std::vector<bool>& pixels)
+{
+	std::ifstream file(path);
+	std::string magic;
+	size_t imageWidth = 0;
+	size_t imageHeight = 0;
+	if (!(file >> magic >> imageWidth >> imageHeight) || magic != "P1" || imageWidth != width || imageHeight != height)
+	{
+		return false;
+	}
+
+	pixels.assign(width * height, false);
+	for (size_t i = 0; i < pixels.size(); i++)
+	{
+		char pixel;
+		if (!(file >> pixel))
+		{
+			return false;
+		}
+		pixels[i] = pixel == '1';
+	}
+	return true;
+}
+
+static bool writePbm(const std::string& path, size_t width, size_t height, const std::vector<bool>& pixels)
+{
+	std::ofstream file(path);
+	file << "P1" << std::endl << width << " " << height << std::endl;
+	for (size_t y = 0; y < height; y++)
+	{
+		for (size_t x = 0; x < width; x++)
+		{
+			file << (pixels[x + y * width] ? '1' : '0');
+		}
+		file << std::endl;
+	}
+	return file.good();
+}
+
+static bool parseManifest(const RegressionConfig& config, std::vector<std::string>& lines, std::vector<RegressionRom>& roms, std::vector<RegressionJob>& jobs)
+{
+	std::ifstream file(config.manifestPath);
+	if (!file.is_open())
+	{
+		std::cout << "[ERROR] Cannot open the manifest '" << config.manifestPath << "'" << std::endl;
+		return false;
+	}
+
+	std::string baseDirectory = directoryOf(config.manifestPath);
+	std::string text;
+	while (std::getline(file, text))
+	{
+		lines.push_back(text);
+		std::istringstream line(text);
+		std::string romPath;
+		std::string quirksText;
+		RegressionJob job = {};
+		job.line = lines.size() - 1;
+
+		if (!(line >> romPath) || romPath[0] == '#')
+		{
+			continue;
+		}
+		if (!(line >> job.frames >> quirksText))
+		{
+			std::cout << "[ERROR] Malformed manifest line " << lines.size() << ": " << text << std::endl;
+			return false;
+		}
+		line >> job.expected;
+
+		// Roms listed several times are loaded once and shared between the jobs
+		auto rom = std::find_if(roms.begin(), roms.end(), [&](const RegressionRom& r) { return r.path == romPath; });
+		if (rom == roms.end())
+		{
+			RegressionRom newRom;
+			newRom.path = romPath;
+			if (!readFile(baseDirectory + romPath, newRom.data))
+			{
+				std::cout << "[ERROR] An error occured while loading the rom '" << romPath << "'" << std::endl;
+				return false;
+			}
+			roms.push_back(newRom);
+			rom = roms.end() - 1;
+		}
+		job.rom = rom - roms.begin();
+
+		size_t platformSeparator = quirksText.find(':');
+		if (platformSeparator != std::string::npos)
+		{
+			if (!Platform::fromString(quirksText.substr(0, platformSeparator), job.platform))
+			{
+				std::cout << "[ERROR] Invalid platform '" << quirksText.substr(0, platformSeparator) << "' on manifest line " << lines.size() << std::endl;
+				return false;
+			}
+			quirksText = quirksText.substr(platformSeparator + 1);
+		}
+
+		if (quirksText == "*")
+		{
+			for (uint8_t mask = 0; mask < (1 << Quirks::QUIRK_COUNT); mask++)
+			{
+				job.quirks = Quirks::fromMask(mask);
+				jobs.push_back(job);
+			}
+		}
+		else if (Quirks::fromString(quirksText, job.quirks))
+		{
+			jobs.push_back(job);
+		}
+		else
+		{
+			std::cout << "[ERROR] Invalid quirks '" << quirksText << "' on manifest line " << lines.size() << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+// Quirks prefixed by the platform unless it is the default one, as written in the manifest
+static std::string configurationOf(const RegressionJob& job, char separator)
+{
+	std::string quirks = job.quirks.toString();
+	return job.platform == Platform::Type::CosmacVip ? quirks : Platform::name(job.platform) + std::string(1, separator) + quirks;
+}
+
+static void runJob(const RegressionConfig& config, const std::vector<RegressionRom>& roms, RegressionJob& job)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	const RegressionRom& rom = roms[job.rom];
+
+	Chip8 emulator(config.cyclesPerFrame, job.quirks);
+	emulator.setPlatform(job.platform);
+	if (!emulator.loadRom(rom.data.data(), rom.data.size()))
+	{
+		job.error = "rom does not fit in memory";
+		return;
+	}
+	emulator.initialize();
+
+	size_t frames = 0;
+	while (frames < job.frames && emulator.runFrame())
+	{
+		frames++;
+	}
+
+	const Framebuffer& framebuffer = emulator.framebuffer();
+	job.hash = framebuffer.hash();
+	job.width = framebuffer.width();
+	job.height = framebuffer.height();
+	job.pixels.resize(job.width * job.height);
+	for (uint8_t y = 0; y < job.height; y++)
+	{
+		for (uint8_t x = 0; x < job.width; x++)
+		{
+			job.pixels[x + y * job.width] = framebuffer.isPixelOn(x, y);
+		}
+	}
+
+	if (frames != job.frames)
+	{
+		job.error = "execution stopped at frame " + std::to_string(frames);
+	}
+	else if (endsWith(job.expected, ".pbm"))
+	{
+		std::vector<bool> golden;
+		if (!readPbm(directoryOf(config.manifestPath) + job.expected, job.width, job.height, golden))
+		{
+			job.error = "cannot read golden image " + job.expected;
+		}
+		else
+		{
+			for (size_t i = 0; i < golden.size(); i++)
+			{
+				job.differentPixels += golden[i] != job.pixels[i];
+			}
+			job.isPassed = job.differentPixels == 0;
+		}
+	}
+	else if (!job.expected.empty())
+	{
+		job.isPassed = std::strtoull(job.expected.c_str(), nullptr, 16) == job.hash;
+	}
+
+	job.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static std::string hashToString(uint64_t hash)
+{
+	std::ostringstream text;
+	text.width(16);
+	text.fill('0');
+	text << std::hex << hash;
+	return text.str();
+}
+
+static bool writeManifest(const RegressionConfig& config, const std::vector<std::string>& lines, const std::vector<RegressionRom>& roms, const std::vector<RegressionJob>& jobs)
+{
+	std::ofstream file(config.manifestPath);
+	size_t job = 0;
+	for (size_t i = 0; i < lines.size(); i++)
+	{
+		if (job >= jobs.size() || jobs[job].line != i)
+		{
+			file << lines[i] << std::endl;
+			continue;
+		}
+
+		// Expanded combinations get a line each so their references can differ
+		for (; job < jobs.size() && jobs[job].line == i; job++)
+		{
+			const RegressionJob& j = jobs[job];
+			std::string expected = endsWith(j.expected, ".pbm") ? j.expected : hashToString(j.hash);
+			file << roms[j.rom].path << " " << j.frames << " " << configurationOf(j, ':') << " " << expected << std::endl;
+		}
+	}
+	return file.good();
+}
+
+static void printUsage()
+{
+	std::cout << "Usage: chip8_regress <manifest> [--threads N] [--cycles N] [--update] [--dump-dir directory]" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	RegressionConfig config = { "", "", std::max(1u, std::thread::hardware_concurrency()), 60, false };
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--threads" && hasValue)
+		{
+			config.threads = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (arg == "--cycles" && hasValue)
+		{
+			config.cyclesPerFrame = std::strtoul(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--dump-dir" && hasValue)
+		{
+			config.dumpDirectory = argv[++i];
+		}
+		else if (arg == "--update")
+		{
+			config.update = true;
+		}
+		else if (arg.compare(0, 2, "--") != 0 && config.manifestPath.empty())
+		{
+			config.manifestPath = arg;
+		}
+		else
+		{
+			printUsage();
+			return 1;
+		}
+	}
+
+	if (config.manifestPath.empty())
+	{
+		printUsage();
+		return 1;
+	}
+
+	std::vector<std::string> lines;
+	std::vector<RegressionRom> roms;
+	std::vector<RegressionJob> jobs;
+	if (!parseManifest(config, lines, roms, jobs))
+	{
+		return 1;
+	}
+
+	// Jobs are independent emulator instances, workers just pull the next one
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::atomic<size_t> nextJob(0);
+	std::vector<std::thread> workers;
+	for (size_t i = 0; i < std::min(config.threads, jobs.size()); i++)
+	{
+		workers.emplace_back([&]() {
+			for (size_t job = nextJob++; job < jobs.size(); job = nextJob++)
+			{
+				runJob(config, roms, jobs[job]);
+			}
+		});
+	}
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+	double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	size_t passed = 0;
+	double jobSeconds = 0.0;
+	for (const RegressionJob& job : jobs)
+	{
+		const std::string& romPath = roms[job.rom].path;
+		jobSeconds += job.seconds;
+		passed += job.isPassed;
+
+		std::cout << (job.isPassed ? "[PASS] " : job.expected.empty() ? "[NEW]  " : "[FAIL] ")
+			<< romPath << " " << configurationOf(job, ':') << " " << job.frames << " frames "
+			<< hashToString(job.hash) << " " << job.seconds << "s";
+		if (!job.error.empty())
+		{
+			std::cout << " (" << job.error << ")";
+		}
+		else if (job.differentPixels > 0)
+		{
+			std::cout << " (" << job.differentPixels << " pixels differ from " << job.expected << ")";
+		}
+		std::cout << std::endl;
+
+		if (!config.dumpDirectory.empty())
+		{
+			writePbm(config.dumpDirectory + "/" + fileNameOf(romPath) + "-" + configurationOf(job, '-') + ".pbm", job.width, job.height, job.pixels);
+		}
+	}
+
+	std::cout << "[SUMMARY] " << passed << "/" << jobs.size() << " passed, "
+		<< config.threads << " threads, wall " << wallSeconds << "s, jobs " << jobSeconds << "s" << std::endl;
+
+	if (config.update)
+	{
+		if (!writeManifest(config, lines, roms, jobs))
+		{
+			std::cout << "[ERROR] Cannot update the manifest '" << config.manifestPath << "'" << std::endl;
+			return 1;
+		}
+		std::cout << "[UPDATE] References written to '" << config.manifestPath << "'" << std::endl;
+		return 0;
+	}
+
+	return passed == jobs.size() ? 0 : 1;
+}
@@ -0,0 +1,163 @@
+#include "Chip8.hpp"
+#include "SharedState.hpp"
+#include "SharedStateWriter.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Round trip through the shared memory segment: this process publishes a frame and spins until a reader, started as a
+// second process of the same executable, has read it in place and acknowledged it
+
+static void printUsage()
+{
+	std::cout << "Usage: chip8_shmbench [--frames N] [--name name]" << std::endl;
+}
+
+// Reader process: reads every frame in place, touching every row, and acknowledges it
+static int runReader(const std::string& name)
+{
+	SharedStateReader reader;
+	if (!reader.open(name))
+	{
+		std::cout << "[ERROR] Cannot open the shared memory '" << name << "'" << std::endl;
+		return 1;
+	}
+
+	uint64_t count = 0;
+	uint64_t readCount = 0;
+	uint64_t visitCount = 0;
+	uint64_t checksum = 0;
+	while (reader.waitFrame(count, std::chrono::seconds(5)))
+	{
+		uint64_t frame = 0;
+		uint64_t sum = 0;
+		reader.read([&](const SharedState::Frame& shared)
+		{
+			visitCount++;
+			frame = shared.frame;
+			sum = shared.pc;
+			for (size_t i = 0; i < shared.wordsPerRow() * shared.height * shared.planeCount; i++)
+			{
+				sum += shared.rows[i];
+			}
+		});
+		checksum += sum;
+		readCount++;
+		count = frame;
+		reader.acknowledge(frame);
+	}
+	std::cout << "[SHMBENCH] reader frames: " << readCount << " reads run again: " << visitCount - readCount
+		<< " checksum: " << std::hex << checksum << std::dec << std::endl;
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	size_t frameCount = 100000;
+	std::string name = "chip8_shmbench";
+	std::string readerName;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--frames" && hasValue)
+		{
+			frameCount = std::max<size_t>(std::strtoul(argv[++i], nullptr, 10), 1);
+		}
+		else if (arg == "--name" && hasValue)
+		{
+			name = argv[++i];
+		}
+		else if (arg == "--reader" && hasValue)
+		{
+			readerName = argv[++i];
+		}
+		else
+		{
+			printUsage();
+			return 1;
+		}
+	}
+
+	if (!readerName.empty())
+	{
+		return runReader(readerName);
+	}
+
+	// Random 8x5 sprites on the 128x64 screen with two planes, the largest frame there is
+	const uint8_t ROM[] = {
+		0x00, 0xFF, 0xF3, 0x01, 0xC0, 0x7F, 0xC1, 0x3F, 0xA2, 0x0E, 0xD0, 0x15, 0x12, 0x04,
+		0xF0, 0x90, 0x90, 0x90, 0xF0
+	};
+	Chip8 emulator(60, Platform::quirks(Platform::Type::XoChip));
+	emulator.setPlatform(Platform::Type::XoChip);
+	if (!emulator.loadRom(ROM, sizeof(ROM)))
+	{
+		return 1;
+	}
+	emulator.initialize();
+
+	SharedStateWriter writer;
+	if (!writer.open(name))
+	{
+		return 1;
+	}
+	std::string command = std::string("\"") + argv[0] + "\" --reader " + name;
+	std::thread readerProcess([&command]() { std::system(command.c_str()); });
+
+	std::vector<double> roundTrips;
+	roundTrips.reserve(frameCount);
+	double publishSeconds = 0.0;
+	bool isReaderStarted = false;
+	for (size_t i = 0; i < frameCount; i++)
+	{
+		emulator.runFrame();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		writer.publish(emulator.framebuffer(), emulator.cpu());
+		std::chrono::steady_clock::time_point published = std::chrono::steady_clock::now();
+
+		// The first frame waits for the reader process to start
+		std::chrono::steady_clock::time_point deadline = published + std::chrono::seconds(isReaderStarted ? 1 : 10);
+		uint32_t spin = 0;
+		while (writer.acknowledgedFrame() != writer.frameCount())
+		{
+			if (++spin >= SharedStateReader::SPIN_COUNT)
+			{
+				std::this_thread::yield();
+			}
+			if ((spin & 0xFF) == 0 && std::chrono::steady_clock::now() >= deadline)
+			{
+				std::cout << "[ERROR] The reader did not acknowledge the frame " << writer.frameCount() << std::endl;
+				writer.close();
+				readerProcess.join();
+				return 1;
+			}
+		}
+		std::chrono::steady_clock::time_point acknowledged = std::chrono::steady_clock::now();
+
+		if (isReaderStarted)
+		{
+			publishSeconds += std::chrono::duration<double>(published - start).count();
+			roundTrips.push_back(std::chrono::duration<double, std::nano>(acknowledged - start).count());
+		}
+		isReaderStarted = true;
+	}
+	writer.close();
+	readerProcess.join();
+
+	std::sort(roundTrips.begin(), roundTrips.end());
+	auto percentile = [&roundTrips](double p) { return roundTrips.empty() ? 0.0 : roundTrips[static_cast<size_t>(p * (roundTrips.size() - 1))]; };
+	std::cout << "[SHMBENCH] frames: " << roundTrips.size()
+		<< " publish ns: " << (roundTrips.empty() ? 0.0 : publishSeconds * 1e9 / roundTrips.size())
+		<< " round trip ns min: " << percentile(0.0)
+		<< " median: " << percentile(0.5)
+		<< " p99: " << percentile(0.99)
+		<< " max: " << percentile(1.0) << std::endl;
+	return 0;
+}
@@ -0,0 +1,356 @@
+#include "Framebuffer.hpp"
+#include "Socket.hpp"
+#include "SpectatorServer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Reference viewer of chip8_headless --spectate and the main window's --spectate, and its load test:
+// every viewer rebuilds the screen from the messages on its own connection, all of them polled from one thread
+
+// Key of the example of RFC 6455 and the answer it expects
+static const char WEBSOCKET_KEY[] = "dGhlIHNhbXBsZSBub25jZQ==";
+static const char WEBSOCKET_ACCEPT[] = "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=";
+
+struct Viewer
+{
+	intptr_t socket;
+	bool isWebSocket;
+	bool isUpgraded;
+	std::vector<uint8_t> input;
+	Framebuffer framebuffer;
+	bool hasKeyframe;
+	uint32_t frame;
+	uint64_t byteCount;
+	uint64_t messageCount;
+	uint64_t keyframeCount;
+};
+
+static void printUsage()
+{
+	std::cout << "Usage: chip8_spectate <port> [--viewers N] [--seconds S] [--websocket]" << std::endl;
+	std::cout << "Runs until the server closes or for S seconds, then prints what the viewers received" << std::endl;
+}
+
+// Inverse of the PackBits of SpectatorServer, false if the data ends before size bytes
+static bool unpackBits(const uint8_t*& data, const uint8_t* end, uint8_t* bytes, size_t size)
+{
+	size_t count = 0;
+	while (count < size)
+	{
+		if (data >= end)
+		{
+			return false;
+		}
+		uint8_t header = *data++;
+		if (header < 128)
+		{
+			size_t length = header + 1u;
+			if (count + length > size || data + length > end)
+			{
+				return false;
+			}
+			std::copy(data, data + length, bytes + count);
+			data += length;
+			count += length;
+		}
+		else if (header > 128)
+		{
+			size_t length = 257u - header;
+			if (count + length > size || data >= end)
+			{
+				return false;
+			}
+			std::fill(bytes + count, bytes + count + length, *data++);
+			count += length;
+		}
+	}
+	return true;
+}
+
+static bool decodeMessage(Viewer& viewer, const uint8_t* data, size_t size)
+{
+	const size_t HEADER_SIZE = 9;
+	if (size < HEADER_SIZE)
+	{
+		return false;
+	}
+	uint8_t type = data[0];
+	uint32_t frame = data[1] | (data[2] << 8) | (data[3] << 16) | (static_cast<uint32_t>(data[4]) << 24);
+	uint8_t width = data[5];
+	uint8_t height = data[6];
+	uint8_t planeCount = data[7];
+	uint8_t rowCount = data[8];
+
+	if (type == SpectatorServer::KEYFRAME)
+	{
+		if (width != viewer.framebuffer.width() || height != viewer.framebuffer.height() || planeCount != viewer.framebuffer.planeCount())
+		{
+			viewer.framebuffer.resize(width, height, planeCount);
+		}
+		viewer.hasKeyframe = true;
+		viewer.keyframeCount++;
+	}
+	else if (type != SpectatorServer::DELTA || !viewer.hasKeyframe || frame <= viewer.frame
+		|| width != viewer.framebuffer.width() || height != viewer.framebuffer.height() || planeCount != viewer.framebuffer.planeCount())
+	{
+		// A delta only applies on the frame it follows
+		return false;
+	}
+	viewer.frame = frame;
+	viewer.messageCount++;
+
+	const uint8_t* row = data + HEADER_SIZE;
+	const uint8_t* end = data + size;
+	uint8_t bytes[256 / 8];
+	size_t rowSize = (width + 7) / 8;
+	for (uint8_t i = 0; i < rowCount; i++)
+	{
+		if (end - row < 2 || row[0] >= planeCount || row[1] >= height)
+		{
+			return false;
+		}
+		uint8_t plane = row[0];
+		uint8_t y = row[1];
+		row += 2;
+		if (!unpackBits(row, end, bytes, rowSize))
+		{
+			return false;
+		}
+		for (uint8_t x = 0; x < width; x++)
+		{
+			viewer.framebuffer.putPixel(x, y, ((bytes[x / 8] >> (7 - x % 8)) & 1) != 0, plane);
+		}
+	}
+	return row == end;
+}
+
+// Decodes the complete messages received, false on anything the protocol does not allow
+static bool decodeInput(Viewer& viewer)
+{
+	std::vector<uint8_t>& input = viewer.input;
+	size_t offset = 0;
+	if (viewer.isWebSocket && !viewer.isUpgraded)
+	{
+		std::string response(input.begin(), input.end());
+		size_t end = response.find("\r\n\r\n");
+		if (end == std::string::npos)
+		{
+			return input.size() < 8192;
+		}
+		if (response.compare(0, 12, "HTTP/1.1 101") != 0 || response.find(WEBSOCKET_ACCEPT) > end)
+		{
+			return false;
+		}
+		viewer.isUpgraded = true;
+		offset = end + 4;
+	}
+
+	while (true)
+	{
+		const uint8_t* data = input.data() + offset;
+		size_t available = input.size() - offset;
+		size_t headerSize;
+		uint64_t size;
+		if (viewer.isWebSocket)
+		{
+			// Final binary messages, never masked from a server
+			if (available < 2)
+			{
+				break;
+			}
+			if (data[0] != 0x82 || (data[1] & 0x80) != 0)
+			{
+				return false;
+			}
+			headerSize = 2;
+			size = data[1];
+			if (size == 126)
+			{
+				headerSize = 4;
+				size = available < headerSize ? 0 : (data[2] << 8) | data[3];
+			}
+			else if (size == 127)
+			{
+				headerSize = 10;
+				size = 0;
+				for (size_t i = 2; i < headerSize && i < available; i++)
+				{
+					size = (size << 8) | data[i];
+				}
+			}
+		}
+		else
+		{
+			headerSize = 4;
+			size = available < headerSize ? 0 : data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+		}
+
+		if (size > SpectatorServer::MAX_MESSAGE_SIZE)
+		{
+			return false;
+		}
+		if (available < headerSize || available - headerSize < size)
+		{
+			break;
+		}
+		if (!decodeMessage(viewer, data + headerSize, static_cast<size_t>(size)))
+		{
+			return false;
+		}
+		offset += headerSize + static_cast<size_t>(size);
+	}
+	input.erase(input.begin(), input.begin() + offset);
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	uint16_t port = 0;
+	size_t viewerCount = 1;
+	double maxSeconds = 0.0;
+	bool isWebSocket = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--viewers" && hasValue)
+		{
+			viewerCount = std::max<size_t>(std::strtoul(argv[++i], nullptr, 10), 1);
+		}
+		else if (arg == "--seconds" && hasValue)
+		{
+			maxSeconds = std::strtod(argv[++i], nullptr);
+		}
+		else if (arg == "--websocket")
+		{
+			isWebSocket = true;
+		}
+		else if (arg.compare(0, 2, "--") != 0 && port == 0)
+		{
+			port = static_cast<uint16_t>(std::strtoul(arg.c_str(), nullptr, 10));
+		}
+		else
+		{
+			printUsage();
+			return 1;
+		}
+	}
+
+	if (port == 0)
+	{
+		printUsage();
+		return 1;
+	}
+	if (!Socket::startup())
+	{
+		std::cout << "[ERROR] Cannot start the sockets" << std::endl;
+		return 1;
+	}
+
+	std::string hello(reinterpret_cast<const char*>(SpectatorServer::MAGIC), sizeof(SpectatorServer::MAGIC));
+	if (isWebSocket)
+	{
+		hello = std::string("GET / HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Key: ")
+			+ WEBSOCKET_KEY + "\r\nSec-WebSocket-Version: 13\r\n\r\n";
+	}
+	std::vector<Viewer> viewers;
+	viewers.reserve(viewerCount);
+	for (size_t i = 0; i < viewerCount; i++)
+	{
+		intptr_t socket = Socket::connect(port);
+		if (socket == Socket::NO_SOCKET || Socket::send(socket, hello.data(), hello.size()) != static_cast<int>(hello.size()))
+		{
+			std::cout << "[ERROR] Cannot connect the viewer " << i << " to localhost:" << port << std::endl;
+			return 1;
+		}
+		Socket::setNonBlocking(socket);
+		viewers.push_back({ socket, isWebSocket, false, std::vector<uint8_t>(), Framebuffer(64, 32), false, 0, 0, 0, 0 });
+	}
+
+	// Received until every connection is closed by the server
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::clock_t cpuStart = std::clock();
+	std::vector<Socket::PollEntry> entries;
+	std::vector<size_t> indexes;
+	std::vector<uint8_t> buffer(64 * 1024);
+	size_t openCount = viewers.size();
+	size_t errorCount = 0;
+	double seconds = 0.0;
+	while (openCount > 0 && (maxSeconds <= 0.0 || seconds < maxSeconds))
+	{
+		entries.clear();
+		indexes.clear();
+		for (size_t i = 0; i < viewers.size(); i++)
+		{
+			if (viewers[i].socket != Socket::NO_SOCKET)
+			{
+				entries.push_back({ viewers[i].socket, false, false, false });
+				indexes.push_back(i);
+			}
+		}
+		Socket::poll(entries, 100);
+
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			if (!entries[i].isReadable)
+			{
+				continue;
+			}
+			Viewer& viewer = viewers[indexes[i]];
+			int received;
+			while ((received = Socket::receive(viewer.socket, buffer.data(), buffer.size())) > 0)
+			{
+				viewer.input.insert(viewer.input.end(), buffer.begin(), buffer.begin() + received);
+				viewer.byteCount += received;
+			}
+			bool isValid = decodeInput(viewer);
+			if (!isValid)
+			{
+				std::cout << "[ERROR] The viewer " << indexes[i] << " received an invalid message" << std::endl;
+				errorCount++;
+			}
+			if (received < 0 || !isValid)
+			{
+				Socket::close(viewer.socket);
+				viewer.socket = Socket::NO_SOCKET;
+				openCount--;
+			}
+		}
+		seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	double cpuSeconds = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+
+	uint64_t byteCount = 0;
+	uint64_t messageCount = 0;
+	uint64_t keyframeCount = 0;
+	for (Viewer& viewer : viewers)
+	{
+		byteCount += viewer.byteCount;
+		messageCount += viewer.messageCount;
+		keyframeCount += viewer.keyframeCount;
+		if (viewer.socket != Socket::NO_SOCKET)
+		{
+			Socket::close(viewer.socket);
+		}
+	}
+
+	double viewerSeconds = viewers.size() * std::max(seconds, 1e-9);
+	std::cout << "[SPECTATE] viewers: " << viewers.size()
+		<< " seconds: " << seconds
+		<< " errors: " << errorCount << std::endl;
+	std::cout << "[SPECTATE] per viewer: messages: " << messageCount / viewers.size()
+		<< " keyframes: " << keyframeCount / viewers.size()
+		<< " bytes: " << byteCount / viewers.size()
+		<< " bytes/s: " << byteCount / viewerSeconds
+		<< " client cpu us/s: " << cpuSeconds * 1000000.0 / viewerSeconds << std::endl;
+	std::cout << "[SPECTATE] viewer 0 frame: " << viewers[0].frame
+		<< " hash: " << std::hex << viewers[0].framebuffer.hash() << std::dec << std::endl;
+	return errorCount == 0 ? 0 : 1;
+}
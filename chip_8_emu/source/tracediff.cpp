@@ -0,0 +1,210 @@
+#include "RomAnalysis.hpp"
+#include "TraceReader.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Finds the first instruction where two traces of chip8_headless --trace differ
+// Both traces are streamed side by side, only the records of the context are kept in memory
+
+static void printUsage()
+{
+	std::cout << "Usage: chip8_tracediff <a.trace> <b.trace> [--context N]" << std::endl;
+	std::cout << "Exits with 0 when the traces match, 1 when they differ and 2 on an error" << std::endl;
+}
+
+static std::string hexToString(uint32_t value, int width)
+{
+	std::ostringstream stream;
+	stream << std::hex << std::uppercase << std::setw(width) << std::setfill('0') << value;
+	return stream.str();
+}
+
+// One line per instruction: index, frame, address, opCode, mnemonic then what it changed
+static std::string recordToString(const TraceReader::Record& record, Platform::Type platform)
+{
+	std::string mnemonic;
+	if (!RomAnalysis::disassemble(record.opCode, platform, mnemonic))
+	{
+		mnemonic = "???";
+	}
+
+	std::ostringstream changes;
+	for (size_t i = 0; i < CPU::MAX_REGISTER; i++)
+	{
+		if ((record.changedRegisters & (1u << i)) != 0)
+		{
+			changes << " V" << hexToString(static_cast<uint32_t>(i), 1) << "=" << hexToString(record.registers[i], 2);
+		}
+	}
+	if (record.isIndexChanged)
+	{
+		changes << " I=" << hexToString(record.I, 4);
+	}
+	for (const TraceRecorder::Write& write : record.writes)
+	{
+		changes << " [" << hexToString(write.addr, 4) << "]=" << hexToString(write.value, 2);
+	}
+
+	std::ostringstream stream;
+	stream << "#" << record.index << " frame " << record.frame << "  " << hexToString(record.pc, 4) << "  " << hexToString(record.opCode, 4) << "  ";
+	if (changes.tellp() > 0)
+	{
+		stream << std::left << std::setw(16) << mnemonic << changes.str();
+	}
+	else
+	{
+		stream << mnemonic;
+	}
+	return stream.str();
+}
+
+static bool isSameWrites(const TraceReader::Record& a, const TraceReader::Record& b)
+{
+	bool isSame = a.writes.size() == b.writes.size();
+	for (size_t i = 0; isSame && i < a.writes.size(); i++)
+	{
+		isSame = a.writes[i].addr == b.writes[i].addr && a.writes[i].value == b.writes[i].value;
+	}
+	return isSame;
+}
+
+static bool isSameRecord(const TraceReader::Record& a, const TraceReader::Record& b)
+{
+	return a.pc == b.pc && a.opCode == b.opCode && a.I == b.I && a.frame == b.frame && a.isFrameStart == b.isFrameStart
+		&& memcmp(a.registers, b.registers, sizeof(a.registers)) == 0 && isSameWrites(a, b);
+}
+
+// Names of the fields that differ
+static std::string compareRecords(const TraceReader::Record& a, const TraceReader::Record& b)
+{
+	std::ostringstream stream;
+	if (a.isFrameStart != b.isFrameStart || a.frame != b.frame)
+	{
+		stream << " frame";
+	}
+	if (a.pc != b.pc)
+	{
+		stream << " pc";
+	}
+	if (a.opCode != b.opCode)
+	{
+		stream << " opCode";
+	}
+	for (size_t i = 0; i < CPU::MAX_REGISTER; i++)
+	{
+		if (a.registers[i] != b.registers[i])
+		{
+			stream << " V" << hexToString(static_cast<uint32_t>(i), 1);
+		}
+	}
+	if (a.I != b.I)
+	{
+		stream << " I";
+	}
+	if (!isSameWrites(a, b))
+	{
+		stream << " writes";
+	}
+	return stream.str();
+}
+
+int main(int argc, char* argv[])
+{
+	std::string paths[2];
+	size_t pathCount = 0;
+	size_t contextSize = 8;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--context" && i + 1 < argc)
+		{
+			contextSize = std::strtoul(argv[++i], nullptr, 10);
+		}
+		else if (arg.compare(0, 2, "--") != 0 && pathCount < 2)
+		{
+			paths[pathCount++] = arg;
+		}
+		else
+		{
+			printUsage();
+			return 2;
+		}
+	}
+
+	if (pathCount < 2)
+	{
+		printUsage();
+		return 2;
+	}
+
+	TraceReader a;
+	TraceReader b;
+	if (!a.open(paths[0]) || !b.open(paths[1]))
+	{
+		return 2;
+	}
+	if (a.platform() != b.platform() || a.quirks().toMask() != b.quirks().toMask())
+	{
+		std::cout << "[TRACEDIFF] The traces were recorded with different machines: "
+			<< Platform::name(a.platform()) << " " << a.quirks().toString() << " and "
+			<< Platform::name(b.platform()) << " " << b.quirks().toString() << std::endl;
+	}
+
+	// Last matching instructions from the first trace, only formatted once a divergence is found
+	std::vector<TraceReader::Record> context(contextSize);
+	uint64_t count = 0;
+	while (true)
+	{
+		bool hasA = a.next();
+		bool hasB = b.next();
+		if (!hasA || !hasB)
+		{
+			for (TraceReader* reader : { &a, &b })
+			{
+				if (reader->isTruncated())
+				{
+					std::cout << "[TRACEDIFF] '" << paths[reader == &a ? 0 : 1] << "' is truncated, compared up to its last complete instruction" << std::endl;
+				}
+			}
+			if (hasA == hasB)
+			{
+				std::cout << "[TRACEDIFF] The traces match over " << count << " instructions" << std::endl;
+				return 0;
+			}
+
+			const TraceReader& longer = hasA ? a : b;
+			std::cout << "[TRACEDIFF] '" << paths[hasA ? 1 : 0] << "' ends after " << count << " instructions, '"
+				<< paths[hasA ? 0 : 1] << "' goes on with" << std::endl;
+			std::cout << "  " << recordToString(longer.record(), longer.platform()) << std::endl;
+			return 1;
+		}
+
+		if (!isSameRecord(a.record(), b.record()))
+		{
+			std::cout << "[TRACEDIFF] First divergence at instruction " << count << ", frame " << a.record().frame
+				<< ", on" << compareRecords(a.record(), b.record()) << std::endl;
+			for (uint64_t i = count - std::min<uint64_t>(count, contextSize); i < count; i++)
+			{
+				std::cout << "    " << recordToString(context[i % contextSize], a.platform()) << std::endl;
+			}
+			std::cout << "  a " << recordToString(a.record(), a.platform()) << std::endl;
+			std::cout << "  b " << recordToString(b.record(), b.platform()) << std::endl;
+			return 1;
+		}
+
+		if (contextSize > 0)
+		{
+			// Assigned in place, the writes keep their capacity
+			context[count % contextSize] = a.record();
+		}
+		count++;
+	}
+}